@@ -41,6 +41,11 @@ static CONSTANT * constants ;
 static int constants_used ;
 static int constants_reserved ;
 
+/* Position + 1 of the first constant with each identifier */
+
+static int64_t * constants_by_code = NULL ;
+static int64_t constants_by_code_size = 0 ;
+
 void constants_init() {
     constants = ( CONSTANT * ) calloc( 16, sizeof( CONSTANT ) );
     constants_reserved = 16 ;
@@ -56,9 +61,8 @@ void constants_alloc( int count ) {
 }
 
 CONSTANT * constants_search( int64_t code ) {
-    int i ;
-    for ( i = 0 ; i < constants_used ; i++ ) if ( constants[i].code == code ) return &constants[i] ;
-    return 0 ;
+    int64_t i = identifier_map_get( constants_by_code, constants_by_code_size, code ) ;
+    return i ? &constants[i - 1] : 0 ;
 }
 
 void constants_add( int64_t code, TYPEDEF type, int64_t value ) {
@@ -88,6 +92,8 @@ void constants_add( int64_t code, TYPEDEF type, int64_t value ) {
     constants[constants_used].type = type ;
     constants[constants_used].value = value ;
     constants_used++ ;
+
+    if ( !c ) identifier_map_set( &constants_by_code, &constants_by_code_size, code, constants_used ) ;
 }
 
 void constants_dump() {
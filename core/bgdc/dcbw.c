@@ -898,12 +898,10 @@ int dcb_load_lib( const char * filename ) {
         dcb.sourcefiles = ( uint8_t ** ) calloc( dcb.data.NSourceFiles, sizeof( uint8_t * ) ) ;
         file_seek( fp, dcb.data.OSourceFiles, SEEK_SET ) ;
         for ( n = 0; n < dcb.data.NSourceFiles; n++ ) {
-            int m;
             uint64_t size;
             file_readUint64( fp, &size ) ;
             file_read( fp, scrfile, size ) ;
-            fileid[n] = -1;
-            for( m = 0; m < n_files; m++ ) if ( !strcmp( scrfile, files[m] ) ) fileid[n] = m;
+            fileid[n] = source_file_search( ( const unsigned char * ) scrfile );
             if ( fileid[n] == -1 ) {
                 strcpy( files[n_files], scrfile );
                 fileid[n] = n_files++;
@@ -38,58 +38,113 @@
 /* Identifier manager                                                     */
 /* ---------------------------------------------------------------------- */
 
-static identifier * identifier_hash[64];
-static int64_t      identifier_code = 1;
-int                 identifier_count = 0;
+/* Identifiers live in an open addressing hash table indexed by name, with
+   linear probing and a load factor of 1/2. They are also kept in a list in
+   order of creation (identifier_first/identifier_next) and in a table
+   indexed by code, where the first identifier added with a code is the one
+   returned by identifier_name */
 
-int identifier_hash_value(const char * string) {
-	const char * ptr = string;
-    int t = 0;
+static identifier ** identifier_hash = NULL;
+static int           identifier_hash_size = 0;
+static identifier *  identifier_list = NULL;
+static identifier *  identifier_list_last = NULL;
+static identifier ** identifier_by_code = NULL;
+static int64_t       identifier_by_code_size = 0;
+static int64_t       identifier_code = 1;
+int                  identifier_count = 0;
 
-/*	while (*ptr) t = (t << 1) | *ptr++; */
-	while (*ptr) t = (t << 3) | ( (*ptr++) & 0x07 ); /* Improved hashing dispersion */
+/* FNV-1a */
 
-	return (t & 63);
+uint32_t identifier_hash_value(const char * string) {
+	const unsigned char * ptr = (const unsigned char *) string;
+	uint32_t h = 2166136261U;
+
+	while (*ptr) h = (h ^ *ptr++) * 16777619U;
+
+	return h;
+}
+
+static void identifier_hash_grow() {
+	int size = identifier_hash_size ? identifier_hash_size * 2 : 1024;
+	identifier ** hash = (identifier **)calloc(size, sizeof(identifier *));
+	int n, i;
+
+	if (!hash) {
+		fprintf(stdout, "identifier_add: out of memory\n");
+		exit(1);
+	}
+
+	for (n = 0; n < identifier_hash_size; n++) {
+		if (!identifier_hash[n]) continue;
+		i = identifier_hash[n]->hash & (size - 1);
+		while (hash[i]) i = (i + 1) & (size - 1);
+		hash[i] = identifier_hash[n];
+	}
+
+	free(identifier_hash);
+	identifier_hash = hash;
+	identifier_hash_size = size;
+}
+
+/* Returns the slot of the name, or the empty slot where it goes */
+
+static int identifier_slot(const char * string, uint32_t hash) {
+	int i = hash & (identifier_hash_size - 1);
+	identifier * ptr;
+
+	while ((ptr = identifier_hash[i])) {
+		if (ptr->hash == hash && strcmp(string, ptr->name) == 0) break;
+		i = (i + 1) & (identifier_hash_size - 1);
+	}
+	return i;
+}
+
+static identifier * identifier_by_code_get(int64_t code) {
+	if (code < 0 || code >= identifier_by_code_size) return 0;
+	return identifier_by_code[code];
 }
 
 identifier * identifier_first() {
-	int n;
-	for (n = 0; n < 64; n++) if (identifier_hash[n]) return identifier_hash[n];
-	return 0;
+	return identifier_list;
 }
 
 identifier * identifier_next(identifier * id) {
-	int n;
-	if (id->next) return id->next;
-	n = identifier_hash_value(id->name);
-	for (n++; n < 64; n++) if (identifier_hash[n]) return identifier_hash[n];
-	return 0;
+	return id->next;
 }
 
 void identifier_init() {
-	int i;
-	for (i = 0; i < 64; i++) identifier_hash[i] = 0;
+	identifier * ptr, * next;
+
+	for (ptr = identifier_list; ptr; ptr = next) {
+		next = ptr->next;
+		free((char *)ptr->name);
+		free(ptr);
+	}
+
+	free(identifier_hash);
+	free(identifier_by_code);
+
+	identifier_hash = NULL;
+	identifier_hash_size = 0;
+	identifier_list = identifier_list_last = NULL;
+	identifier_by_code = NULL;
+	identifier_by_code_size = 0;
 	identifier_count = 0;
 	identifier_code = 1;
+
+	identifier_hash_grow();
 }
 
 void identifier_dump() {
 	identifier * ptr;
-    int i;
 	printf("\n---- %d identifiers ----\n\n", identifier_count);
-	for (i = 0; i < 64; i++) {
-		ptr = identifier_hash[i];
-		int ii = 0;
-		while (ptr) {
-			ii++;
-			printf("%4d: %-32s [%04d] [%3d]\n", ( int ) ptr->code, ptr->name, i, ii);
-			ptr = ptr->next;
-		}
+	for (ptr = identifier_list; ptr; ptr = ptr->next) {
+		printf("%4d: %-32s [%04d]\n", ( int ) ptr->code, ptr->name, ( int ) ( ptr->hash & (identifier_hash_size - 1) ));
 	}
 }
 
 int64_t identifier_add_as(const char * string, int64_t code) {
-	int hash = identifier_hash_value(string);
+	uint32_t hash = identifier_hash_value(string);
 	identifier * w = (identifier *)calloc(1, sizeof(identifier));
 
 	if (!w) {
@@ -105,8 +160,30 @@ int64_t identifier_add_as(const char * string, int64_t code) {
 	w->line = line_count; /* Save First appearance */
 	w->f = current_file;  /* Save File info */
 	w->code = code;
-	w->next = identifier_hash[hash];
-	identifier_hash[hash] = w;
+	w->hash = hash;
+
+	/* A name added again hides the previous one */
+
+	if ((identifier_count + 1) * 2 > identifier_hash_size) identifier_hash_grow();
+	identifier_hash[identifier_slot(string, hash)] = w;
+
+	if (identifier_list_last) identifier_list_last->next = w;
+	else                      identifier_list = w;
+	identifier_list_last = w;
+
+	if (code >= identifier_by_code_size) {
+		int64_t size = identifier_by_code_size ? identifier_by_code_size : 1024;
+		while (size <= code) size *= 2;
+		identifier_by_code = (identifier **)realloc(identifier_by_code, size * sizeof(identifier *));
+		if (!identifier_by_code) {
+			fprintf(stdout, "identifier_add: out of memory\n");
+			exit(1);
+		}
+		memset(identifier_by_code + identifier_by_code_size, 0, (size - identifier_by_code_size) * sizeof(identifier *));
+		identifier_by_code_size = size;
+	}
+	if (code >= 0 && !identifier_by_code[code]) identifier_by_code[code] = w;
+
 	identifier_count++;
 
 	return 1;
@@ -119,66 +196,57 @@ int64_t identifier_add(const char * string) {
 }
 
 int64_t identifier_search(const char * string) {
-	int hash = identifier_hash_value(string);
-	identifier * ptr = identifier_hash[hash];
-
-	while (ptr) {
-		if (!ptr->name) return 0;
-		if (ptr->name[0] == *string) {
-			if (strcmp(string, ptr->name) == 0) break;
-		}
-		ptr = ptr->next;
-	}
+	identifier * ptr = identifier_hash[identifier_slot(string, identifier_hash_value(string))];
 	return ptr ? ptr->code : 0;
 }
 
 /* Return line for the identifier */
 int identifier_line(int64_t code) {
-	identifier * ptr;
-    int i;
-
-	for (i = 0; i < 64; i++) {
-		ptr = identifier_hash[i];
-		while (ptr) {
-			if (ptr->code == code) return ptr->line;
-			ptr = ptr->next;
-		}
-	}
-	return 0;
+	identifier * ptr = identifier_by_code_get(code);
+	return ptr ? ptr->line : 0;
 }
 
 /* Return file for the identifier */
 int identifier_file(int64_t code) {
-	identifier * ptr;
-    int i;
-
-	for (i = 0; i < 64; i++) {
-		ptr = identifier_hash[i];
-		while (ptr) {
-			if (ptr->code == code) return ptr->f;
-			ptr = ptr->next;
-		}
-	}
-	return 0;
+	identifier * ptr = identifier_by_code_get(code);
+	return ptr ? ptr->f : 0;
 }
 
 const char * identifier_name(int64_t code) {
-	identifier * ptr;
-    int i;
+	identifier * ptr = identifier_by_code_get(code);
+	return ptr ? ptr->name : 0;
+}
 
-	for (i = 0; i < 64; i++) {
-		ptr = identifier_hash[i];
-		while (ptr) {
-			if (ptr->code == code) return ptr->name;
-			ptr = ptr->next;
+int64_t identifier_search_or_add(const char * string) {
+	uint32_t hash = identifier_hash_value(string);
+	identifier * ptr = identifier_hash[identifier_slot(string, hash)];
+	return ptr ? ptr->code : identifier_add(string);
+}
+
+/* Tables indexed by identifier code, used by the other managers to find
+   their objects by name. Entries are 0 when not set */
+
+void identifier_map_set(int64_t ** map, int64_t * size, int64_t code, int64_t value) {
+	int64_t n;
+
+	if (code < 0) return;
+
+	if (code >= *size) {
+		n = *size ? *size : 256;
+		while (n <= code) n *= 2;
+		*map = (int64_t *)realloc(*map, n * sizeof(int64_t));
+		if (!*map) {
+			fprintf(stdout, "identifier_map_set: out of memory\n");
+			exit(1);
 		}
+		memset(*map + *size, 0, (n - *size) * sizeof(int64_t));
+		*size = n;
 	}
-	return 0;
+	(*map)[code] = value;
 }
 
-int64_t identifier_search_or_add(const char * string) {
-	int64_t result = identifier_search(string);
-	return result ? result : identifier_add(string);
+int64_t identifier_map_get(int64_t * map, int64_t size, int64_t code) {
+	return (code >= 0 && code < size) ? map[code] : 0;
 }
 
 int64_t identifier_next_code() {
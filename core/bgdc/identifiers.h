@@ -29,12 +29,15 @@
 #ifndef __IDENTIFIERS_H
 #define __IDENTIFIERS_H
 
+#include <stdint.h>
+
 typedef struct _identifier {
 	const char *   name;
 	int64_t        code;
 	int	           line;		/* First USE for the identifier */
 	int            f; 			/* file where the id was found */
-	struct _identifier * next;
+	uint32_t       hash;		/* identifier_hash_value of the name */
+	struct _identifier * next;	/* next identifier in order of creation */
 } identifier;
 
 /* Identifier manager */
@@ -51,6 +54,11 @@ extern int identifier_file(int64_t code) ;
 
 extern int64_t identifier_next_code() ;
 
+extern uint32_t identifier_hash_value(const char * string) ;
+
+extern void identifier_map_set(int64_t ** map, int64_t * size, int64_t code, int64_t value) ;
+extern int64_t identifier_map_get(int64_t * map, int64_t size, int64_t code) ;
+
 extern identifier * identifier_first() ;
 extern identifier * identifier_next (identifier * id) ;
 
@@ -203,6 +203,15 @@ int main( int argc, char *argv[] ) {
                 continue;
             }
 
+            if ( !strcmp( argv[i], "--cache" ) ) {
+                if ( i == argc - 1 ) {
+                    printf( MSG_DIRECTORY_MISSING "\n" );
+                    exit( 1 );
+                }
+                token_cache_open( argv[++i] );
+                continue;
+            }
+
             j = 1;
             while ( argv[i][j] ) {
                 if ( argv[i][j] == 'd' ) {
@@ -397,6 +406,7 @@ int main( int argc, char *argv[] ) {
     }
 
     compile_program();
+    token_cache_save();
 
     if ( stubname[0] != 0 ) {
         if ( !file_exists( stubname ) ) {
@@ -53,6 +53,7 @@
                                                 "   -D macro=text   Set a macro\n" \
                                                 "   -p|--pedantic   Don't use automatic declare\n" \
                                                 "   --libmode       Build a library\n" \
+                                                "   --cache dir     Keep the scanned tokens of every source file at dir\n" \
                                                 "   -L library      Include a library\n" \
                                                 "   -C options      Specify compiler options\n" \
                                                 "                   Where options are:\n" \
@@ -50,6 +50,12 @@ int64_t procdef_maxid = -1;
 PROCDEF ** procs = 0;
 int64_t procs_allocated = 0;
 
+/* typeid + 1 of the process with each identifier, the lowest one when
+   there are several */
+
+static int64_t * procs_by_identifier = NULL;
+static int64_t procs_by_identifier_size = 0;
+
 int64_t procdef_getid() {
     for ( int64_t i = 0; i <= procdef_maxid; i++ ) if ( !procs[i] ) return i;
     return ++procdef_maxid;
@@ -57,6 +63,7 @@ int64_t procdef_getid() {
 
 PROCDEF * procdef_new( int64_t typeid, int64_t id ) {
     PROCDEF * proc = ( PROCDEF * ) calloc( 1, sizeof( PROCDEF ) );
+    int64_t first;
     int n;
 
     if (!proc) {
@@ -93,6 +100,9 @@ PROCDEF * procdef_new( int64_t typeid, int64_t id ) {
     proc->identifier        = id;
     procs[typeid]           = proc;
 
+    first = identifier_map_get( procs_by_identifier, procs_by_identifier_size, id );
+    if ( !first || first > typeid ) identifier_map_set( &procs_by_identifier, &procs_by_identifier_size, id, typeid + 1 );
+
     for ( n = 0; n < MAX_PARAMS; n++ ) proc->paramtype[n] = TYPE_UNDEFINED;
 
     proc->exitcode          = 0;
@@ -104,9 +114,8 @@ PROCDEF * procdef_new( int64_t typeid, int64_t id ) {
 }
 
 PROCDEF * procdef_search( int64_t id ) {
-    int n;
-    for ( n = 0; n <= procdef_maxid; n++ ) if ( procs[n]->identifier == id ) return procs[n];
-    return 0;
+    int64_t n = identifier_map_get( procs_by_identifier, procs_by_identifier_size, id );
+    return n ? procs[n - 1] : 0;
 }
 
 PROCDEF * procdef_search_by_codeblock( CODEBLOCK * p ) {
@@ -120,6 +129,8 @@ PROCDEF * procdef_get (int64_t typeid) {
 }
 
 void procdef_destroy (PROCDEF * proc) {
+    int64_t n;
+
     varspace_destroy( proc->privars );
     segment_destroy( proc->pridata );
 
@@ -127,6 +138,11 @@ void procdef_destroy (PROCDEF * proc) {
     segment_destroy( proc->pubdata );
 
     procs[proc->typeid] = 0;
+
+    if ( identifier_map_get( procs_by_identifier, procs_by_identifier_size, proc->identifier ) == proc->typeid + 1 ) {
+        for ( n = 0; n <= procdef_maxid && ( !procs[n] || procs[n]->identifier != proc->identifier ); n++ );
+        identifier_map_set( &procs_by_identifier, &procs_by_identifier_size, proc->identifier, n <= procdef_maxid ? n + 1 : 0 );
+    }
     free( proc->code.data );
     free( proc->code.loops );
     free( proc->code.labels );
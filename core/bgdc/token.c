@@ -33,6 +33,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <unistd.h>
 
 #include "bgdc.h"
 
@@ -85,6 +86,41 @@ static int                  id_pragma;
 static int                  id_decode_utf8_strings;
 static int                  id_no_decode_utf8_strings;
 
+/* Token cache: the words and numbers scanned in a source file, by offset
+   in its clean source. It is keyed by the file contents, so a build only
+   scans again the files that changed since the last one */
+
+#define TOKEN_CACHE_MAGIC   "BGDCTOK1"
+
+#define CACHED_WORD         1
+#define CACHED_NUMBER       2
+
+typedef struct _token_cached {
+    uint32_t        start;          /* Offset in the clean source */
+    uint32_t        end;
+    uint32_t        data;           /* Offset of the upper case word, or of the number code and value */
+    uint16_t        kind;           /* CACHED_WORD or CACHED_NUMBER */
+    uint16_t        type;           /* IDENTIFIER, NUMBER or FLOAT */
+} TOKEN_CACHED;
+
+typedef struct _token_cache {
+    uint64_t        hash;
+    uint32_t        size;           /* Size of the clean source */
+    TOKEN_CACHED    * tokens;       /* Sorted by start */
+    int             count;
+    int             allocated;
+    unsigned char   * data;
+    int             data_size;
+    int             data_allocated;
+    int             cursor;         /* Next token, when scanning forward */
+    int             dirty;
+} TOKEN_CACHE;
+
+static char                 * token_cache_dir = NULL;
+static TOKEN_CACHE          * token_caches[MAX_SOURCES];
+static TOKEN_CACHE          * source_cache;
+static TOKEN_CACHE          * old_sources_cache[MAX_SOURCES];
+
 /* ---------------------------------------------------------------------- */
 
 static int token_endfile();
@@ -187,14 +223,257 @@ int n_files = 0;                                /* Includes */
 unsigned char files[MAX_SOURCES][__MAX_PATH];   /* Includes */
 unsigned char *source_data[MAX_SOURCES];        /* Includes */
 
+/* Hash of files[] by name, entries are the file number + 1 */
+
+static int files_hash[MAX_SOURCES * 2];
+static int files_indexed = 0;
+
 /* ---------------------------------------------------------------------- */
 
-int load_file( unsigned char * filename ) {
+/* Returns the number of a source file already in files[], or -1. Files
+   may be appended to files[] directly, they are hashed on the next search */
+
+int source_file_search( const unsigned char * filename ) {
+    int i;
+
+    for ( ; files_indexed < n_files; files_indexed++ ) {
+        for ( i = identifier_hash_value( ( const char * ) files[files_indexed] ) & ( MAX_SOURCES * 2 - 1 ); files_hash[i]; i = ( i + 1 ) & ( MAX_SOURCES * 2 - 1 ) )
+            if ( !strcmp( ( const char * ) files[files_hash[i] - 1], ( const char * ) files[files_indexed] ) ) break;
+        if ( !files_hash[i] ) files_hash[i] = files_indexed + 1;
+    }
+
+    for ( i = identifier_hash_value( ( const char * ) filename ) & ( MAX_SOURCES * 2 - 1 ); files_hash[i]; i = ( i + 1 ) & ( MAX_SOURCES * 2 - 1 ) )
+        if ( !strcmp( ( const char * ) files[files_hash[i] - 1], ( const char * ) filename ) ) return files_hash[i] - 1;
+
+    return -1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static uint64_t token_cache_hash( const unsigned char * data, size_t size, uint64_t hash ) {
+    while ( size-- ) {
+        hash ^= *data++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void token_cache_path( char * path, uint64_t hash ) {
+    sprintf( path, "%s" PATH_SEP "%016" PRIx64 ".tok", token_cache_dir, hash );
+}
+
+/* ---------------------------------------------------------------------- */
+/*
+ *  FUNCTION : token_cache_load
+ *
+ *  Returns the token cache of a loaded source file, reading it from
+ *  the cache directory the first time. The key covers the file
+ *  contents and the character tables the scanner uses. The file
+ *  must be the current source.
+ *
+ *  PARAMS :
+ *      n           Number of the source file
+ *
+ *  RETURN VALUE :
+ *      Token cache of the file, or NULL if no cache directory is set
+ */
+
+static TOKEN_CACHE * token_cache_load( int n ) {
+    char path[__MAX_PATH];
+    TOKEN_CACHE * tc;
+    char magic[8];
+    uint64_t hash;
+    uint32_t count, data_size;
+    file * fp;
+
+    if ( !token_cache_dir ) return NULL;
+    if ( token_caches[n] ) return token_caches[n];
+
+    tc = ( TOKEN_CACHE * ) calloc( 1, sizeof( TOKEN_CACHE ) );
+    if ( !tc ) compile_error( MSG_OUT_OF_MEMORY );
+
+    tc->hash = token_cache_hash( ( const unsigned char * ) TOKEN_CACHE_MAGIC, 8, 0xcbf29ce484222325ULL );
+    tc->hash = token_cache_hash( ( const unsigned char * ) c_type, sizeof( c_type ), tc->hash );
+    tc->hash = token_cache_hash( c_upper, sizeof( c_upper ), tc->hash );
+    tc->hash = token_cache_hash( source_data[n], strlen( ( const char * ) source_data[n] ), tc->hash );
+    tc->size = strlen( ( const char * ) source_start );
+    token_caches[n] = tc;
+
+    token_cache_path( path, tc->hash );
+    fp = file_open( path, "rb0" );
+    if ( !fp ) return tc;
+
+    if ( file_read( fp, magic, 8 ) == 8 && !memcmp( magic, TOKEN_CACHE_MAGIC, 8 ) &&
+         file_readUint64( fp, &hash ) && hash == tc->hash &&
+         file_readUint32( fp, &count ) && file_readUint32( fp, &data_size ) ) {
+        tc->tokens = ( TOKEN_CACHED * ) malloc( count * sizeof( TOKEN_CACHED ) + 1 );
+        tc->data = ( unsigned char * ) malloc( data_size + 1 );
+        if ( !tc->tokens || !tc->data ) compile_error( MSG_OUT_OF_MEMORY );
+        if ( file_read( fp, tc->tokens, count * sizeof( TOKEN_CACHED ) ) == ( int ) ( count * sizeof( TOKEN_CACHED ) ) &&
+             file_read( fp, tc->data, data_size ) == ( int ) data_size ) {
+            tc->count = tc->allocated = count;
+            tc->data_size = tc->data_allocated = data_size;
+        }
+    }
+    file_close( fp );
+
+    return tc;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Returns the cache of the current source if the scanner is in it. Macro
+   expansion reads the macro text without a new source, it is not cached */
+
+static TOKEN_CACHE * token_cache_current() {
+    if ( source_cache && source_ptr >= source_start && source_ptr < source_start + source_cache->size ) return source_cache;
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Returns the cached token starting at the offset, or NULL. On a miss the
+   cursor is left at the position where token_cache_add inserts it */
+
+static TOKEN_CACHED * token_cache_find( TOKEN_CACHE * tc, uint32_t offset ) {
+    int lo = 0, hi = tc->count;
+
+    if ( tc->cursor < tc->count && tc->tokens[tc->cursor].start == offset ) return &tc->tokens[tc->cursor++];
+
+    while ( lo < hi ) {
+        int mid = ( lo + hi ) / 2;
+        if ( tc->tokens[mid].start < offset ) lo = mid + 1;
+        else                                  hi = mid;
+    }
+
+    if ( lo < tc->count && tc->tokens[lo].start == offset ) {
+        tc->cursor = lo + 1;
+        return &tc->tokens[lo];
+    }
+
+    tc->cursor = lo;
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Adds the token just scanned after a token_cache_find miss at its start.
+   Words keep their upper case text, numbers their code and value */
+
+static void token_cache_add( TOKEN_CACHE * tc, uint32_t start, uint32_t end, int kind, const unsigned char * word ) {
+    TOKEN_CACHED * t;
+    int size = kind == CACHED_WORD ? end - start + 1 : sizeof( int64_t ) + sizeof( double );
+
+    if ( tc->count == tc->allocated ) {
+        tc->allocated += 1024;
+        tc->tokens = ( TOKEN_CACHED * ) realloc( tc->tokens, tc->allocated * sizeof( TOKEN_CACHED ) );
+        if ( !tc->tokens ) compile_error( MSG_OUT_OF_MEMORY );
+    }
+
+    if ( tc->data_size + size > tc->data_allocated ) {
+        tc->data_allocated += size + 16384;
+        tc->data = ( unsigned char * ) realloc( tc->data, tc->data_allocated );
+        if ( !tc->data ) compile_error( MSG_OUT_OF_MEMORY );
+    }
+
+    t = &tc->tokens[tc->cursor];
+    if ( tc->cursor < tc->count ) memmove( t + 1, t, ( tc->count - tc->cursor ) * sizeof( TOKEN_CACHED ) );
+    tc->count++;
+    tc->cursor++;
+    tc->dirty = 1;
+
+    t->start = start;
+    t->end = end;
+    t->data = tc->data_size;
+    t->kind = kind;
+    t->type = token.type;
+
+    if ( kind == CACHED_WORD ) {
+        memcpy( tc->data + tc->data_size, word, size );
+    } else {
+        memcpy( tc->data + tc->data_size, &token.code, sizeof( int64_t ) );
+        memcpy( tc->data + tc->data_size + sizeof( int64_t ), &token.value, sizeof( double ) );
+    }
+    tc->data_size += size;
+}
+
+/* ---------------------------------------------------------------------- */
+/*
+ *  FUNCTION : token_cache_open
+ *
+ *  Enables the token cache, stored at the given directory. The
+ *  main source file may be loaded already.
+ *
+ *  PARAMS :
+ *      dir         Existing directory for the cache files
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void token_cache_open( const char * dir ) {
+    token_cache_dir = strdup( dir );
+    if ( !token_cache_dir ) compile_error( MSG_OUT_OF_MEMORY );
+
+    if ( sources == 1 && current_file >= 0 && !source_cache ) source_cache = token_cache_load( current_file );
+}
+
+/* ---------------------------------------------------------------------- */
+/*
+ *  FUNCTION : token_cache_save
+ *
+ *  Writes the cache of every source file that got new tokens in this
+ *  build. Files are written under a temporary name and renamed, so a
+ *  concurrent build never reads a partial cache.
+ *
+ *  PARAMS :
+ *      None
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void token_cache_save() {
+    char path[__MAX_PATH], tmp[__MAX_PATH + 16];
+    uint32_t count, data_size;
     int n;
 
-    for( n = 0; n < n_files; n++ ) if ( !strcmp( files[n], filename ) ) break;
+    for ( n = 0; n < n_files; n++ ) {
+        TOKEN_CACHE * tc = token_caches[n];
+        file * fp;
+        int ok;
+
+        if ( !tc || !tc->dirty ) continue;
+
+        token_cache_path( path, tc->hash );
+        sprintf( tmp, "%s.%d", path, ( int ) getpid() );
+
+        fp = file_open( tmp, "wb0" );
+        if ( !fp ) continue;
+
+        count = tc->count;
+        data_size = tc->data_size;
+        ok = file_write( fp, ( void * ) TOKEN_CACHE_MAGIC, 8 ) == 8 &&
+             file_writeUint64( fp, &tc->hash ) &&
+             file_writeUint32( fp, &count ) &&
+             file_writeUint32( fp, &data_size ) &&
+             file_write( fp, tc->tokens, count * sizeof( TOKEN_CACHED ) ) == ( int ) ( count * sizeof( TOKEN_CACHED ) ) &&
+             file_write( fp, tc->data, data_size ) == ( int ) data_size;
+        file_close( fp );
+
+        if ( !ok || rename( tmp, path ) ) remove( tmp );
+        tc->dirty = 0;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+int load_file( unsigned char * filename ) {
+    int n = source_file_search( filename );
 
-    if ( n >= n_files ) {
+    if ( n == -1 ) {
         if ( n_files == MAX_SOURCES ) compile_error( MSG_TOO_MANY_FILES );
 
         file * fp = file_open( filename, "rb0" );
@@ -212,6 +491,7 @@ int load_file( unsigned char * filename ) {
     }
 
     token_init( source_data[n], n );
+    source_cache = token_cache_load( n );
     return n;
 }
 
@@ -879,6 +1159,7 @@ void token_init( const unsigned char * source, int file ) {
     old_current_file  [sources] = current_file;
     old_sources       [sources] = source_ptr;
     old_sources_start [sources] = source_start;
+    old_sources_cache [sources] = source_cache;
     sources++;
 
     /* Use the new source */
@@ -887,6 +1168,7 @@ void token_init( const unsigned char * source, int file ) {
     current_file = file;
     source_ptr = clean_source;
     source_start = clean_source;
+    source_cache = NULL;
 
     use_saved = 0;
 }
@@ -902,6 +1184,7 @@ int token_endfile() {
         current_file = old_current_file[sources];
         source_ptr = old_sources[sources];
         source_start = old_sources_start[sources];
+        source_cache = old_sources_cache[sources];
         use_saved = 0;
     }
 
@@ -927,6 +1210,9 @@ void token_next() {
     static int  i, len;
     static unsigned char buffer[1024];
     unsigned char * buffer_ptr = buffer;
+    const unsigned char * start;
+    TOKEN_CACHE * tc;
+    TOKEN_CACHED * cached;
 
     if ( !source_ptr ) {
         token.type = NOTOKEN;
@@ -1091,6 +1377,22 @@ void token_next() {
             double num = 0.0;
             int64_t base = 10;
 
+            /* Numbers scanned by a previous build */
+
+            start = source_ptr;
+            tc = token_cache_current();
+            cached = tc ? token_cache_find( tc, start - source_start ) : NULL;
+
+            if ( cached ) {
+                token.type = cached->type;
+                memcpy( &token.code, tc->data + cached->data, sizeof( int64_t ) );
+                memcpy( &token.value, tc->data + cached->data + sizeof( int64_t ), sizeof( double ) );
+                source_ptr = source_start + cached->end;
+                token.line  = line_count;
+                token.file  = current_file;
+                return;
+            }
+
             /* Hex/Bin/Octal numbers with the h/b/o sufix */
             if ( *source_ptr == '0' && *(source_ptr+1) == 'x' ) {
                 base = 16;
@@ -1183,6 +1485,8 @@ void token_next() {
             if ( base == 8  && ( *source_ptr == 'o' || *source_ptr == 'O' ) ) source_ptr++;
             if ( base == 2  && ( *source_ptr == 'b' || *source_ptr == 'B' ) ) source_ptr++;
 
+            if ( tc ) token_cache_add( tc, start - source_start, source_ptr - source_start, CACHED_NUMBER, NULL );
+
             token.line = line_count;
             token.file = current_file;
             return;
@@ -1192,7 +1496,20 @@ void token_next() {
 
         if ( ISWORDFIRST( *source_ptr ) ) {
             int maybe_label = source_ptr[-1] == '\n';
-            GET_NEXT_TOKEN_IN_TMPBUFFER;
+
+            start = source_ptr;
+            tc = token_cache_current();
+            cached = tc ? token_cache_find( tc, start - source_start ) : NULL;
+
+            if ( cached ) {
+                memcpy( buffer, tc->data + cached->data, cached->end - cached->start + 1 );
+                source_ptr = source_start + cached->end;
+                token.code = ( int64_t ) identifier_search_or_add( buffer );
+                token.type = IDENTIFIER;
+            } else {
+                GET_NEXT_TOKEN_IN_TMPBUFFER;
+                if ( tc ) token_cache_add( tc, start - source_start, source_ptr - source_start, CACHED_WORD, buffer );
+            }
 
             token.line = line_count;
             token.file = current_file;
@@ -72,11 +72,16 @@ extern void token_set_pos( tok_pos tp );
 
 extern void add_simple_define( unsigned char * macro, unsigned char *text );
 
+extern void token_cache_open( const char * dir );
+extern void token_cache_save();
+
 extern int line_count;
 extern int current_file;
 extern int n_files;
 extern unsigned char files[MAX_SOURCES][__MAX_PATH];
 
+extern int source_file_search( const unsigned char * filename );
+
 /* All tokens are exported */
 extern struct _token token;
 extern struct _token token_prev;
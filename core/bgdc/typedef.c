@@ -184,10 +184,14 @@ static int64_t * named_codes = NULL;
 static int named_count = 0;
 static int named_reserved = 0;
 
+/* Position + 1 of the first named type with each identifier */
+
+static int64_t * named_by_code = NULL;
+static int64_t named_by_code_size = 0;
+
 TYPEDEF * typedef_by_name( int64_t code ) {
-    int n;
-    for ( n = 0; n < named_count; n++ ) if ( named_codes[n] == code ) return &named_types[n];
-    return 0;
+    int64_t n = identifier_map_get( named_by_code, named_by_code_size, code );
+    return n ? &named_types[n - 1] : 0;
 }
 
 void typedef_name( TYPEDEF t, int64_t code ) {
@@ -202,6 +206,8 @@ void typedef_name( TYPEDEF t, int64_t code ) {
     named_codes[named_count] = code;
     named_types[named_count] = t;
     named_count++;
+
+    if ( !identifier_map_get( named_by_code, named_by_code_size, code ) ) identifier_map_set( &named_by_code, &named_by_code_size, code, named_count );
 }
 
 int typedef_tcount( TYPEDEF t ) {
@@ -40,6 +40,12 @@
 
 VARSPACE global, local;
 
+/* Varspaces with fewer variables are searched linearly */
+
+#define VARSPACE_INDEX_MIN  32
+
+#define VARSPACE_HASH(code) ( ( int64_t ) ( ( ( uint64_t ) ( code ) * 0x9E3779B97F4A7C15ULL ) >> 32 ) )
+
 /*
  *  FUNCTION : varspace_dump
  *
@@ -123,6 +129,7 @@ VARSPACE * varspace_new() {
 
 void varspace_destroy( VARSPACE * v ) {
     free( v->vars );
+    free( v->index );
     free( v );
 }
 
@@ -149,6 +156,9 @@ void varspace_init( VARSPACE * n ) {
     n->stringvars = NULL;
     n->stringvar_reserved = 0;
     n->stringvar_count = 0;
+    n->index = NULL;
+    n->index_size = 0;
+    n->indexed = 0;
     if ( !n->vars ) compile_error( "varspace_init: out of memory\n" );
 }
 
@@ -220,6 +230,42 @@ void varspace_add( VARSPACE * n, VARIABLE v ) {
     n->size += typedef_size( v.type );
 }
 
+/*
+ *  FUNCTION : varspace_index
+ *
+ *  Add to the hash of the varspace the variables created since the
+ *  last call. Variables are added to vars[] directly in many places,
+ *  so the hash is brought up to date when searching instead of in
+ *  varspace_add. Only the first variable with a code is indexed, as
+ *  a linear search would find.
+ *
+ *  PARAMS :
+ *      n    Pointer to the varspace
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+static void varspace_index( VARSPACE * n ) {
+    int64_t i, p, mask;
+
+    if ( n->count * 2 > n->index_size ) {
+        free( n->index );
+        for ( n->index_size = 64; n->index_size < n->count * 2; n->index_size *= 2 );
+        n->index = ( int64_t * ) calloc( n->index_size, sizeof( int64_t ) );
+        if ( !n->index ) compile_error( "varspace_index: out of memory\n" );
+        n->indexed = 0;
+    }
+
+    mask = n->index_size - 1;
+    for ( p = n->indexed; p < n->count; p++ ) {
+        for ( i = VARSPACE_HASH( n->vars[p].code ) & mask; n->index[i]; i = ( i + 1 ) & mask )
+            if ( n->vars[n->index[i] - 1].code == n->vars[p].code ) break;
+        if ( !n->index[i] ) n->index[i] = p + 1;
+    }
+    n->indexed = n->count;
+}
+
 /*
  *  FUNCTION : varspace_search
  *
@@ -234,7 +280,18 @@ void varspace_add( VARSPACE * n, VARIABLE v ) {
  */
 
 VARIABLE * varspace_search( VARSPACE * n, int64_t code ) {
-    int i;
-    for ( i = 0; i < n->count; i++ ) if ( n->vars[i].code == code ) return &n->vars[i];
+    int64_t i, mask;
+
+    if ( n->count < VARSPACE_INDEX_MIN ) {
+        for ( i = 0; i < n->count; i++ ) if ( n->vars[i].code == code ) return &n->vars[i];
+        return 0;
+    }
+
+    if ( n->indexed < n->count ) varspace_index( n );
+
+    mask = n->index_size - 1;
+    for ( i = VARSPACE_HASH( code ) & mask; n->index[i]; i = ( i + 1 ) & mask )
+        if ( n->vars[n->index[i] - 1].code == code ) return &n->vars[n->index[i] - 1];
+
     return 0;
 }
@@ -44,6 +44,9 @@ typedef struct _varspace {
     int64_t * stringvars; 		// offsets of string-type variables
     int64_t stringvar_reserved; // number of allocated string offsets
     int64_t stringvar_count; 	// number of string offsets
+    int64_t * index; 			// hash of variable positions by code, see varspace_search
+    int64_t index_size; 		// number of slots of the hash
+    int64_t indexed; 			// number of variables already in the hash
 } VARSPACE;
 
 typedef struct _variable {
@@ -60,6 +60,24 @@ static char * dcb_exts[] = { ".dcb", ".dat", ".bin", NULL };
 
 static int standalone  = 0;  /* 1 only if this is an standalone interpreter   */
 static int embedded    = 0;  /* 1 only if this is a stub with an embedded DCB */
+static int timer       = 0;  /* 1 for report startup times (-t)              */
+
+/* ---------------------------------------------------------------------- */
+
+/* Milliseconds from an arbitrary point, for the startup timer */
+
+static double startup_ticks() {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter( &count );
+    QueryPerformanceFrequency( &freq );
+    return ( double ) count.QuadPart * 1000.0 / ( double ) freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
 
 /* ---------------------------------------------------------------------- */
 
@@ -90,6 +108,7 @@ int main( int argc, char *argv[] ) {
     argv[1] = "game.dcb";
 #endif
 
+    double time_start = startup_ticks(), time_dcb, time_modules;
     char * filename = NULL, dcbname[ __MAX_PATH ], *ptr, *arg0 = NULL;
     int i, j, ret = -1;
     file * fp = NULL;
@@ -171,6 +190,7 @@ int main( int argc, char *argv[] ) {
                 j = 1 ;
                 while ( argv[i][j] ) {
                     if ( argv[i][j] == 'd' ) debug++;
+                    if ( argv[i][j] == 't' ) timer = 1;
                     if ( argv[i][j] == 'i' ) {
                         if ( argv[i][j+1] == 0 ) {
                             if ( i == argc - 1 ) {
@@ -260,6 +280,8 @@ int main( int argc, char *argv[] ) {
         dcb_load_from( fp, ( const char * ) dcbname, dcb_signature.dcb_offset );
     }
 
+    time_dcb = startup_ticks();
+
     /* If the dcb is not in debug mode */
 
     if ( dcb.data.NSourceFiles == 0 ) debug = 0;
@@ -268,6 +290,8 @@ int main( int argc, char *argv[] ) {
 
     sysproc_init() ;
 
+    time_modules = startup_ticks();
+
 #ifdef _WIN32
     HWND hWnd = GetConsoleWindow();
     DWORD dwProcessId;
@@ -282,6 +306,11 @@ int main( int argc, char *argv[] ) {
     argv[0] = filename;
     bgdrtm_entry( argc, argv );
 
+    if ( timer ) {
+        double time_end = startup_ticks();
+        fprintf( stderr, "Startup: dcb %.2f ms, modules %.2f ms, total %.2f ms\n", time_dcb - time_start, time_modules - time_dcb, time_end - time_start );
+    }
+
     if ( mainproc ) {
         ( void ) instance_new( mainproc, NULL ) ;
         ret = instance_go_all() ;
@@ -33,6 +33,7 @@
 
 #define MSG_USAGE                               "Usage: %s [options] <data code block file>[.dcb]\n\n"
 #define MSG_OPTIONS                             "   -d       Activate DEBUG mode (several -d for increment debug level)\n" \
-                                                "   -i dir   Adds the directory to the PATH\n\n"
+                                                "   -i dir   Adds the directory to the PATH\n" \
+                                                "   -t       Show the startup times\n\n"
 
 #endif
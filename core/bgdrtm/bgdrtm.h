@@ -68,6 +68,19 @@ extern int64_t must_exit;
 
 extern int64_t frame_completed;
 
+/* Frame profile, enabled by runners like bgdbench. Times in usecs, hook_us
+   (allocated by the runner) follows the handler_hook_list order */
+
+typedef struct {
+    int64_t enabled;
+    int64_t frame_limit;        /* instance_go_all returns after these frames, 0 for no limit */
+    int64_t frames;
+    int64_t exec_us;
+    int64_t * hook_us;
+} FRAME_PROFILE;
+
+extern FRAME_PROFILE frame_profile;
+
 extern int64_t trace_sentence;
 extern INSTANCE * trace_instance;
 
@@ -34,10 +34,18 @@
 #else
 #include <direct.h>
 #endif
+
+#if !defined( _WIN32 ) && !defined( __SWITCH__ )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define DCB_USE_MMAP
+#endif
 #include "bgdrtm.h"
 #include "dcb.h"
 #include "dirs.h"
 #include "files.h"
+#include "offsets.h"
+#include "pslang.h"
 #include "xstrings.h"
 
 #define SYSPROCS_ONLY_DECLARE
@@ -67,13 +75,15 @@ void sysprocs_fixup( void ) {
     int64_t n;
 
     while ( proc->func ) {
+        int64_t id = getid( proc->name );
+
         proc->code = -1;
 
         s = sysproc_code_ref;
         for ( n = 0; n < dcb.data.NSysProcsCodes; n++, s++ ) {
             if (
                 proc->type == s->Type && proc->params == s->Params &&
-                s->Id == getid( proc->name ) && !strcmp( (const char *)s->ParamTypes, proc->paramtypes ) )
+                s->Id == id && !strcmp( (const char *)s->ParamTypes, proc->paramtypes ) )
             {
                 proc->code = s->Code;
                 break;
@@ -85,6 +95,281 @@ void sysprocs_fixup( void ) {
 
 /* ---------------------------------------------------------------------- */
 
+/* Unresolved system functions are bound to these, so the interpreter
+   never needs to check the pointer */
+
+static int64_t sysproc_unknown_function( INSTANCE * r, int64_t * params ) {
+    fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Unknown system function\n", r->proc->name, LOCQWORD( r, PROCESS_ID ) );
+    exit( 0 );
+    return 0;
+}
+
+static int64_t sysproc_unknown_process( INSTANCE * r, int64_t * params ) {
+    fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Unknown system process\n", r->proc->name, LOCQWORD( r, PROCESS_ID ) );
+    exit( 0 );
+    return 0;
+}
+
+static SYSPROC sysproc_unknown[2] = {
+    { -1, "", "", 0, 0, sysproc_unknown_function, 0 },
+    { -1, "", "", 0, 0, sysproc_unknown_process, 0 }
+};
+
+/* ---------------------------------------------------------------------- */
+
+/* Stack slots pushed (or popped, if negative) by an instruction.
+   Calls into labels (MN_NCALL) are handled at runtime by the interpreter. */
+
+#define STACK_EFFECT_UNKNOWN    0x7FFF
+
+static int64_t mnemonic_stack_effect( int64_t * ptr ) {
+    PROCDEF * proc;
+
+    switch ( *ptr & MN_MASK ) {
+        case MN_DUP:
+        case MN_PUSH:
+        case MN_TYPE:
+        case MN_PRIVATE:
+        case MN_LOCAL:
+        case MN_GLOBAL:
+        case MN_PUBLIC:
+        case MN_GET_PRIV:
+        case MN_GET_LOCAL:
+        case MN_GET_GLOBAL:
+        case MN_GET_PUBLIC:
+            return 1;
+
+        case MN_END:
+        case MN_CLONE:
+        case MN_DEBUG:
+        case MN_INDEX:
+        case MN_REMOTE:
+        case MN_REMOTE_PUBLIC:
+        case MN_PTR:
+        case MN_GET_REMOTE:
+        case MN_GET_REMOTE_PUBLIC:
+        case MN_JUMP:
+        case MN_JTFALSE:
+        case MN_JTTRUE:
+        case MN_JNOCASE:
+        case MN_NEG:
+        case MN_NOT:
+        case MN_BNOT:
+        case MN_POSTINC:
+        case MN_POSTDEC:
+        case MN_INC:
+        case MN_DEC:
+        case MN_INT2STR:
+        case MN_DOUBLE2STR:
+        case MN_FLOAT2STR:
+        case MN_CHR2STR:
+        case MN_INT2FLOAT:
+        case MN_FLOAT2INT:
+        case MN_FLOAT2DOUBLE:
+        case MN_DOUBLE2FLOAT:
+        case MN_INT2DOUBLE:
+        case MN_DOUBLE2INT:
+        case MN_A2STR:
+        case MN_INT2DWORD:
+        case MN_INT2WORD:
+        case MN_INT2BYTE:
+        case MN_NCALL:
+        case MN_EXITHNDLR:
+        case MN_ERRHNDLR:
+        case MN_STR2POINTER:
+        case MN_POINTER2STR:
+        case MN_STR2INT:
+        case MN_STR2DOUBLE:
+        case MN_STR2FLOAT:
+        case MN_STR2CHR:
+        case MN_NOP:
+        case MN_SENTENCE:
+            return 0;
+
+        case MN_RETURN:
+        case MN_FRAME:
+        case MN_POP:
+        case MN_SWITCH:
+        case MN_CASE:
+        case MN_ARRAY:
+        case MN_JFALSE:
+        case MN_JTRUE:
+        case MN_MUL:
+        case MN_DIV:
+        case MN_ADD:
+        case MN_SUB:
+        case MN_MOD:
+        case MN_ROR:
+        case MN_ROL:
+        case MN_AND:
+        case MN_OR:
+        case MN_XOR:
+        case MN_BAND:
+        case MN_BOR:
+        case MN_BXOR:
+        case MN_EQ:
+        case MN_NE:
+        case MN_GT:
+        case MN_LT:
+        case MN_GTE:
+        case MN_LTE:
+        case MN_LET:
+        case MN_VARADD:
+        case MN_VARSUB:
+        case MN_VARMUL:
+        case MN_VARDIV:
+        case MN_VARMOD:
+        case MN_VARXOR:
+        case MN_VARAND:
+        case MN_VAROR:
+        case MN_VARROR:
+        case MN_VARROL:
+        case MN_STRI2CHR:
+        case MN_STR2CHARNUL:
+        case MN_STR2A:
+        case MN_STRACAT:
+            return -1;
+
+        case MN_CASE_R:
+        case MN_LETNP:
+            return -2;
+
+        case MN_COPY_ARRAY:
+        case MN_COPY_ARRAY_REPEAT:
+            return -3;
+
+        case MN_COPY_STRUCT:
+            return -5;
+
+        case MN_CALL:
+            if ( !( proc = procdef_get( ptr[1] ) ) ) return STACK_EFFECT_UNKNOWN;
+            return 1 - proc->params;
+
+        case MN_PROC:
+            if ( !( proc = procdef_get( ptr[1] ) ) ) return STACK_EFFECT_UNKNOWN;
+            return -proc->params;
+
+        case MN_SYSCALL:
+            return 1 - ( ( SYSPROC * ) ( intptr_t ) ptr[1] )->params;
+
+        case MN_SYSPROC:
+            return -( ( SYSPROC * ) ( intptr_t ) ptr[1] )->params;
+    }
+
+    return STACK_EFFECT_UNKNOWN;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : procdef_stack_size
+ *
+ *  Computes the stack a process needs from the stack effect of its code,
+ *  scanned in order. The compiler only leaves values on the stack inside
+ *  an expression or a SWITCH, so the depth is the same along every path
+ *  reaching an instruction, and the scan finds the maximum depth.
+ *  Only valid once the code is bound by sysprocs_bind.
+ *
+ *  PARAMS :
+ *      proc            Pointer to the process definition
+ *
+ *  RETURN VALUE :
+ *      Stack size in bytes, including the size word, or 0 if unknown
+ */
+
+static int64_t procdef_stack_size( PROCDEF * proc ) {
+    int64_t * ptr, * end, depth = 0, max = 0, effect;
+
+    if ( !proc->code ) return 0;
+
+    ptr = proc->code;
+    end = ptr + proc->code_size / sizeof( int64_t );
+
+    while ( ptr < end ) {
+        if ( ( effect = mnemonic_stack_effect( ptr ) ) == STACK_EFFECT_UNKNOWN ) return 0;
+        depth += effect;
+        if ( depth < 0 ) depth = 0;
+        if ( depth > max ) max = depth;
+        ptr += MN_PARAMS( *ptr ) + 1;
+    }
+
+    max = ( 1 + max + STACK_RESERVE ) * sizeof( int64_t );
+
+    return ( max > STACK_SIZE_MAX ) ? STACK_SIZE_MAX : max;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : sysprocs_bind
+ *
+ *  Replaces the operand of every SYSCALL and SYSPROC in the loaded code
+ *  with the SYSPROC pointer, so calls don't go through the sysproc table,
+ *  and computes the stack size of every process.
+ *  Must be called once, after the modules are loaded.
+ *
+ */
+
+void sysprocs_bind( void ) {
+    int64_t n, * ptr, * end;
+    SYSPROC * p;
+
+    for ( n = 0; n < procdef_count; n++ ) {
+        if ( !procs[n].code ) continue;
+
+        ptr = procs[n].code;
+        end = ptr + procs[n].code_size / sizeof( int64_t );
+
+        while ( ptr < end ) {
+            if ( ( *ptr & MN_MASK ) == MN_SYSCALL || ( *ptr & MN_MASK ) == MN_SYSPROC ) {
+                p = sysproc_get( ptr[1] );
+                if ( !p ) p = &sysproc_unknown[( *ptr & MN_MASK ) == MN_SYSPROC];
+                ptr[1] = ( int64_t ) ( intptr_t ) p;
+            }
+            ptr += MN_PARAMS( *ptr ) + 1;
+        }
+    }
+
+    /* Calls must be bound to get the parameters of system functions */
+
+    for ( n = 0; n < procdef_count; n++ ) procs[n].stack_size = procdef_stack_size( &procs[n] );
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : procdef_calls
+ *
+ *  Checks if the code of a process calls a given system function.
+ *  Only valid once the code is bound by sysprocs_bind.
+ *
+ *  PARAMS :
+ *      proc            Pointer to the process definition
+ *      func            System function
+ *
+ *  RETURN VALUE :
+ *      1 if the process calls the function, 0 otherwise
+ */
+
+int64_t procdef_calls( PROCDEF * proc, void * func ) {
+    int64_t * ptr, * end;
+
+    if ( !proc->code ) return 0;
+
+    ptr = proc->code;
+    end = ptr + proc->code_size / sizeof( int64_t );
+
+    while ( ptr < end ) {
+        if ( ( ( *ptr & MN_MASK ) == MN_SYSCALL || ( *ptr & MN_MASK ) == MN_SYSPROC ) &&
+             ( ( SYSPROC * ) ( intptr_t ) ptr[1] )->func == ( SYSFUNC * ) func ) return 1;
+        ptr += MN_PARAMS( *ptr ) + 1;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
 PROCDEF * procdef_get( int64_t n ) {
     if ( n >= 0 && n < procdef_count ) return &procs[n];
     return NULL;
@@ -104,6 +389,27 @@ DCB_HEADER dcb;
 
 /* ---------------------------------------------------------------------- */
 
+/* The DCB file, mapped in memory when possible (see dcb_data) */
+
+#ifdef DCB_USE_MMAP
+static uint8_t * dcb_map = NULL;
+static int64_t dcb_map_size = 0;
+#endif
+
+/* Identifier table hashed by code and by name, entries are index + 1 */
+
+static int64_t * dcb_id_by_code = NULL;
+static int64_t * dcb_id_by_name = NULL;
+static int64_t dcb_id_mask = 0;
+
+#define DCB_ID_CODE_HASH(code)  ( ( int64_t ) ( ( ( uint64_t ) ( code ) * 0x9E3779B97F4A7C15ULL ) >> 32 ) )
+
+/* Debug source files are read on first use, see dcb_source_count */
+
+static uint8_t * dcb_source_loaded = NULL;
+
+/* ---------------------------------------------------------------------- */
+
 static char * trim( char * ptr ) {
     char * ostr = ptr, * bptr = ptr;
     while ( *ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t' ) ptr++;
@@ -115,6 +421,25 @@ static char * trim( char * ptr ) {
 
 /* ---------------------------------------------------------------------- */
 
+/* Source names are made absolute when the DCB is loaded, a CD() or CHDIR()
+   in the program would change the file a relative name points to before
+   it is read. Names not found from the current directory are kept as they
+   are, file_open searches them in the PATH */
+
+static char * source_path( const char * fname ) {
+    char * full = NULL;
+    FILE * fp = fopen( fname, "r" );
+
+    if ( fp ) {
+        fclose( fp );
+        full = getfullpath( ( char * ) fname );
+    }
+
+    return full ? full : strdup( fname );
+}
+
+/* ---------------------------------------------------------------------- */
+
 static int load_file( const char * filename, int n ) {
     char line[2048], ** lines;
     int allocated = 16, count = 0, i;
@@ -122,7 +447,6 @@ static int load_file( const char * filename, int n ) {
 
     fp = file_open( filename, "r0" );
     if ( !fp ) {
-        dcb.sourcefiles[n] = 0;
         dcb.sourcelines[n] = 0;
         dcb.sourcecount[n] = 0;
         return 0;
@@ -160,13 +484,6 @@ static int load_file( const char * filename, int n ) {
     }
     file_close( fp );
 
-    dcb.sourcefiles[n] = ( uint8_t * ) strdup( filename );
-    if ( !dcb.sourcefiles[n] ) {
-        for ( i = 0; i < count; i++ ) free( lines[ i ] );
-        free( lines );
-        file_close( fp );
-        return -1;
-    }
     dcb.sourcelines[n] = ( uint8_t ** ) lines;
     dcb.sourcecount[n] = count;
     return 1;
@@ -174,6 +491,86 @@ static int load_file( const char * filename, int n ) {
 
 /* ---------------------------------------------------------------------- */
 
+/*
+ *  FUNCTION : dcb_source_count
+ *
+ *  Returns the number of lines of a source file of a debug DCB,
+ *  reading the file the first time it is used.
+ *
+ *  PARAMS :
+ *      n               Number of the source file
+ *
+ *  RETURN VALUE :
+ *      Number of lines in dcb.sourcelines[n], 0 if not available
+ */
+
+int64_t dcb_source_count( int64_t n ) {
+    if ( n < 0 || n >= ( int64_t ) dcb.data.NSourceFiles ) return 0;
+
+    if ( !dcb_source_loaded[n] ) {
+        dcb_source_loaded[n] = 1;
+        switch ( load_file( ( const char * ) dcb.sourcefiles[n], n ) ) {
+            case 0:
+                fprintf( stdout, "WARNING: Runtime warning - file not found (%s)\n", dcb.sourcefiles[n] );
+                break;
+
+            case -1:
+                fprintf( stdout, "ERROR: Runtime error - no enough memory for load (%s)\n", dcb.sourcefiles[n] );
+                exit(2);
+                break;
+        }
+    }
+
+    return dcb.sourcecount[n];
+}
+
+/* ---------------------------------------------------------------------- */
+
+static uint32_t dcb_id_name_hash( const char * name ) {
+    uint32_t h = 2166136261U;
+    int n;
+
+    for ( n = 0; n < ( int ) sizeof( dcb.id[0].Name ) && name[n]; n++ ) h = ( h ^ ( uint8_t ) name[n] ) * 16777619U;
+    return h;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : dcb_id_index
+ *
+ *  Builds the hashes used by getid and getid_name. When an identifier
+ *  or a code appears more than once the first one is kept, as the
+ *  linear search did.
+ *
+ */
+
+static void dcb_id_index( void ) {
+    int64_t n, i, size;
+
+    for ( size = 64; size < ( int64_t ) dcb.data.NID * 2; size *= 2 );
+
+    dcb_id_by_code = ( int64_t * ) calloc( size, sizeof( int64_t ) );
+    dcb_id_by_name = ( int64_t * ) calloc( size, sizeof( int64_t ) );
+    if ( !dcb_id_by_code || !dcb_id_by_name ) {
+        fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+        exit(2);
+    }
+    dcb_id_mask = size - 1;
+
+    for ( n = 0; n < dcb.data.NID; n++ ) {
+        for ( i = DCB_ID_CODE_HASH( dcb.id[n].Code ) & dcb_id_mask; dcb_id_by_code[i]; i = ( i + 1 ) & dcb_id_mask )
+            if ( dcb.id[dcb_id_by_code[i] - 1].Code == dcb.id[n].Code ) break;
+        if ( !dcb_id_by_code[i] ) dcb_id_by_code[i] = n + 1;
+
+        for ( i = dcb_id_name_hash( ( const char * ) dcb.id[n].Name ) & dcb_id_mask; dcb_id_by_name[i]; i = ( i + 1 ) & dcb_id_mask )
+            if ( !strncmp( ( const char * ) dcb.id[dcb_id_by_name[i] - 1].Name, ( const char * ) dcb.id[n].Name, sizeof( dcb.id[n].Name ) ) ) break;
+        if ( !dcb_id_by_name[i] ) dcb_id_by_name[i] = n + 1;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
 int dcb_load( const char * filename ) {
     file * fp;
 
@@ -191,16 +588,80 @@ int dcb_load( const char * filename ) {
 
 /* ---------------------------------------------------------------------- */
 
-DCB_VAR * read_and_arrange_varspace( file * fp, int count ) {
-    int n, n1;
-    DCB_VAR * vars = ( DCB_VAR * ) calloc( count, sizeof( DCB_VAR ) );
-    if ( !vars ) {
+/*
+ *  FUNCTION : dcb_map_file
+ *
+ *  Maps the whole DCB file in memory, if it is a regular file. The
+ *  mapping is private, so the pages used in place (code, data and
+ *  tables) are read on first access and copied only when written.
+ *
+ */
+
+static void dcb_map_file( file * fp ) {
+#ifdef DCB_USE_MMAP
+    struct stat st;
+    void * map;
+
+    if ( fp->type != F_FILE || fstat( fileno( fp->fp ), &st ) || !S_ISREG( st.st_mode ) || !st.st_size ) return;
+
+    map = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( fp->fp ), 0 );
+    if ( map == MAP_FAILED ) return;
+
+    dcb_map = ( uint8_t * ) map;
+    dcb_map_size = st.st_size;
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : dcb_data
+ *
+ *  Returns a section of the DCB. On little endian hosts, with the file
+ *  mapped, aligned sections are used in place. Otherwise the section is
+ *  copied to a new buffer and the caller must arrange it.
+ *
+ *  PARAMS :
+ *      fp              DCB file
+ *      offset          Offset of the section in the file
+ *      size            Size of the section in bytes
+ *
+ *  RETURN VALUE :
+ *      Pointer to the data
+ */
+
+static void * dcb_data( file * fp, int64_t offset, int64_t size ) {
+    void * data;
+
+#if defined( DCB_USE_MMAP ) && __BYTEORDER == __LIL_ENDIAN
+    if ( dcb_map && !( offset & 7 ) && offset + size <= dcb_map_size ) return dcb_map + offset;
+#endif
+
+    data = malloc( size );
+    if ( !data ) {
         fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
         exit(2);
     }
 
+#ifdef DCB_USE_MMAP
+    if ( dcb_map && offset + size <= dcb_map_size ) {
+        memcpy( data, dcb_map + offset, size );
+        return data;
+    }
+#endif
+
+    file_seek( fp, offset, SEEK_SET );
+    file_read( fp, data, size );
+    return data;
+}
+
+/* ---------------------------------------------------------------------- */
+
+DCB_VAR * read_and_arrange_varspace( file * fp, int64_t offset, int count ) {
+    int n, n1;
+    DCB_VAR * vars = ( DCB_VAR * ) dcb_data( fp, offset, count * sizeof( DCB_VAR ) );
+
     for ( n = 0; n < count; n++ ) {
-        file_read( fp, &vars[n], sizeof( DCB_VAR ) );
         ARRANGE_QWORD( &vars[n].ID );
         ARRANGE_QWORD( &vars[n].Offset );
         for ( n1 = 0; n1 < MAX_TYPECHUNKS; n1++ ) ARRANGE_QWORD( &vars[n].Type.Count[n1] );
@@ -258,6 +719,8 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
 
     if ( memcmp( dcb.data.Header, DCB_MAGIC, sizeof( DCB_MAGIC ) - 1 ) != 0 || dcb.data.Version < 0x0800 ) return 0;
 
+    dcb_map_file( fp );
+
     globaldata = calloc( dcb.data.SGlobal + 8, 1 );
     localdata  = calloc( dcb.data.SLocal + 8, 1 );
     localstr   = ( int64_t * ) calloc( dcb.data.NLocStrings + 8, sizeof( int64_t ) );
@@ -376,17 +839,12 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
             file_read( fp, &dcb.id[n], sizeof( DCB_ID ) );
             ARRANGE_QWORD( &dcb.id[n].Code );
         }
-    }
 
-    if ( dcb.data.NGloVars ) {
-        file_seek( fp, offset + dcb.data.OGloVars, SEEK_SET );
-        dcb.glovar = read_and_arrange_varspace( fp, dcb.data.NGloVars );
+        dcb_id_index();
     }
 
-    if ( dcb.data.NLocVars ) {
-        file_seek( fp, offset + dcb.data.OLocVars, SEEK_SET );
-        dcb.locvar = read_and_arrange_varspace( fp, dcb.data.NLocVars );
-    }
+    if ( dcb.data.NGloVars ) dcb.glovar = read_and_arrange_varspace( fp, offset + dcb.data.OGloVars, dcb.data.NGloVars );
+    if ( dcb.data.NLocVars ) dcb.locvar = read_and_arrange_varspace( fp, offset + dcb.data.OLocVars, dcb.data.NLocVars );
 
     if ( dcb.data.NVarSpaces ) {
         dcb.varspace = ( DCB_VARSPACE * ) calloc( dcb.data.NVarSpaces, sizeof( DCB_VARSPACE ) );
@@ -408,8 +866,7 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
         for ( n = 0; n < dcb.data.NVarSpaces; n++ ) {
             dcb.varspace_vars[n] = 0;
             if ( !dcb.varspace[n].NVars ) continue;
-            file_seek( fp, offset + dcb.varspace[n].OVars, SEEK_SET );
-            dcb.varspace_vars[n] = read_and_arrange_varspace( fp, dcb.varspace[n].NVars );
+            dcb.varspace_vars[n] = read_and_arrange_varspace( fp, offset + dcb.varspace[n].OVars, dcb.varspace[n].NVars );
         }
     }
 
@@ -419,25 +876,23 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
         dcb.sourcecount = ( uint64_t * ) calloc( dcb.data.NSourceFiles, sizeof( uint64_t ) );
         dcb.sourcelines = ( uint8_t *** ) calloc( dcb.data.NSourceFiles, sizeof( uint8_t ** ) );
         dcb.sourcefiles = ( uint8_t ** ) calloc( dcb.data.NSourceFiles, sizeof( uint8_t * ) );
+        dcb_source_loaded = ( uint8_t * ) calloc( dcb.data.NSourceFiles, sizeof( uint8_t ) );
 
-        if ( !dcb.sourcecount || !dcb.sourcelines || !dcb.sourcefiles ) {
+        if ( !dcb.sourcecount || !dcb.sourcelines || !dcb.sourcefiles || !dcb_source_loaded ) {
             fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
             exit(2);
         }
 
+        /* Only the names, the files are read by dcb_source_count */
+
         file_seek( fp, offset + dcb.data.OSourceFiles, SEEK_SET );
         for ( n = 0; n < dcb.data.NSourceFiles; n++ ) {
             file_readUint64( fp, &size );
             file_read( fp, fname, size );
-            switch ( load_file( fname, n ) ) {
-                case 0:
-                    fprintf( stdout, "WARNING: Runtime warning - file not found (%s)\n", fname );
-                    break;
-
-                case -1:
-                    fprintf( stdout, "ERROR: Runtime error - no enough memory for load (%s)\n", fname );
-                    exit(2);
-                    break;
+            dcb.sourcefiles[n] = ( uint8_t * ) source_path( fname );
+            if ( !dcb.sourcefiles[n] ) {
+                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+                exit(2);
             }
         }
     }
@@ -456,35 +911,14 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
         procs[n].type               = n;
         procs[n].name               = getid_name( procs[n].id );
         procs[n].breakpoint         = 0;
+        procs[n].stack_size         = 0;
 
-        if ( dcb.proc[n].data.SPrivate ) {
-            procs[n].pridata = ( uint8_t * )calloc( dcb.proc[n].data.SPrivate, sizeof( uint8_t ) ); /* Size in bytes */
-            if ( !procs[n].pridata ) {
-                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
-                exit(2);
-            }
-            file_seek( fp, offset + dcb.proc[n].data.OPrivate, SEEK_SET );
-            file_read( fp, procs[n].pridata, dcb.proc[n].data.SPrivate );      /* *** */
-        }
-
-        if ( dcb.proc[n].data.SPublic ) {
-            procs[n].pubdata = ( uint8_t * )calloc( dcb.proc[n].data.SPublic, sizeof( uint8_t ) ); /* Size in bytes */
-            if ( !procs[n].pubdata ) {
-                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
-                exit(2);
-            }
-            file_seek( fp, offset + dcb.proc[n].data.OPublic, SEEK_SET );
-            file_read( fp, procs[n].pubdata, dcb.proc[n].data.SPublic );       /* *** */
-        }
+        if ( dcb.proc[n].data.SPrivate ) procs[n].pridata = ( uint8_t * ) dcb_data( fp, offset + dcb.proc[n].data.OPrivate, dcb.proc[n].data.SPrivate );   /* *** */
+        if ( dcb.proc[n].data.SPublic )  procs[n].pubdata = ( uint8_t * ) dcb_data( fp, offset + dcb.proc[n].data.OPublic, dcb.proc[n].data.SPublic );     /* *** */
 
         if ( dcb.proc[n].data.SCode ) {
-            procs[n].code = ( int64_t * ) calloc( dcb.proc[n].data.SCode / sizeof( int64_t ), sizeof( int64_t ) ); /* Size in bytes */
-            if ( !procs[n].code ) {
-                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
-                exit(2);
-            }
-            file_seek( fp, offset + dcb.proc[n].data.OCode, SEEK_SET );
-            file_readUint64A( fp, (uint64_t *)procs[n].code, dcb.proc[n].data.SCode / sizeof(uint64_t) );
+            procs[n].code = ( int64_t * ) dcb_data( fp, offset + dcb.proc[n].data.OCode, dcb.proc[n].data.SCode );
+            ARRANGE_QWORDS( procs[n].code, dcb.proc[n].data.SCode / sizeof( int64_t ) );
 
             if ( dcb.proc[n].data.OExitCode )   procs[n].exitcode = dcb.proc[n].data.OExitCode;
             else                                procs[n].exitcode = 0;
@@ -494,34 +928,17 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
         }
 
         if ( dcb.proc[n].data.NPriStrings ) {
-            procs[n].strings = ( int64_t * )calloc( dcb.proc[n].data.NPriStrings, sizeof( int64_t ) );
-            if ( !procs[n].strings ) {
-                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
-                exit(2);
-            }
-            file_seek( fp, offset + dcb.proc[n].data.OPriStrings, SEEK_SET );
-            file_readUint64A( fp, (uint64_t *)procs[n].strings, dcb.proc[n].data.NPriStrings );
+            procs[n].strings = ( int64_t * ) dcb_data( fp, offset + dcb.proc[n].data.OPriStrings, dcb.proc[n].data.NPriStrings * sizeof( int64_t ) );
+            ARRANGE_QWORDS( procs[n].strings, dcb.proc[n].data.NPriStrings );
         }
 
         if ( dcb.proc[n].data.NPubStrings ) {
-            procs[n].pubstrings = ( int64_t * )calloc( dcb.proc[n].data.NPubStrings, sizeof( int64_t ) );
-            if ( !procs[n].pubstrings ) {
-                fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
-                exit(2);
-            }
-            file_seek( fp, offset + dcb.proc[n].data.OPubStrings, SEEK_SET );
-            file_readUint64A( fp, (uint64_t *)procs[n].pubstrings, dcb.proc[n].data.NPubStrings );
-        }
-
-        if ( dcb.proc[n].data.NPriVars ) {
-            file_seek( fp, offset + dcb.proc[n].data.OPriVars, SEEK_SET );
-            dcb.proc[n].privar = read_and_arrange_varspace( fp, dcb.proc[n].data.NPriVars );
+            procs[n].pubstrings = ( int64_t * ) dcb_data( fp, offset + dcb.proc[n].data.OPubStrings, dcb.proc[n].data.NPubStrings * sizeof( int64_t ) );
+            ARRANGE_QWORDS( procs[n].pubstrings, dcb.proc[n].data.NPubStrings );
         }
 
-        if ( dcb.proc[n].data.NPubVars ) {
-            file_seek( fp, offset + dcb.proc[n].data.OPubVars, SEEK_SET );
-            dcb.proc[n].pubvar = read_and_arrange_varspace( fp, dcb.proc[n].data.NPubVars );
-        }
+        if ( dcb.proc[n].data.NPriVars ) dcb.proc[n].privar = read_and_arrange_varspace( fp, offset + dcb.proc[n].data.OPriVars, dcb.proc[n].data.NPriVars );
+        if ( dcb.proc[n].data.NPubVars ) dcb.proc[n].pubvar = read_and_arrange_varspace( fp, offset + dcb.proc[n].data.OPubVars, dcb.proc[n].data.NPubVars );
     }
 
     /* Retrieves the fixup table for system procedures */
@@ -563,16 +980,26 @@ int dcb_load_from( file * fp, const char * filename, int offset ) {
 /* ---------------------------------------------------------------------- */
 
 char * getid_name( int64_t code ) {
-    int n;
-    for ( n = 0; n < dcb.data.NID; n++ ) if ( dcb.id[n].Code == code ) return (char *)dcb.id[n].Name;
+    int64_t i;
+
+    if ( !dcb_id_by_code ) return "(?)";
+
+    for ( i = DCB_ID_CODE_HASH( code ) & dcb_id_mask; dcb_id_by_code[i]; i = ( i + 1 ) & dcb_id_mask )
+        if ( dcb.id[dcb_id_by_code[i] - 1].Code == code ) return ( char * ) dcb.id[dcb_id_by_code[i] - 1].Name;
+
     return "(?)";
 }
 
 /* ---------------------------------------------------------------------- */
 
 int64_t getid( char * name ) {
-    int n;
-    for ( n = 0; n < dcb.data.NID; n++ ) if ( strcmp( (const char *)dcb.id[n].Name, name ) == 0 ) return dcb.id[n].Code;
+    int64_t i;
+
+    if ( !dcb_id_by_name ) return -1;
+
+    for ( i = dcb_id_name_hash( name ) & dcb_id_mask; dcb_id_by_name[i]; i = ( i + 1 ) & dcb_id_mask )
+        if ( !strncmp( ( const char * ) dcb.id[dcb_id_by_name[i] - 1].Name, name, sizeof( dcb.id[0].Name ) ) ) return dcb.id[dcb_id_by_name[i] - 1].Code;
+
     return -1;
 }
 
@@ -42,9 +42,6 @@
 #include "instance.h"
 #include "xstrings.h"
 
-#undef STACK_SIZE
-#define STACK_SIZE 4096
-
 /* ---------------------------------------------------------------------- */
 /* Instance management module, with initialization and destruction        */
 /* functions, duplication, etc.                                           */
@@ -61,11 +58,14 @@
 
 INSTANCE ** hashed_by_id = NULL;
 INSTANCE ** hashed_by_instance = NULL;
-INSTANCE ** hashed_by_type = NULL;
 INSTANCE ** hashed_by_priority = NULL;
 
 INSTANCE * first_instance = NULL;
 
+/* Instances in the lists by type */
+
+static int64_t instance_count_typed = 0;
+
 /* Priority lists */
 
 static INSTANCE * iterator_by_priority  = NULL;
@@ -121,26 +121,68 @@ void instance_remove_from_list_by_instance( INSTANCE * r ) {
 /* By type                                                                */
 /* ---------------------------------------------------------------------- */
 
-void instance_add_to_list_by_type( INSTANCE * r, uint64_t itype ) {
-    unsigned int hash = HASH( itype );
+/* Every PROCDEF keeps an array with its instances, in order of creation,
+   and the serial number given to each one. New instances are appended. A
+   removed one leaves a hole, and the holes are dropped once they are half
+   the array. Scans by type hold a serial number, not a position, so they
+   don't depend on the holes */
+
+static void instance_compact_by_type( PROCDEF * proc ) {
+    int64_t n, k;
+
+    for ( n = k = 0; n < proc->instance_used; n++ ) {
+        if ( !proc->instances[ n ] ) continue;
+        proc->instances[ k ] = proc->instances[ n ];
+        proc->instance_serials[ k ] = proc->instance_serials[ n ];
+        proc->instances[ k ]->type_index = k;
+        k++;
+    }
 
-    if ( !hashed_by_type ) hashed_by_type = calloc( HASH_SIZE, sizeof( INSTANCE * ) );
+    proc->instance_used = k;
+}
+
+/* ---------------------------------------------------------------------- */
 
-    r->prev_by_type = NULL;
-    r->next_by_type = hashed_by_type[hash];
-    if ( r->next_by_type ) r->next_by_type->prev_by_type = r;
-    hashed_by_type[hash] = r;
+void instance_add_to_list_by_type( INSTANCE * r, uint64_t itype ) {
+    PROCDEF * proc = procdef_get( itype );
+    INSTANCE ** instances;
+    int64_t * serials, reserved;
+
+    r->type_index = -1;
+    if ( !proc ) return;
+
+    if ( proc->instance_used >= proc->instance_reserved ) {
+        reserved = proc->instance_reserved ? proc->instance_reserved * 2 : 16;
+        instances = ( INSTANCE ** ) realloc( proc->instances, reserved * sizeof( INSTANCE * ) );
+        assert( instances );
+        proc->instances = instances;
+        serials = ( int64_t * ) realloc( proc->instance_serials, reserved * sizeof( int64_t ) );
+        assert( serials );
+        proc->instance_serials = serials;
+        proc->instance_reserved = reserved;
+    }
+
+    r->type_index = proc->instance_used;
+    proc->instance_serials[ proc->instance_used ] = ++proc->instance_serial;
+    proc->instances[ proc->instance_used++ ] = r;
+    proc->instance_count++;
+    instance_count_typed++;
 }
 
 /* ---------------------------------------------------------------------- */
 
 void instance_remove_from_list_by_type( INSTANCE * r, uint64_t itype ) {
-    unsigned int hash = HASH( itype );
+    PROCDEF * proc = procdef_get( itype );
 
-    if ( r->prev_by_type ) r->prev_by_type->next_by_type = r->next_by_type;
-    if ( r->next_by_type ) r->next_by_type->prev_by_type = r->prev_by_type;
+    if ( !proc || r->type_index < 0 || r->type_index >= proc->instance_used || proc->instances[ r->type_index ] != r ) return;
 
-    if ( hashed_by_type[hash] == r ) hashed_by_type[hash] = r->next_by_type;
+    proc->instances[ r->type_index ] = NULL;
+    r->type_index = -1;
+    proc->instance_count--;
+    instance_count_typed--;
+
+    while ( proc->instance_used && !proc->instances[ proc->instance_used - 1 ] ) proc->instance_used--;
+    if ( proc->instance_used - proc->instance_count > proc->instance_count ) instance_compact_by_type( proc );
 }
 
 /* ---------------------------------------------------------------------- */
@@ -272,6 +314,25 @@ int64_t instance_getid() {
 
 /* ---------------------------------------------------------------------- */
 
+/*
+ *  FUNCTION : instance_setmaxid
+ *
+ *  Set the next instance identifier to try, after the instances were
+ *  replaced (a restored state).
+ *
+ *  PARAMS :
+ *      id              Next identifier, FIRST_INSTANCE_ID if out of range
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void instance_setmaxid( int64_t id ) {
+    instance_maxid = ( id < FIRST_INSTANCE_ID || id > LAST_INSTANCE_ID ) ? FIRST_INSTANCE_ID : id;
+}
+
+/* ---------------------------------------------------------------------- */
+
 /*
  *  FUNCTION : instance_duplicate
  *
@@ -366,7 +427,7 @@ INSTANCE * instance_duplicate( INSTANCE * father ) {
 
     r->called_by = NULL;
 
-    r->stack = malloc( father->stack[0] );
+    r->stack = malloc( father->stack[0] & STACK_SIZE_MASK );
     memmove(r->stack, father->stack, ( void * ) father->stack_ptr - ( void * ) father->stack );
     r->stack_ptr = &r->stack[1];
 
@@ -477,9 +538,9 @@ INSTANCE * instance_new( PROCDEF * proc, INSTANCE * father ) {
 
     r->called_by = NULL;
 
-    r->stack = malloc( STACK_SIZE );
+    r->stack = malloc( proc->stack_size ? proc->stack_size : STACK_SIZE );
     r->stack_ptr = &r->stack[1];
-    r->stack[0] = STACK_SIZE;
+    r->stack[0] = proc->stack_size ? proc->stack_size : STACK_SIZE;
 
     /* Initialize list pointers */
 
@@ -518,6 +579,47 @@ INSTANCE * instance_getsmallbro( INSTANCE * i ) {
 
 /* ---------------------------------------------------------------------- */
 
+/*
+ *  FUNCTION : instance_stack_grow
+ *
+ *  Grows the stack of an instance, so it has room for at least the
+ *  given number of values. Exits with a runtime error if the stack
+ *  can't grow more.
+ *
+ *  PARAMS :
+ *      r           Pointer to the instance
+ *      slots       Number of values to push
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void instance_stack_grow( INSTANCE * r, int64_t slots ) {
+    int64_t used = r->stack_ptr - r->stack, size = r->stack[0] & STACK_SIZE_MASK, need, * stack;
+
+    need = ( used + slots ) * sizeof( int64_t );
+    if ( need <= size ) return;
+
+    if ( need > STACK_SIZE_MAX ) {
+        fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Stack overflow\n", r->proc->name, LOCQWORD( r, PROCESS_ID ) );
+        exit( 0 );
+    }
+
+    while ( size < need ) size *= 2;
+    if ( size > STACK_SIZE_MAX ) size = STACK_SIZE_MAX;
+
+    if ( !( stack = ( int64_t * ) realloc( r->stack, size ) ) ) {
+        fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+        exit( 2 );
+    }
+
+    r->stack = stack;
+    r->stack_ptr = &stack[used];
+    r->stack[0] = ( r->stack[0] & STACK_RETURN_VALUE ) | size;
+}
+
+/* ---------------------------------------------------------------------- */
+
 /*
  *  FUNCTION : instance_destroy
  *
@@ -687,32 +789,70 @@ INSTANCE * instance_next_by_priority() {
 
 /*
 context = NULL = start scan
-context = pointer = continue scan
+context = n = continue scan, n is the serial number of the last instance returned
 context = -1 = end scan
+
+The scan goes from the newest instance to the oldest, by serial number, so
+every instance alive at the start of the scan that doesn't end before it's
+reached is returned once, whatever ends in the middle of the scan, and the
+context never points to freed memory. Instances created during the scan
+aren't returned.
 */
 
 INSTANCE * instance_get_by_type( uint64_t itype, INSTANCE ** context ) {
-    INSTANCE * i;
+    PROCDEF * proc;
+    int64_t lo, hi, mid, serial;
+
+    if ( !context || !itype /* || itype >= FIRST_INSTANCE_ID */ ) return NULL;
 
-    if ( !context || !hashed_by_type || !itype /* || itype >= FIRST_INSTANCE_ID */ ) return NULL;
+    if ( !( proc = procdef_get( itype ) ) ) return ( *context = NULL );
 
-    if ( !*context ) /* start scan */
-        i = hashed_by_type[HASH( itype )];
-    else if ( ( i = *context ) == ( INSTANCE * ) -1 ) /* End scan */
-        return ( *context = NULL );
+    if ( *context == ( INSTANCE * ) -1 ) return ( *context = NULL ); /* End scan */
 
-    if ( i ) /* Valid instance, continue scan */
-    {
-        if ( i->next_by_type )
-            *context = i->next_by_type;
-        else
-            *context = ( INSTANCE * ) -1; /* Next call will be "end scan" */
+    /* First position with the serial of the last instance returned or after */
 
-        return i;
+    lo = 0;
+    hi = proc->instance_used;
+
+    if ( *context ) {
+        serial = ( intptr_t ) *context;
+        while ( lo < hi ) {
+            mid = ( lo + hi ) / 2;
+            if ( proc->instance_serials[ mid ] < serial ) lo = mid + 1;
+            else hi = mid;
+        }
     }
 
-    /* Here only if hashed_by_type[HASH( itype )] is NULL */
-    return ( *context = NULL ); /* return is null, then end scan */
+    while ( --hi >= 0 && !proc->instances[ hi ] );
+
+    if ( hi < 0 ) return ( *context = NULL ); /* return is null, then end scan */
+
+    *context = ( INSTANCE * ) ( intptr_t ) proc->instance_serials[ hi ];
+
+    return proc->instances[ hi ];
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : instance_count_by_type
+ *
+ *  Returns how many instances of a type exist, or of every type if 0.
+ *  Instances killed that didn't end yet are counted.
+ *
+ *  PARAMS :
+ *      type            Integer type
+ *
+ *  RETURN VALUE :
+ *      Number of instances
+ */
+
+int64_t instance_count_by_type( uint64_t itype ) {
+    PROCDEF * proc;
+
+    if ( !itype ) return instance_count_typed;
+    if ( !( proc = procdef_get( itype ) ) ) return 0;
+    return proc->instance_count;
 }
 
 /* ---------------------------------------------------------------------- */
@@ -0,0 +1,1455 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "offsets.h"
+#include "bgdrtm.h"
+#include "pslang.h"
+#include "sysprocs_p.h"
+#include "instance.h"
+#include "instance_state.h"
+#include "varspace_file.h"
+#include "xstrings.h"
+
+/* ---------------------------------------------------------------------- */
+/* Process tree state. A state holds the global data, every instance with */
+/* its local, private and public data, stack and code position, the order */
+/* of the priority and type lists, and all the strings used by them.      */
+/* Pointer variables pointing to global or instance data are saved as     */
+/* relocations, so the state can be restored on a new run. The stack has */
+/* no types: the code of the process is followed up to the saved position */
+/* to know which stack words are addresses, and those are relocated too.  */
+/* Pointers to any other memory can't be saved.                           */
+/* ---------------------------------------------------------------------- */
+
+#define STATE_MAGIC             "BGDSTATE"
+#define STATE_VERSION           3
+#define STATE_BYTEORDER         0x01020304
+#define STATE_IO_CHUNK          0x40000000
+
+#define STATE_SEGMENT_LOCAL     0
+#define STATE_SEGMENT_PRIVATE   1
+#define STATE_SEGMENT_PUBLIC    2
+#define STATE_SEGMENT_GLOBAL    3
+#define STATE_SEGMENT_STACK     4
+
+/* Kinds of stack words */
+
+#define STATE_WORD_VALUE        1
+#define STATE_WORD_ADDRESS      2
+#define STATE_WORD_UNKNOWN      3   /* May be an address or not */
+#define STATE_WORD_RESULT       4   /* Return value of a call not done yet */
+
+#define STATE_ALIGN(n)          (((n) + 7) & ~7)
+#define STATE_MAX_INSTANCES     ( LAST_INSTANCE_ID - FIRST_INSTANCE_ID + 1 )
+
+typedef struct {
+    char     magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    uint64_t program;           /* Hash of the program layout */
+    int64_t  size;              /* Total size, header included */
+    int64_t  global_size;
+    int64_t  local_size;
+    int64_t  ninstances;
+    int64_t  nrelocs;
+    int64_t  nstrings;
+    int64_t  strings_offset;
+} STATE_HEADER;
+
+/* Each instance record is followed by its local, private and public
+   data and the used stack words. The relocations go after the last
+   instance */
+
+typedef struct {
+    int64_t  proc;
+    int64_t  codeptr;           /* Position in the code of the process */
+    int64_t  called_by;         /* Number of the caller instance, -1 if none */
+    int64_t  exitcode;
+    int64_t  errorcode;
+    int64_t  call_level;
+    int64_t  first_run;
+    int64_t  last_priority;
+    int64_t  switchval;
+    int64_t  switchval_string;  /* String number + 1, 0 if none */
+    int64_t  cased;
+    int64_t  breakpoint;
+    int64_t  stack_size;        /* First word of the stack: size and flags */
+    int64_t  stack_used;        /* Words in use after the first one */
+} STATE_INSTANCE;
+
+typedef struct {
+    int64_t  instance;          /* Instance number of the pointer, -1 for global data */
+    int64_t  segment;
+    int64_t  slot;              /* Index in the pointer slots of the segment, or stack word */
+    int64_t  target;            /* Instance number pointed to, -1 for global data */
+    int64_t  target_segment;
+    int64_t  target_offset;
+} STATE_RELOC;
+
+typedef struct {
+    int64_t * offsets;
+    int64_t  count;
+} STATE_SLOTS;
+
+typedef struct {
+    uintptr_t base;
+    int64_t  size;
+    int64_t  instance;
+    int64_t  segment;
+} STATE_RANGE;
+
+typedef struct {
+    uint8_t * data;
+    int64_t  size;
+    int64_t  allocated;
+} STATE_BUFFER;
+
+typedef struct {
+    INSTANCE * instance;
+    int64_t * code;
+    int64_t  size;              /* Words of code */
+    int64_t  depth;             /* Stack words tracked */
+    int64_t * depths;           /* Stack depth before every instruction, -1 if not reached */
+    uint8_t * kinds;            /* Kind of the stack words before every instruction */
+    uint8_t * queued;
+    int64_t * pending;
+    int64_t  npending;
+} STATE_FLOW;
+
+typedef struct {
+    int64_t * table;            /* String code and number pairs */
+    uint64_t mask;
+    int64_t * unique;           /* String codes, by number */
+    int64_t  count;
+} STATE_STRINGS;
+
+typedef struct {
+    uint8_t * data;
+    int64_t * records;          /* Offset of each instance record */
+    int64_t  relocs;            /* Offset of the relocations */
+    int64_t  lists;             /* Offset of the lists order */
+    const char ** strings;
+} STATE_IMAGE;
+
+static int64_t * global_strings = NULL;
+static int64_t global_string_count = -1;
+
+/* Pointer slots by segment. Private and public, two by process */
+
+static STATE_SLOTS global_pointers = { NULL, 0 };
+static STATE_SLOTS local_pointers = { NULL, 0 };
+static STATE_SLOTS * proc_pointers = NULL;
+
+/* ---------------------------------------------------------------------- */
+
+static int state_init() {
+    int64_t n;
+
+    if ( global_string_count >= 0 ) return 0;
+
+    if ( ( global_pointers.count = varspace_pointers( dcb.glovar, dcb.data.NGloVars, &global_pointers.offsets ) ) < 0 ) return -1;
+    if ( ( local_pointers.count = varspace_pointers( dcb.locvar, dcb.data.NLocVars, &local_pointers.offsets ) ) < 0 ) return -1;
+
+    if ( !proc_pointers && !( proc_pointers = calloc( procdef_count * 2 + 1, sizeof( STATE_SLOTS ) ) ) ) return -1;
+
+    for ( n = 0; n < procdef_count; n++ ) {
+        STATE_SLOTS * p = &proc_pointers[n * 2];
+        if ( ( p[0].count = varspace_pointers( dcb.proc[n].privar, dcb.proc[n].data.NPriVars, &p[0].offsets ) ) < 0 ) return -1;
+        if ( ( p[1].count = varspace_pointers( dcb.proc[n].pubvar, dcb.proc[n].data.NPubVars, &p[1].offsets ) ) < 0 ) return -1;
+    }
+
+    global_string_count = varspace_strings( dcb.glovar, dcb.data.NGloVars, &global_strings );
+
+    return global_string_count < 0 ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static STATE_SLOTS * state_pointers( int64_t proc, int64_t segment ) {
+    switch ( segment ) {
+        case STATE_SEGMENT_GLOBAL:
+            return &global_pointers;
+
+        case STATE_SEGMENT_LOCAL:
+            return &local_pointers;
+
+        case STATE_SEGMENT_PRIVATE:
+            return &proc_pointers[proc * 2];
+
+        default:
+            return &proc_pointers[proc * 2 + 1];
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+static uint64_t state_hash( uint64_t h, const void * data, size_t len ) {
+    const uint8_t * p = ( const uint8_t * ) data;
+    while ( len-- ) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : state_program
+ *
+ *  Hashes the layout of the running program: data sizes, string slots
+ *  and processes. A state can only be restored by the same program.
+ *
+ */
+
+static uint64_t state_program() {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int64_t n;
+
+    h = state_hash( h, &dcb.data.SGlobal, sizeof( dcb.data.SGlobal ) );
+    h = state_hash( h, &local_size, sizeof( local_size ) );
+    h = state_hash( h, &procdef_count, sizeof( procdef_count ) );
+    h = state_hash( h, global_strings, global_string_count * sizeof( int64_t ) );
+    h = state_hash( h, localstr, local_strings * sizeof( int64_t ) );
+
+    for ( n = 0; n < procdef_count; n++ ) {
+        if ( procs[n].name ) h = state_hash( h, procs[n].name, strlen( procs[n].name ) );
+        h = state_hash( h, &procs[n].private_size, sizeof( procs[n].private_size ) );
+        h = state_hash( h, &procs[n].public_size, sizeof( procs[n].public_size ) );
+        h = state_hash( h, &procs[n].code_size, sizeof( procs[n].code_size ) );
+        h = state_hash( h, procs[n].strings, procs[n].string_count * sizeof( int64_t ) );
+        h = state_hash( h, procs[n].pubstrings, procs[n].pubstring_count * sizeof( int64_t ) );
+    }
+
+    return h;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Save                                                                   */
+/* ---------------------------------------------------------------------- */
+
+static int64_t state_put( STATE_BUFFER * b, const void * data, int64_t len ) {
+    int64_t pos = b->size, size = STATE_ALIGN( len );
+
+    if ( b->size + size > b->allocated ) {
+        int64_t allocated = b->allocated ? b->allocated : 65536;
+        uint8_t * d;
+
+        while ( b->size + size > allocated ) allocated *= 2;
+        if ( !( d = realloc( b->data, allocated ) ) ) return -1;
+        b->data = d;
+        b->allocated = allocated;
+    }
+
+    if ( len ) memcpy( b->data + pos, data, len );
+    if ( size > len ) memset( b->data + pos + len, 0, size - len );
+    b->size += size;
+
+    return pos;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int state_strings_init( STATE_STRINGS * s, int64_t slots ) {
+    uint64_t size;
+
+    for ( size = 16; size < ( uint64_t ) slots * 2; size <<= 1 );
+
+    s->table = malloc( size * 2 * sizeof( int64_t ) );
+    s->unique = malloc( ( slots + 1 ) * sizeof( int64_t ) );
+    if ( !s->table || !s->unique ) return -1;
+
+    memset( s->table, 0xff, size * 2 * sizeof( int64_t ) );
+    s->mask = size - 1;
+    s->count = 0;
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int64_t state_string_number( STATE_STRINGS * s, int64_t code ) {
+    uint64_t h = ( ( uint64_t ) code * 0x9e3779b97f4a7c15ULL ) >> 32 & s->mask;
+
+    while ( s->table[h * 2] != -1 && s->table[h * 2] != code ) h = ( h + 1 ) & s->mask;
+
+    if ( s->table[h * 2] == -1 ) {
+        s->table[h * 2] = code;
+        s->table[h * 2 + 1] = s->count;
+        s->unique[s->count++] = code;
+    }
+
+    return s->table[h * 2 + 1];
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void state_patch_strings( STATE_STRINGS * s, uint8_t * data, int64_t * offsets, int64_t count ) {
+    int64_t n;
+
+    for ( n = 0; n < count; n++ ) {
+        int64_t * slot = ( int64_t * ) ( data + offsets[n] );
+        *slot = state_string_number( s, *slot );
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int state_range_compare( const void * a, const void * b ) {
+    uintptr_t ba = ( ( const STATE_RANGE * ) a )->base, bb = ( ( const STATE_RANGE * ) b )->base;
+    return ba < bb ? -1 : ba > bb;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static STATE_RANGE * state_range_find( STATE_RANGE * ranges, int64_t count, uintptr_t v ) {
+    int64_t lo = 0, hi = count - 1, mid;
+
+    while ( lo <= hi ) {
+        mid = ( lo + hi ) / 2;
+        if ( v < ranges[mid].base ) hi = mid - 1;
+        else if ( v >= ranges[mid].base + ranges[mid].size ) lo = mid + 1;
+        else return &ranges[mid];
+    }
+
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Adds the relocations of the pointer slots of a segment. Returns -1 if a
+   pointer is not NULL and points out of the global and instance data */
+
+static int state_put_relocs( STATE_BUFFER * b, STATE_RANGE * ranges, int64_t nranges, uint8_t * data, int64_t proc, int64_t instance, int64_t segment, int64_t * nrelocs ) {
+    STATE_SLOTS * slots = state_pointers( proc, segment );
+    STATE_RANGE * range;
+    STATE_RELOC reloc;
+    uintptr_t v;
+    int64_t n;
+
+    for ( n = 0; n < slots->count; n++ ) {
+        if ( !( v = ( uintptr_t ) *( int64_t * ) ( data + slots->offsets[n] ) ) ) continue;
+        if ( !( range = state_range_find( ranges, nranges, v ) ) ) return -1;
+
+        reloc.instance = instance;
+        reloc.segment = segment;
+        reloc.slot = n;
+        reloc.target = range->instance;
+        reloc.target_segment = range->segment;
+        reloc.target_offset = v - range->base;
+        if ( state_put( b, &reloc, sizeof( reloc ) ) < 0 ) return -1;
+
+        ( *nrelocs )++;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Stack words                                                            */
+/* ---------------------------------------------------------------------- */
+
+/* Kind of a value loaded from a variable: an address if the variable is
+   a pointer, by the same slots the data relocations use */
+
+static uint8_t state_loaded_kind( int64_t code, STATE_SLOTS * slots, int64_t offset ) {
+    int64_t n;
+
+    if ( ( MN_TYPEOF( code ) & ~MN_UNSIGNED ) != MN_QWORD ) return STATE_WORD_VALUE;
+    if ( !slots ) return STATE_WORD_UNKNOWN;
+
+    for ( n = 0; n < slots->count; n++ )
+        if ( slots->offsets[n] == offset ) return STATE_WORD_ADDRESS;
+
+    return STATE_WORD_VALUE;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Kind of the result of an operation on two words */
+
+static uint8_t state_binary_kind( int64_t code, uint8_t a, uint8_t b ) {
+    if ( ( MN_TYPEOF( code ) & ~MN_UNSIGNED ) != MN_QWORD ) return STATE_WORD_VALUE;
+
+    switch ( code & MN_MASK ) {
+        case MN_ADD:
+            if ( ( a == STATE_WORD_ADDRESS && b == STATE_WORD_VALUE ) || ( a == STATE_WORD_VALUE && b == STATE_WORD_ADDRESS ) ) return STATE_WORD_ADDRESS;
+            break;
+
+        case MN_SUB:
+            if ( a == STATE_WORD_ADDRESS && b == STATE_WORD_VALUE ) return STATE_WORD_ADDRESS;
+            if ( a == STATE_WORD_ADDRESS && b == STATE_WORD_ADDRESS ) return STATE_WORD_VALUE;
+            break;
+    }
+
+    return ( a == STATE_WORD_VALUE && b == STATE_WORD_VALUE ) ? STATE_WORD_VALUE : STATE_WORD_UNKNOWN;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Joins a stack to the one known at a position of the code. The code only
+   leaves words on the stack inside an expression or a SWITCH, every path
+   reaching a position must have the same depth. Words of different kinds
+   are unknown */
+
+static int state_flow_reach( STATE_FLOW * f, int64_t pos, int64_t depth, uint8_t * kinds ) {
+    uint8_t * k;
+    int64_t n, changed = 0;
+
+    if ( pos < 0 || pos >= f->size || depth < 0 || depth > f->depth ) return -1;
+
+    k = f->kinds + pos * f->depth;
+
+    if ( f->depths[pos] == -1 ) {
+        f->depths[pos] = depth;
+        memcpy( k, kinds, depth );
+        changed = 1;
+    } else {
+        if ( f->depths[pos] != depth ) return -1;
+        for ( n = 0; n < depth; n++ ) {
+            if ( k[n] != kinds[n] && k[n] != STATE_WORD_UNKNOWN ) {
+                k[n] = STATE_WORD_UNKNOWN;
+                changed = 1;
+            }
+        }
+    }
+
+    if ( changed && !f->queued[pos] ) {
+        f->queued[pos] = 1;
+        f->pending[f->npending++] = pos;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Follows an instruction: the stack words it pops and pushes, by the
+   interpreter, and the positions it goes on to */
+
+#define STATE_NEED(n)   if ( d < ( n ) ) return -1
+
+static int state_flow_step( STATE_FLOW * f, int64_t pos, uint8_t * w ) {
+    int64_t * ptr = f->code + pos, d = f->depths[pos], next = pos + MN_PARAMS( *ptr ) + 1, k;
+    INSTANCE * i = f->instance;
+    PROCDEF * proc;
+
+    memcpy( w, f->kinds + pos * f->depth, d );
+
+    switch ( *ptr & MN_MASK ) {
+        case MN_NOP:
+        case MN_DEBUG:
+        case MN_SENTENCE:
+            break;
+
+        case MN_INDEX:
+        case MN_INC:
+        case MN_DEC:
+            STATE_NEED( 1 );
+            break;
+
+        case MN_EXITHNDLR:
+        case MN_ERRHNDLR:
+            /* Handlers run once the code is left, with no words */
+            if ( ptr[1] > 0 && state_flow_reach( f, ptr[1], 0, w ) ) return -1;
+            break;
+
+        case MN_DUP:
+            STATE_NEED( 1 );
+            w[d] = w[d - 1];
+            d++;
+            break;
+
+        case MN_PUSH:
+        case MN_TYPE:
+            w[d++] = STATE_WORD_VALUE;
+            break;
+
+        case MN_POP:
+        case MN_SWITCH:
+        case MN_CASE:
+        case MN_FRAME:
+            STATE_NEED( 1 );
+            d--;
+            break;
+
+        case MN_CASE_R:
+        case MN_LETNP:
+            STATE_NEED( 2 );
+            d -= 2;
+            break;
+
+        case MN_PRIVATE:
+        case MN_PUBLIC:
+        case MN_LOCAL:
+        case MN_GLOBAL:
+            w[d++] = STATE_WORD_ADDRESS;
+            break;
+
+        case MN_REMOTE:
+        case MN_REMOTE_PUBLIC:
+            STATE_NEED( 1 );
+            w[d - 1] = STATE_WORD_ADDRESS;
+            break;
+
+        case MN_GET_PRIV:
+            w[d++] = state_loaded_kind( *ptr, state_pointers( i->proc->type, STATE_SEGMENT_PRIVATE ), ptr[1] );
+            break;
+
+        case MN_GET_PUBLIC:
+            w[d++] = state_loaded_kind( *ptr, state_pointers( i->proc->type, STATE_SEGMENT_PUBLIC ), ptr[1] );
+            break;
+
+        case MN_GET_LOCAL:
+            w[d++] = state_loaded_kind( *ptr, &local_pointers, ptr[1] );
+            break;
+
+        case MN_GET_GLOBAL:
+            w[d++] = state_loaded_kind( *ptr, &global_pointers, ptr[1] );
+            break;
+
+        case MN_GET_REMOTE:
+            STATE_NEED( 1 );
+            w[d - 1] = state_loaded_kind( *ptr, &local_pointers, ptr[1] );
+            break;
+
+        case MN_GET_REMOTE_PUBLIC:
+            /* The process of the remote instance is not known */
+            STATE_NEED( 1 );
+            w[d - 1] = state_loaded_kind( *ptr, NULL, ptr[1] );
+            break;
+
+        case MN_PTR:
+            STATE_NEED( 1 );
+            w[d - 1] = state_loaded_kind( *ptr, NULL, 0 );
+            break;
+
+        case MN_POSTINC:
+        case MN_POSTDEC:
+            STATE_NEED( 1 );
+            w[d - 1] = state_loaded_kind( *ptr, NULL, 0 );
+            break;
+
+        case MN_ARRAY:
+        case MN_LET:
+        case MN_VARADD:
+        case MN_VARSUB:
+        case MN_VARMUL:
+        case MN_VARDIV:
+        case MN_VARMOD:
+        case MN_VARXOR:
+        case MN_VARAND:
+        case MN_VAROR:
+        case MN_VARROR:
+        case MN_VARROL:
+            /* The address below is kept */
+            STATE_NEED( 2 );
+            d--;
+            break;
+
+        case MN_ADD:
+        case MN_SUB:
+        case MN_MUL:
+        case MN_DIV:
+        case MN_MOD:
+        case MN_ROR:
+        case MN_ROL:
+        case MN_AND:
+        case MN_OR:
+        case MN_XOR:
+        case MN_BAND:
+        case MN_BOR:
+        case MN_BXOR:
+            STATE_NEED( 2 );
+            w[d - 2] = state_binary_kind( *ptr, w[d - 2], w[d - 1] );
+            d--;
+            break;
+
+        case MN_EQ:
+        case MN_NE:
+        case MN_GT:
+        case MN_LT:
+        case MN_GTE:
+        case MN_LTE:
+        case MN_STRI2CHR:
+        case MN_STR2A:
+        case MN_STRACAT:
+        case MN_STR2CHARNUL:
+            STATE_NEED( 2 );
+            w[d - 2] = STATE_WORD_VALUE;
+            d--;
+            break;
+
+        case MN_NOT:
+            STATE_NEED( 1 );
+            w[d - 1] = STATE_WORD_VALUE;
+            break;
+
+        case MN_NEG:
+        case MN_BNOT:
+            STATE_NEED( 1 );
+            if ( w[d - 1] != STATE_WORD_VALUE ) w[d - 1] = STATE_WORD_UNKNOWN;
+            break;
+
+        case MN_INT2STR:
+        case MN_DOUBLE2STR:
+        case MN_FLOAT2STR:
+        case MN_CHR2STR:
+        case MN_INT2FLOAT:
+        case MN_FLOAT2INT:
+        case MN_FLOAT2DOUBLE:
+        case MN_DOUBLE2FLOAT:
+        case MN_INT2DOUBLE:
+        case MN_DOUBLE2INT:
+        case MN_INT2DWORD:
+        case MN_INT2WORD:
+        case MN_INT2BYTE:
+        case MN_A2STR:
+        case MN_POINTER2STR:
+        case MN_STR2INT:
+        case MN_STR2DOUBLE:
+        case MN_STR2FLOAT:
+        case MN_STR2POINTER:
+        case MN_STR2CHR:
+            /* Conversions of the word at the operand depth */
+            k = ptr[1];
+            if ( k < 0 ) return -1;
+            STATE_NEED( k + 1 );
+            if ( ( *ptr & MN_MASK ) == MN_STR2CHR ) w[d - 1] = STATE_WORD_VALUE;
+            else w[d - k - 1] = ( ( *ptr & MN_MASK ) == MN_STR2POINTER ) ? STATE_WORD_UNKNOWN : STATE_WORD_VALUE;
+            break;
+
+        case MN_COPY_ARRAY:
+        case MN_COPY_ARRAY_REPEAT:
+            STATE_NEED( 3 );
+            d -= 3;
+            break;
+
+        case MN_COPY_STRUCT:
+            STATE_NEED( 5 );
+            d -= 5;
+            break;
+
+        case MN_CALL:
+        case MN_PROC:
+            if ( !( proc = procdef_get( ptr[1] ) ) ) return -1;
+            STATE_NEED( proc->params );
+            d -= proc->params;
+            if ( ( *ptr & MN_MASK ) == MN_CALL ) w[d++] = STATE_WORD_UNKNOWN;
+            break;
+
+        case MN_SYSCALL:
+        case MN_SYSPROC:
+            k = ( ( SYSPROC * ) ( intptr_t ) ptr[1] )->params;
+            STATE_NEED( k );
+            d -= k;
+            if ( ( *ptr & MN_MASK ) == MN_SYSCALL ) w[d++] = STATE_WORD_UNKNOWN;
+            break;
+
+        case MN_JUMP:
+            return state_flow_reach( f, ptr[1], d, w );
+
+        case MN_JTRUE:
+        case MN_JFALSE:
+            STATE_NEED( 1 );
+            d--;
+            if ( state_flow_reach( f, ptr[1], d, w ) ) return -1;
+            break;
+
+        case MN_JTTRUE:
+        case MN_JTFALSE:
+            STATE_NEED( 1 );
+            if ( state_flow_reach( f, ptr[1], d, w ) ) return -1;
+            break;
+
+        case MN_JNOCASE:
+        case MN_CLONE:
+            if ( state_flow_reach( f, ptr[1], d, w ) ) return -1;
+            break;
+
+        case MN_NCALL:
+            /* The label code returns to the next instruction with the
+               same words */
+            if ( state_flow_reach( f, ptr[1], d, w ) ) return -1;
+            break;
+
+        case MN_END:
+        case MN_RETURN:
+            return 0;
+
+        default:
+            return -1;
+    }
+
+    return state_flow_reach( f, next, d, w );
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : state_stack_kinds
+ *
+ *  Finds the kind of every used stack word of an instance, following the
+ *  code of its process from the start up to the saved position. The top
+ *  word of an instance waiting for a CALL is the return value, still not
+ *  written.
+ *
+ *  PARAMS :
+ *      i               Pointer to the instance
+ *      kinds           Array with a byte for every used stack word
+ *
+ *  RETURN VALUE :
+ *      0 if the kinds are known, -1 if the code can't be followed
+ */
+
+static int state_stack_kinds( INSTANCE * i, uint8_t * kinds ) {
+    STATE_FLOW f;
+    uint8_t * w = NULL;
+    int64_t pos = i->codeptr - i->code, used = i->stack_ptr - &i->stack[1], result = -1;
+
+    /* Inside a label called by CALL the words below belong to the caller */
+    if ( i->call_level > 0 || !i->code ) return -1;
+
+    memset( &f, 0, sizeof( f ) );
+    f.instance = i;
+    f.code = i->code;
+    f.size = i->proc->code_size / sizeof( int64_t );
+    f.depth = ( i->stack[0] & STACK_SIZE_MASK ) / sizeof( int64_t );
+
+    if ( pos < 0 || pos >= f.size ) return -1;
+
+    f.depths = malloc( f.size * sizeof( int64_t ) );
+    f.kinds = malloc( f.size * f.depth );
+    f.queued = calloc( f.size, 1 );
+    f.pending = malloc( f.size * sizeof( int64_t ) );
+    w = malloc( f.depth + 1 );
+    if ( !f.depths || !f.kinds || !f.queued || !f.pending || !w ) goto state_stack_kinds_exit;
+
+    memset( f.depths, 0xff, f.size * sizeof( int64_t ) );
+
+    if ( state_flow_reach( &f, 0, 0, w ) ) goto state_stack_kinds_exit;
+
+    while ( f.npending ) {
+        int64_t n = f.pending[--f.npending];
+        f.queued[n] = 0;
+        if ( state_flow_step( &f, n, w ) ) goto state_stack_kinds_exit;
+    }
+
+    if ( f.depths[pos] != used ) goto state_stack_kinds_exit;
+
+    memcpy( kinds, f.kinds + pos * f.depth, used );
+
+    if ( used && ( LOCQWORD( i, STATUS ) & STATUS_WAITING_MASK ) && ( i->stack[0] & STACK_RETURN_VALUE ) &&
+         pos >= 2 && f.depths[pos - 2] >= 0 && f.code[pos - 2] == MN_CALL )
+        kinds[used - 1] = STATE_WORD_RESULT;
+
+    result = 0;
+
+state_stack_kinds_exit:
+    free( f.depths );
+    free( f.kinds );
+    free( f.queued );
+    free( f.pending );
+    free( w );
+
+    return result;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Adds the relocations of the stack words of an instance that are
+   addresses. Returns -1 if an address points out of the global and
+   instance data, or if the kind of a word pointing into the data can't
+   be known */
+
+static int state_put_stack_relocs( STATE_BUFFER * b, STATE_RANGE * ranges, int64_t nranges, INSTANCE * i, int64_t instance, int64_t * nrelocs ) {
+    int64_t n, used = i->stack_ptr - &i->stack[1], known, result = -1;
+    uint8_t * kinds;
+    STATE_RANGE * range;
+    STATE_RELOC reloc;
+    uintptr_t v;
+
+    if ( !used ) return 0;
+
+    if ( !( kinds = malloc( used ) ) ) return -1;
+    known = !state_stack_kinds( i, kinds );
+
+    for ( n = 0; n < used; n++ ) {
+        v = ( uintptr_t ) i->stack[1 + n];
+        range = state_range_find( ranges, nranges, v );
+
+        if ( !known || kinds[n] == STATE_WORD_UNKNOWN ) {
+            if ( range ) goto state_put_stack_relocs_exit;
+            continue;
+        }
+
+        if ( kinds[n] != STATE_WORD_ADDRESS || !v ) continue;
+        if ( !range ) goto state_put_stack_relocs_exit;
+
+        reloc.instance = instance;
+        reloc.segment = STATE_SEGMENT_STACK;
+        reloc.slot = n;
+        reloc.target = range->instance;
+        reloc.target_segment = range->segment;
+        reloc.target_offset = v - range->base;
+        if ( state_put( b, &reloc, sizeof( reloc ) ) < 0 ) goto state_put_stack_relocs_exit;
+
+        ( *nrelocs )++;
+    }
+
+    result = 0;
+
+state_put_stack_relocs_exit:
+    free( kinds );
+
+    return result;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : instance_state_save
+ *
+ *  Saves the state of the whole process tree to a file. Must be called
+ *  between frames, when no instance is running code.
+ *
+ *  PARAMS :
+ *      fp              Pointer to the file object
+ *
+ *  RETURN VALUE :
+ *      Number of bytes saved, -1 if error or if the state holds a pointer
+ *      that can't be saved
+ */
+
+int64_t instance_state_save( file * fp ) {
+    STATE_HEADER header;
+    STATE_INSTANCE rec;
+    STATE_BUFFER buf = { NULL, 0, 0 }, relocs = { NULL, 0, 0 };
+    STATE_STRINGS strings = { NULL, 0, NULL, 0 };
+    STATE_RANGE * ranges = NULL;
+    INSTANCE ** list = NULL, * i;
+    int64_t * number = NULL;
+    int64_t n, k, pos, len, chunk, ninstances = 0, nranges = 0, nrelocs = 0, slots, result = -1;
+
+    if ( state_init() ) return -1;
+
+    for ( i = first_instance; i; i = i->next ) ninstances++;
+
+    list = malloc( ( ninstances + 1 ) * sizeof( INSTANCE * ) );
+    ranges = malloc( ( ninstances * 3 + 1 ) * sizeof( STATE_RANGE ) );
+    number = malloc( STATE_MAX_INSTANCES * sizeof( int64_t ) );
+    if ( !list || !ranges || !number ) goto state_save_exit;
+
+    /* Number the instances and collect their data segments */
+
+    slots = global_string_count;
+
+    for ( n = 0, i = first_instance; i; i = i->next, n++ ) {
+        list[n] = i;
+        number[LOCQWORD( i, PROCESS_ID ) - FIRST_INSTANCE_ID] = n;
+        slots += local_strings + i->proc->string_count + i->proc->pubstring_count + 1;
+
+        if ( local_size ) ranges[nranges++] = ( STATE_RANGE ) { ( uintptr_t ) i->locdata, local_size, n, STATE_SEGMENT_LOCAL };
+        if ( i->private_size ) ranges[nranges++] = ( STATE_RANGE ) { ( uintptr_t ) i->pridata, i->private_size, n, STATE_SEGMENT_PRIVATE };
+        if ( i->public_size ) ranges[nranges++] = ( STATE_RANGE ) { ( uintptr_t ) i->pubdata, i->public_size, n, STATE_SEGMENT_PUBLIC };
+    }
+    if ( dcb.data.SGlobal ) ranges[nranges++] = ( STATE_RANGE ) { ( uintptr_t ) globaldata, dcb.data.SGlobal, -1, STATE_SEGMENT_GLOBAL };
+
+    qsort( ranges, nranges, sizeof( STATE_RANGE ), state_range_compare );
+
+    /* Pointers, by their type, and addresses in the stack */
+
+    if ( state_put_relocs( &relocs, ranges, nranges, globaldata, 0, -1, STATE_SEGMENT_GLOBAL, &nrelocs ) ) goto state_save_exit;
+
+    for ( n = 0; n < ninstances; n++ ) {
+        i = list[n];
+
+        if ( state_put_relocs( &relocs, ranges, nranges, ( uint8_t * ) i->locdata, i->proc->type, n, STATE_SEGMENT_LOCAL, &nrelocs ) ||
+             state_put_relocs( &relocs, ranges, nranges, ( uint8_t * ) i->pridata, i->proc->type, n, STATE_SEGMENT_PRIVATE, &nrelocs ) ||
+             state_put_relocs( &relocs, ranges, nranges, ( uint8_t * ) i->pubdata, i->proc->type, n, STATE_SEGMENT_PUBLIC, &nrelocs ) ||
+             state_put_stack_relocs( &relocs, ranges, nranges, i, n, &nrelocs ) ) goto state_save_exit;
+    }
+
+    if ( state_strings_init( &strings, slots ) ) goto state_save_exit;
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, STATE_MAGIC, sizeof( header.magic ) );
+    header.byteorder = STATE_BYTEORDER;
+    header.version = STATE_VERSION;
+    header.program = state_program();
+    header.global_size = dcb.data.SGlobal;
+    header.local_size = local_size;
+    header.ninstances = ninstances;
+    header.nrelocs = nrelocs;
+
+    if ( state_put( &buf, &header, sizeof( header ) ) < 0 ) goto state_save_exit;
+
+    /* Global data */
+
+    if ( ( pos = state_put( &buf, globaldata, dcb.data.SGlobal ) ) < 0 ) goto state_save_exit;
+    state_patch_strings( &strings, buf.data + pos, global_strings, global_string_count );
+
+    /* Instances */
+
+    for ( n = 0; n < ninstances; n++ ) {
+        i = list[n];
+
+        memset( &rec, 0, sizeof( rec ) );
+        rec.proc = i->proc->type;
+        rec.codeptr = i->codeptr - i->code;
+        rec.called_by = instance_exists( i->called_by ) ? number[LOCQWORD( i->called_by, PROCESS_ID ) - FIRST_INSTANCE_ID] : -1;
+        rec.exitcode = i->exitcode;
+        rec.errorcode = i->errorcode;
+        rec.call_level = i->call_level;
+        rec.first_run = i->first_run;
+        rec.last_priority = i->last_priority;
+        rec.switchval = i->switchval;
+        rec.switchval_string = i->switchval_string ? state_string_number( &strings, i->switchval_string ) + 1 : 0;
+        rec.cased = i->cased;
+        rec.breakpoint = i->breakpoint;
+        rec.stack_size = i->stack[0];
+        rec.stack_used = i->stack_ptr - &i->stack[1];
+
+        if ( state_put( &buf, &rec, sizeof( rec ) ) < 0 ) goto state_save_exit;
+
+        if ( ( pos = state_put( &buf, i->locdata, local_size ) ) < 0 ) goto state_save_exit;
+        state_patch_strings( &strings, buf.data + pos, localstr, local_strings );
+
+        if ( ( pos = state_put( &buf, i->pridata, i->private_size ) ) < 0 ) goto state_save_exit;
+        state_patch_strings( &strings, buf.data + pos, i->proc->strings, i->proc->string_count );
+
+        if ( ( pos = state_put( &buf, i->pubdata, i->public_size ) ) < 0 ) goto state_save_exit;
+        state_patch_strings( &strings, buf.data + pos, i->proc->pubstrings, i->proc->pubstring_count );
+
+        if ( state_put( &buf, &i->stack[1], rec.stack_used * sizeof( int64_t ) ) < 0 ) goto state_save_exit;
+    }
+
+    /* Relocations */
+
+    if ( state_put( &buf, relocs.data, relocs.size ) < 0 ) goto state_save_exit;
+
+    /* Order of the priority and type lists */
+
+    for ( n = 0; hashed_by_priority && n < 65536; n++ )
+        for ( i = hashed_by_priority[n]; i; i = i->next_by_priority )
+            if ( state_put( &buf, &number[LOCQWORD( i, PROCESS_ID ) - FIRST_INSTANCE_ID], sizeof( int64_t ) ) < 0 ) goto state_save_exit;
+
+    for ( n = 0; n < procdef_count; n++ )
+        for ( k = 0; k < procs[n].instance_used; k++ )
+            if ( procs[n].instances[k] && state_put( &buf, &number[LOCQWORD( procs[n].instances[k], PROCESS_ID ) - FIRST_INSTANCE_ID], sizeof( int64_t ) ) < 0 ) goto state_save_exit;
+
+    /* Instances with a process_type without PROCDEF, in no type list */
+
+    for ( i = first_instance; i; i = i->next )
+        if ( i->type_index < 0 && state_put( &buf, &number[LOCQWORD( i, PROCESS_ID ) - FIRST_INSTANCE_ID], sizeof( int64_t ) ) < 0 ) goto state_save_exit;
+
+    /* Strings */
+
+    header.strings_offset = buf.size;
+
+    for ( n = 0; n < strings.count; n++ ) {
+        const char * str = ( const char * ) string_get( strings.unique[n] );
+
+        len = strlen( str );
+        if ( state_put( &buf, &len, sizeof( len ) ) < 0 ) goto state_save_exit;
+        if ( state_put( &buf, str, len + 1 ) < 0 ) goto state_save_exit;
+    }
+
+    header.nstrings = strings.count;
+    header.size = buf.size;
+    memcpy( buf.data, &header, sizeof( header ) );
+
+    for ( pos = 0; pos < buf.size; pos += chunk ) {
+        chunk = buf.size - pos > STATE_IO_CHUNK ? STATE_IO_CHUNK : buf.size - pos;
+        if ( file_write( fp, buf.data + pos, chunk ) != chunk ) goto state_save_exit;
+    }
+
+    result = buf.size;
+
+state_save_exit:
+    free( buf.data );
+    free( relocs.data );
+    free( strings.table );
+    free( strings.unique );
+    free( ranges );
+    free( number );
+    free( list );
+
+    return result;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Restore                                                                */
+/* ---------------------------------------------------------------------- */
+
+static int state_check_strings( uint8_t * data, int64_t * offsets, int64_t count, int64_t nstrings ) {
+    int64_t n;
+
+    for ( n = 0; n < count; n++ ) {
+        uint64_t v = *( uint64_t * ) ( data + offsets[n] );
+        if ( v >= ( uint64_t ) nstrings ) return -1;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int64_t state_record_proc( STATE_IMAGE * image, int64_t instance ) {
+    return instance == -1 ? 0 : ( ( STATE_INSTANCE * ) ( image->data + image->records[instance] ) )->proc;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int64_t state_segment_size( STATE_HEADER * header, STATE_IMAGE * image, int64_t instance, int64_t segment ) {
+    PROCDEF * proc;
+
+    if ( instance == -1 ) return segment == STATE_SEGMENT_GLOBAL ? header->global_size : -1;
+
+    proc = &procs[state_record_proc( image, instance )];
+
+    switch ( segment ) {
+        case STATE_SEGMENT_LOCAL:
+            return header->local_size;
+
+        case STATE_SEGMENT_PRIVATE:
+            return proc->private_size;
+
+        case STATE_SEGMENT_PUBLIC:
+            return proc->public_size;
+    }
+
+    return -1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : state_check
+ *
+ *  Validates a state image and indexes its instance records and strings,
+ *  so the restore can't fail after the current tree is destroyed.
+ *
+ */
+
+static int state_check( STATE_IMAGE * image ) {
+    STATE_HEADER * header = ( STATE_HEADER * ) image->data;
+    STATE_INSTANCE * rec;
+    STATE_RELOC * reloc;
+    PROCDEF * proc;
+    uint8_t * used;
+    int64_t n, k, pos, len, end = header->strings_offset;
+
+    if ( header->ninstances < 0 || header->ninstances > STATE_MAX_INSTANCES ) return -1;
+    if ( header->nrelocs < 0 || header->nrelocs > header->size / ( int64_t ) sizeof( STATE_RELOC ) ) return -1;
+    if ( header->nstrings < 0 || header->nstrings > header->size / 16 ) return -1;
+    if ( end < ( int64_t ) sizeof( STATE_HEADER ) || end > header->size ) return -1;
+
+    image->records = malloc( ( header->ninstances + 1 ) * sizeof( int64_t ) );
+    image->strings = malloc( ( header->nstrings + 1 ) * sizeof( char * ) );
+    if ( !image->records || !image->strings ) return -1;
+
+    /* Strings */
+
+    for ( pos = end, n = 0; n < header->nstrings; n++ ) {
+        if ( pos + ( int64_t ) sizeof( int64_t ) > header->size ) return -1;
+        len = *( int64_t * ) ( image->data + pos );
+        pos += sizeof( int64_t );
+        if ( len < 0 || len >= header->size - pos || image->data[pos + len] ) return -1;
+        image->strings[n] = ( const char * ) image->data + pos;
+        pos += STATE_ALIGN( len + 1 );
+    }
+
+    /* Global data */
+
+    pos = sizeof( STATE_HEADER ) + STATE_ALIGN( header->global_size );
+    if ( pos > end ) return -1;
+    if ( state_check_strings( image->data + sizeof( STATE_HEADER ), global_strings, global_string_count, header->nstrings ) ) return -1;
+
+    /* Instance records */
+
+    for ( n = 0; n < header->ninstances; n++ ) {
+        if ( pos + ( int64_t ) sizeof( STATE_INSTANCE ) > end ) return -1;
+
+        image->records[n] = pos;
+        rec = ( STATE_INSTANCE * ) ( image->data + pos );
+
+        if ( rec->proc < 0 || rec->proc >= procdef_count ) return -1;
+        proc = &procs[rec->proc];
+
+        if ( rec->codeptr < 0 || rec->codeptr >= proc->code_size / ( int64_t ) sizeof( int64_t ) ) return -1;
+        if ( rec->called_by < -1 || rec->called_by >= header->ninstances ) return -1;
+        if ( rec->switchval_string < 0 || rec->switchval_string > header->nstrings ) return -1;
+        if ( rec->stack_used < 0 || ( int64_t ) ( ( rec->stack_used + 1 ) * sizeof( int64_t ) ) > ( rec->stack_size & STACK_SIZE_MASK ) ) return -1;
+
+        pos += sizeof( STATE_INSTANCE );
+        if ( pos + STATE_ALIGN( header->local_size ) + STATE_ALIGN( proc->private_size ) + STATE_ALIGN( proc->public_size ) +
+             rec->stack_used * ( int64_t ) sizeof( int64_t ) > end ) return -1;
+
+        if ( state_check_strings( image->data + pos, localstr, local_strings, header->nstrings ) ) return -1;
+        pos += STATE_ALIGN( header->local_size );
+
+        if ( state_check_strings( image->data + pos, proc->strings, proc->string_count, header->nstrings ) ) return -1;
+        pos += STATE_ALIGN( proc->private_size );
+
+        if ( state_check_strings( image->data + pos, proc->pubstrings, proc->pubstring_count, header->nstrings ) ) return -1;
+        pos += STATE_ALIGN( proc->public_size );
+
+        pos += rec->stack_used * sizeof( int64_t );
+    }
+
+    /* Process ids, in range and unique */
+
+    if ( !( used = calloc( STATE_MAX_INSTANCES, 1 ) ) ) return -1;
+
+    for ( n = 0; n < header->ninstances; n++ ) {
+        k = *( int64_t * ) ( image->data + image->records[n] + sizeof( STATE_INSTANCE ) + PROCESS_ID );
+        if ( k < FIRST_INSTANCE_ID || k > LAST_INSTANCE_ID || used[k - FIRST_INSTANCE_ID] ) {
+            free( used );
+            return -1;
+        }
+        used[k - FIRST_INSTANCE_ID] = 1;
+    }
+
+    free( used );
+
+    /* Relocations, once all the records are known */
+
+    image->relocs = pos;
+
+    if ( pos + header->nrelocs * ( int64_t ) sizeof( STATE_RELOC ) > end ) return -1;
+
+    for ( reloc = ( STATE_RELOC * ) ( image->data + pos ), n = 0; n < header->nrelocs; n++, reloc++ ) {
+        if ( reloc->instance < -1 || reloc->instance >= header->ninstances ) return -1;
+        if ( reloc->target < -1 || reloc->target >= header->ninstances ) return -1;
+        if ( reloc->segment == STATE_SEGMENT_STACK ) {
+            if ( reloc->instance == -1 || reloc->slot < 0 || reloc->slot >= ( ( STATE_INSTANCE * ) ( image->data + image->records[reloc->instance] ) )->stack_used ) return -1;
+        } else {
+            if ( state_segment_size( header, image, reloc->instance, reloc->segment ) < 0 ) return -1;
+            if ( reloc->slot < 0 || reloc->slot >= state_pointers( state_record_proc( image, reloc->instance ), reloc->segment )->count ) return -1;
+        }
+        if ( reloc->target_offset < 0 || reloc->target_offset >= state_segment_size( header, image, reloc->target, reloc->target_segment ) ) return -1;
+    }
+
+    pos += header->nrelocs * sizeof( STATE_RELOC );
+
+    /* Priority and type lists */
+
+    image->lists = pos;
+
+    if ( pos + header->ninstances * 2 * ( int64_t ) sizeof( int64_t ) > end ) return -1;
+
+    for ( n = 0; n < header->ninstances * 2; n++ ) {
+        k = ( ( int64_t * ) ( image->data + pos ) )[n];
+        if ( k < 0 || k >= header->ninstances ) return -1;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : instance_state_read
+ *
+ *  Reads and validates a process tree state from a file. The current
+ *  state is not modified until instance_state_restore is called.
+ *
+ *  PARAMS :
+ *      fp              Pointer to the file object
+ *
+ *  RETURN VALUE :
+ *      Pointer to the state, NULL if error or if the state was saved
+ *      by another program
+ */
+
+void * instance_state_read( file * fp ) {
+    STATE_HEADER header;
+    STATE_IMAGE * image;
+    int64_t pos, chunk;
+
+    if ( state_init() ) return NULL;
+
+    if ( file_read( fp, &header, sizeof( header ) ) != sizeof( header ) ) return NULL;
+
+    if ( memcmp( header.magic, STATE_MAGIC, sizeof( header.magic ) ) ||
+         header.byteorder != STATE_BYTEORDER ||
+         header.version != STATE_VERSION ||
+         header.program != state_program() ||
+         header.global_size != ( int64_t ) dcb.data.SGlobal ||
+         header.local_size != local_size ||
+         header.size < ( int64_t ) sizeof( header ) ) return NULL;
+
+    if ( !( image = calloc( 1, sizeof( STATE_IMAGE ) ) ) ) return NULL;
+
+    if ( !( image->data = malloc( header.size ) ) ) {
+        free( image );
+        return NULL;
+    }
+
+    memcpy( image->data, &header, sizeof( header ) );
+
+    for ( pos = sizeof( header ); pos < header.size; pos += chunk ) {
+        chunk = header.size - pos > STATE_IO_CHUNK ? STATE_IO_CHUNK : header.size - pos;
+        if ( file_read( fp, image->data + pos, chunk ) != chunk ) {
+            instance_state_free( image );
+            return NULL;
+        }
+    }
+
+    if ( state_check( image ) ) {
+        instance_state_free( image );
+        return NULL;
+    }
+
+    return image;
+}
+
+/* ---------------------------------------------------------------------- */
+
+void instance_state_free( void * state ) {
+    STATE_IMAGE * image = ( STATE_IMAGE * ) state;
+
+    if ( !image ) return;
+
+    free( image->data );
+    free( image->records );
+    free( image->strings );
+    free( image );
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void state_restore_strings( uint8_t * data, int64_t * offsets, int64_t count, int64_t * codes ) {
+    int64_t n;
+
+    for ( n = 0; n < count; n++ ) {
+        int64_t * slot = ( int64_t * ) ( data + offsets[n] );
+        *slot = codes[*slot];
+        string_use( *slot );
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+static uint8_t * state_segment_base( INSTANCE ** list, int64_t instance, int64_t segment ) {
+    if ( instance == -1 ) return ( uint8_t * ) globaldata;
+
+    switch ( segment ) {
+        case STATE_SEGMENT_LOCAL:
+            return ( uint8_t * ) list[instance]->locdata;
+
+        case STATE_SEGMENT_PRIVATE:
+            return ( uint8_t * ) list[instance]->pridata;
+
+        default:
+            return ( uint8_t * ) list[instance]->pubdata;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : instance_state_restore
+ *
+ *  Replaces the whole process tree and the global data with a state
+ *  read by instance_state_read. Must be called between frames, when no
+ *  instance is running code. The state is freed.
+ *
+ *  PARAMS :
+ *      state           Pointer to the state
+ *
+ *  RETURN VALUE :
+ *      Number of instances restored
+ */
+
+int64_t instance_state_restore( void * state ) {
+    STATE_IMAGE * image = ( STATE_IMAGE * ) state;
+    STATE_HEADER * header = ( STATE_HEADER * ) image->data;
+    STATE_INSTANCE * rec;
+    STATE_RELOC * reloc;
+    INSTANCE ** list, * r;
+    int64_t * codes, * order, n, k, pos, maxid = FIRST_INSTANCE_ID - 1;
+    uint8_t * base;
+
+    list = malloc( ( header->ninstances + 1 ) * sizeof( INSTANCE * ) );
+    codes = malloc( ( header->nstrings + 1 ) * sizeof( int64_t ) );
+    if ( !list || !codes ) {
+        fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+        exit(2);
+    }
+
+    /* Strings are held while the old tree is destroyed */
+
+    for ( n = 0; n < header->nstrings; n++ ) {
+        codes[n] = string_new( ( const unsigned char * ) image->strings[n] );
+        string_use( codes[n] );
+    }
+
+    instance_destroy_all( NULL );
+
+    /* Global data */
+
+    for ( n = 0; n < global_string_count; n++ ) string_discard( GLOQWORD( global_strings[n] ) );
+    memcpy( globaldata, image->data + sizeof( STATE_HEADER ), header->global_size );
+    state_restore_strings( globaldata, global_strings, global_string_count, codes );
+
+    /* Instances */
+
+    for ( n = 0; n < header->ninstances; n++ ) {
+        rec = ( STATE_INSTANCE * ) ( image->data + image->records[n] );
+        pos = image->records[n] + sizeof( STATE_INSTANCE );
+
+        r = ( INSTANCE * ) calloc( 1, sizeof( INSTANCE ) );
+        if ( !r ) {
+            fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+            exit(2);
+        }
+
+        r->proc             = &procs[rec->proc];
+        r->private_size     = r->proc->private_size;
+        r->public_size      = r->proc->public_size;
+
+        r->pridata          = ( int64_t * ) malloc( r->private_size + 8 );
+        r->pubdata          = ( int64_t * ) malloc( r->public_size + 8 );
+        r->locdata          = ( int64_t * ) malloc( local_size + 8 );
+        r->stack            = ( int64_t * ) malloc( rec->stack_size & STACK_SIZE_MASK );
+        if ( !r->pridata || !r->pubdata || !r->locdata || !r->stack ) {
+            fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+            exit(2);
+        }
+
+        r->code             = r->proc->code;
+        r->codeptr          = r->proc->code + rec->codeptr;
+        r->exitcode         = rec->exitcode;
+        r->errorcode        = rec->errorcode;
+        r->call_level       = rec->call_level;
+        r->first_run        = rec->first_run;
+        r->last_priority    = rec->last_priority;
+
+        r->switchval        = rec->switchval;
+        r->switchval_string = 0;
+        r->cased            = rec->cased;
+
+        r->breakpoint       = rec->breakpoint;
+
+        if ( rec->switchval_string ) {
+            r->switchval_string = codes[rec->switchval_string - 1];
+            string_use( r->switchval_string );
+        }
+
+        memcpy( r->locdata, image->data + pos, local_size );
+        state_restore_strings( r->locdata, localstr, local_strings, codes );
+        pos += STATE_ALIGN( local_size );
+
+        memcpy( r->pridata, image->data + pos, r->private_size );
+        state_restore_strings( r->pridata, r->proc->strings, r->proc->string_count, codes );
+        pos += STATE_ALIGN( r->private_size );
+
+        memcpy( r->pubdata, image->data + pos, r->public_size );
+        state_restore_strings( r->pubdata, r->proc->pubstrings, r->proc->pubstring_count, codes );
+        pos += STATE_ALIGN( r->public_size );
+
+        r->stack[0] = rec->stack_size;
+        memcpy( &r->stack[1], image->data + pos, rec->stack_used * sizeof( int64_t ) );
+        r->stack_ptr = &r->stack[1 + rec->stack_used];
+
+        list[n] = r;
+    }
+
+    /* Caller links and pointers, once all the instances exist */
+
+    for ( n = 0; n < header->ninstances; n++ ) {
+        rec = ( STATE_INSTANCE * ) ( image->data + image->records[n] );
+        list[n]->called_by = rec->called_by == -1 ? NULL : list[rec->called_by];
+    }
+
+    reloc = ( STATE_RELOC * ) ( image->data + image->relocs );
+
+    for ( n = 0; n < header->nrelocs; n++, reloc++ ) {
+        if ( reloc->segment == STATE_SEGMENT_STACK ) {
+            list[reloc->instance]->stack[1 + reloc->slot] = ( int64_t ) ( intptr_t ) ( state_segment_base( list, reloc->target, reloc->target_segment ) + reloc->target_offset );
+            continue;
+        }
+        base = state_segment_base( list, reloc->instance, reloc->segment );
+        k = state_pointers( reloc->instance == -1 ? 0 : list[reloc->instance]->proc->type, reloc->segment )->offsets[reloc->slot];
+        *( int64_t * ) ( base + k ) = ( int64_t ) ( intptr_t ) ( state_segment_base( list, reloc->target, reloc->target_segment ) + reloc->target_offset );
+    }
+
+    /* Lists. Every list grows from its head, so they are built backwards,
+       except the lists by type that grow at the end */
+
+    for ( n = header->ninstances - 1; n >= 0; n-- ) {
+        r = list[n];
+
+        r->prev = NULL;
+        r->next = first_instance;
+        if ( first_instance ) first_instance->prev = r;
+        first_instance = r;
+
+        instance_add_to_list_by_id( r, LOCQWORD( r, PROCESS_ID ) );
+        instance_add_to_list_by_instance( r );
+
+        if ( ( int64_t ) LOCQWORD( r, PROCESS_ID ) > maxid ) maxid = LOCQWORD( r, PROCESS_ID );
+    }
+
+    /* New instances get ids after the restored ones */
+
+    instance_setmaxid( maxid + 1 );
+
+    order = ( int64_t * ) ( image->data + image->lists );
+
+    for ( n = header->ninstances - 1; n >= 0; n-- ) instance_add_to_list_by_priority( list[order[n]], list[order[n]]->last_priority );
+
+    order += header->ninstances;
+
+    for ( n = 0; n < header->ninstances; n++ ) instance_add_to_list_by_type( list[order[n]], LOCQWORD( list[order[n]], PROCESS_TYPE ) );
+
+    /* Modules see the instances as new ones */
+
+    if ( instance_create_hook_count )
+        for ( n = 0; n < header->ninstances; n++ )
+            for ( k = 0; k < instance_create_hook_count; k++ )
+                instance_create_hook_list[k]( list[n] );
+
+    for ( n = 0; n < header->nstrings; n++ ) string_discard( codes[n] );
+
+    n = header->ninstances;
+
+    free( codes );
+    free( list );
+    instance_state_free( image );
+
+    return n;
+}
+
+/* ---------------------------------------------------------------------- */
@@ -30,9 +30,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include <inttypes.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #include "bgdrtm.h"
 #include "dcb.h"
 
@@ -61,6 +66,35 @@ int64_t debugger_step = 0;                  // execute 1 sentence or 1 procedure
 int64_t trace_sentence = -1;
 INSTANCE * trace_instance = NULL;
 
+FRAME_PROFILE frame_profile = { 0 };
+
+/* ---------------------------------------------------------------------- */
+
+/* Microseconds from an arbitrary point, for the frame profile */
+
+static int64_t profile_ticks() {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter( &count );
+    QueryPerformanceFrequency( &freq );
+    return ( int64_t ) ( count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart );
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( int64_t ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+#define STACK_END(r)    ( ( int64_t * ) ( ( uint8_t * ) ( r )->stack + ( ( r )->stack[0] & STACK_SIZE_MASK ) ) )
+
+/* The stack of an instance starts with the size computed for its process,
+   enough for its code. It only grows when that code runs again on top of
+   the values already pushed: label calls and the ONEXIT code */
+
+#define STACK_GROW_FRAME(r) instance_stack_grow( ( r ), 1 + ( ( r )->proc->stack_size ? ( r )->proc->stack_size / ( int64_t ) sizeof( int64_t ) : STACK_RESERVE ) )
+
 /* ---------------------------------------------------------------------- */
 
 static int stack_dump( INSTANCE * r ) {
@@ -83,10 +117,12 @@ static int stack_dump( INSTANCE * r ) {
 
 int64_t instance_go_all() {
     INSTANCE * i = NULL;
-    int64_t n, status, i_count;
+    int64_t n, status, i_count, frame_start = 0;
 
     must_exit = 0;
 
+    if ( frame_profile.enabled ) frame_start = profile_ticks();
+
     while ( first_instance ) {
         frame_completed = 0;
 
@@ -101,9 +137,9 @@ int64_t instance_go_all() {
                 if ( status == STATUS_RUNNING ) {
                     /* Run instance */
                     /* Hook */
-                    if ( process_exec_hook_count )
-                        for ( n = 0; n < process_exec_hook_count; n++ )
-                            process_exec_hook_list[n]( i );
+                    if ( i->proc->process_exec_hook_count )
+                        for ( n = 0; n < i->proc->process_exec_hook_count; n++ )
+                            i->proc->process_exec_hooks[n]( i );
                     /* Hook */
                 } else if ( status & ~( STATUS_KILLED | STATUS_DEAD ) ) { /* STATUS_SLEEPING OR STATUS_FROZEN OR STATUS_WAITING_MASK OR STATUS_PAUSED_MASK */
                     i = instance_next_by_priority();
@@ -145,6 +181,27 @@ int64_t instance_go_all() {
 
             if ( !first_instance ) break;
 
+            if ( frame_profile.enabled ) {
+                int64_t ticks = profile_ticks(), hook_end;
+
+                frame_profile.exec_us += ticks - frame_start;
+
+                /* Hook */
+                for ( n = 0; n < handler_hook_count; n++ ) {
+                    handler_hook_list[n].hook();
+                    hook_end = profile_ticks();
+                    if ( frame_profile.hook_us ) frame_profile.hook_us[n] += hook_end - ticks;
+                    ticks = hook_end;
+                }
+                /* Hook */
+
+                frame_start = ticks;
+
+                if ( ++frame_profile.frames == frame_profile.frame_limit ) break;
+
+                continue;
+            }
+
             /* Hook */
             if ( handler_hook_count )
                 for ( n = 0; n < handler_hook_count; n++ )
@@ -195,9 +252,9 @@ int64_t instance_go( INSTANCE * r ) {
 
     /* Start process or return from frame */
     /* Hook */
-    if ( instance_pre_execute_hook_count )
-        for ( n = 0; n < instance_pre_execute_hook_count; n++ )
-            instance_pre_execute_hook_list[n]( r );
+    if ( r->proc->pre_execute_hook_count )
+        for ( n = 0; n < r->proc->pre_execute_hook_count; n++ )
+            r->proc->pre_execute_hooks[n]( r );
     /* Hook */
 
     // breakpoint on entry
@@ -235,7 +292,10 @@ main_loop_instance_go:
                 if ( debug > 1 ) printf( "%*.*s[%4" PRIu64 "] ", c, c, "", ( uint64_t ) ( ptr - r->code ) );
             }
             else if ( debug > 1 ) printf( "[%4" PRIu64 "] ", ( uint64_t ) ( ptr - r->code ) );
-            mnemonic_dump( *ptr, ptr[1] );
+            if ( ( *ptr & MN_MASK ) == MN_SYSCALL || ( *ptr & MN_MASK ) == MN_SYSPROC )
+                mnemonic_dump( *ptr, ( ( SYSPROC * ) ( intptr_t ) ptr[1] )->code );
+            else
+                mnemonic_dump( *ptr, ptr[1] );
             fflush(stdout);
         }
 
@@ -304,6 +364,9 @@ main_loop_instance_go:
                     exit( 0 );
                 }
 
+                /* Room for the return value and the slot above it */
+                if ( r->stack_ptr + 2 > STACK_END( r ) ) instance_stack_grow( r, 2 );
+
                 /* Process uses FRAME or locals, must create an instance */
                 i = instance_new( proc, r );
                 /* Can't create instante, return -1 */
@@ -378,13 +441,10 @@ main_loop_instance_go:
                 break;
             }
 
-            case MN_SYSCALL:
-                p = sysproc_get( ptr[1] );
-                if ( !p ) {
-                    fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Unknown system function\n", r->proc->name, LOCQWORD( r, PROCESS_ID ) );
-                    exit( 0 );
-                }
+            /* The operand is bound to the SYSPROC by sysprocs_bind */
 
+            case MN_SYSCALL:
+                p = ( SYSPROC * ) ( intptr_t ) ptr[1];
                 r->stack_ptr -= p->params;
                 *r->stack_ptr = ( *p->func )( r, r->stack_ptr );
                 r->stack_ptr++;
@@ -392,11 +452,7 @@ main_loop_instance_go:
                 break;
 
             case MN_SYSPROC:
-                p = sysproc_get( ptr[1] );
-                if ( !p ) {
-                    fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Unknown system process\n", r->proc->name, LOCQWORD( r, PROCESS_ID ) );
-                    exit( 0 );
-                }
+                p = ( SYSPROC * ) ( intptr_t ) ptr[1];
                 r->stack_ptr -= p->params;
                 ( *p->func )( r, r->stack_ptr );
                 ptr += 2;
@@ -2900,6 +2956,8 @@ main_loop_instance_go:
                 break;
 
             case MN_NCALL:
+                /* The label code may need as much stack as the process */
+                STACK_GROW_FRAME( r );
                 *r->stack_ptr++ = ptr - r->code + 2 ; /* Push next address */
                 ptr = r->code + ptr[1] ; /* Call function */
                 r->call_level++;
@@ -3194,7 +3252,6 @@ main_loop_instance_go:
             fprintf( stderr, "ERROR: Runtime error in %s(%" PRId64 ") - Critical Stack Problem StackBase=%p StackPTR=%p\n", r->proc->name, LOCQWORD( r, PROCESS_ID ), (void *)r->stack, (void *)r->stack_ptr );
             exit( 0 );
         }
-
 #ifdef EXIT_ON_EMPTY_STACK
         if ( r->stack_ptr == r->stack ) {
             r->codeptr = ptr;
@@ -3224,6 +3281,7 @@ break_all:
             LOCQWORD( r, STATUS ) = ( STATUS_DEAD | ( LOCQWORD( r, STATUS ) & STATUS_PAUSED_MASK ) );
             r->codeptr = r->code + r->exitcode;
             ptr = r->codeptr;
+            STACK_GROW_FRAME( r );
             goto main_loop_instance_go;
 //            instance_go( r );
 //            if ( !instance_exists( r ) ) r = NULL;
@@ -3234,9 +3292,9 @@ break_all:
     }
 
     /* Hook */
-    if ( r && instance_pos_execute_hook_count ) {
-        for ( n = 0; n < instance_pos_execute_hook_count; n++ )
-            instance_pos_execute_hook_list[n]( r );
+    if ( r && r->proc->pos_execute_hook_count ) {
+        for ( n = 0; n < r->proc->pos_execute_hook_count; n++ )
+            r->proc->pos_execute_hooks[n]( r );
     }
     /* Hook */
     if ( r && LOCQWORD( r, STATUS ) != STATUS_KILLED && r->first_run ) r->first_run = 0;
@@ -101,12 +101,28 @@ int64_t module_finalize_count = 0;
 
 /* ---------------------------------------------------------------------- */
 
+/* Instance hooks registered with a filter. Processes rejected by the
+   filter don't get the hook in their hook vectors */
+
+typedef struct {
+    INSTANCE_HOOK hook;
+    PROCDEF_FILTER filter;
+} HOOK_FILTER;
+
+static HOOK_FILTER * hook_filter_list = NULL;
+static int64_t hook_filter_allocated = 0;
+static int64_t hook_filter_count = 0;
+
+/* ---------------------------------------------------------------------- */
+
 static SYSPROC ** sysproc_tab = NULL;
+static int64_t sysproc_maxcode = -1;
 
 /* ---------------------------------------------------------------------- */
 
 int nmodules = 0;
 void * modules_hnd[512] = { 0 };
+char * modules_name[512] = { 0 };   /* Import name of every handle */
 
 /* ---------------------------------------------------------------------- */
 
@@ -417,7 +433,72 @@ int64_t sysproc_add( char * name, char * paramtypes, int64_t type, void * func )
 
 /* ---------------------------------------------------------------------- */
 
+/*
+ *  FUNCTION : instance_hook_filter
+ *
+ *  Restricts an instance hook (process_exec, pre_execute or pos_execute)
+ *  to the processes accepted by a filter. Must be called from the
+ *  module_initialize of the module, the filter runs once per process.
+ *
+ *  PARAMS :
+ *      hook            Hook exported by the module
+ *      filter          Returns 1 if the hook applies to the process
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void instance_hook_filter( INSTANCE_HOOK hook, PROCDEF_FILTER filter ) {
+    HOOK_FILTER f = { hook, filter };
+    hook_add( f, hook_filter_list, hook_filter_allocated, hook_filter_count );
+}
+
+/* ---------------------------------------------------------------------- */
+
+static INSTANCE_HOOK * sysproc_proc_hooks( PROCDEF * proc, INSTANCE_HOOK * list, int64_t count, int64_t * result ) {
+    INSTANCE_HOOK * hooks;
+    int64_t n, f;
+
+    *result = 0;
+    if ( !count ) return NULL;
+
+    hooks = calloc( count, sizeof( INSTANCE_HOOK ) );
+    if ( !hooks ) {
+        fprintf( stderr, "ERROR: Runtime error - %s: out of memory\n", __FUNCTION__ );
+        exit(2);
+    }
+
+    for ( n = 0; n < count; n++ ) {
+        for ( f = 0; f < hook_filter_count && hook_filter_list[f].hook != list[n]; f++ );
+        if ( f < hook_filter_count && !hook_filter_list[f].filter( proc ) ) continue;
+        hooks[( *result )++] = list[n];
+    }
+
+    return hooks;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Builds the instance hook vectors of every process */
+
+static void sysproc_build_hooks() {
+    int64_t n;
+
+    for ( n = 0; n < procdef_count; n++ ) {
+        procs[n].process_exec_hooks = sysproc_proc_hooks( &procs[n], process_exec_hook_list, process_exec_hook_count, &procs[n].process_exec_hook_count );
+        procs[n].pre_execute_hooks = sysproc_proc_hooks( &procs[n], instance_pre_execute_hook_list, instance_pre_execute_hook_count, &procs[n].pre_execute_hook_count );
+        procs[n].pos_execute_hooks = sysproc_proc_hooks( &procs[n], instance_pos_execute_hook_list, instance_pos_execute_hook_count, &procs[n].pos_execute_hook_count );
+    }
+
+    free( hook_filter_list );
+    hook_filter_list = NULL;
+    hook_filter_allocated = hook_filter_count = 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
 SYSPROC * sysproc_get( int64_t code ) {
+    if ( code < 0 || code > sysproc_maxcode ) return NULL;
     return sysproc_tab[code];
 }
 
@@ -507,6 +588,7 @@ void sysproc_init() {
             exit( 0 );
         }
 
+        modules_name[ nmodules ] = strdup( ( const char * ) string_get( dcb.imports[n] ) );
         modules_hnd[ nmodules++ ] = library;
 
         globals_fixup     = ( DLVARFIXUP * ) _dlibaddr( library, "globals_fixup" );
@@ -593,6 +675,12 @@ void sysproc_init() {
         proc++;
     }
 
+    sysproc_maxcode = maxcode;
+
+    /* Calls in the code use the SYSPROC pointers from now on */
+
+    sysprocs_bind();
+
     /* Sort handler_hooks */
     if ( handler_hook_list )
         qsort( handler_hook_list, handler_hook_count, sizeof( handler_hook_list[0] ), ( int ( * )( const void *, const void * ) ) compare_priority );
@@ -601,6 +689,10 @@ void sysproc_init() {
     if ( module_initialize_count )
         for ( n = 0; n < module_initialize_count; n++ )
             module_initialize_list[n]();
+
+    /* Modules may filter their instance hooks at initialization */
+
+    sysproc_build_hooks();
 }
 
 /* ---------------------------------------------------------------------- */
@@ -625,6 +717,8 @@ char * sysproc_name( int64_t code ) {
 void sysproc_exit() {
     while( nmodules-- ) {
         dlibclose( modules_hnd[ nmodules ] );
+        free( modules_name[ nmodules ] );
+        modules_name[ nmodules ] = NULL;
     }
 }
 
@@ -42,6 +42,12 @@ extern char * sysproc_name( int64_t code ) ;
 
 /* ---------------------------------------------------------------------- */
 
+extern int nmodules ;
+extern void * modules_hnd[] ;
+extern char * modules_name[] ;
+
+/* ---------------------------------------------------------------------- */
+
 extern HOOK * handler_hook_list ;
 extern int64_t handler_hook_allocated ;
 extern int64_t handler_hook_count ;
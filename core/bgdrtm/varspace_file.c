@@ -32,6 +32,13 @@
 
 #include <stdint.h>
 
+#if !defined( _WIN32 ) && !defined( __SWITCH__ )
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SNAPSHOT_USE_MMAP
+#endif
+
 #include "files.h"
 #include "varspace_file.h"
 #include "xstrings.h"
@@ -300,7 +307,7 @@ int64_t loadtype( file * fp, void * data, DCB_TYPEDEF * var, int64_t dcbformat )
 
                         if ( len > 0 ) file_read( fp, str, len );
                         str[len] = 0;
-                        *( uint64_t* )data = string_new( str );
+                        *( uint64_t* )data = string_new( ( const unsigned char * ) str );
                         string_use( *( uint64_t* )data );
                         free( str );
                         data = ( uint8_t* )data + sizeof( uint64_t );
@@ -331,3 +338,531 @@ int64_t loadtype( file * fp, void * data, DCB_TYPEDEF * var, int64_t dcbformat )
     }
     return result;
 }
+
+/* ----------------------------------------------------------------- */
+/* Snapshots                                                         */
+/* ----------------------------------------------------------------- */
+/*
+ *  A snapshot is the raw memory image of the variables, followed by a
+ *  table with the contents of every distinct string. String slots in the
+ *  image hold an index in that table instead of a string id. The header
+ *  carries a hash of the type layout, so the image can be copied back
+ *  with a single read when the layout matches.
+ *
+ *  Snapshots use the byte order of the host that wrote them.
+ */
+
+#define SNAPSHOT_MAGIC          "BGDSNAP\x1a"
+#define SNAPSHOT_VERSION        1
+#define SNAPSHOT_BYTEORDER      0x01020304
+#define SNAPSHOT_MMAP_THRESHOLD ( 1024 * 1024 )
+#define SNAPSHOT_IO_CHUNK       ( 1024 * 1024 * 1024 )
+
+typedef struct {
+    char     magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    uint64_t layout;
+    uint64_t data_size;
+    uint64_t nstrings;
+    uint64_t strings_size;
+} SNAPSHOT_HEADER;
+
+typedef struct {
+    int64_t slot_type;      /* TYPE_STRING or TYPE_POINTER */
+    int64_t * slots;        /* Offsets of the slots of that type */
+    int64_t count;
+    int64_t allocated;
+    uint64_t layout;        /* FNV-1a of the type layout */
+} SNAPSHOT_PLAN;
+
+/* ----------------------------------------------------------------- */
+
+static uint64_t snapshot_hash( uint64_t h, const void * data, size_t len ) {
+    const uint8_t * p = ( const uint8_t * ) data;
+    while ( len-- ) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* ----------------------------------------------------------------- */
+
+static int snapshot_plan_add( SNAPSHOT_PLAN * plan, int64_t offset ) {
+    if ( plan->count >= plan->allocated ) {
+        int64_t * s;
+        int64_t allocated = plan->allocated ? plan->allocated * 2 : 256;
+        s = realloc( plan->slots, allocated * sizeof( int64_t ) );
+        if ( !s ) return -1;
+        plan->slots = s;
+        plan->allocated = allocated;
+    }
+    plan->slots[plan->count++] = offset;
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+static int64_t snapshot_plan_type( SNAPSHOT_PLAN * plan, DCB_TYPEDEF * var, int64_t offset );
+
+static int64_t snapshot_plan_vars( SNAPSHOT_PLAN * plan, DCB_VAR * var, int64_t nvars, int64_t offset ) {
+    int64_t result = 0, partial;
+
+    for ( ; nvars > 0; nvars--, var++ ) {
+        if ( ( partial = snapshot_plan_type( plan, &var->Type, offset + result ) ) < 0 ) return -1;
+        result += partial;
+    }
+    return result;
+}
+
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : snapshot_plan_type
+ *
+ *  Walks a type once, hashing its layout and collecting the offsets of
+ *  its slots of plan->slot_type. Runs of numeric data are not visited
+ *  element by element; arrays of structs reuse the offsets of the first
+ *  element.
+ *
+ *  RETURN VALUE :
+ *      Size in bytes of the type, -1 if error
+ *
+ */
+
+static int64_t snapshot_plan_type( SNAPSHOT_PLAN * plan, DCB_TYPEDEF * var, int64_t offset ) {
+    int64_t n = 0, count = 1, size, first, last, i, j;
+    uint64_t v;
+
+    for ( ;; ) {
+        v = var->BaseType[n];
+        plan->layout = snapshot_hash( plan->layout, &v, sizeof( v ) );
+
+        switch ( var->BaseType[n] ) {
+            case TYPE_DOUBLE:
+            case TYPE_INT:
+            case TYPE_QWORD:
+                return count * sizeof( uint64_t );
+
+            case TYPE_FLOAT:
+            case TYPE_INT32:
+            case TYPE_DWORD:
+                return count * sizeof( uint32_t );
+
+            case TYPE_SHORT:
+            case TYPE_WORD:
+                return count * sizeof( uint16_t );
+
+            case TYPE_BYTE:
+            case TYPE_SBYTE:
+            case TYPE_CHAR:
+                return count;
+
+            case TYPE_STRING:
+            case TYPE_POINTER:
+                if ( var->BaseType[n] == plan->slot_type )
+                    for ( i = 0; i < count; i++ )
+                        if ( snapshot_plan_add( plan, offset + i * sizeof( uint64_t ) ) ) return -1;
+                return count * sizeof( uint64_t );
+
+            case TYPE_ARRAY:
+                v = var->Count[n];
+                plan->layout = snapshot_hash( plan->layout, &v, sizeof( v ) );
+                count *= var->Count[n];
+                n++;
+                continue;
+
+            case TYPE_STRUCT:
+                first = plan->count;
+                size = snapshot_plan_vars( plan, dcb.varspace_vars[var->Members], dcb.varspace[var->Members].NVars, offset );
+                if ( size < 0 ) return -1;
+                last = plan->count;
+                for ( i = 1; i < count && first != last; i++ )
+                    for ( j = first; j < last; j++ )
+                        if ( snapshot_plan_add( plan, plan->slots[j] + i * size ) ) return -1;
+                return count * size;
+
+            default:
+                return -1;
+        }
+    }
+}
+
+/* ----------------------------------------------------------------- */
+
+static int64_t snapshot_plan( SNAPSHOT_PLAN * plan, DCB_TYPEDEF * var, int64_t nvars ) {
+    int64_t result = 0, partial;
+
+    memset( plan, 0, sizeof( SNAPSHOT_PLAN ) );
+    plan->slot_type = TYPE_STRING;
+    plan->layout = 0xcbf29ce484222325ULL;
+
+    for ( ; nvars > 0; nvars--, var++ ) {
+        if ( ( partial = snapshot_plan_type( plan, var, result ) ) < 0 ) {
+            free( plan->slots );
+            plan->slots = NULL;
+            return -1;
+        }
+        result += partial;
+    }
+    return result;
+}
+
+/* ----------------------------------------------------------------- */
+
+static int64_t varspace_slots( DCB_VAR * var, int64_t nvars, int64_t slot_type, int64_t ** offsets ) {
+    SNAPSHOT_PLAN plan;
+
+    memset( &plan, 0, sizeof( SNAPSHOT_PLAN ) );
+    plan.slot_type = slot_type;
+
+    for ( ; nvars > 0; nvars--, var++ ) {
+        if ( snapshot_plan_type( &plan, &var->Type, var->Offset ) < 0 ) {
+            free( plan.slots );
+            return -1;
+        }
+    }
+
+    *offsets = plan.slots;
+    return plan.count;
+}
+
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : varspace_strings
+ *
+ *  Collects the offsets of every string slot in a list of variables,
+ *  using the offset of each variable in its data segment.
+ *
+ *  PARAMS :
+ *  var     Pointer to the variable array
+ *  nvars   Number of variables (length of var array)
+ *  offsets Receives a malloc'ed array of offsets, to be freed by the caller
+ *
+ *  RETURN VALUE :
+ *      Number of string slots, -1 if error
+ *
+ */
+
+int64_t varspace_strings( DCB_VAR * var, int64_t nvars, int64_t ** offsets ) {
+    return varspace_slots( var, nvars, TYPE_STRING, offsets );
+}
+
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : varspace_pointers
+ *
+ *  Same as varspace_strings, for the pointer slots.
+ *
+ */
+
+int64_t varspace_pointers( DCB_VAR * var, int64_t nvars, int64_t ** offsets ) {
+    return varspace_slots( var, nvars, TYPE_POINTER, offsets );
+}
+
+/* ----------------------------------------------------------------- */
+
+static int snapshot_write_all( file * fp, uint8_t * buffer, int64_t len ) {
+    int64_t chunk;
+
+    while ( len > 0 ) {
+        chunk = len > SNAPSHOT_IO_CHUNK ? SNAPSHOT_IO_CHUNK : len;
+        if ( file_write( fp, buffer, chunk ) != chunk ) return -1;
+        buffer += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+static int snapshot_read_all( file * fp, uint8_t * buffer, int64_t len ) {
+    int64_t chunk;
+
+    while ( len > 0 ) {
+        chunk = len > SNAPSHOT_IO_CHUNK ? SNAPSHOT_IO_CHUNK : len;
+        if ( file_read( fp, buffer, chunk ) != chunk ) return -1;
+        buffer += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : savetypes_snapshot
+ *
+ *  Save data from memory to a given file at the current file offset,
+ *  using the snapshot format. Every string is stored once, no matter
+ *  how many variables use it.
+ *  Big snapshots are written through a memory map of the file when the
+ *  platform allows it.
+ *
+ *  PARAMS :
+ *  fp    Pointer to the file object
+ *  data   Pointer to the data
+ *  var    Pointer to the type array
+ *  nvars   Number of variables (length of var array)
+ *
+ *  RETURN VALUE :
+ *      Number of bytes of data saved, -1 if error
+ *
+ */
+
+int64_t savetypes_snapshot( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars ) {
+    SNAPSHOT_PLAN plan;
+    SNAPSHOT_HEADER header;
+    int64_t size, n, total, * table = NULL, * unique = NULL, * number = NULL;
+    uint64_t mask = 0, h;
+    uint8_t * out = NULL, * ptr;
+    int mapped = 0;
+
+    if ( ( size = snapshot_plan( &plan, var, nvars ) ) < 0 ) return -1;
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, SNAPSHOT_MAGIC, sizeof( header.magic ) );
+    header.byteorder = SNAPSHOT_BYTEORDER;
+    header.version = SNAPSHOT_VERSION;
+    header.layout = plan.layout;
+    header.data_size = size;
+
+    /* Deduplicate strings: table is an open addressing hash of string ids,
+       number keeps the position in the string table of every string slot */
+
+    if ( plan.count ) {
+        for ( mask = 1; mask < ( uint64_t ) plan.count * 2; mask <<= 1 );
+        table = malloc( mask * sizeof( int64_t ) * 2 );
+        unique = malloc( plan.count * sizeof( int64_t ) );
+        number = malloc( plan.count * sizeof( int64_t ) );
+        if ( !table || !unique || !number ) goto snapshot_save_error;
+        memset( table, 0xff, mask * sizeof( int64_t ) );
+        mask--;
+
+        for ( n = 0; n < plan.count; n++ ) {
+            int64_t code = *( int64_t * )( ( uint8_t * ) data + plan.slots[n] );
+
+            /* Same string than the previous slot, very common in arrays */
+            if ( n && code == *( int64_t * )( ( uint8_t * ) data + plan.slots[n - 1] ) ) {
+                number[n] = number[n - 1];
+                continue;
+            }
+
+            h = ( ( uint64_t ) code * 0x9e3779b97f4a7c15ULL ) >> 32 & mask;
+            while ( table[h] != -1 && table[h] != code ) h = ( h + 1 ) & mask;
+
+            if ( table[h] == -1 ) {
+                table[h] = code;
+                table[mask + 1 + h] = header.nstrings;
+                unique[header.nstrings++] = code;
+                header.strings_size += sizeof( uint32_t ) + strlen( ( const char * ) string_get( code ) ) + 1;
+            }
+            number[n] = table[mask + 1 + h];
+        }
+    }
+
+    total = sizeof( header ) + header.data_size + header.strings_size;
+
+#ifdef SNAPSHOT_USE_MMAP
+    if ( fp->type == F_FILE && total >= SNAPSHOT_MMAP_THRESHOLD && file_pos( fp ) == 0 ) {
+        int fd = fileno( fp->fp );
+        fflush( fp->fp );
+        if ( !ftruncate( fd, total ) ) {
+            out = mmap( NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+            if ( out == MAP_FAILED ) out = NULL;
+            else mapped = 1;
+        }
+    }
+#endif
+
+    if ( !out && !( out = malloc( total ) ) ) goto snapshot_save_error;
+
+    /* Header and raw image, string slots are patched with the string number */
+
+    memcpy( out, &header, sizeof( header ) );
+    ptr = out + sizeof( header );
+    memcpy( ptr, data, size );
+
+    for ( n = 0; n < plan.count; n++ ) *( int64_t * )( ptr + plan.slots[n] ) = number[n];
+
+    /* String table */
+
+    for ( ptr += size, n = 0; n < ( int64_t ) header.nstrings; n++ ) {
+        const unsigned char * str = string_get( unique[n] );
+        uint32_t len = strlen( ( const char * ) str );
+
+        memcpy( ptr, &len, sizeof( len ) );
+        memcpy( ptr + sizeof( len ), str, len + 1 );
+        ptr += sizeof( len ) + len + 1;
+    }
+
+#ifdef SNAPSHOT_USE_MMAP
+    if ( mapped ) {
+        munmap( out, total );
+        out = NULL;
+        fseek( fp->fp, total, SEEK_SET );
+    }
+#endif
+
+    if ( out && snapshot_write_all( fp, out, total ) ) goto snapshot_save_error;
+
+    if ( !mapped ) free( out );
+    free( table );
+    free( unique );
+    free( number );
+    free( plan.slots );
+    return size;
+
+snapshot_save_error:
+#ifdef SNAPSHOT_USE_MMAP
+    if ( mapped && out ) munmap( out, total );
+#endif
+    if ( !mapped ) free( out );
+    free( table );
+    free( unique );
+    free( number );
+    free( plan.slots );
+    return -1;
+}
+
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : loadtypes_snapshot
+ *
+ *  Load data from a given file at the current file offset. If the file
+ *  holds a snapshot, its layout must match the given types and the image
+ *  is read back in one go. Files in the old format are loaded with
+ *  loadtypes.
+ *  The whole snapshot is read (or mapped, when big) and checked before
+ *  the variables are touched, so a bad file leaves them unchanged.
+ *
+ *  PARAMS :
+ *  fp    Pointer to the file object
+ *  data   Pointer to the data
+ *  var    Pointer to the type array
+ *  nvars   Number of variables (length of var array)
+ *
+ *  RETURN VALUE :
+ *      Number of bytes of data loaded, -1 if error
+ *
+ */
+
+int64_t loadtypes_snapshot( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars ) {
+    SNAPSHOT_PLAN plan;
+    SNAPSHOT_HEADER header;
+    int64_t size, n, len, * codes = NULL, * slot;
+    int64_t pos = file_pos( fp );
+    uint8_t * image = NULL, * strs, * ptr, * end, * map = NULL;
+    size_t map_size = 0;
+
+    if ( file_read( fp, &header, sizeof( header ) ) != sizeof( header ) || memcmp( header.magic, SNAPSHOT_MAGIC, sizeof( header.magic ) ) ) {
+        /* Not a snapshot */
+        file_seek( fp, pos, SEEK_SET );
+        return loadtypes( fp, data, var, nvars, 0 );
+    }
+
+    if ( header.byteorder != SNAPSHOT_BYTEORDER || header.version != SNAPSHOT_VERSION ) return -1;
+
+    /* Every string takes at least its length and the ending 0 */
+    if ( header.nstrings > header.strings_size / ( sizeof( uint32_t ) + 1 ) ) return -1;
+
+    if ( ( size = snapshot_plan( &plan, var, nvars ) ) < 0 ) return -1;
+
+    if ( header.layout != plan.layout || header.data_size != ( uint64_t ) size ) {
+        /* Saved with other types */
+        free( plan.slots );
+        return -1;
+    }
+
+#ifdef SNAPSHOT_USE_MMAP
+    if ( fp->type == F_FILE && size + header.strings_size >= SNAPSHOT_MMAP_THRESHOLD ) {
+        struct stat st;
+        int64_t start = pos + sizeof( header );
+
+        if ( fstat( fileno( fp->fp ), &st ) || ( uint64_t ) st.st_size < start + size + header.strings_size ) goto snapshot_load_error; /* Truncated */
+
+        map_size = start + size + header.strings_size;
+        map = mmap( NULL, map_size, PROT_READ, MAP_PRIVATE, fileno( fp->fp ), 0 );
+        if ( map == MAP_FAILED ) map = NULL;
+        else {
+            image = map + start;
+            file_seek( fp, map_size, SEEK_SET );
+        }
+    }
+#endif
+
+    if ( !map ) {
+        if ( !( image = malloc( size + header.strings_size ) ) ) goto snapshot_load_error;
+        if ( snapshot_read_all( fp, image, size + header.strings_size ) ) goto snapshot_load_error; /* Truncated */
+    }
+
+    strs = image + size;
+    end = strs + header.strings_size;
+
+    /* Check the string table and the string slots */
+
+    for ( ptr = strs, n = 0; n < ( int64_t ) header.nstrings; n++ ) {
+        uint32_t l;
+        if ( end - ptr < ( int64_t ) sizeof( l ) ) goto snapshot_load_error;
+        memcpy( &l, ptr, sizeof( l ) );
+        ptr += sizeof( l );
+        if ( end - ptr < ( int64_t ) l + 1 || ptr[l] != '\0' ) goto snapshot_load_error;
+        ptr += l + 1;
+    }
+
+    if ( ptr != end ) goto snapshot_load_error;
+
+    for ( n = 0; n < plan.count; n++ ) {
+        memcpy( &len, image + plan.slots[n], sizeof( len ) );
+        if ( len < 0 || ( uint64_t ) len >= header.nstrings ) goto snapshot_load_error;
+    }
+
+    /* Create every distinct string once */
+
+    if ( header.nstrings && !( codes = malloc( header.nstrings * sizeof( int64_t ) ) ) ) goto snapshot_load_error;
+
+    for ( ptr = strs, n = 0; n < ( int64_t ) header.nstrings; n++ ) {
+        uint32_t l;
+        memcpy( &l, ptr, sizeof( l ) );
+        codes[n] = string_new( ptr + sizeof( l ) );
+        string_use( codes[n] );
+        ptr += sizeof( l ) + l + 1;
+    }
+
+    /* Release the current strings, then copy the image back */
+
+    for ( n = 0; n < plan.count; n++ ) string_discard( *( int64_t * )( ( uint8_t * ) data + plan.slots[n] ) );
+
+    memcpy( data, image, size );
+
+    for ( n = 0; n < plan.count; n++ ) {
+        slot = ( int64_t * )( ( uint8_t * ) data + plan.slots[n] );
+        *slot = codes[*slot];
+        string_use( *slot );
+    }
+
+    for ( n = 0; n < ( int64_t ) header.nstrings; n++ ) string_discard( codes[n] );
+
+#ifdef SNAPSHOT_USE_MMAP
+    if ( map ) munmap( map, map_size );
+#endif
+    if ( !map ) free( image );
+    free( codes );
+    free( plan.slots );
+    return size;
+
+snapshot_load_error:
+#ifdef SNAPSHOT_USE_MMAP
+    if ( map ) munmap( map, map_size );
+#endif
+    if ( !map ) free( image );
+    free( codes );
+    free( plan.slots );
+    return -1;
+}
+
+/* ----------------------------------------------------------------- */
@@ -30,10 +30,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#if USE_CRYPT
-
 #include "b_crypt.h"
 
+#if USE_CRYPT
+
 /* ------------------------------------------------------------------------- */
 
 crypt_handle * crypt_create( int method, char * key )
@@ -138,3 +138,350 @@ int crypt_data( crypt_handle * ch, char * in, char * out, int size, int enc )
 /* ------------------------------------------------------------------------- */
 
 #endif
+
+/* ------------------------------------------------------------------------- */
+/* ChaCha20                                                                  */
+/* ------------------------------------------------------------------------- */
+
+#define U8TO32( p )         ( ( uint32_t )( p )[0] | ( ( uint32_t )( p )[1] << 8 ) | ( ( uint32_t )( p )[2] << 16 ) | ( ( uint32_t )( p )[3] << 24 ) )
+#define U32TO8( p, v )      { ( p )[0] = ( uint8_t )( v ); ( p )[1] = ( uint8_t )( ( v ) >> 8 ); ( p )[2] = ( uint8_t )( ( v ) >> 16 ); ( p )[3] = ( uint8_t )( ( v ) >> 24 ); }
+
+#define ROTL32( v, n )      ( ( ( v ) << ( n ) ) | ( ( v ) >> ( 32 - ( n ) ) ) )
+
+#define QUARTERROUND( a, b, c, d ) \
+    a += b; d ^= a; d = ROTL32( d, 16 ); \
+    c += d; b ^= c; b = ROTL32( b, 12 ); \
+    a += b; d ^= a; d = ROTL32( d, 8 );  \
+    c += d; b ^= c; b = ROTL32( b, 7 );
+
+/* ------------------------------------------------------------------------- */
+
+void chacha_init( chacha_ctx * ctx, const uint8_t * key, const uint8_t * nonce )
+{
+    int n;
+
+    ctx->state[0] = 0x61707865;
+    ctx->state[1] = 0x3320646e;
+    ctx->state[2] = 0x79622d32;
+    ctx->state[3] = 0x6b206574;
+    for ( n = 0; n < 8; n++ ) ctx->state[4 + n] = U8TO32( key + n * 4 );
+    ctx->state[12] = 0;
+    for ( n = 0; n < 3; n++ ) ctx->state[13 + n] = U8TO32( nonce + n * 4 );
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void chacha_block( const chacha_ctx * ctx, uint32_t counter, uint8_t * out )
+{
+    uint32_t x[16], in[16];
+    int n;
+
+    memcpy( in, ctx->state, sizeof( in ) );
+    in[12] = counter;
+    memcpy( x, in, sizeof( x ) );
+
+    for ( n = 0; n < 10; n++ )
+    {
+        QUARTERROUND( x[0], x[4], x[ 8], x[12] )
+        QUARTERROUND( x[1], x[5], x[ 9], x[13] )
+        QUARTERROUND( x[2], x[6], x[10], x[14] )
+        QUARTERROUND( x[3], x[7], x[11], x[15] )
+        QUARTERROUND( x[0], x[5], x[10], x[15] )
+        QUARTERROUND( x[1], x[6], x[11], x[12] )
+        QUARTERROUND( x[2], x[7], x[ 8], x[13] )
+        QUARTERROUND( x[3], x[4], x[ 9], x[14] )
+    }
+
+    for ( n = 0; n < 16; n++ )
+    {
+        uint32_t v = x[n] + in[n];
+        U32TO8( out + n * 4, v )
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* XOR data with the key stream starting at any byte offset, so the same
+   call encrypts, decrypts and seeks. The context is not modified, disjoint
+   ranges can be processed at the same time */
+
+void chacha_crypt( const chacha_ctx * ctx, uint64_t offset, uint8_t * data, size_t size )
+{
+    uint8_t ks[CHACHA_BLOCK_SIZE];
+    uint32_t counter = ( uint32_t )( offset / CHACHA_BLOCK_SIZE );
+    size_t skip = ( size_t )( offset % CHACHA_BLOCK_SIZE ), n, i;
+
+    while ( size )
+    {
+        chacha_block( ctx, counter++, ks );
+
+        n = CHACHA_BLOCK_SIZE - skip;
+        if ( n > size ) n = size;
+
+        for ( i = 0; i < n; i++ ) data[i] ^= ks[skip + i];
+
+        data += n;
+        size -= n;
+        skip = 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Poly1305 (26 bit limbs)                                                   */
+/* ------------------------------------------------------------------------- */
+
+void poly1305_init( poly1305_ctx * ctx, const uint8_t * key )
+{
+    ctx->r[0] = ( U8TO32( key +  0 )      ) & 0x3ffffff;
+    ctx->r[1] = ( U8TO32( key +  3 ) >> 2 ) & 0x3ffff03;
+    ctx->r[2] = ( U8TO32( key +  6 ) >> 4 ) & 0x3ffc0ff;
+    ctx->r[3] = ( U8TO32( key +  9 ) >> 6 ) & 0x3f03fff;
+    ctx->r[4] = ( U8TO32( key + 12 ) >> 8 ) & 0x00fffff;
+
+    memset( ctx->h, 0, sizeof( ctx->h ) );
+
+    ctx->pad[0] = U8TO32( key + 16 );
+    ctx->pad[1] = U8TO32( key + 20 );
+    ctx->pad[2] = U8TO32( key + 24 );
+    ctx->pad[3] = U8TO32( key + 28 );
+
+    ctx->leftover = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void poly1305_blocks( poly1305_ctx * ctx, const uint8_t * m, size_t size, uint32_t hibit )
+{
+    uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2], r3 = ctx->r[3], r4 = ctx->r[4];
+    uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+    uint64_t d0, d1, d2, d3, d4;
+    uint32_t c;
+
+    while ( size >= 16 )
+    {
+        h0 += ( U8TO32( m +  0 )      ) & 0x3ffffff;
+        h1 += ( U8TO32( m +  3 ) >> 2 ) & 0x3ffffff;
+        h2 += ( U8TO32( m +  6 ) >> 4 ) & 0x3ffffff;
+        h3 += ( U8TO32( m +  9 ) >> 6 ) & 0x3ffffff;
+        h4 += ( U8TO32( m + 12 ) >> 8 ) | hibit;
+
+        d0 = ( uint64_t ) h0 * r0 + ( uint64_t ) h1 * s4 + ( uint64_t ) h2 * s3 + ( uint64_t ) h3 * s2 + ( uint64_t ) h4 * s1;
+        d1 = ( uint64_t ) h0 * r1 + ( uint64_t ) h1 * r0 + ( uint64_t ) h2 * s4 + ( uint64_t ) h3 * s3 + ( uint64_t ) h4 * s2;
+        d2 = ( uint64_t ) h0 * r2 + ( uint64_t ) h1 * r1 + ( uint64_t ) h2 * r0 + ( uint64_t ) h3 * s4 + ( uint64_t ) h4 * s3;
+        d3 = ( uint64_t ) h0 * r3 + ( uint64_t ) h1 * r2 + ( uint64_t ) h2 * r1 + ( uint64_t ) h3 * r0 + ( uint64_t ) h4 * s4;
+        d4 = ( uint64_t ) h0 * r4 + ( uint64_t ) h1 * r3 + ( uint64_t ) h2 * r2 + ( uint64_t ) h3 * r1 + ( uint64_t ) h4 * r0;
+
+                   c = ( uint32_t )( d0 >> 26 ); h0 = ( uint32_t ) d0 & 0x3ffffff;
+        d1 += c;   c = ( uint32_t )( d1 >> 26 ); h1 = ( uint32_t ) d1 & 0x3ffffff;
+        d2 += c;   c = ( uint32_t )( d2 >> 26 ); h2 = ( uint32_t ) d2 & 0x3ffffff;
+        d3 += c;   c = ( uint32_t )( d3 >> 26 ); h3 = ( uint32_t ) d3 & 0x3ffffff;
+        d4 += c;   c = ( uint32_t )( d4 >> 26 ); h4 = ( uint32_t ) d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+
+        m += 16;
+        size -= 16;
+    }
+
+    ctx->h[0] = h0; ctx->h[1] = h1; ctx->h[2] = h2; ctx->h[3] = h3; ctx->h[4] = h4;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void poly1305_update( poly1305_ctx * ctx, const uint8_t * data, size_t size )
+{
+    size_t n;
+
+    if ( ctx->leftover )
+    {
+        n = 16 - ctx->leftover;
+        if ( n > size ) n = size;
+        memcpy( ctx->buffer + ctx->leftover, data, n );
+        ctx->leftover += n;
+        data += n;
+        size -= n;
+        if ( ctx->leftover < 16 ) return;
+        poly1305_blocks( ctx, ctx->buffer, 16, 1 << 24 );
+        ctx->leftover = 0;
+    }
+
+    if ( size >= 16 )
+    {
+        n = size & ~( size_t ) 15;
+        poly1305_blocks( ctx, data, n, 1 << 24 );
+        data += n;
+        size -= n;
+    }
+
+    if ( size )
+    {
+        memcpy( ctx->buffer, data, size );
+        ctx->leftover = size;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void poly1305_finish( poly1305_ctx * ctx, uint8_t * tag )
+{
+    uint32_t h0, h1, h2, h3, h4, g0, g1, g2, g3, g4, c, mask;
+    uint64_t f;
+
+    if ( ctx->leftover )
+    {
+        ctx->buffer[ctx->leftover++] = 1;
+        memset( ctx->buffer + ctx->leftover, 0, 16 - ctx->leftover );
+        poly1305_blocks( ctx, ctx->buffer, 16, 0 );
+    }
+
+    h0 = ctx->h[0]; h1 = ctx->h[1]; h2 = ctx->h[2]; h3 = ctx->h[3]; h4 = ctx->h[4];
+
+                 c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c;     c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c;     c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c;     c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    /* h - p, selected in constant time if h >= p */
+    g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    g4 = h4 + c - ( 1 << 26 );
+
+    mask = ( g4 >> 31 ) - 1;
+    g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+    mask = ~mask;
+    h0 = ( h0 & mask ) | g0;
+    h1 = ( h1 & mask ) | g1;
+    h2 = ( h2 & mask ) | g2;
+    h3 = ( h3 & mask ) | g3;
+    h4 = ( h4 & mask ) | g4;
+
+    h0 = ( h0       ) | ( h1 << 26 );
+    h1 = ( h1 >>  6 ) | ( h2 << 20 );
+    h2 = ( h2 >> 12 ) | ( h3 << 14 );
+    h3 = ( h3 >> 18 ) | ( h4 <<  8 );
+
+    f = ( uint64_t ) h0 + ctx->pad[0];             h0 = ( uint32_t ) f;
+    f = ( uint64_t ) h1 + ctx->pad[1] + ( f >> 32 ); h1 = ( uint32_t ) f;
+    f = ( uint64_t ) h2 + ctx->pad[2] + ( f >> 32 ); h2 = ( uint32_t ) f;
+    f = ( uint64_t ) h3 + ctx->pad[3] + ( f >> 32 ); h3 = ( uint32_t ) f;
+
+    U32TO8( tag +  0, h0 )
+    U32TO8( tag +  4, h1 )
+    U32TO8( tag +  8, h2 )
+    U32TO8( tag + 12, h3 )
+
+    memset( ctx, 0, sizeof( *ctx ) );
+}
+
+/* ------------------------------------------------------------------------- */
+/* Authenticated stream                                                      */
+/* ------------------------------------------------------------------------- */
+
+static void crypt_stream_pad( crypt_stream * cs, uint64_t size )
+{
+    static const uint8_t zero[16] = { 0 };
+    if ( size % 16 ) poly1305_update( &cs->mac, zero, 16 - ( size_t )( size % 16 ) );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void crypt_stream_init( crypt_stream * cs, const uint8_t * key, const uint8_t * nonce, const uint8_t * aad, size_t aad_size )
+{
+    uint8_t block[CHACHA_BLOCK_SIZE];
+
+    chacha_init( &cs->cipher, key, nonce );
+
+    /* The MAC key is the first 32 bytes of block 0 */
+    memset( block, 0, sizeof( block ) );
+    chacha_crypt( &cs->cipher, 0, block, sizeof( block ) );
+    poly1305_init( &cs->mac, block );
+    memset( block, 0, sizeof( block ) );
+
+    cs->aad_size = aad_size;
+    cs->data_size = 0;
+
+    if ( aad_size )
+    {
+        poly1305_update( &cs->mac, aad, aad_size );
+        crypt_stream_pad( cs, aad_size );
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Offset is relative to the start of the data */
+
+void crypt_stream_xor( const crypt_stream * cs, uint64_t offset, uint8_t * data, size_t size )
+{
+    chacha_crypt( &cs->cipher, offset + CHACHA_BLOCK_SIZE, data, size );
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Adds ciphered data to the tag */
+
+void crypt_stream_authenticate( crypt_stream * cs, const uint8_t * data, size_t size )
+{
+    poly1305_update( &cs->mac, data, size );
+    cs->data_size += size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void crypt_stream_encrypt( crypt_stream * cs, uint8_t * data, size_t size )
+{
+    crypt_stream_xor( cs, cs->data_size, data, size );
+    crypt_stream_authenticate( cs, data, size );
+}
+
+/* ------------------------------------------------------------------------- */
+
+void crypt_stream_decrypt( crypt_stream * cs, uint8_t * data, size_t size )
+{
+    uint64_t offset = cs->data_size;
+
+    crypt_stream_authenticate( cs, data, size );
+    crypt_stream_xor( cs, offset, data, size );
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Ends the stream, no more data can be added */
+
+void crypt_stream_tag( crypt_stream * cs, uint8_t * tag )
+{
+    uint8_t sizes[16];
+
+    crypt_stream_pad( cs, cs->data_size );
+
+    U32TO8( sizes +  0, ( uint32_t ) cs->aad_size )
+    U32TO8( sizes +  4, ( uint32_t )( cs->aad_size >> 32 ) )
+    U32TO8( sizes +  8, ( uint32_t ) cs->data_size )
+    U32TO8( sizes + 12, ( uint32_t )( cs->data_size >> 32 ) )
+    poly1305_update( &cs->mac, sizes, sizeof( sizes ) );
+
+    poly1305_finish( &cs->mac, tag );
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* Returns 1 if the tag matches */
+
+int crypt_stream_verify( crypt_stream * cs, const uint8_t * tag )
+{
+    uint8_t calc[CHACHA_TAG_SIZE];
+    uint8_t diff = 0;
+    int n;
+
+    crypt_stream_tag( cs, calc );
+    for ( n = 0; n < CHACHA_TAG_SIZE; n++ ) diff |= calc[n] ^ tag[n];
+
+    return !diff;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -323,7 +323,7 @@ void mnemonic_dump( int64_t i, int64_t param ) {
 
         if ( i == MN_SENTENCE ) {
 #ifdef __BGDRTM__
-            if ( dcb.sourcecount[param >> 24] ) {
+            if ( dcb_source_count( dcb.data.Version == 0x0700 ? param >> 24 : param >> 20 ) ) {
                 if ( dcb.data.Version == 0x0700 ) printf( "%s:%-10" PRId64 " %s\n", dcb.sourcefiles[param >> 24], param & 0xFFFFFF, dcb.sourcelines[param >> 24] [( param & 0xFFFFFF )-1] );
                 else                              printf( "%s:%-10" PRId64 " %s\n", dcb.sourcefiles[param >> 20], param & 0xFFFFF , dcb.sourcelines[param >> 20] [( param & 0xFFFFF  )-1] );
             }
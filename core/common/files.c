@@ -41,12 +41,14 @@
 #endif
 
 #include <stdint.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "files.h"
+#include "b_crypt.h"
 
 #define MAX_POSSIBLE_PATHS  128
 
@@ -95,11 +97,330 @@ void file_add_xfile( file * fp, const char * stubname, long offset, char * name,
     x_files_count++;
 }
 
+/* ---------------------------------------------------------------------- */
+/* Crypted files                                                          */
+/* ---------------------------------------------------------------------- */
+
+/* Layout: header (magic, nonce, version), then segments of 64KB of data
+   ciphered with ChaCha20, each one followed by its Poly1305 tag. Every
+   segment has its own nonce, the header nonce with the segment number mixed
+   in, and its tag covers the header with a flag set for the last segment, so
+   segments can't be moved, dropped or cut. Only the segment being read is
+   loaded, authenticated and deciphered, reads never see bytes that were not
+   authenticated */
+
+#define CRYPT_FILE_MAGIC        "BGDCRYPT"
+#define CRYPT_FILE_VERSION      2
+#define CRYPT_FILE_HEADER       24
+#define CRYPT_FILE_LAST         21      /* Header byte set in the tag of the last segment */
+#define CRYPT_FILE_SEGMENT      65536
+#define CRYPT_FILE_RAW_SEGMENT  ( CRYPT_FILE_SEGMENT + CHACHA_TAG_SIZE )
+
+struct file_crypt {
+    file *          raw;
+    uint8_t         key[CHACHA_KEY_SIZE];
+    uint8_t         header[CRYPT_FILE_HEADER];
+    long            pos;
+    long            size;       /* Reading only */
+    long            segments;   /* Reading only */
+    long            segment;    /* Segment in the buffer, -1 for none */
+    int             used;       /* Data bytes in the buffer */
+    int             writing;
+    uint8_t         buffer[CRYPT_FILE_RAW_SEGMENT];
+};
+
+static uint8_t file_key[CHACHA_KEY_SIZE];
+static int file_key_set = 0;
+
+/* Set the key for crypted files, NULL for none. While a key is set, files
+   opened for read are deciphered if crypted, and files opened with 'c' in
+   the mode are written crypted. Without a key, opens with 'c' fail */
+
+void file_crypt_key( const uint8_t * key ) {
+    file_key_set = ( key != NULL );
+    if ( key ) memcpy( file_key, key, CHACHA_KEY_SIZE );
+    else memset( file_key, 0, CHACHA_KEY_SIZE );
+}
+
+/* 1 while a key is set */
+
+int file_crypt_keyed( void ) {
+    return file_key_set;
+}
+
+/* The nonce only needs to be unique for the key */
+
+static void file_crypt_nonce( uint8_t * nonce ) {
+    static uint32_t count = 0;
+    uint64_t t;
+#ifdef _WIN32
+    LARGE_INTEGER pc;
+#else
+    FILE * fp = fopen( "/dev/urandom", "rb" );
+
+    if ( fp ) {
+        size_t n = fread( nonce, 1, CHACHA_NONCE_SIZE, fp );
+        fclose( fp );
+        if ( n == CHACHA_NONCE_SIZE ) return;
+    }
+#endif
+
+#ifdef _WIN32
+    QueryPerformanceCounter( &pc );
+    t = ( uint64_t ) pc.QuadPart;
+#else
+    t = ( uint64_t ) clock();
+#endif
+    t ^= ( uint64_t ) time( NULL ) << 32;
+    count++;
+
+    memcpy( nonce, &t, 8 );
+    memcpy( nonce + 8, &count, 4 );
+}
+
+static void file_crypt_close_raw( file * f ) {
+    if ( f->type == F_FILE || f->type == F_XFILE ) fclose( f->fp );
+#ifndef NO_ZLIB
+    if ( f->type == F_GZFILE ) gzclose( f->gz );
+#endif
+}
+
+/* Stream of a segment, its nonce is the header nonce xored with its number */
+
+static void file_crypt_segment_stream( struct file_crypt * c, crypt_stream * cs, long segment, int last ) {
+    uint8_t nonce[CHACHA_NONCE_SIZE], aad[CRYPT_FILE_HEADER];
+    int n;
+
+    memcpy( nonce, c->header + 8, CHACHA_NONCE_SIZE );
+    for ( n = 0; n < 8; n++ ) nonce[4 + n] ^= ( uint8_t )( ( uint64_t ) segment >> ( n * 8 ) );
+
+    memcpy( aad, c->header, CRYPT_FILE_HEADER );
+    aad[CRYPT_FILE_LAST] = last ? 1 : 0;
+
+    crypt_stream_init( cs, c->key, nonce, aad, CRYPT_FILE_HEADER );
+}
+
+/* Cipher the buffer and write it as the next segment */
+
+static int file_crypt_put_segment( file * fp, int last ) {
+    struct file_crypt * c = fp->crypt;
+    crypt_stream cs;
+    int n = c->used + CHACHA_TAG_SIZE;
+
+    file_crypt_segment_stream( c, &cs, c->segment, last );
+    crypt_stream_encrypt( &cs, c->buffer, c->used );
+    crypt_stream_tag( &cs, c->buffer + c->used );
+
+    if ( file_write( c->raw, c->buffer, n ) != n ) {
+        fp->error = 1;
+        return -1;
+    }
+
+    c->segment++;
+    c->used = 0;
+
+    return 0;
+}
+
+/* Load a segment in the buffer, deciphered if its tag matches */
+
+static int file_crypt_get_segment( file * fp, long segment ) {
+    struct file_crypt * c = fp->crypt;
+    long offset = CRYPT_FILE_HEADER + segment * CRYPT_FILE_RAW_SEGMENT;
+    int n = ( segment < c->segments - 1 ) ? CRYPT_FILE_SEGMENT : ( int )( c->size - segment * CRYPT_FILE_SEGMENT );
+    crypt_stream cs;
+
+    c->segment = -1;
+
+    if ( file_pos( c->raw ) != offset && file_seek( c->raw, offset, SEEK_SET ) < 0 ) {
+        fp->error = 1;
+        return -1;
+    }
+
+    if ( file_read( c->raw, c->buffer, n + CHACHA_TAG_SIZE ) != n + CHACHA_TAG_SIZE ) {
+        fp->error = 1;
+        return -1;
+    }
+
+    file_crypt_segment_stream( c, &cs, segment, segment == c->segments - 1 );
+    crypt_stream_authenticate( &cs, c->buffer, n );
+    if ( !crypt_stream_verify( &cs, c->buffer + n ) ) {
+        fp->error = 1;
+        return -1;
+    }
+    crypt_stream_xor( &cs, 0, c->buffer, n );
+
+    c->segment = segment;
+    c->used = n;
+
+    return 0;
+}
+
+/* Wrap an opened file. Returns 1 if the file is now crypted, 0 if it is
+   not a crypted file, -1 on error or if the file was modified */
+
+static int file_crypt_open( file * f, int writing ) {
+    uint8_t header[CRYPT_FILE_HEADER];
+    struct file_crypt * c;
+    long raw_size = 0;
+
+    if ( writing ) {
+        memset( header, 0, sizeof( header ) );
+        memcpy( header, CRYPT_FILE_MAGIC, 8 );
+        file_crypt_nonce( header + 8 );
+        header[20] = CRYPT_FILE_VERSION;
+
+        if ( file_write( f, header, CRYPT_FILE_HEADER ) != CRYPT_FILE_HEADER ) return -1;
+    } else {
+        if ( file_read( f, header, CRYPT_FILE_HEADER ) != CRYPT_FILE_HEADER || memcmp( header, CRYPT_FILE_MAGIC, 8 ) ) {
+            file_rewind( f );
+            return 0;
+        }
+
+        if ( header[20] != CRYPT_FILE_VERSION ) return -1;
+
+        /* Every segment has a tag, the last one may have no data */
+        raw_size = file_size( f ) - CRYPT_FILE_HEADER;
+        if ( raw_size < CHACHA_TAG_SIZE ) return -1;
+    }
+
+    c = ( struct file_crypt * ) calloc( 1, sizeof( struct file_crypt ) );
+    if ( !c ) return -1;
+
+    c->raw = ( file * ) malloc( sizeof( file ) );
+    if ( !c->raw ) {
+        free( c );
+        return -1;
+    }
+    *c->raw = *f;
+
+    memcpy( c->key, file_key, CHACHA_KEY_SIZE );
+    memcpy( c->header, header, CRYPT_FILE_HEADER );
+    c->pos = 0;
+    c->segment = 0;
+    c->used = 0;
+    c->writing = writing;
+
+    f->type = F_CRYPTFILE;
+    f->crypt = c;
+    f->eof = 0;
+    f->error = 0;
+
+    if ( !writing ) {
+        c->segments = ( raw_size + CRYPT_FILE_RAW_SEGMENT - 1 ) / CRYPT_FILE_RAW_SEGMENT;
+        c->size = raw_size - c->segments * CHACHA_TAG_SIZE;
+
+        /* The last segment tells if the file was cut, and checks the key */
+        if ( raw_size - ( c->segments - 1 ) * CRYPT_FILE_RAW_SEGMENT < CHACHA_TAG_SIZE ||
+             file_crypt_get_segment( f, c->segments - 1 ) ) {
+            *f = *c->raw;
+            free( c->raw );
+            free( c );
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+static int file_crypt_read( file * fp, void * buffer, int len ) {
+    struct file_crypt * c = fp->crypt;
+    long segment, offset;
+    int done = 0, n;
+
+    if ( c->writing ) return 0;
+
+    while ( done < len && c->pos < c->size ) {
+        segment = c->pos / CRYPT_FILE_SEGMENT;
+        if ( segment != c->segment && file_crypt_get_segment( fp, segment ) ) break;
+
+        offset = c->pos - segment * CRYPT_FILE_SEGMENT;
+        n = ( len - done > c->used - offset ) ? ( int )( c->used - offset ) : len - done;
+
+        memcpy( ( uint8_t * ) buffer + done, c->buffer + offset, n );
+        c->pos += n;
+        done += n;
+    }
+
+    if ( done < len ) fp->eof = 1;
+
+    return done;
+}
+
+static int file_crypt_write( file * fp, void * buffer, int len ) {
+    struct file_crypt * c = fp->crypt;
+    int done = 0, n;
+
+    if ( !c->writing ) return 0;
+
+    /* A full buffer is written when more data comes, the last segment is
+       written on close */
+    while ( done < len ) {
+        if ( c->used == CRYPT_FILE_SEGMENT && file_crypt_put_segment( fp, 0 ) ) break;
+
+        n = ( len - done > CRYPT_FILE_SEGMENT - c->used ) ? CRYPT_FILE_SEGMENT - c->used : len - done;
+        memcpy( c->buffer + c->used, ( uint8_t * ) buffer + done, n );
+        c->used += n;
+        done += n;
+    }
+
+    c->pos += done;
+    return done;
+}
+
+/* Files being written can't seek */
+
+static int file_crypt_seek( file * fp, long pos, int where ) {
+    struct file_crypt * c = fp->crypt;
+
+    if ( where == SEEK_CUR )        pos += c->pos;
+    else if ( where == SEEK_END )   pos += c->writing ? c->pos : c->size;
+
+    if ( c->writing ) return ( pos == c->pos ) ? 0 : -1;
+
+    if ( pos < 0 ) pos = 0;
+    if ( pos > c->size ) pos = c->size;
+
+    c->pos = pos;
+    fp->eof = 0;
+
+    return 0;
+}
+
+static char * file_crypt_gets( file * fp, char * buffer, int len ) {
+    long start = fp->crypt->pos;
+    int n, l;
+
+    if ( len < 1 ) return NULL;
+
+    n = file_crypt_read( fp, buffer, len - 1 );
+    for ( l = 0; l < n; ) if ( buffer[l++] == '\n' ) break;
+    buffer[l] = 0;
+
+    if ( l < n ) file_crypt_seek( fp, start + l, SEEK_SET );
+
+    return l ? buffer : NULL;
+}
+
+static void file_crypt_close( file * fp ) {
+    struct file_crypt * c = fp->crypt;
+
+    if ( c->writing ) file_crypt_put_segment( fp, 1 );
+
+    file_crypt_close_raw( c->raw );
+    free( c->raw );
+    free( c );
+}
+
+/* ---------------------------------------------------------------------- */
+
 /* Read a datablock from file */
 
 int file_read( file * fp, void * buffer, int len ) {
     if ( !fp || !len ) return 0;
 
+    if ( fp->type == F_CRYPTFILE ) return file_crypt_read( fp, buffer, len );
+
     if ( fp->type == F_XFILE ) {
         XFILE * xf;
         int result;
@@ -196,6 +517,9 @@ int file_qgets( file * fp, char * buffer, int len ) {
 
         if ( !l ) return 0;
     }
+    else if ( fp->type == F_CRYPTFILE ) {
+        result = file_crypt_gets( fp, buffer, len );
+    }
 #ifndef NO_ZLIB
     else if ( fp->type == F_GZFILE ) {
         result = gzgets( fp->gz, buffer, len );
@@ -266,6 +590,9 @@ int file_gets( file * fp, char * buffer, int len ) {
 
         if ( !l ) return 0;
     }
+    else if ( fp->type == F_CRYPTFILE ) {
+        result = file_crypt_gets( fp, buffer, len );
+    }
 #ifndef NO_ZLIB
     else if ( fp->type == F_GZFILE ) {
         result = gzgets( fp->gz, buffer, len );
@@ -526,6 +853,8 @@ int file_write( file * fp, void * buffer, int len ) {
         return result;
     }
 
+    if ( fp->type == F_CRYPTFILE ) return file_crypt_write( fp, buffer, len );
+
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) {
         int result = gzwrite( fp->gz, buffer, len );
@@ -546,6 +875,8 @@ int file_size( file * fp ) {
 
     if ( fp->type == F_XFILE ) return x_file[fp->n].size;
 
+    if ( fp->type == F_CRYPTFILE ) return fp->crypt->writing ? fp->crypt->pos : fp->crypt->size;
+
     pos = file_pos( fp );
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) {
@@ -568,6 +899,8 @@ int file_size( file * fp ) {
 int file_pos( file * fp ) {
     if ( fp->type == F_XFILE ) return fp->pos - x_file[fp->n].offset;
 
+    if ( fp->type == F_CRYPTFILE ) return fp->crypt->pos;
+
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) return gztell( fp->gz );
 #endif
@@ -578,6 +911,8 @@ int file_pos( file * fp ) {
 int file_flush( file * fp ) {
     if ( fp->type == F_XFILE ) return 0;
 
+    if ( fp->type == F_CRYPTFILE ) return fp->crypt->writing ? file_flush( fp->crypt->raw ) : 0;
+
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) return 0;
 #endif
@@ -601,6 +936,8 @@ int file_seek( file * fp, int pos, int where ) {
         return pos;
     }
 
+    if ( fp->type == F_CRYPTFILE ) return file_crypt_seek( fp, pos, where );
+
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) {
         assert( fp->gz );
@@ -620,6 +957,10 @@ void file_rewind( file * fp ) {
             fp->pos = x_file[fp->n].offset;
             break;
 
+        case F_CRYPTFILE:
+            file_crypt_seek( fp, 0, SEEK_SET );
+            break;
+
 #ifndef NO_ZLIB
         case F_GZFILE:
             gzrewind( fp->gz );
@@ -648,7 +989,7 @@ static int open_raw( file * f, const char * filename, const char * mode ) {
 
     p = _mode;
     while ( *mode ) {
-        if ( *mode != '0' ) {
+        if ( *mode != '0' && *mode != 'c' ) {
             *p = *mode;
             p++;
         }
@@ -663,6 +1004,29 @@ static int open_raw( file * f, const char * filename, const char * mode ) {
     return 0;
 }
 
+/* Count the opened file and layer a crypted file over it if needed */
+
+static file * file_opened( file * f, const char * mode ) {
+    int r = 0;
+
+    opened_files++;
+
+    if ( file_key_set ) {
+        if ( strchr( mode, 'w' ) ) {
+            if ( strchr( mode, 'c' ) ) r = file_crypt_open( f, 1 );
+        } else if ( !strchr( mode, '+' ) && !strchr( mode, 'a' ) ) {
+            r = file_crypt_open( f, 0 );
+        }
+    }
+
+    if ( r < 0 ) {
+        file_close( f );
+        return NULL;
+    }
+
+    return f;
+}
+
 file * file_open( const char * filename, char * mode ) {
     char work [__MAX_PATH];
     char here [__MAX_PATH];
@@ -673,6 +1037,9 @@ file * file_open( const char * filename, char * mode ) {
 
     file * f;
 
+    /* A crypted write without a key would silently write plain text */
+    if ( strchr( mode, 'c' ) && strchr( mode, 'w' ) && !file_key_set ) return NULL;
+
     f = ( file * ) calloc( 1, sizeof( file ) );
     assert( f );
 
@@ -685,10 +1052,7 @@ file * file_open( const char * filename, char * mode ) {
 
     filename = f->name;
 
-    if ( open_raw( f, filename, mode ) ) {
-        opened_files++;
-        return f;
-    }
+    if ( open_raw( f, filename, mode ) ) return file_opened( f, mode );
 
 
     /* if real file don't exists in disk */
@@ -703,8 +1067,7 @@ file * file_open( const char * filename, char * mode ) {
                 f->n    = i;
                 f->fp = fopen( x_file[i].stubname, "rb" );
 
-                opened_files++;
-                return f;
+                return file_opened( f, mode );
             }
         }
     }
@@ -725,19 +1088,13 @@ file * file_open( const char * filename, char * mode ) {
         strcpy( here, strrchr( name, '.' ) + 1 );
         strcat( here, PATH_SEP );
         strcat( here, name );
-        if ( open_raw( f, here, mode ) ) {
-            opened_files++;
-            return f;
-        }
+        if ( open_raw( f, here, mode ) ) return file_opened( f, mode );
     }
 
     for ( i = 0; possible_paths[i]; i++ ) {
         strcpy( here, possible_paths[i] );
         strcat( here, name );
-        if ( open_raw( f, here, mode ) ) {
-            opened_files++;
-            return f;
-        }
+        if ( open_raw( f, here, mode ) ) return file_opened( f, mode );
     }
 
     free( f );
@@ -748,6 +1105,7 @@ file * file_open( const char * filename, char * mode ) {
 
 void file_close( file * fp ) {
     if ( fp == NULL ) return;
+    if ( fp->type == F_CRYPTFILE ) file_crypt_close( fp );
     if ( fp->type == F_FILE || fp->type == F_XFILE ) fclose( fp->fp );
 #ifndef NO_ZLIB
     if ( fp->type == F_GZFILE ) gzclose( fp->gz );
@@ -804,7 +1162,7 @@ int file_exists( const char * filename ) {
 /* Check for file end is reached */
 
 int file_eof( file * fp ) {
-    if ( fp->type == F_XFILE ) {
+    if ( fp->type == F_XFILE || fp->type == F_CRYPTFILE ) {
         return fp->eof ? 1 : 0;
     }
 
@@ -827,6 +1185,8 @@ FILE * file_fp( file * f ) {
         return f->fp;
     }
 
+    if ( f->type == F_CRYPTFILE ) return NULL;
+
     return f->fp;
 }
 
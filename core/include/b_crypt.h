@@ -24,12 +24,14 @@
  *
  */
 
-
-#if USE_CRYPT
-
 #ifndef __B_CRYPT_H
 #define __B_CRYPT_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+#if USE_CRYPT
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef USE_LIBDES
@@ -70,7 +72,57 @@ extern crypt_handle * crypt_create( int method, char * key );
 extern void crypt_destroy( crypt_handle * ch );
 extern int crypt_data( crypt_handle * ch, char * in, char * out, int size, int enc );
 
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Stream cipher: ChaCha20 + Poly1305 (RFC 8439)                             */
+/* ------------------------------------------------------------------------- */
+
+#define CHACHA_KEY_SIZE     32
+#define CHACHA_NONCE_SIZE   12
+#define CHACHA_BLOCK_SIZE   64
+#define CHACHA_TAG_SIZE     16
+
+typedef struct {
+    uint32_t state[16];
+} chacha_ctx;
+
+typedef struct {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+    uint8_t buffer[16];
+    size_t leftover;
+} poly1305_ctx;
+
+/* Chunked authenticated encryption. The data is ciphered from block 1 of
+   the key stream and the tag covers the additional data and the ciphered
+   data, as the AEAD construction of RFC 8439 */
+
+typedef struct {
+    chacha_ctx cipher;
+    poly1305_ctx mac;
+    uint64_t aad_size;
+    uint64_t data_size;
+} crypt_stream;
+
+/* ------------------------------------------------------------------------- */
+
+extern void chacha_init( chacha_ctx * ctx, const uint8_t * key, const uint8_t * nonce );
+extern void chacha_crypt( const chacha_ctx * ctx, uint64_t offset, uint8_t * data, size_t size );
+
+extern void poly1305_init( poly1305_ctx * ctx, const uint8_t * key );
+extern void poly1305_update( poly1305_ctx * ctx, const uint8_t * data, size_t size );
+extern void poly1305_finish( poly1305_ctx * ctx, uint8_t * tag );
+
+extern void crypt_stream_init( crypt_stream * cs, const uint8_t * key, const uint8_t * nonce, const uint8_t * aad, size_t aad_size );
+extern void crypt_stream_xor( const crypt_stream * cs, uint64_t offset, uint8_t * data, size_t size );
+extern void crypt_stream_authenticate( crypt_stream * cs, const uint8_t * data, size_t size );
+extern void crypt_stream_encrypt( crypt_stream * cs, uint8_t * data, size_t size );
+extern void crypt_stream_decrypt( crypt_stream * cs, uint8_t * data, size_t size );
+extern void crypt_stream_tag( crypt_stream * cs, uint8_t * tag );
+extern int crypt_stream_verify( crypt_stream * cs, const uint8_t * tag );
+
 /* ------------------------------------------------------------------------- */
 
-#endif
 #endif
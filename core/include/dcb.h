@@ -249,6 +249,8 @@ typedef struct {
 extern DCB_HEADER dcb;
 
 extern void sysprocs_fixup( void );
+extern void sysprocs_bind( void );
 extern int64_t getid( char * name );
+extern int64_t dcb_source_count( int64_t n );
 
 #endif
@@ -100,6 +100,8 @@ extern int    file_eof         (file * fp) ;
 extern FILE * file_fp          (file * fp) ;
 
 extern void   xfile_init       (int maxfiles);
+extern void   file_crypt_key   (const uint8_t * key);
+extern int    file_crypt_keyed (void);
 
 extern int    opened_files;
 
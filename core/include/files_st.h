@@ -38,6 +38,7 @@
 #define F_XFILE  1
 #define F_FILE   2
 #define F_GZFILE 3
+#define F_CRYPTFILE 4
 
 #ifndef NO_ZLIB
 #include <zlib.h>
@@ -71,6 +72,8 @@
 #define PATH_SLASH
 #endif
 
+struct file_crypt;
+
 typedef struct {
     int     type;
 
@@ -83,6 +86,7 @@ typedef struct {
 	char	name[__MAX_PATH];
 	long    pos;
 	int     eof;
+    struct file_crypt * crypt;
 } file;
 
 #endif
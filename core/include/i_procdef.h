@@ -38,10 +38,15 @@ extern PROCDEF * mainproc;
 extern PROCDEF * procs;
 extern int64_t procdef_count;
 
+typedef int ( * PROCDEF_FILTER )( PROCDEF * );
+
 extern PROCDEF  * procdef_get( int64_t n );
 extern PROCDEF  * procdef_get_by_name(char * name );
 extern SYSPROC  * sysproc_get( int64_t code );
 extern int64_t    sysproc_add( char * name, char * paramtypes, int64_t type, void * func );
 extern void       sysproc_init();
 
+extern int64_t    procdef_calls( PROCDEF * proc, void * func );
+extern void       instance_hook_filter( void ( * hook )( INSTANCE * ), PROCDEF_FILTER filter );
+
 #endif
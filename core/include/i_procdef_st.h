@@ -60,6 +60,28 @@ typedef struct _procdef {
 	char * name;
 
     int64_t breakpoint;
+
+    /* Initial stack size in bytes, 0 if unknown, see procdef_stack_size */
+
+    int64_t stack_size;
+
+    /* Instance hooks that apply to this process, see instance_hook_filter */
+
+    void ( ** process_exec_hooks )( INSTANCE * );
+    int64_t process_exec_hook_count;
+    void ( ** pre_execute_hooks )( INSTANCE * );
+    int64_t pre_execute_hook_count;
+    void ( ** pos_execute_hooks )( INSTANCE * );
+    int64_t pos_execute_hook_count;
+
+    /* Live instances of this process, see instance_add_to_list_by_type */
+
+    INSTANCE ** instances;
+    int64_t * instance_serials;
+    int64_t instance_used;
+    int64_t instance_count;
+    int64_t instance_reserved;
+    int64_t instance_serial;
 } PROCDEF;
 
 #define PROC_USES_FRAME 	0x01
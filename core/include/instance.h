@@ -49,15 +49,19 @@ extern INSTANCE * first_instance ;
 extern INSTANCE * last_instance ;
 
 extern int64_t instance_getid() ;
+extern void instance_setmaxid( int64_t id ) ;
 extern INSTANCE * instance_get( int64_t id ) ;
 extern INSTANCE * instance_get_by_type( uint64_t type, INSTANCE ** context ) ;
+extern int64_t instance_count_by_type( uint64_t type ) ;
 extern INSTANCE * instance_getfather( INSTANCE * i ) ;
 extern INSTANCE * instance_getson( INSTANCE * i ) ;
 extern INSTANCE * instance_getbigbro( INSTANCE * i ) ;
 extern INSTANCE * instance_getsmallbro( INSTANCE * i ) ;
 extern INSTANCE * instance_new( PROCDEF * proc, INSTANCE * father ) ;
 extern INSTANCE * instance_duplicate( INSTANCE * i ) ;
+extern void instance_stack_grow( INSTANCE * r, int64_t slots ) ;
 extern void instance_destroy( INSTANCE * r ) ;
+extern void instance_destroy_all( INSTANCE * except ) ;
 extern void instance_dump( INSTANCE * father, int64_t indent ) ;
 extern void instance_dump_all() ;
 extern void instance_posupdate( INSTANCE * i ) ;
@@ -69,6 +73,15 @@ extern void instance_dirty( INSTANCE * i ) ;
 
 extern void instance_reset_iterator_by_priority() ;
 
+#ifdef __BGDRTM__
+extern INSTANCE ** hashed_by_priority ;
+
+extern void instance_add_to_list_by_id( INSTANCE * r, uint64_t id ) ;
+extern void instance_add_to_list_by_instance( INSTANCE * r ) ;
+extern void instance_add_to_list_by_type( INSTANCE * r, uint64_t itype ) ;
+extern void instance_add_to_list_by_priority( INSTANCE * r, int64_t priority ) ;
+#endif
+
 /* The following functions are the entry points of the interpreter. */
 
 extern int64_t instance_go( INSTANCE * r ) ;
@@ -36,6 +36,12 @@
 #define STACK_SIZE_MASK     0x7FFF
 #define STACK_SIZE          2048
 
+/* Stacks start at the size computed for the process, plus STACK_RESERVE
+   slots, and grow as needed up to STACK_SIZE_MAX bytes */
+
+#define STACK_RESERVE       8
+#define STACK_SIZE_MAX      ( STACK_SIZE_MASK & ~( int64_t ) 7 )
+
 /* ---------------------------------------------------------------------- */
 /* Instances. An instance is created from a process, but in reality,      */
 /* it is independent of the original process.                             */
@@ -72,10 +78,9 @@ typedef struct _instance {
     struct _instance * prev_by_priority;
     int64_t last_priority;
 
-    /* Linked list by process_type */
+    /* Position in the instances of its process_type, -1 if none */
 
-    struct _instance * next_by_type;
-    struct _instance * prev_by_type;
+    int64_t type_index;
 
     /* Linked list by INSTANCE * */
 
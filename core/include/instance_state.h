@@ -0,0 +1,45 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+#ifndef __INSTANCE_STATE_H
+#define __INSTANCE_STATE_H
+
+#include <stdint.h>
+
+#include "files.h"
+
+/* ---------------------------------------------------------------------- */
+/* Save and restore of the whole process tree                             */
+/* ---------------------------------------------------------------------- */
+
+extern int64_t instance_state_save( file * fp ) ;
+extern void * instance_state_read( file * fp ) ;
+extern int64_t instance_state_restore( void * state ) ;
+extern void instance_state_free( void * state ) ;
+
+#endif
@@ -39,4 +39,10 @@
     int64_t savetypes( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars, int64_t dcbformat );
     int64_t loadtypes( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars, int64_t dcbformat );
 
+    int64_t savetypes_snapshot( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars );
+    int64_t loadtypes_snapshot( file * fp, void * data, DCB_TYPEDEF * var, int64_t nvars );
+
+    int64_t varspace_strings( DCB_VAR * var, int64_t nvars, int64_t ** offsets );
+    int64_t varspace_pointers( DCB_VAR * var, int64_t nvars, int64_t ** offsets );
+
 #endif
@@ -145,6 +145,7 @@ GRAPH * bitmap_new( int64_t code, int64_t width, int64_t height, SDL_Surface * s
 #ifdef USE_SDL2
     gr->tex = NULL;
     gr->texture_must_update = 0;
+    memset( &gr->update_rect, 0, sizeof( gr->update_rect ) );
 #endif
 
     gr->width = w;
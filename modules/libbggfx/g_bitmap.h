@@ -43,6 +43,11 @@
 #define BITMAP_TEXTURE_STREAMING    4           // SDL_TEXTUREACCESS_STREAMING
 #define BITMAP_TEXTURE_TARGET       8           // SDL_TEXTUREACCESS_TARGET
 
+// texture_must_update
+
+#define BITMAP_UPDATE_ALL           1           // Whole surface
+#define BITMAP_UPDATE_RECT          2           // Only update_rect
+
 #define CPOINT_UNDEFINED            0x7fff   /* It's enough if X is set to this value */
 #define POINT_UNDEFINED             0x7ffffff
 
@@ -99,6 +104,7 @@ typedef struct {
 #ifdef USE_SDL2
     SDL_Texture     * tex;
     int64_t         texture_must_update;
+    SDL_Rect        update_rect;
 #endif
 #ifdef USE_SDL2_GPU
     GPU_Image       * tex;
@@ -49,8 +49,12 @@
 
 #ifdef USE_SDL2
 
+/* Uploads the surface, or only update_rect, to the texture or the segments */
+
 static inline int gr_update_texture( GRAPH * gr ) {
     SDL_Surface * surface;
+    SDL_Rect rect = { 0, 0, gr->surface->w, gr->surface->h }, seg, part, local;
+    int64_t i;
 
 #ifndef __DISABLE_PALETTES__
     if ( gr->surface->format->format == gPixelFormat->format ) {
@@ -63,14 +67,33 @@ static inline int gr_update_texture( GRAPH * gr ) {
     surface = gr->tex;
 #endif
 
-    if ( SDL_MUSTLOCK( surface ) ) {
-        SDL_LockSurface( surface );
-        SDL_UpdateTexture( gr->tex, NULL, surface->pixels, surface->pitch );
-        SDL_UnlockSurface( surface );
+    if ( gr->texture_must_update == BITMAP_UPDATE_RECT ) rect = gr->update_rect;
+
+    if ( SDL_MUSTLOCK( surface ) ) SDL_LockSurface( surface );
+
+#define SURFACE_PIXELS(r) ( ( uint8_t * ) surface->pixels + ( r ).y * surface->pitch + ( r ).x * surface->format->BytesPerPixel )
+
+    if ( gr->tex ) {
+        SDL_UpdateTexture( gr->tex, &rect, SURFACE_PIXELS( rect ), surface->pitch );
     } else {
-        SDL_UpdateTexture( gr->tex, NULL, surface->pixels, surface->pitch );
+        /* The mirrored segments share these textures */
+        for ( i = 0; i < gr->nsegments; i++ ) {
+            seg.x = gr->segments[ i ].offx;
+            seg.y = gr->segments[ i ].offy;
+            seg.w = gr->segments[ i ].width;
+            seg.h = gr->segments[ i ].height;
+            if ( !SDL_IntersectRect( &rect, &seg, &part ) ) continue;
+            local = part;
+            local.x -= seg.x;
+            local.y -= seg.y;
+            SDL_UpdateTexture( gr->segments[ i ].tex, &local, SURFACE_PIXELS( part ), surface->pitch );
+        }
     }
 
+#undef SURFACE_PIXELS
+
+    if ( SDL_MUSTLOCK( surface ) ) SDL_UnlockSurface( surface );
+
 #ifndef __DISABLE_PALETTES__
     if ( surface != gr->surface ) SDL_FreeSurface( surface );
 #endif
@@ -131,6 +154,7 @@ int gr_prepare_renderer( GRAPH * dest, REGION * clip, int64_t flags, BLENDMODE *
                 return 1;
             }
 
+            dest->texture_must_update = BITMAP_UPDATE_ALL;
             gr_update_texture(dest);
 
             dest->type = BITMAP_TEXTURE_TARGET;
@@ -257,6 +281,11 @@ void gr_blit(   GRAPH * dest,
 
     if ( scalex <= 0.0 || scaley <= 0.0 ) return;
 
+#ifdef USE_SDL2
+    /* Graph to graph in software, if enabled */
+    if ( dest && !gr_raster_blit( dest, clip, scrx, scry, flags, angle, scalex, scaley, centerx, centery, gr, gr_clip, alpha, color_r, color_g, color_b ) ) return;
+#endif
+
     /* Create segments if needed */
 
     if ( !gr->tex && !gr->segments ) {
@@ -371,6 +400,7 @@ void gr_blit(   GRAPH * dest,
                 return;
             }
 
+            gr->texture_must_update = BITMAP_UPDATE_ALL;
             gr_update_texture(gr);
         }
         gr->type = BITMAP_TEXTURE_STATIC;
@@ -378,7 +408,7 @@ void gr_blit(   GRAPH * dest,
     }
 
 #ifdef USE_SDL2
-    if ( gr->tex && gr->texture_must_update ) gr_update_texture(gr);
+    if ( ( gr->tex || gr->segments ) && gr->texture_must_update ) gr_update_texture(gr);
 #endif
 
 #ifdef USE_SDL2_GPU
@@ -378,6 +378,97 @@ void draw_rectangles_filled( GRAPH * dest, REGION * clip, int64_t count, SDL_Rec
     points[count++].y = _y; \
 }
 
+#define setSpan(_x,_x2,_y) { \
+    spans[count].x = _x; \
+    spans[count].y = _y; \
+    spans[count].w = ( _x2 ) - ( _x ) + 1; \
+    spans[count++].h = 1; \
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Shapes drawn without a cache share this one */
+
+static DRAW_CACHE * draw_scratch = NULL;
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : draw_cache_find
+ *
+ *  Look for a tessellation of the shape in the cache, moving its items to
+ *  the given origin if it was built for another one
+ *
+ *  PARAMS :
+ *      cache           Cache or NULL
+ *      key             Shape parameters (DRAW_CACHE_KEYS values)
+ *      x, y            Origin
+ *
+ *  RETURN VALUE :
+ *      The cache, or NULL if it must be built again
+ *
+ */
+
+static DRAW_CACHE * draw_cache_find( DRAW_CACHE * cache, int64_t * key, int64_t x, int64_t y ) {
+    int64_t incx, incy, i;
+
+    if ( !cache || memcmp( cache->key, key, sizeof( cache->key ) ) ) return NULL;
+
+    incx = x - cache->x;
+    incy = y - cache->y;
+
+    if ( incx || incy ) {
+        if ( key[ 0 ] == DRAW_CACHE_CIRCLE_FILLED ) {
+            SDL_Rect * p = ( SDL_Rect * ) DRAW_CACHE_ITEMS( cache );
+            for ( i = 0; i < cache->count; i++, p++ ) p->x += incx, p->y += incy;
+        } else {
+            SDL_Point * p = ( SDL_Point * ) DRAW_CACHE_ITEMS( cache );
+            for ( i = 0; i < cache->count; i++, p++ ) p->x += incx, p->y += incy;
+        }
+        cache->x = x;
+        cache->y = y;
+    }
+
+    return cache;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : draw_cache_alloc
+ *
+ *  Prepare a cache to hold a new tessellation of a shape. The cache
+ *  and its items are a single block, released with free()
+ *
+ *  PARAMS :
+ *      cache           Pointer to the cache, allocated or grown if needed
+ *      key             Shape parameters (DRAW_CACHE_KEYS values)
+ *      x, y            Origin
+ *      size            Max items
+ *      item_size       Size of an item
+ *
+ *  RETURN VALUE :
+ *      The empty cache, or NULL if out of memory
+ *
+ */
+
+static DRAW_CACHE * draw_cache_alloc( DRAW_CACHE ** cache, int64_t * key, int64_t x, int64_t y, int64_t size, size_t item_size ) {
+    DRAW_CACHE * dc = * cache;
+
+    size *= item_size;
+
+    if ( !dc || dc->size < size ) {
+        if ( !( dc = realloc( dc, sizeof( DRAW_CACHE ) + size ) ) ) return NULL;
+        dc->size = size;
+        * cache = dc;
+    }
+
+    memcpy( dc->key, key, sizeof( dc->key ) );
+    dc->x = x;
+    dc->y = y;
+    dc->count = 0;
+
+    return dc;
+}
+
 /* --------------------------------------------------------------------------- */
 /*
  *  FUNCTION : draw_circle
@@ -389,26 +480,31 @@ void draw_rectangles_filled( GRAPH * dest, REGION * clip, int64_t count, SDL_Rec
  *      clip            Clipping region or NULL for the whole screen
  *      x, y            Coordinates of the center
  *      r               Radius, in pixels
+ *      cache           Cache for the points, or NULL
  *
  *  RETURN VALUE :
  *      None
  *
  */
 
-void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, int64_t * cache_size, void ** cache ) {
+void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, DRAW_CACHE ** cache ) {
 
 #ifdef USE_SDL2
-    SDL_Point * points;
-    int free_on_exit = 1;
-    int64_t count = 0;
+    int64_t key[ DRAW_CACHE_KEYS ] = { DRAW_CACHE_CIRCLE, r };
+    DRAW_CACHE * dc;
+
+    if ( r < 0 ) return;
+    if ( !cache ) cache = &draw_scratch;
 
-    if ( !cache || !*cache ) {
+    if ( !( dc = draw_cache_find( * cache, key, x, y ) ) ) {
         int64_t cx = 0, cy = r;
         int64_t df = 1 - r, de = 3, dse = -2 * r + 5;
+        int64_t count = 0;
+        SDL_Point * points;
 
-        points = malloc( sizeof( SDL_Point ) * r * 8 );
+        if ( !( dc = draw_cache_alloc( cache, key, x, y, r * 8 + 8, sizeof( SDL_Point ) ) ) ) return;
 
-        if ( !points ) return;
+        points = ( SDL_Point * ) DRAW_CACHE_ITEMS( dc );
 
         do {
             setPoint( x - cx, y - cy );
@@ -434,21 +530,10 @@ void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r,
             else df += dse, de += 2, dse += 4, cy-- ;
         } while ( cx <= cy ) ;
 
-        if ( cache ) {
-            * cache = points;
-            if ( cache_size ) * cache_size = count;
-            free_on_exit = 0;
-        }
-
-    } else {
-        points = ( SDL_Point * ) * cache;
-        count = * cache_size;
-        free_on_exit = 0;
+        dc->count = count;
     }
 
-    draw_points( dest, clip, count, points );
-
-    if ( free_on_exit ) free( points );
+    draw_points( dest, clip, dc->count, ( SDL_Point * ) DRAW_CACHE_ITEMS( dc ) );
 #endif
 #ifdef USE_SDL2_GPU
     DRAW_PREPARE_RENDERER();
@@ -459,95 +544,63 @@ void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r,
 #endif
 }
 
-/* --------------------------------------------------------------------------- */
-
-#ifdef USE_SDL2
-static int _sort_circle_points(const void * a, const void * b ) {
-
-    SDL_Point * _a = ( SDL_Point *) a;
-    SDL_Point * _b = ( SDL_Point *) b;
-
-    if ( _a->y != _b->y ) return _a->y - _b->y;
-    if ( _a->x != _b->x ) {
-        if ( _a->y & 1 ) return _b->x - _a->x;
-        return _a->x - _b->x;
-    }
-    return 0;
-
-}
-#endif
-
 /* --------------------------------------------------------------------------- */
 /*
  *  FUNCTION : draw_circle_filled
  *
- *  Draw a filled circle
+ *  Draw a filled circle, as one horizontal span per row
  *
  *  PARAMS :
  *      dest            Destination bitmap or NULL for screen
  *      clip            Clipping region or NULL for the whole screen
  *      x, y            Coordinates of the center
  *      r               Radius, in pixels
+ *      cache           Cache for the spans, or NULL
  *
  *  RETURN VALUE :
  *      None
  *
  */
 
-void draw_circle_filled( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, int64_t * cache_size, void ** cache ) {
+void draw_circle_filled( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, DRAW_CACHE ** cache ) {
 #ifdef USE_SDL2
-    SDL_Point * points;
-    int free_on_exit = 1;
-    int64_t count = 0;
+    int64_t key[ DRAW_CACHE_KEYS ] = { DRAW_CACHE_CIRCLE_FILLED, r };
+    DRAW_CACHE * dc;
+
+    if ( r < 0 ) return;
+    if ( !cache ) cache = &draw_scratch;
 
-    if ( !cache || !*cache ) {
+    if ( !( dc = draw_cache_find( * cache, key, x, y ) ) ) {
         int64_t cx = 0, cy = r;
         int64_t df = 1 - r, de = 3, dse = -2 * r + 5;
+        int64_t count = 0;
+        SDL_Rect * spans;
 
-        points = malloc( sizeof( SDL_Point ) * r * 8 );
+        if ( !( dc = draw_cache_alloc( cache, key, x, y, r * 2 + 2, sizeof( SDL_Rect ) ) ) ) return;
 
-        if ( !points ) return;
+        spans = ( SDL_Rect * ) DRAW_CACHE_ITEMS( dc );
 
         do {
             if ( cx != cy ) {
-                setPoint(x - cy, y - cx);
-                setPoint(x - cy + cy * 2, y - cx);
-                if ( cx ) {
-                    setPoint(x - cy, y + cx);
-                    setPoint(x - cy + cy * 2, y + cx);
-                }
+                setSpan( x - cy, x + cy, y - cx );
+                if ( cx ) setSpan( x - cy, x + cy, y + cx );
             }
             if ( df < 0 ) {
                 df += de, de += 2, dse += 2 ;
             } else {
                 df += dse, de += 2, dse += 4;
-                setPoint(x - cx, y - cy);
-                setPoint(x - cx + cx * 2, y - cy);
-                if ( cy ) {
-                    setPoint(x - cx, y + cy);
-                    setPoint(x - cx + cx *2, y + cy);
-                }
+                setSpan( x - cx, x + cx, y - cy );
+                if ( cy ) setSpan( x - cx, x + cx, y + cy );
                 cy-- ;
             }
             cx++ ;
         }
         while ( cx <= cy ) ;
 
-        if ( cache ) {
-            * cache = points;
-            if ( cache_size ) * cache_size = count;
-            free_on_exit = 0;
-        }
-
-    } else {
-        points = ( SDL_Point * ) * cache;
-        count = * cache_size;
-        free_on_exit = 0;
+        dc->count = count;
     }
 
-    draw_lines( dest, clip, count, points );
-
-    if ( free_on_exit ) free( points );
+    draw_rectangles_filled( dest, clip, dc->count, ( SDL_Rect * ) DRAW_CACHE_ITEMS( dc ) );
 #endif
 #ifdef USE_SDL2_GPU
     DRAW_PREPARE_RENDERER();
@@ -575,19 +628,23 @@ void draw_circle_filled( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int6
  *          x4, y4      Curve points
  *          level       Curve smoothness (1 to 15, 15 is more)
  *
+ *      cache           Cache for the points, or NULL
+ *
  *  RETURN VALUE :
  *      None
  *
  */
 
-void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x2, int64_t y2, int64_t x3, int64_t y3, int64_t x4, int64_t y4, int64_t level, int64_t * cache_size, void ** cache ) {
+void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x2, int64_t y2, int64_t x3, int64_t y3, int64_t x4, int64_t y4, int64_t level, DRAW_CACHE ** cache ) {
 
-    SDL_Point * points;
-    int free_on_exit = 1;
-    int64_t count = 0;
+    int64_t key[ DRAW_CACHE_KEYS ] = { DRAW_CACHE_CURVE, x2 - x1, y2 - y1, x3 - x1, y3 - y1, x4 - x1, y4 - y1, level };
+    DRAW_CACHE * dc;
 
-    if ( !cache || !*cache ) {
-        double x = ( double ) x1, y = ( double ) y1;
+    if ( !cache ) cache = &draw_scratch;
+
+    if ( !( dc = draw_cache_find( * cache, key, x1, y1 ) ) ) {
+        /* The curve is computed relative to x1, y1, so moving it gives the same points */
+        double x = 0.0, y = 0.0;
         double xp = x, yp = y;
         double delta;
         double dx, d2x, d3x;
@@ -595,6 +652,8 @@ void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x
         double a, b, c;
         int64_t i;
         int64_t n = 1;
+        int64_t count = 0;
+        SDL_Point * points;
 
         /* Compute number of iterations */
 
@@ -607,24 +666,28 @@ void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x
         /* a, b, c are the coefficient of the polynom in target defining the parametric curve */
         /* The computation is done independently for x and y */
 
-        a = ( double )( -x1 + 3 * x2 - 3 * x3 + x4 );
-        b = ( double )( 3 * x1 - 6 * x2 + 3 * x3 );
-        c = ( double )( -3 * x1 + 3 * x2 );
+        x2 -= x1; x3 -= x1; x4 -= x1;
+        y2 -= y1; y3 -= y1; y4 -= y1;
+
+        a = ( double )( 3 * x2 - 3 * x3 + x4 );
+        b = ( double )( - 6 * x2 + 3 * x3 );
+        c = ( double )( 3 * x2 );
 
         d3x = 6 * a * delta * delta * delta;
         d2x = d3x + 2 * b * delta * delta;
         dx = a * delta * delta * delta + b * delta * delta + c * delta;
 
-        a = ( double )( -y1 + 3 * y2 - 3 * y3 + y4 );
-        b = ( double )( 3 * y1 - 6 * y2 + 3 * y3 );
-        c = ( double )( -3 * y1 + 3 * y2 );
+        a = ( double )( 3 * y2 - 3 * y3 + y4 );
+        b = ( double )( - 6 * y2 + 3 * y3 );
+        c = ( double )( 3 * y2 );
 
         d3y = 6 * a * delta * delta * delta;
         d2y = d3y + 2 * b * delta * delta;
         dy = a * delta * delta * delta + b * delta * delta + c * delta;
 
-        points = malloc( sizeof( SDL_Point ) * ( n + 1 ) /* * 2 */ );
-        if ( !points ) return;
+        if ( !( dc = draw_cache_alloc( cache, key, x1, y1, n + 1, sizeof( SDL_Point ) ) ) ) return;
+
+        points = ( SDL_Point * ) DRAW_CACHE_ITEMS( dc );
 
         for ( i = 0; i < n; i++ ) {
             x += dx;
@@ -634,28 +697,17 @@ void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x
             dy += d2y;
             d2y += d3y;
             if (( int64_t )( xp ) != ( int64_t )( x ) || ( int64_t )( yp ) != ( int64_t )( y ) ) {
-                if ( count == 0 ) setPoint( ( int64_t ) xp, ( int64_t ) yp );
-                setPoint( ( int64_t ) x, ( int64_t ) y );
+                if ( count == 0 ) setPoint( x1 + ( int64_t ) xp, y1 + ( int64_t ) yp );
+                setPoint( x1 + ( int64_t ) x, y1 + ( int64_t ) y );
             }
             xp = x;
             yp = y;
         }
 
-        if ( cache ) {
-            * cache = points;
-            if ( cache_size ) * cache_size = count;
-            free_on_exit = 0;
-        }
-
-    } else {
-        points = ( SDL_Point * ) * cache;
-        count = * cache_size;
-        free_on_exit = 0;
+        dc->count = count;
     }
 
-    draw_lines( dest, clip, count, points );
-
-    if ( free_on_exit ) free( points );
+    draw_lines( dest, clip, dc->count, ( SDL_Point * ) DRAW_CACHE_ITEMS( dc ) );
 
 }
 
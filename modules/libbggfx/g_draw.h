@@ -31,6 +31,29 @@
 
 /* --------------------------------------------------------------------------- */
 
+/* Points or spans of a shape, reused while its parameters don't change.
+   The items follow the struct in the same block, released with free() */
+
+enum {
+    DRAW_CACHE_CIRCLE = 1,
+    DRAW_CACHE_CIRCLE_FILLED,
+    DRAW_CACHE_CURVE
+};
+
+#define DRAW_CACHE_KEYS     8
+
+typedef struct {
+    int64_t key[ DRAW_CACHE_KEYS ];     /* Shape and its parameters, relative to x, y */
+    int64_t x;                          /* Origin of the items */
+    int64_t y;
+    int64_t count;                      /* Items in use */
+    int64_t size;                       /* Bytes allocated for items */
+} DRAW_CACHE;
+
+#define DRAW_CACHE_ITEMS(dc)    ( ( void * ) ( ( DRAW_CACHE * ) ( dc ) + 1 ) )
+
+/* --------------------------------------------------------------------------- */
+
 extern int64_t drawing_blend_mode;
 extern CUSTOM_BLENDMODE drawing_custom_blendmode;
 
@@ -55,9 +78,9 @@ extern void draw_lines( GRAPH * dest, REGION * clip, int64_t count, SDL_Point *
 extern void draw_rectangles( GRAPH * dest, REGION * clip, int64_t count, SDL_Rect * rects );
 extern void draw_rectangles_filled( GRAPH * dest, REGION * clip, int64_t count, SDL_Rect * rects );
 #endif
-extern void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, int64_t * cache_size, void ** cache );
-extern void draw_circle_filled( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, int64_t * cache_size, void ** cache );
-extern void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x2, int64_t y2, int64_t x3, int64_t y3, int64_t x4, int64_t y4, int64_t level, int64_t * cache_size, void ** cache );
+extern void draw_circle( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, DRAW_CACHE ** cache );
+extern void draw_circle_filled( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, DRAW_CACHE ** cache );
+extern void draw_bezier( GRAPH * dest, REGION * clip, int64_t x1, int64_t y1, int64_t x2, int64_t y2, int64_t x3, int64_t y3, int64_t x4, int64_t y4, int64_t level, DRAW_CACHE ** cache );
 
 #ifdef USE_SDL2_GPU
 extern void draw_arc( GRAPH * dest, REGION * clip, int64_t x, int64_t y, int64_t r, int64_t start_angle, int64_t end_angle );
@@ -38,48 +38,109 @@
 
 #include "fmath.h"
 
+/* -------------------------------------------------------------------------- */
+/* Screen effects                                                             */
+/* -------------------------------------------------------------------------- */
+/*
+ * Fade, tint, flash, letterbox and vignette are drawn together by a single
+ * object over everything else, in that order: tint, vignette, flash,
+ * letterbox and fade. Each value moves linearly to its target on a clock
+ * in usecs that stops while the system is paused. Nothing is drawn when
+ * every effect is at rest and has no visible result.
+ */
+
+#define FX_VIGNETTE_SIZE    64
+
+/* Value moving from "from" to "to" between start and start + duration (usecs) */
+
+typedef struct {
+    double from;
+    double to;
+    int64_t start;
+    int64_t duration;
+} FX_VALUE;
+
 /* -------------------------------------------------------------------------- */
 
 int fade_on = 0;
 int fade_set = 0;
 
-static int fade_to_r = 0;
-static int fade_to_g = 0;
-static int fade_to_b = 0;
-static int fade_to_a = 0;
+int fade_region = 0;
 
-static double fade_pos_r = 0.0;
-static double fade_pos_g = 0.0;
-static double fade_pos_b = 0.0;
-static double fade_pos_a = 0.0;
+static FX_VALUE fade_color[ 4 ] = { { 0 } };                            /* r, g, b, a */
+static FX_VALUE tint_color[ 3 ] = { { 255, 255 }, { 255, 255 }, { 255, 255 } };
+static FX_VALUE flash_power = { 0 };
+static int flash_r = 0, flash_g = 0, flash_b = 0;
+static FX_VALUE letterbox_size = { 0 };
+static FX_VALUE vignette_power = { 0 };
 
-static int fade_time_pos;
-static double fade_time_step;
+static GRAPH * vignette_graph = NULL;
 
-int fade_region = 0;
+/* Effects clock and its values for the current frame */
+
+static int64_t fx_clock = 0;
+static int64_t fx_last_ticks = 0;
+
+static double fade_pos[ 4 ], tint_pos[ 3 ], flash_pos, letterbox_pos, vignette_pos;
+
+/* -------------------------------------------------------------------------- */
+
+static double fx_value( FX_VALUE * v ) {
+    int64_t elapsed = fx_clock - v->start;
+
+    if ( elapsed >= v->duration ) return v->to;
+    if ( elapsed <= 0 ) return v->from;
+
+    return v->from + ( v->to - v->from ) * elapsed / v->duration;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int fx_running( FX_VALUE * v ) {
+    return fx_clock - v->start < v->duration && v->from != v->to;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* Starts moving to "to" from the current value, duration in milliseconds */
+
+static void fx_move( FX_VALUE * v, double to, int64_t duration ) {
+    v->from = fx_value( v );
+    v->to = to;
+    v->start = fx_clock;
+    v->duration = duration > 0 ? duration * 1000 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void fx_update_clock() {
+    int64_t now = frame_get_ticks();
+
+    if ( fx_last_ticks && !system_paused && !debugger_show_console ) fx_clock += now - fx_last_ticks;
+    fx_last_ticks = now;
+}
 
 /* -------------------------------------------------------------------------- */
 /* duration = milliseconds                                                    */
 
 void gr_fade_init( int r, int g, int b, int a, int duration, int region ) {
+    double to[ 4 ] = { r, g, b, a }, max = 0.0;
+    int n;
 
-    if ( ( int ) fade_pos_a == 0 ) fade_pos_r = fade_pos_g = fade_pos_b = 0.0;
-
-    double  dif_r = ( double ) r - fade_pos_r,
-            dif_g = ( double ) g - fade_pos_g,
-            dif_b = ( double ) b - fade_pos_b,
-            dif_a = ( double ) a - fade_pos_a;
+    fx_update_clock();
 
-    double max = MAX( ABS( dif_r ), MAX( ABS( dif_g ), MAX( ABS( dif_b ), ABS( dif_a ) ) ) );
+    if ( ( int ) fx_value( &fade_color[ 3 ] ) == 0 ) {
+        for ( n = 0; n < 3; n++ ) fade_color[ n ].to = fade_color[ n ].from = 0.0;
+    }
 
-    if ( ( int ) max > 0 ) fade_time_step = duration / max; else fade_time_step = 0.0;
+    for ( n = 0; n < 4; n++ ) max = MAX( max, ABS( to[ n ] - fx_value( &fade_color[ n ] ) ) );
 
-    fade_time_pos = SDL_GetTicks();
+    /* Every channel moves at the same speed, the farthest one takes the whole duration */
 
-    fade_to_r = r;
-    fade_to_g = g;
-    fade_to_b = b;
-    fade_to_a = a;
+    for ( n = 0; n < 4; n++ ) {
+        double dif = ABS( to[ n ] - fx_value( &fade_color[ n ] ) );
+        fx_move( &fade_color[ n ], to[ n ], ( int ) max > 0 ? ( int64_t ) ( duration * dif / max ) : 0 );
+    }
 
     fade_on = 1;
 
@@ -90,95 +151,207 @@ void gr_fade_init( int r, int g, int b, int a, int duration, int region ) {
 
 /* -------------------------------------------------------------------------- */
 
-static void gr_fade_step() {
-    double delta;
-    int currtime = SDL_GetTicks();
+void gr_tint_init( int r, int g, int b, int duration ) {
+    fx_update_clock();
 
-    if ( fade_on ) {
-        fade_set = 1;
-        GLOQWORD( libbggfx, FADING ) = 1;
-
-        if ( system_paused || debugger_show_console ) fade_time_pos = currtime;
-
-        if ( fade_time_step == 0.0 ) {
-            fade_pos_r = fade_to_r;
-            fade_pos_g = fade_to_g;
-            fade_pos_b = fade_to_b;
-            fade_pos_a = fade_to_a;
-
-        } else if ( ( delta = ( currtime - fade_time_pos ) / fade_time_step ) != 0 ) {
-            if ( fade_pos_r < fade_to_r ) {
-                fade_pos_r = fade_pos_r + delta; if ( fade_pos_r > fade_to_r ) fade_pos_r = fade_to_r;
-            } else if ( fade_pos_r > fade_to_r ) {
-                fade_pos_r = fade_pos_r - delta; if ( fade_pos_r < fade_to_r ) fade_pos_r = fade_to_r;
-            }
-            if ( fade_pos_g < fade_to_g ) {
-                fade_pos_g = fade_pos_g + delta; if ( fade_pos_g > fade_to_g ) fade_pos_g = fade_to_g;
-            } else if ( fade_pos_g > fade_to_g ) {
-                fade_pos_g = fade_pos_g - delta; if ( fade_pos_g < fade_to_g ) fade_pos_g = fade_to_g;
-            }
-            if ( fade_pos_b < fade_to_b ) {
-                fade_pos_b = fade_pos_b + delta; if ( fade_pos_b > fade_to_b ) fade_pos_b = fade_to_b;
-            } else if ( fade_pos_b > fade_to_b ) {
-                fade_pos_b = fade_pos_b - delta; if ( fade_pos_b < fade_to_b ) fade_pos_b = fade_to_b;
-            }
-            if ( fade_pos_a < fade_to_a ) {
-                fade_pos_a = fade_pos_a + delta; if ( fade_pos_a > fade_to_a ) fade_pos_a = fade_to_a;
-            } else if ( fade_pos_a > fade_to_a ) {
-                fade_pos_a = fade_pos_a - delta; if ( fade_pos_a < fade_to_a ) fade_pos_a = fade_to_a;
-            }
-            fade_time_pos = currtime;
+    fx_move( &tint_color[ 0 ], r, duration );
+    fx_move( &tint_color[ 1 ], g, duration );
+    fx_move( &tint_color[ 2 ], b, duration );
+}
+
+/* -------------------------------------------------------------------------- */
+
+void gr_flash_init( int r, int g, int b, int duration ) {
+    fx_update_clock();
+
+    flash_r = r;
+    flash_g = g;
+    flash_b = b;
+
+    /* Starts at full power and goes off */
+    flash_power.to = 255.0;
+    flash_power.start = fx_clock;
+    flash_power.duration = 0;
+    fx_move( &flash_power, 0.0, duration );
+}
+
+/* -------------------------------------------------------------------------- */
+
+void gr_letterbox_init( int size, int duration ) {
+    fx_update_clock();
+    fx_move( &letterbox_size, MAX( size, 0 ), duration );
+}
+
+/* -------------------------------------------------------------------------- */
+
+void gr_vignette_init( int power, int duration ) {
+    fx_update_clock();
+    fx_move( &vignette_power, MAX( 0, MIN( power, 255 ) ), duration );
+}
+
+/* -------------------------------------------------------------------------- */
+
+static GRAPH * gr_vignette_graph() {
+    SDL_Surface * surface;
+    int x, y;
+    double dx, dy, d;
+
+    if ( vignette_graph ) return vignette_graph;
+
+    surface = SDL_CreateRGBSurface( 0, FX_VIGNETTE_SIZE, FX_VIGNETTE_SIZE, 32, gPixelFormat->Rmask, gPixelFormat->Gmask, gPixelFormat->Bmask, gPixelFormat->Amask );
+    if ( !surface ) return NULL;
 
+    /* Black, transparent in the center and opaque in the corners */
+    for ( y = 0; y < FX_VIGNETTE_SIZE; y++ ) {
+        uint32_t * row = ( uint32_t * ) ( ( uint8_t * ) surface->pixels + y * surface->pitch );
+        for ( x = 0; x < FX_VIGNETTE_SIZE; x++ ) {
+            dx = ( x + 0.5 ) / ( FX_VIGNETTE_SIZE / 2.0 ) - 1.0;
+            dy = ( y + 0.5 ) / ( FX_VIGNETTE_SIZE / 2.0 ) - 1.0;
+            d = ( dx * dx + dy * dy ) / 2.0;
+            row[ x ] = SDL_MapRGBA( surface->format, 0, 0, 0, ( uint8_t ) ( 255.0 * MIN( d, 1.0 ) ) );
         }
     }
 
-    if ( fade_set ) {
-        REGION * region = region_get( fade_region );
+    vignette_graph = bitmap_new( 0, 0, 0, surface );
+    SDL_FreeSurface( surface );
+
+    return vignette_graph;
+}
+
+/* -------------------------------------------------------------------------- */
 
+static void gr_fx_fill( REGION * region, double x, double y, double w, double h, BLENDMODE blend, int r, int g, int b, int a ) {
 #ifdef USE_SDL2
-        SDL_RenderSetClipRect( gRenderer, NULL );
+    SDL_Rect rect;
+
+    if ( w <= 0 || h <= 0 ) return;
+
+    rect.x = region->x + x;
+    rect.y = region->y + y;
+    rect.w = w;
+    rect.h = h;
+
+    SDL_SetRenderDrawBlendMode( gRenderer, blend );
+    SDL_SetRenderDrawColor( gRenderer, r, g, b, a );
+    SDL_RenderFillRect( gRenderer, &rect );
+#endif
+#ifdef USE_SDL2_GPU
+    SDL_Color color;
+
+    if ( w <= 0 || h <= 0 ) return;
+
+    color.r = r; color.g = g; color.b = b; color.a = a;
+
+    GPU_SetShapeBlending( GPU_TRUE );
+    GPU_SetShapeBlendMode( blend );
+    GPU_RectangleFilled( gRenderer, region->x + x, region->y + y, region->x + x + w, region->y + y + h, color );
+    GPU_SetShapeBlending( GPU_FALSE );
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void gr_fade_step() {
+    REGION * region, screen;
+    double w, h;
+
+    screen.x = screen.y = 0;
+    screen.x2 = scr_width - 1;
+    screen.y2 = scr_height - 1;
+    w = screen.x2 + 1;
+    h = screen.y2 + 1;
+
+#ifdef USE_SDL2
+    SDL_RenderSetClipRect( gRenderer, NULL );
 #else
-        GPU_UnsetClip( gRenderer );
+    GPU_UnsetClip( gRenderer );
 #endif
-        if ( !fade_on && ( int ) fade_pos_a == 0 ) fade_set = 0;
 
-        shader_deactivate();
+    shader_deactivate();
 
+    /* Tint */
+
+    if ( ( int ) tint_pos[ 0 ] != 255 || ( int ) tint_pos[ 1 ] != 255 || ( int ) tint_pos[ 2 ] != 255 )
 #ifdef USE_SDL2
-        SDL_SetRenderDrawBlendMode( gRenderer, SDL_BLENDMODE_BLEND );
-        SDL_SetRenderDrawColor( gRenderer, fade_pos_r, fade_pos_g, fade_pos_b, fade_pos_a );
-
-        SDL_Rect r;
-        if ( region ) {
-            r.x = region->x;
-            r.y = region->y;
-            r.w = region->x2 - region->x + 1;
-            r.h = region->y2 - region->y + 1;
-        }
+        gr_fx_fill( &screen, 0, 0, w, h, SDL_BLENDMODE_MOD, tint_pos[ 0 ], tint_pos[ 1 ], tint_pos[ 2 ], 255 );
+#else
+        gr_fx_fill( &screen, 0, 0, w, h, GPU_BLEND_MULTIPLY, tint_pos[ 0 ], tint_pos[ 1 ], tint_pos[ 2 ], 255 );
+#endif
+
+    /* Vignette */
+
+    if ( ( int ) vignette_pos && gr_vignette_graph() )
+        gr_blit( NULL, NULL, w / 2.0, h / 2.0, 0, 0, w * 100.0 / FX_VIGNETTE_SIZE, h * 100.0 / FX_VIGNETTE_SIZE, POINT_UNDEFINED, POINT_UNDEFINED, vignette_graph, NULL, ( uint8_t ) vignette_pos, 255, 255, 255, BLEND_DISABLED, NULL );
+
+    /* Flash */
 
-        SDL_RenderFillRect( gRenderer, !region ? NULL : &r );
+    if ( ( int ) flash_pos )
+#ifdef USE_SDL2
+        gr_fx_fill( &screen, 0, 0, w, h, SDL_BLENDMODE_ADD, flash_r, flash_g, flash_b, flash_pos );
+#else
+        gr_fx_fill( &screen, 0, 0, w, h, GPU_BLEND_ADD, flash_r, flash_g, flash_b, flash_pos );
 #endif
-#ifdef USE_SDL2_GPU
-        SDL_Color color;
-        color.r = fade_pos_r; color.g = fade_pos_g; color.b = fade_pos_b; color.a = fade_pos_a;
 
-        GPU_SetShapeBlending( GPU_TRUE );
-        if ( region )   GPU_RectangleFilled( gRenderer, region->x, region->y, region->x2 + 1, region->y2 + 1, color );
-        else            GPU_RectangleFilled( gRenderer, 0.0, 0.0, gRenderer->w, gRenderer->h, color );
-        GPU_SetShapeBlending( GPU_FALSE );
+    /* Letterbox */
+
+    if ( ( int ) letterbox_pos ) {
+        double size = MIN( letterbox_pos, h / 2.0 );
+#ifdef USE_SDL2
+        gr_fx_fill( &screen, 0, 0, w, size, SDL_BLENDMODE_NONE, 0, 0, 0, 255 );
+        gr_fx_fill( &screen, 0, h - size, w, size, SDL_BLENDMODE_NONE, 0, 0, 0, 255 );
+#else
+        gr_fx_fill( &screen, 0, 0, w, size, GPU_BLEND_NORMAL, 0, 0, 0, 255 );
+        gr_fx_fill( &screen, 0, h - size, w, size, GPU_BLEND_NORMAL, 0, 0, 0, 255 );
 #endif
+    }
 
-        if ( ( int ) fade_pos_r == fade_to_r && ( int ) fade_pos_g == fade_to_g && ( int ) fade_pos_b == fade_to_b && ( int ) fade_pos_a == fade_to_a ) {
-            GLOQWORD( libbggfx, FADING ) = 0;
-            fade_on = 0;
-        }
+    /* Fade */
+
+    if ( fade_set ) {
+        if ( !( region = region_get( fade_region ) ) ) region = &screen;
+#ifdef USE_SDL2
+        gr_fx_fill( region, 0, 0, region->x2 - region->x + 1, region->y2 - region->y + 1, SDL_BLENDMODE_BLEND, fade_pos[ 0 ], fade_pos[ 1 ], fade_pos[ 2 ], fade_pos[ 3 ] );
+#else
+        gr_fx_fill( region, 0, 0, region->x2 - region->x + 1, region->y2 - region->y + 1, GPU_BLEND_NORMAL, fade_pos[ 0 ], fade_pos[ 1 ], fade_pos[ 2 ], fade_pos[ 3 ] );
+#endif
     }
 }
 
 /* --------------------------------------------------------------------------- */
 
+/* Updates the values of every effect, draws only if any of them shows */
+
 static int __gr_fade_info( void * what, REGION * bbox, int64_t * z, int64_t * drawme ) {
-    * drawme = ( fade_on || fade_set );
+    int n, running;
+
+    fx_update_clock();
+
+    running = 0;
+    for ( n = 0; n < 4; n++ ) {
+        fade_pos[ n ] = fx_value( &fade_color[ n ] );
+        running |= fx_running( &fade_color[ n ] );
+    }
+    for ( n = 0; n < 3; n++ ) tint_pos[ n ] = fx_value( &tint_color[ n ] );
+    flash_pos = fx_value( &flash_power );
+    letterbox_pos = fx_value( &letterbox_size );
+    vignette_pos = fx_value( &vignette_power );
+
+    if ( fade_on ) {
+        fade_set = 1;
+        if ( !running ) {
+            GLOQWORD( libbggfx, FADING ) = 0;
+            fade_on = 0;
+        } else {
+            GLOQWORD( libbggfx, FADING ) = 1;
+        }
+    }
+
+    if ( !fade_on && ( int ) fade_pos[ 3 ] == 0 ) fade_set = 0;
+
+    * drawme = fade_set ||
+               ( int ) tint_pos[ 0 ] != 255 || ( int ) tint_pos[ 1 ] != 255 || ( int ) tint_pos[ 2 ] != 255 ||
+               ( int ) flash_pos || ( int ) letterbox_pos || ( int ) vignette_pos;
+
     return 0;
 }
 
@@ -34,6 +34,10 @@ extern int fade_set;
 
 extern void gr_fade_init( int to_r, int to_g, int to_b, int to_a, int duration, int region ) ;
 // extern void gr_fade_step() ;
+extern void gr_tint_init( int r, int g, int b, int duration ) ;
+extern void gr_flash_init( int r, int g, int b, int duration ) ;
+extern void gr_letterbox_init( int size, int duration ) ;
+extern void gr_vignette_init( int power, int duration ) ;
 extern void gr_fade_initalize();
 
 #endif
@@ -29,6 +29,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifndef _WIN32
+#include <errno.h>
+#endif
 
 #include "bgddl.h"
 
@@ -43,14 +46,23 @@
 #define FPS_INTIAL_VALUE    60
 #define FPS_INTIAL_SKIP     2
 
+/* The last part of each wait is a busy loop, long enough to absorb the
+   oversleep of the system timer. It adapts between these limits (usecs) */
+
+#define FRAME_SPIN_INITIAL  1000
+#define FRAME_SPIN_MIN      100
+#define FRAME_SPIN_MAX      4000
+
 /* --------------------------------------------------------------------------- */
 
 int64_t fps_value = FPS_INTIAL_VALUE;
+int64_t fps_mode = FPS_SYNC;
 int64_t max_jump = FPS_INTIAL_SKIP;
 double frame_ms = 1000.0 / FPS_INTIAL_VALUE; /* 40.0; */
+double frame_us = 1000000.0 / FPS_INTIAL_VALUE;
 
 uint64_t frames_count = 0;
-int64_t last_frame_ticks = 0;
+int64_t last_frame_ticks = 0;       /* usecs */
 int64_t jump = 0;
 
 int64_t FPS_count = 0;
@@ -59,13 +71,73 @@ int64_t FPS_init = 0;
 int64_t FPS_count_sync = 0;
 int64_t FPS_init_sync = 0;
 
-double ticks_per_frame = 0.0;
-double fps_partial = 0.0;
+double frame_accumulator = 0.0;     /* FPS_FIXED: real time not simulated yet, usecs */
+
+static int64_t frame_spin = FRAME_SPIN_INITIAL;
 
 /* --------------------------------------------------------------------------- */
 /* Inicializaci�n y controles de tiempo                                        */
 /* --------------------------------------------------------------------------- */
 
+/* Current time in usecs */
+
+int64_t frame_get_ticks() {
+#if defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
+    return bgdrtm_ptimer_get_ticks_us();
+#else
+    static uint64_t freq = 0;
+    uint64_t counter = SDL_GetPerformanceCounter();
+
+    if ( !freq ) freq = SDL_GetPerformanceFrequency();
+
+    return ( int64_t ) ( ( counter / freq ) * 1000000 + ( counter % freq ) * 1000000 / freq );
+#endif
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void frame_sleep( int64_t us ) {
+#if defined(_WIN32) || defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
+    SDL_Delay( ( Uint32 ) ( us / 1000 ) );
+#else
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = ( us % 1000000 ) * 1000;
+
+    while ( nanosleep( &ts, &ts ) == -1 && errno == EINTR );
+#endif
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Sleeps most of the time and spins the rest, returns the current time */
+
+static int64_t frame_wait_until( int64_t deadline ) {
+    int64_t now = frame_get_ticks(), wake = deadline - frame_spin;
+
+    if ( now < wake ) {
+        int64_t overslept, target;
+
+        frame_sleep( wake - now );
+        now = frame_get_ticks();
+
+        /* Grow fast if the sleep passed the deadline, shrink slowly */
+        overslept = now - wake;
+        target = overslept + overslept / 2 + FRAME_SPIN_MIN;
+        if ( target > frame_spin ) frame_spin = target;
+        else                       frame_spin += ( target - frame_spin ) / 16;
+
+        if ( frame_spin < FRAME_SPIN_MIN ) frame_spin = FRAME_SPIN_MIN;
+        if ( frame_spin > FRAME_SPIN_MAX ) frame_spin = FRAME_SPIN_MAX;
+    }
+
+    while ( now < deadline ) now = frame_get_ticks();
+
+    return now;
+}
+
+/* --------------------------------------------------------------------------- */
 /*
  *  FUNCTION : gr_set_fps
  *
@@ -83,6 +155,7 @@ void gr_set_fps( int64_t fps, int64_t skip ) {
     if ( fps == fps_value && skip == max_jump ) return;
 
     frame_ms = fps ? 1000.0 / ( double ) fps : 0.0;
+    frame_us = fps ? 1000000.0 / ( double ) fps : 0.0;
     max_jump = skip;
     fps_value = ( int64_t ) fps;
 
@@ -92,6 +165,106 @@ void gr_set_fps( int64_t fps, int64_t skip ) {
     jump = 0;
 }
 
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : gr_set_fps_mode
+ *
+ *  FPS_SYNC keeps the frames at the given rate, dropping the time lost when
+ *  more than the maximum frameskip frames are late.
+ *
+ *  FPS_FIXED runs the logic at a fixed step: the real time goes to an
+ *  accumulator and each frame consumes one step. While the logic is ahead,
+ *  it waits until the next step is due and the frame is drawn once, with
+ *  frame_info.alpha set to the part of the step not simulated yet. When it
+ *  is behind, steps run without drawing up to the maximum frameskip.
+ *
+ *  In both modes frame_info.frame_time is the whole frame period, the work
+ *  and the wait, not only the work time.
+ *
+ *  PARAMS :
+ *      mode        FPS_SYNC or FPS_FIXED
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void gr_set_fps_mode( int64_t mode ) {
+    if ( mode == fps_mode ) return;
+
+    fps_mode = mode;
+    frame_accumulator = 0.0;
+
+    FPS_init_sync = FPS_init = 0;
+    FPS_count_sync = FPS_count = 0;
+
+    jump = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int64_t frame_sync( int64_t frame_ticks ) {
+    double deadline;
+
+    FPS_count_sync++;
+
+    deadline = FPS_init_sync + FPS_count_sync * frame_us;
+
+    if ( frame_ticks <= deadline ) {
+        frame_ticks = frame_wait_until( ( int64_t ) deadline );
+        jump = 0;
+    } else {
+        if ( jump < max_jump ) /* Como no me alcanza el tiempo, voy a hacer skip */
+            jump++; /* No dibujar el frame */
+        else {
+            FPS_init_sync = frame_ticks;
+            FPS_count_sync = 0;
+            jump = 0;
+        }
+    }
+
+    return frame_ticks;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void frame_set_alpha() {
+    * ( double * ) &GLOQWORD( libbggfx, FRAME_ALPHA ) = ( frame_accumulator < frame_us ) ? frame_accumulator / frame_us : 1.0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int64_t frame_fixed( int64_t frame_ticks ) {
+    int64_t now;
+
+    /* A logic step was just executed */
+    frame_accumulator += ( frame_ticks - last_frame_ticks ) - frame_us;
+
+    if ( frame_accumulator >= frame_us && jump < max_jump ) {
+        /* Behind, run the next step without drawing */
+        jump++;
+        frame_set_alpha();
+        return frame_ticks;
+    }
+
+    jump = 0;
+
+    if ( frame_accumulator >= frame_us ) {
+        /* Don't keep more late time than we can recover */
+        if ( frame_accumulator > frame_us * ( max_jump + 1 ) ) frame_accumulator = frame_us * ( max_jump + 1 );
+        frame_set_alpha();
+        return frame_ticks;
+    }
+
+    /* Ahead, wait until the next step is due, the frame is drawn once. The
+       time waited goes to the accumulator and the next step consumes it */
+    now = frame_wait_until( frame_ticks + ( int64_t ) ( frame_us - frame_accumulator ) );
+
+    frame_accumulator += now - frame_ticks;
+    frame_set_alpha();
+
+    return now;
+}
+
 /* --------------------------------------------------------------------------- */
 /*
  *  FUNCTION : gr_wait_frame
@@ -113,18 +286,12 @@ void gr_wait_frame() {
     /* -------------- */
 
     /* Tomo Tick actual */
-#if defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
-    frame_ticks = bgdrtm_ptimer_get_ticks_us() / 1000L;
-#else
-    frame_ticks = SDL_GetTicks();
-#endif
+    frame_ticks = frame_get_ticks();
+
     if ( !FPS_init_sync ) {
-#if defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
-        FPS_init_sync = FPS_init = bgdrtm_ptimer_get_ticks_us() / 1000L;
-#else
-        FPS_init_sync = FPS_init = SDL_GetTicks();
-#endif
+        FPS_init_sync = FPS_init = frame_ticks;
         FPS_count_sync = FPS_count = 0;
+        frame_accumulator = 0.0;
         jump = 0;
 
         /* Tiempo inicial del nuevo frame */
@@ -133,9 +300,6 @@ void gr_wait_frame() {
         return;
     }
 
-    /* Tiempo transcurrido total del ejecucion del ultimo frame (Frame time en ms) */
-    * ( double * ) &GLOQWORD( libbggfx, FRAME_TIME ) = ( frame_ticks - last_frame_ticks ) / 1000.0f;
-
     /* -------------- */
 
     FPS_count++;
@@ -143,53 +307,16 @@ void gr_wait_frame() {
     /* -------------- */
 
     if ( fps_value ) {
-        FPS_count_sync++;
-
-        ticks_per_frame = ( ( double ) ( frame_ticks - FPS_init_sync ) ) / ( double ) FPS_count_sync;
-        fps_partial = 1000.0 / ticks_per_frame;
-
-        if ( fps_partial == fps_value ) {
-            FPS_init_sync = frame_ticks;
-            FPS_count_sync = 0;
-            jump = 0;
-        }
-        else if ( fps_partial > fps_value ) {
-            int32_t delay = FPS_count_sync * frame_ms - ( frame_ticks - FPS_init_sync );
-
-            if ( delay > 0 ) {
-#if defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
-            {
-                    unsigned long ta = bgdrtm_ptimer_get_ticks_us(), te = ta + delay * 1000;
-                    if ( ta > te ) while ( bgdrtm_ptimer_get_ticks_us() > te );
-                    while ( bgdrtm_ptimer_get_ticks_us() < te );
-                }
-#else
-                SDL_Delay( delay );
-#endif
-                /* Reajust after delay */
-#if defined(TARGET_GP2X_WIZ) || defined(TARGET_CAANOO)
-                frame_ticks = bgdrtm_ptimer_get_ticks_us() / 1000L;
-#else
-                frame_ticks = SDL_GetTicks();
-#endif
-                ticks_per_frame = ( ( double ) ( frame_ticks - FPS_init_sync ) ) / ( double ) FPS_count_sync;
-                fps_partial = 1000.0 / ticks_per_frame;
-            }
-
-            jump = 0;
-        } else {
-            if ( jump < max_jump ) /* Como no me alcanza el tiempo, voy a hacer skip */
-                jump++; /* No dibujar el frame */
-            else {
-                FPS_init_sync = frame_ticks;
-                FPS_count_sync = 0;
-                jump = 0;
-            }
-        }
+        if ( fps_mode == FPS_FIXED ) frame_ticks = frame_fixed( frame_ticks );
+        else                         frame_ticks = frame_sync( frame_ticks );
     }
 
+    /* Tiempo transcurrido total del ejecucion del ultimo frame (en segundos y usecs) */
+    * ( double * ) &GLOQWORD( libbggfx, FRAME_TIME ) = ( frame_ticks - last_frame_ticks ) / 1000000.0;
+    GLOQWORD( libbggfx, FRAME_TIME_US ) = frame_ticks - last_frame_ticks;
+
     /* Si paso 1 segundo o mas desde la ultima lectura */
-    if ( frame_ticks - FPS_init >= 1000 ) {
+    if ( frame_ticks - FPS_init >= 1000000 ) {
         if ( fps_value ) {
             GLOQWORD( libbggfx, SPEED_GAUGE ) = FPS_count /*fps_partial*/ * 100.0 / fps_value;
         } else {
@@ -256,6 +383,7 @@ void gr_draw_frame() {
     }
 
     /* Update the object list */
+    instance_update_objects();
     gr_update_objects();
 
     /* Dump everything */
@@ -263,6 +391,9 @@ void gr_draw_frame() {
 
 //    if ( fade_on || fade_set ) gr_fade_step();
 
+    /* Queue the frame if recording */
+    g_record_frame();
+
     //Update screen
 #ifdef USE_SDL2
     SDL_RenderPresent( gRenderer );
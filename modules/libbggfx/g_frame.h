@@ -31,10 +31,20 @@
 
 /* --------------------------------------------------------------------------- */
 
+/* Frame modes */
+
+#define FPS_SYNC            0
+#define FPS_FIXED           1
+
+/* --------------------------------------------------------------------------- */
+
 extern uint64_t frames_count ;
 extern int64_t last_frame_ticks ;
 extern int64_t next_frame_ticks ;
 extern double frame_ms ;
+extern double frame_us ;
+extern int64_t fps_value ;
+extern int64_t fps_mode ;
 extern int64_t max_jump ;
 extern int64_t current_jump ;
 extern int64_t jump ;
@@ -43,10 +53,13 @@ extern int64_t FPS_init ;
 
 /* --------------------------------------------------------------------------- */
 
+extern int64_t frame_get_ticks();
+
 extern void frame_init();
 extern void frame_exit();
 
 extern void gr_set_fps( int64_t fps, int64_t jump );
+extern void gr_set_fps_mode( int64_t mode );
 extern void gr_wait_frame();
 extern void gr_draw_frame();
 
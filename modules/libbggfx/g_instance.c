@@ -93,16 +93,37 @@ GRAPH * instance_graph( INSTANCE * i ) {
 
 /* ---------------------------------------------------------------------- */
 
+/* Bounding box of the last instance_get_bbox, with the values it was
+   calculated from. Kept in the _render_reserved_.bbox local */
+
+typedef struct {
+    int64_t graph;
+    int64_t width;
+    int64_t height;
+    int64_t cpoint;
+    double x;
+    double y;
+    int64_t flags;
+    int64_t angle;
+    double scalex;
+    double scaley;
+    double centerx;
+    double centery;
+    int64_t clip_w;
+    int64_t clip_h;
+    REGION bbox;
+} __PACKED BBOX_CACHE;
+
+/* ---------------------------------------------------------------------- */
+
 void instance_get_bbox( INSTANCE * i, GRAPH * gr, REGION * dest ) {
+    BBOX_CACHE * cache = ( BBOX_CACHE * ) LOCADDR( libbggfx, i, _BBOX );
     BGD_Rect * map_clip = NULL, _map_clip;
     double x, y, scalex, scaley, centerx, centery;
+    int64_t flags, angle, cpoint;
     REGION *region;
     int64_t r;
 
-    r = LOCINT64( libbggfx, i, REGIONID );
-    if ( r > 0 && r < MAX_REGIONS ) region = &regions[ r ];
-    else                            region = &regions[ 0 ];
-
     x = LOCDOUBLE( libbggfx, i, COORDX );
     y = LOCDOUBLE( libbggfx, i, COORDY );
 
@@ -115,21 +136,43 @@ void instance_get_bbox( INSTANCE * i, GRAPH * gr, REGION * dest ) {
     _map_clip.w = LOCINT64( libbggfx, i, CLIPW );
     _map_clip.h = LOCINT64( libbggfx, i, CLIPH );
 
+    centerx = LOCDOUBLE( libbggfx, i, GRAPHCENTERX );
+    centery = LOCDOUBLE( libbggfx, i, GRAPHCENTERY );
+
+    flags = LOCQWORD( libbggfx, i, FLAGS ) ^ LOCQWORD( libbggfx, i, XGRAPH_FLAGS );
+    angle = LOCQWORD( libbggfx, i, XGRAPH ) ? 0 : LOCINT64( libbggfx, i, ANGLE );
+
+    if ( gr->ncpoints && gr->cpoints[0].x != CPOINT_UNDEFINED ) cpoint = ( ( int64_t ) gr->cpoints[0].x << 32 ) | ( uint32_t ) gr->cpoints[0].y;
+    else                                                        cpoint = CPOINT_UNDEFINED;
+
+    /* Nothing changed since the last time */
+
+    if ( cache->graph == ( int64_t ) ( intptr_t ) gr &&
+         cache->width == gr->width && cache->height == gr->height && cache->cpoint == cpoint &&
+         cache->x == x && cache->y == y && cache->flags == flags && cache->angle == angle &&
+         cache->scalex == scalex && cache->scaley == scaley &&
+         cache->centerx == centerx && cache->centery == centery &&
+         cache->clip_w == _map_clip.w && cache->clip_h == _map_clip.h ) {
+        *dest = cache->bbox;
+        return;
+    }
+
+    r = LOCINT64( libbggfx, i, REGIONID );
+    if ( r > 0 && r < MAX_REGIONS ) region = &regions[ r ];
+    else                            region = &regions[ 0 ];
+
     if ( _map_clip.w && _map_clip.h ) {
         _map_clip.x = LOCINT64( libbggfx, i, CLIPX );
         _map_clip.y = LOCINT64( libbggfx, i, CLIPY );
         map_clip = &_map_clip;
     }
 
-    centerx = LOCDOUBLE( libbggfx, i, GRAPHCENTERX );
-    centery = LOCDOUBLE( libbggfx, i, GRAPHCENTERY );
-
     gr_get_bbox( dest,
                  region,
                  x,
                  y,
-                 LOCQWORD( libbggfx, i, FLAGS ) ^ LOCQWORD( libbggfx, i, XGRAPH_FLAGS ),
-                 LOCQWORD( libbggfx, i, XGRAPH ) ? 0 : LOCINT64( libbggfx, i, ANGLE ),
+                 flags,
+                 angle,
                  scalex,
                  scaley,
                  centerx,
@@ -137,6 +180,44 @@ void instance_get_bbox( INSTANCE * i, GRAPH * gr, REGION * dest ) {
                  gr,
                  map_clip
                );
+
+    cache->graph = ( int64_t ) ( intptr_t ) gr;
+    cache->width = gr->width;
+    cache->height = gr->height;
+    cache->cpoint = cpoint;
+    cache->x = x;
+    cache->y = y;
+    cache->flags = flags;
+    cache->angle = angle;
+    cache->scalex = scalex;
+    cache->scaley = scaley;
+    cache->centerx = centerx;
+    cache->centery = centery;
+    cache->clip_w = _map_clip.w;
+    cache->clip_h = _map_clip.h;
+    cache->bbox = *dest;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Checks if the instance may be visible in its region. Instances drawn
+   into a graph are always visible */
+
+static int instance_in_region( INSTANCE * i, GRAPH * gr ) {
+    REGION bbox, * region;
+    int64_t r;
+
+    if ( LOCQWORD( libbggfx, i, RENDER_GRAPHID ) ) return 1;
+
+    r = LOCINT64( libbggfx, i, REGIONID );
+    if ( r > 0 && r < MAX_REGIONS ) region = &regions[ r ];
+    else                            region = &regions[ 0 ];
+
+    instance_get_bbox( i, gr, &bbox );
+
+    /* One pixel of margin for the rounding of the bbox */
+
+    return !( bbox.x2 < region->x - 1 || bbox.x > region->x2 + 1 || bbox.y2 < region->y - 1 || bbox.y > region->y2 + 1 );
 }
 
 /* ---------------------------------------------------------------------- */
@@ -349,7 +430,49 @@ int draw_instance_info( void * what, REGION * region, int64_t * z, int64_t * dra
 
     /* Si tiene grafico o xgraph o (ctype == 0 y esta corriendo o congelado) */
 
-    if ( drawme && LOCQWORD( libbggfx, i, CTYPE ) == C_SCREEN && ( LOCQWORD( libbggfx, i, STATUS ) & ( STATUS_RUNNING | STATUS_FROZEN ) ) ) * drawme = 1;
+    /* Instances out of their region are not drawn */
+
+    if ( drawme && LOCQWORD( libbggfx, i, CTYPE ) == C_SCREEN && ( LOCQWORD( libbggfx, i, STATUS ) & ( STATUS_RUNNING | STATUS_FROZEN ) ) ) * drawme = instance_in_region( i, graph );
 
     return 1;
 }
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : instance_update_objects
+ *
+ *  Registers the object of every C_SCREEN instance that got a GRAPH or
+ *  XGRAPH, and removes the object of every instance that has none or
+ *  moved to a scroll, so processes not drawn on screen don't cost anything
+ *  to the object list. C_SCROLL instances go to the scroll index instead.
+ *  Called once per frame, before gr_update_objects.
+ *
+ *  PARAMS :
+ *      None
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void instance_update_objects( void ) {
+    INSTANCE * i;
+    int64_t has_graph;
+
+    scroll_index_reset();
+
+    for ( i = first_instance; i; i = i->next ) {
+        has_graph = LOCQWORD( libbggfx, i, GRAPHID ) || LOCQWORD( libbggfx, i, XGRAPH );
+
+        if ( has_graph && LOCQWORD( libbggfx, i, CTYPE ) == C_SCROLL ) {
+            scroll_index_add( i );
+            has_graph = 0;
+        }
+
+        if ( has_graph && !LOCQWORD( libbggfx, i, _OBJECTID ) ) {
+            LOCQWORD( libbggfx, i, _OBJECTID ) = gr_new_object( LOCINT64( libbggfx, i, COORDZ ), draw_instance_info, draw_instance, i );
+        } else if ( !has_graph && LOCQWORD( libbggfx, i, _OBJECTID ) ) {
+            gr_destroy_object( LOCQWORD( libbggfx, i, _OBJECTID ) );
+            LOCQWORD( libbggfx, i, _OBJECTID ) = 0;
+        }
+    }
+}
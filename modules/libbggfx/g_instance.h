@@ -40,6 +40,7 @@ extern void draw_instance_at( INSTANCE * i, REGION * r, double x, double y, GRAP
 extern void draw_instance( void * what, REGION * clip ) ;
 extern GRAPH * instance_graph( INSTANCE * i ) ;
 extern int draw_instance_info( void * what, REGION * region, int64_t * z, int64_t * drawme );
+extern void instance_update_objects( void );
 
 /* --------------------------------------------------------------------------- */
 
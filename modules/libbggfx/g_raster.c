@@ -0,0 +1,782 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fmath.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bgdrtm.h"
+
+#include "bgddl.h"
+#include "libbggfx.h"
+
+/* --------------------------------------------------------------------------- */
+/*
+ * Software blitter for graph to graph drawing. When enabled, gr_blit draws
+ * into the surface of the destination graph instead of switching the
+ * renderer to a target texture, and the texture is updated from the
+ * changed rect the next time the graph is drawn. The destination area is
+ * split in bands of rows, drawn by a pool of threads.
+ *
+ * Only 32 bits graphs in the screen format are drawn here, and only while
+ * the destination is not a target texture; anything else returns to the
+ * renderer.
+ */
+
+int64_t gr_raster_threads = 0;  /* 0 disabled, or threads drawing (the caller included) */
+
+/* --------------------------------------------------------------------------- */
+
+enum {
+    RASTER_COPY = 0,
+    RASTER_BLEND,
+    RASTER_ADD,
+    RASTER_SUB
+};
+
+#define DIV255(x)   ( ( ( x ) + 128 + ( ( ( x ) + 128 ) >> 8 ) ) >> 8 )
+
+typedef void ( RASTER_JOB )( void * data, int64_t band, uint32_t * scratch );
+
+static struct {
+    SDL_Thread * threads[ RASTER_MAX_THREADS ];
+    int64_t nthreads;                   /* Workers, without the caller */
+
+    SDL_mutex * lock;
+    SDL_cond * wake;
+    SDL_cond * done;
+
+    RASTER_JOB * job;
+    void * data;
+    int64_t nbands;
+    SDL_atomic_t next;                  /* Next band to draw */
+
+    int64_t pending;                    /* Workers still drawing the job */
+    int64_t generation;                 /* Job counter */
+    int64_t start_generation;           /* Job counter when the workers were started */
+    int64_t quit;
+
+    /* Row buffer of each thread, the caller uses the first one */
+    uint32_t * scratch[ RASTER_MAX_THREADS ];
+    int64_t scratch_size[ RASTER_MAX_THREADS ];
+} raster = { { NULL } };
+
+typedef struct {
+    uint8_t * dst;
+    int64_t dst_pitch;
+    const uint8_t * src;
+    int64_t src_pitch;
+
+    int64_t x0, y0, x1, y1;             /* Destination area, x1 and y1 excluded */
+
+    int64_t sx, sy, sw, sh;             /* Source rect */
+    int64_t flip_x, flip_y;
+
+    /* Without rotation */
+    int64_t axis;
+    int64_t dx, dy, dw, dh;             /* Destination rect */
+    int32_t * xmap;                     /* Source column of every destination column */
+    int64_t direct;                     /* Source columns are consecutive */
+
+    /* With rotation, source position of a destination pixel center:
+       u = u0 + x * dudx + y * dudy, v = v0 + x * dvdx + y * dvdy */
+    double u0, dudx, dudy;
+    double v0, dvdx, dvdy;
+
+    int64_t mode;
+    uint8_t mod[ 4 ];                   /* Color and alpha modulation, by byte */
+    int64_t identity;                   /* No modulation */
+    int64_t alpha_byte;
+} RASTER_BLIT;
+
+/* --------------------------------------------------------------------------- */
+/* Thread pool                                                                 */
+/* --------------------------------------------------------------------------- */
+
+static void raster_run_bands( int64_t slot ) {
+    int64_t band;
+
+    while ( ( band = SDL_AtomicAdd( &raster.next, 1 ) ) < raster.nbands ) raster.job( raster.data, band, raster.scratch[ slot ] );
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int raster_worker( void * arg ) {
+    int64_t slot = ( int64_t ) ( intptr_t ) arg, generation = raster.start_generation;
+
+    SDL_LockMutex( raster.lock );
+    for ( ;; ) {
+        while ( !raster.quit && raster.generation == generation ) SDL_CondWait( raster.wake, raster.lock );
+        if ( raster.quit ) break;
+        generation = raster.generation;
+        SDL_UnlockMutex( raster.lock );
+
+        raster_run_bands( slot );
+
+        SDL_LockMutex( raster.lock );
+        if ( !--raster.pending ) SDL_CondSignal( raster.done );
+    }
+    SDL_UnlockMutex( raster.lock );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Grows the row buffers of the threads used by a job, they are kept for
+   the next ones */
+
+static int raster_scratch_reserve( int64_t slots, int64_t size ) {
+    uint32_t * p;
+    int64_t n;
+
+    for ( n = 0; n < slots; n++ ) {
+        if ( raster.scratch_size[ n ] >= size ) continue;
+        if ( !( p = realloc( raster.scratch[ n ], size * sizeof( uint32_t ) ) ) ) return -1;
+        raster.scratch[ n ] = p;
+        raster.scratch_size[ n ] = size;
+    }
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Runs job for every band, and returns when all of them are drawn. Every
+   thread gives the job a buffer of scratch_size pixels.
+   Returns 0, or -1 if the buffers can't be allocated */
+
+static int raster_dispatch( RASTER_JOB * job, void * data, int64_t nbands, int64_t parallel, int64_t scratch_size ) {
+    parallel = parallel && raster.nthreads && nbands > 1;
+
+    if ( raster_scratch_reserve( parallel ? raster.nthreads + 1 : 1, scratch_size ) ) return -1;
+
+    raster.job = job;
+    raster.data = data;
+    raster.nbands = nbands;
+    SDL_AtomicSet( &raster.next, 0 );
+
+    if ( !parallel ) {
+        raster_run_bands( 0 );
+        return 0;
+    }
+
+    SDL_LockMutex( raster.lock );
+    raster.pending = raster.nthreads;
+    raster.generation++;
+    SDL_CondBroadcast( raster.wake );
+    SDL_UnlockMutex( raster.lock );
+
+    raster_run_bands( 0 );
+
+    SDL_LockMutex( raster.lock );
+    while ( raster.pending ) SDL_CondWait( raster.done, raster.lock );
+    SDL_UnlockMutex( raster.lock );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void raster_stop_workers() {
+    int64_t n;
+
+    if ( !raster.nthreads ) return;
+
+    SDL_LockMutex( raster.lock );
+    raster.quit = 1;
+    SDL_CondBroadcast( raster.wake );
+    SDL_UnlockMutex( raster.lock );
+
+    for ( n = 0; n < raster.nthreads; n++ ) {
+        SDL_WaitThread( raster.threads[ n ], NULL );
+        raster.threads[ n ] = NULL;
+    }
+
+    raster.nthreads = 0;
+    raster.quit = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : gr_raster_set_threads
+ *
+ *  Enable or disable the software blitter for graph to graph drawing
+ *
+ *  PARAMS :
+ *      threads         Threads drawing, 0 to disable it or -1 for one by CPU
+ *
+ *  RETURN VALUE :
+ *      Previous number of threads
+ *
+ */
+
+int64_t gr_raster_set_threads( int64_t threads ) {
+    int64_t old = gr_raster_threads, n;
+
+    if ( threads < 0 ) threads = SDL_GetCPUCount();
+    if ( threads > RASTER_MAX_THREADS ) threads = RASTER_MAX_THREADS;
+
+    raster_stop_workers();
+
+    gr_raster_threads = threads;
+
+    if ( threads > 1 ) {
+        if ( !raster.lock ) {
+            raster.lock = SDL_CreateMutex();
+            raster.wake = SDL_CreateCond();
+            raster.done = SDL_CreateCond();
+        }
+
+        /* Without a pool the caller draws alone */
+        if ( raster.lock && raster.wake && raster.done ) {
+            raster.start_generation = raster.generation;
+            for ( n = 0; n < threads - 1; n++ ) {
+                if ( !( raster.threads[ n ] = SDL_CreateThread( raster_worker, "raster", ( void * ) ( intptr_t ) ( n + 1 ) ) ) ) break;
+            }
+            raster.nthreads = n;
+        }
+    }
+
+    return old;
+}
+
+/* --------------------------------------------------------------------------- */
+
+void gr_raster_exit() {
+    int64_t n;
+
+    raster_stop_workers();
+
+    for ( n = 0; n < RASTER_MAX_THREADS; n++ ) {
+        free( raster.scratch[ n ] );
+        raster.scratch[ n ] = NULL;
+        raster.scratch_size[ n ] = 0;
+    }
+
+    if ( raster.lock ) SDL_DestroyMutex( raster.lock );
+    if ( raster.wake ) SDL_DestroyCond( raster.wake );
+    if ( raster.done ) SDL_DestroyCond( raster.done );
+
+    raster.lock = NULL;
+    raster.wake = raster.done = NULL;
+
+    gr_raster_threads = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+#ifdef USE_SDL2
+
+/* --------------------------------------------------------------------------- */
+/* Pixels                                                                      */
+/* --------------------------------------------------------------------------- */
+
+/* Modulated source, same math as the SSE2 version */
+
+#define RASTER_SOURCE() \
+    if ( b->identity ) { \
+        sp[0] = s[0]; sp[1] = s[1]; sp[2] = s[2]; sp[3] = s[3]; \
+    } else { \
+        sp[0] = DIV255( s[0] * b->mod[0] ); sp[1] = DIV255( s[1] * b->mod[1] ); \
+        sp[2] = DIV255( s[2] * b->mod[2] ); sp[3] = DIV255( s[3] * b->mod[3] ); \
+    } \
+    sa = sp[ al ]
+
+static void raster_combine_c( RASTER_BLIT * b, uint8_t * d, const uint8_t * s, int64_t n ) {
+    int64_t al = b->alpha_byte, k;
+    int sp[ 4 ], sa, t;
+
+    switch ( b->mode ) {
+        case RASTER_COPY:
+            if ( b->identity ) {
+                memcpy( d, s, n * 4 );
+                break;
+            }
+            for ( ; n--; d += 4, s += 4 ) {
+                RASTER_SOURCE();
+                d[0] = sp[0]; d[1] = sp[1]; d[2] = sp[2]; d[3] = sp[3];
+            }
+            break;
+
+        case RASTER_BLEND:
+            for ( ; n--; d += 4, s += 4 ) {
+                RASTER_SOURCE();
+                if ( !sa ) continue;
+                for ( k = 0; k < 4; k++ ) d[k] = DIV255( sp[k] * ( k == al ? 255 : sa ) + d[k] * ( 255 - sa ) );
+            }
+            break;
+
+        case RASTER_ADD:
+            for ( ; n--; d += 4, s += 4 ) {
+                RASTER_SOURCE();
+                for ( k = 0; k < 4; k++ ) {
+                    if ( k == al ) continue;
+                    t = d[k] + DIV255( sp[k] * sa );
+                    d[k] = t > 255 ? 255 : t;
+                }
+            }
+            break;
+
+        case RASTER_SUB:
+            for ( ; n--; d += 4, s += 4 ) {
+                RASTER_SOURCE();
+                for ( k = 0; k < 4; k++ ) {
+                    if ( k == al ) continue;
+                    t = d[k] - DIV255( sp[k] * sa );
+                    d[k] = t < 0 ? 0 : t;
+                }
+            }
+            break;
+    }
+}
+
+#undef RASTER_SOURCE
+
+/* --------------------------------------------------------------------------- */
+
+#ifdef __SSE2__
+
+static inline __m128i raster_div255_sse2( __m128i x ) {
+    x = _mm_add_epi16( x, _mm_set1_epi16( 128 ) );
+    return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+/* 4 pixels at once, alpha must be the last byte. Returns the pixels done */
+
+static int64_t raster_combine_sse2( RASTER_BLIT * b, uint8_t * d, const uint8_t * s, int64_t n ) {
+    __m128i zero = _mm_setzero_si128(), c255 = _mm_set1_epi16( 255 );
+    __m128i amask = _mm_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0 );
+    __m128i mod = _mm_set_epi16( b->mod[3], b->mod[2], b->mod[1], b->mod[0], b->mod[3], b->mod[2], b->mod[1], b->mod[0] );
+    __m128i sp, dp, slo, shi, dlo, dhi, salo, sahi, out;
+    int64_t i;
+
+    for ( i = 0; i + 4 <= n; i += 4, d += 16, s += 16 ) {
+        sp = _mm_loadu_si128( ( const __m128i * ) s );
+        slo = _mm_unpacklo_epi8( sp, zero );
+        shi = _mm_unpackhi_epi8( sp, zero );
+
+        if ( !b->identity ) {
+            slo = raster_div255_sse2( _mm_mullo_epi16( slo, mod ) );
+            shi = raster_div255_sse2( _mm_mullo_epi16( shi, mod ) );
+        }
+
+        if ( b->mode == RASTER_COPY ) {
+            _mm_storeu_si128( ( __m128i * ) d, _mm_packus_epi16( slo, shi ) );
+            continue;
+        }
+
+        /* Source alpha in every channel */
+        salo = _mm_shufflehi_epi16( _mm_shufflelo_epi16( slo, 0xff ), 0xff );
+        sahi = _mm_shufflehi_epi16( _mm_shufflelo_epi16( shi, 0xff ), 0xff );
+
+        dp = _mm_loadu_si128( ( const __m128i * ) d );
+
+        if ( b->mode == RASTER_BLEND ) {
+            dlo = _mm_unpacklo_epi8( dp, zero );
+            dhi = _mm_unpackhi_epi8( dp, zero );
+
+            /* color: s * sa + d * ( 255 - sa ), alpha: s * 255 + d * ( 255 - sa ) */
+            dlo = _mm_mullo_epi16( dlo, _mm_sub_epi16( c255, salo ) );
+            dhi = _mm_mullo_epi16( dhi, _mm_sub_epi16( c255, sahi ) );
+            salo = _mm_or_si128( _mm_andnot_si128( amask, salo ), _mm_and_si128( amask, c255 ) );
+            sahi = _mm_or_si128( _mm_andnot_si128( amask, sahi ), _mm_and_si128( amask, c255 ) );
+            slo = raster_div255_sse2( _mm_add_epi16( _mm_mullo_epi16( slo, salo ), dlo ) );
+            shi = raster_div255_sse2( _mm_add_epi16( _mm_mullo_epi16( shi, sahi ), dhi ) );
+            out = _mm_packus_epi16( slo, shi );
+        } else {
+            /* s * sa, alpha untouched */
+            slo = raster_div255_sse2( _mm_mullo_epi16( slo, _mm_andnot_si128( amask, salo ) ) );
+            shi = raster_div255_sse2( _mm_mullo_epi16( shi, _mm_andnot_si128( amask, sahi ) ) );
+            out = _mm_packus_epi16( slo, shi );
+            out = ( b->mode == RASTER_ADD ) ? _mm_adds_epu8( dp, out ) : _mm_subs_epu8( dp, out );
+        }
+
+        _mm_storeu_si128( ( __m128i * ) d, out );
+    }
+
+    return i;
+}
+
+#endif
+
+/* --------------------------------------------------------------------------- */
+
+static void raster_combine( RASTER_BLIT * b, uint8_t * d, const uint8_t * s, int64_t n ) {
+#ifdef __SSE2__
+    if ( b->alpha_byte == 3 && !( b->mode == RASTER_COPY && b->identity ) ) {
+        int64_t done = raster_combine_sse2( b, d, s, n );
+        d += done * 4;
+        s += done * 4;
+        n -= done;
+    }
+#endif
+    if ( n > 0 ) raster_combine_c( b, d, s, n );
+}
+
+/* --------------------------------------------------------------------------- */
+/* Blit                                                                        */
+/* --------------------------------------------------------------------------- */
+
+static inline const uint32_t * raster_src_row( RASTER_BLIT * b, int64_t y ) {
+    if ( b->flip_y ) y = b->sh - 1 - y;
+    return ( const uint32_t * ) ( b->src + ( b->sy + y ) * b->src_pitch ) + b->sx;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Columns [*first, *last] of row y whose center is inside the source */
+
+static int raster_row_span( RASTER_BLIT * b, int64_t y, int64_t * first, int64_t * last ) {
+    double lo = b->x0, hi = b->x1 - 1, a, step, t0, t1, limit;
+    int64_t u, v, x, pass;
+
+    for ( pass = 0; pass < 2; pass++ ) {
+        if ( !pass ) { a = b->u0 + y * b->dudy; step = b->dudx; limit = b->sw; }
+        else         { a = b->v0 + y * b->dvdy; step = b->dvdx; limit = b->sh; }
+
+        if ( fabs( step ) < 1e-12 ) {
+            if ( a < 0 || a >= limit ) return 0;
+            continue;
+        }
+
+        t0 = -a / step;
+        t1 = ( limit - a ) / step;
+        if ( t0 > t1 ) { double t = t0; t0 = t1; t1 = t; }
+
+        if ( t0 > lo ) lo = t0;
+        if ( t1 < hi ) hi = t1;
+    }
+
+    if ( lo > hi ) return 0;
+
+    * first = ( int64_t ) ceil( lo );
+    * last = ( int64_t ) floor( hi );
+
+    /* Rounding can leave the ends out, drop them */
+    for ( ; * first <= * last; ( * first )++ ) {
+        x = * first;
+        u = ( int64_t ) floor( b->u0 + x * b->dudx + y * b->dudy );
+        v = ( int64_t ) floor( b->v0 + x * b->dvdx + y * b->dvdy );
+        if ( u >= 0 && u < b->sw && v >= 0 && v < b->sh ) break;
+    }
+    for ( ; * last >= * first; ( * last )-- ) {
+        x = * last;
+        u = ( int64_t ) floor( b->u0 + x * b->dudx + y * b->dudy );
+        v = ( int64_t ) floor( b->v0 + x * b->dvdx + y * b->dvdy );
+        if ( u >= 0 && u < b->sw && v >= 0 && v < b->sh ) break;
+    }
+
+    return * first <= * last;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void raster_blit_band( void * data, int64_t band, uint32_t * buffer ) {
+    RASTER_BLIT * b = ( RASTER_BLIT * ) data;
+    int64_t y = b->y0 + band * RASTER_BAND_ROWS, y2 = y + RASTER_BAND_ROWS;
+    int64_t width = b->x1 - b->x0, x, first, last, u, v;
+    const uint32_t * srow;
+    uint8_t * drow;
+
+    if ( y2 > b->y1 ) y2 = b->y1;
+
+    for ( ; y < y2; y++ ) {
+        drow = b->dst + y * b->dst_pitch;
+
+        if ( b->axis ) {
+            /* Source row of the pixel center */
+            srow = raster_src_row( b, ( ( 2 * ( y - b->dy ) + 1 ) * b->sh ) / ( 2 * b->dh ) );
+
+            if ( b->direct ) {
+                raster_combine( b, drow + b->x0 * 4, ( const uint8_t * ) ( srow + b->xmap[ 0 ] ), width );
+            } else {
+                for ( x = 0; x < width; x++ ) buffer[ x ] = srow[ b->xmap[ x ] ];
+                raster_combine( b, drow + b->x0 * 4, ( const uint8_t * ) buffer, width );
+            }
+            continue;
+        }
+
+        if ( !raster_row_span( b, y, &first, &last ) ) continue;
+
+        for ( x = first; x <= last; x++ ) {
+            u = ( int64_t ) floor( b->u0 + x * b->dudx + y * b->dudy );
+            v = ( int64_t ) floor( b->v0 + x * b->dvdx + y * b->dvdy );
+
+            /* Inside between the ends of the span, clamp for rounding */
+            if ( u < 0 ) u = 0; else if ( u >= b->sw ) u = b->sw - 1;
+            if ( v < 0 ) v = 0; else if ( v >= b->sh ) v = b->sh - 1;
+
+            buffer[ x - first ] = raster_src_row( b, v )[ b->flip_x ? b->sw - 1 - u : u ];
+        }
+
+        raster_combine( b, drow + first * 4, ( const uint8_t * ) buffer, last - first + 1 );
+    }
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Adds a rect to the area of the surface to update in the texture */
+
+static void raster_mark_dirty( GRAPH * gr, int64_t x0, int64_t y0, int64_t x1, int64_t y1 ) {
+    SDL_Rect * r = &gr->update_rect;
+
+    if ( gr->texture_must_update == BITMAP_UPDATE_RECT ) {
+        if ( r->x < x0 ) x0 = r->x;
+        if ( r->y < y0 ) y0 = r->y;
+        if ( r->x + r->w > x1 ) x1 = r->x + r->w;
+        if ( r->y + r->h > y1 ) y1 = r->y + r->h;
+    } else if ( gr->texture_must_update ) {
+        return; /* Whole surface */
+    }
+
+    r->x = x0;
+    r->y = y0;
+    r->w = x1 - x0;
+    r->h = y1 - y0;
+
+    gr->texture_must_update = BITMAP_UPDATE_RECT;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : gr_raster_blit
+ *
+ *  Draw a graph into another one in software, with the same parameters
+ *  and result as gr_blit
+ *
+ *  PARAMS :
+ *      same as gr_blit, without blend_mode and custom_blendmode (only the
+ *      blend flags are used, as the SDL2 renderer does)
+ *
+ *  RETURN VALUE :
+ *      0 if done, not 0 if gr_blit must draw it
+ *
+ */
+
+int gr_raster_blit( GRAPH * dest, REGION * clip, double scrx, double scry, int64_t flags, int64_t angle, double scalex, double scaley, double centerx, double centery, GRAPH * gr, BGD_Rect * gr_clip, uint8_t alpha, uint8_t color_r, uint8_t color_g, uint8_t color_b ) {
+    SDL_Surface * ds, * ss;
+    RASTER_BLIT b;
+    double scalex_adjusted, scaley_adjusted, rad, c, s, fx, fy, minx, miny, maxx, maxy;
+    int64_t cx, cy, pcx, pcy, x, n, lanes[ 4 ];
+    uint8_t mods[ 4 ];
+
+    /* A target graph keeps its pixels in the texture, not in the surface */
+    if ( !gr_raster_threads || !dest || !gr || dest == gr || dest->type == BITMAP_TEXTURE_TARGET || gr->type == BITMAP_TEXTURE_TARGET ) return 1;
+
+    if ( !( ss = gr->surface ) || gr_create_image_for_graph( dest ) ) return 1;
+    ds = dest->surface;
+
+    if ( ds->format->format != gPixelFormat->format || ss->format->format != ds->format->format || ds->format->BytesPerPixel != 4 ) return 1;
+    if ( SDL_MUSTLOCK( ds ) || SDL_MUSTLOCK( ss ) ) return 1;
+
+    memset( &b, 0, sizeof( b ) );
+
+    /* Same geometry as gr_blit */
+
+    if ( gr_clip ) {
+        b.sx = gr_clip->x;
+        b.sy = gr_clip->y;
+        b.sw = gr_clip->w;
+        b.sh = gr_clip->h;
+        if ( b.sx < 0 || b.sy < 0 || b.sx + b.sw > ss->w || b.sy + b.sh > ss->h ) return 1;
+    } else {
+        b.sw = gr->width;
+        b.sh = gr->height;
+    }
+
+    if ( b.sw <= 0 || b.sh <= 0 ) return 0;
+
+    if ( flags & B_TRANSLUCENT ) alpha >>= 1;
+
+    scalex_adjusted = scalex / 100.0;
+    scaley_adjusted = scaley / 100.0;
+
+    if ( centerx == POINT_UNDEFINED || centery == POINT_UNDEFINED ) {
+        if ( gr->ncpoints && gr->cpoints[0].x != CPOINT_UNDEFINED ) {
+            centerx = gr->cpoints[0].x;
+            centery = gr->cpoints[0].y;
+        } else {
+            centerx = b.sw / 2.0;
+            centery = b.sh / 2.0;
+        }
+    }
+
+    if ( flags & B_HMIRROR ) {
+        angle = -angle;
+        centerx = gr->width - 1 - centerx;
+        b.flip_x = 1;
+    }
+    if ( flags & B_VMIRROR ) {
+        angle = -angle;
+        centery = gr->height - 1 - centery;
+        b.flip_y = 1;
+    }
+
+    cx = ( int ) ( centerx * scalex_adjusted );
+    cy = ( int ) ( centery * scaley_adjusted );
+
+    b.dx = ( int ) ( scrx - cx );
+    b.dy = ( int ) ( scry - cy );
+    b.dw = ( int ) ( scalex_adjusted * b.sw );
+    b.dh = ( int ) ( scaley_adjusted * b.sh );
+
+    if ( b.dw <= 0 || b.dh <= 0 ) return 0;
+
+    /* Only nearest sampling here */
+    if ( angle % 360000 || b.dw != b.sw || b.dh != b.sh ) {
+        const char * quality = SDL_GetHint( SDL_HINT_RENDER_SCALE_QUALITY );
+        if ( quality && strcmp( quality, "nearest" ) && strcmp( quality, "0" ) ) return 1;
+    }
+
+    /* Destination area */
+
+    if ( clip ) {
+        b.x0 = clip->x;
+        b.y0 = clip->y;
+        b.x1 = clip->x2 + 1;
+        b.y1 = clip->y2 + 1;
+    } else {
+        b.x0 = b.y0 = 0;
+        b.x1 = ds->w;
+        b.y1 = ds->h;
+    }
+
+    if ( b.x0 < 0 ) b.x0 = 0;
+    if ( b.y0 < 0 ) b.y0 = 0;
+    if ( b.x1 > ds->w ) b.x1 = ds->w;
+    if ( b.y1 > ds->h ) b.y1 = ds->h;
+
+    b.axis = !( angle % 360000 );
+
+    if ( b.axis ) {
+        if ( b.x0 < b.dx ) b.x0 = b.dx;
+        if ( b.y0 < b.dy ) b.y0 = b.dy;
+        if ( b.x1 > b.dx + b.dw ) b.x1 = b.dx + b.dw;
+        if ( b.y1 > b.dy + b.dh ) b.y1 = b.dy + b.dh;
+    } else {
+        /* Rotation around the center, clockwise as SDL_RenderCopyEx */
+        rad = ( angle / -1000.0 ) * M_PI / 180.0;
+        c = cos( rad );
+        s = sin( rad );
+        pcx = b.dx + cx;
+        pcy = b.dy + cy;
+
+        minx = miny = 1e300;
+        maxx = maxy = -1e300;
+        for ( n = 0; n < 4; n++ ) {
+            fx = ( ( n & 1 ) ? b.dw : 0 ) - cx;
+            fy = ( ( n & 2 ) ? b.dh : 0 ) - cy;
+            if ( pcx + fx * c - fy * s < minx ) minx = pcx + fx * c - fy * s;
+            if ( pcx + fx * c - fy * s > maxx ) maxx = pcx + fx * c - fy * s;
+            if ( pcy + fx * s + fy * c < miny ) miny = pcy + fx * s + fy * c;
+            if ( pcy + fx * s + fy * c > maxy ) maxy = pcy + fx * s + fy * c;
+        }
+
+        if ( b.x0 < floor( minx ) ) b.x0 = floor( minx );
+        if ( b.y0 < floor( miny ) ) b.y0 = floor( miny );
+        if ( b.x1 > ceil( maxx ) ) b.x1 = ceil( maxx );
+        if ( b.y1 > ceil( maxy ) ) b.y1 = ceil( maxy );
+
+        /* Inverse of the rotation, from the destination pixel center to the source */
+        b.dudx = c * b.sw / b.dw;
+        b.dudy = s * b.sw / b.dw;
+        b.u0 = ( ( 0.5 - pcx ) * c + ( 0.5 - pcy ) * s + cx ) * b.sw / b.dw;
+        b.dvdx = -s * b.sh / b.dh;
+        b.dvdy = c * b.sh / b.dh;
+        b.v0 = ( -( 0.5 - pcx ) * s + ( 0.5 - pcy ) * c + cy ) * b.sh / b.dh;
+    }
+
+    if ( b.x0 >= b.x1 || b.y0 >= b.y1 ) return 0;
+
+    if ( b.axis ) {
+        if ( !( b.xmap = malloc( ( b.x1 - b.x0 ) * sizeof( int32_t ) ) ) ) return 1;
+
+        b.direct = !b.flip_x && b.dw == b.sw;
+        for ( x = b.x0; x < b.x1; x++ ) {
+            n = ( ( 2 * ( x - b.dx ) + 1 ) * b.sw ) / ( 2 * b.dw );
+            b.xmap[ x - b.x0 ] = b.flip_x ? b.sw - 1 - n : n;
+        }
+    }
+
+    /* Pixels */
+
+    b.dst = ( uint8_t * ) ds->pixels;
+    b.dst_pitch = ds->pitch;
+    b.src = ( const uint8_t * ) ss->pixels;
+    b.src_pitch = ss->pitch;
+
+         if ( flags & B_NOCOLORKEY )    b.mode = RASTER_COPY;
+    else if ( flags & B_ABLEND     )    b.mode = RASTER_ADD;
+    else if ( flags & B_SBLEND     )    b.mode = RASTER_SUB;
+    else                                b.mode = RASTER_BLEND;
+
+    /* Byte of every channel in memory */
+    lanes[ 0 ] = ds->format->Rshift / 8;
+    lanes[ 1 ] = ds->format->Gshift / 8;
+    lanes[ 2 ] = ds->format->Bshift / 8;
+    lanes[ 3 ] = ds->format->Ashift / 8;
+    mods[ 0 ] = color_r;
+    mods[ 1 ] = color_g;
+    mods[ 2 ] = color_b;
+    mods[ 3 ] = alpha;
+
+    for ( n = 0; n < 4; n++ ) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        lanes[ n ] = 3 - lanes[ n ];
+#endif
+        b.mod[ lanes[ n ] ] = mods[ n ];
+    }
+
+    b.alpha_byte = lanes[ 3 ];
+    b.identity = ( color_r == 255 && color_g == 255 && color_b == 255 && alpha == 255 );
+
+    /* Direct rows are combined from the source, the others need a row buffer */
+    if ( raster_dispatch( raster_blit_band, &b, ( b.y1 - b.y0 + RASTER_BAND_ROWS - 1 ) / RASTER_BAND_ROWS, ( b.x1 - b.x0 ) * ( b.y1 - b.y0 ) >= RASTER_MIN_PARALLEL,
+                          ( b.axis && b.direct ) ? 0 : b.x1 - b.x0 ) ) {
+        free( b.xmap );
+        return 1;
+    }
+
+    free( b.xmap );
+
+    raster_mark_dirty( dest, b.x0, b.y0, b.x1, b.y1 );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+#endif
+
+/* --------------------------------------------------------------------------- */
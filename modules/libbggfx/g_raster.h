@@ -0,0 +1,57 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/* --------------------------------------------------------------------------- */
+
+#ifndef __G_RASTER_H
+#define __G_RASTER_H
+
+#include <bgddl.h>
+#include <g_bitmap.h>
+#include <g_regions.h>
+
+/* --------------------------------------------------------------------------- */
+
+#define RASTER_MAX_THREADS      32
+#define RASTER_BAND_ROWS        32      /* Rows drawn by a thread at once */
+#define RASTER_MIN_PARALLEL     16384   /* Smaller blits are drawn by the calling thread only */
+
+/* --------------------------------------------------------------------------- */
+
+extern int64_t gr_raster_threads;
+
+extern int64_t gr_raster_set_threads( int64_t threads );
+extern void gr_raster_exit( void );
+
+#ifdef USE_SDL2
+extern int gr_raster_blit( GRAPH * dest, REGION * clip, double scrx, double scry, int64_t flags, int64_t angle, double scalex, double scaley, double centerx, double centery, GRAPH * gr, BGD_Rect * gr_clip, uint8_t alpha, uint8_t color_r, uint8_t color_g, uint8_t color_b );
+#endif
+
+/* --------------------------------------------------------------------------- */
+
+#endif
@@ -28,6 +28,11 @@
 
 /* --------------------------------------------------------------------------- */
 
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "g_bitmap.h"
 #include "g_grlib.h"
 
@@ -80,3 +85,308 @@ GRAPH * g_get_screen( void ) {
 }
 
 /* --------------------------------------------------------------------------- */
+/* Screen recording                                                            */
+/* --------------------------------------------------------------------------- */
+/*
+ * Every frame is read into one of RECORD_BUFFERS preallocated buffers just
+ * before it is presented, and a thread converts and writes the queued
+ * frames, so the game only waits for it when the queue is full.
+ */
+
+#define RECORD_BUFFERS  8
+
+typedef struct {
+    uint8_t * pixels;
+    int64_t frame;
+} RECORD_FRAME;
+
+static struct {
+    int64_t active;
+    int64_t format;
+    int64_t error;
+    char * filename;
+    FILE * file;
+    int width, height;
+    int64_t frames;
+
+    RECORD_FRAME queue[ RECORD_BUFFERS ];
+    int head, tail, count;
+
+    SDL_mutex * lock;
+    SDL_cond * cond;
+    SDL_Thread * thread;
+
+    uint8_t * yuv;
+    int ( * save_png )( SDL_Surface * surface, const char * file );
+} record = { 0 };
+
+/* --------------------------------------------------------------------------- */
+
+static int record_write_png( RECORD_FRAME * f ) {
+    char * filename;
+    SDL_Surface * surface;
+    size_t len = strlen( record.filename ) + 16;
+    int r = -1;
+
+    if ( !record.save_png || !( filename = malloc( len ) ) ) return -1;
+
+    /* name.png -> name_000000.png */
+    snprintf( filename, len, "%s_%06" PRId64 ".png", record.filename, f->frame );
+
+    surface = SDL_CreateRGBSurfaceWithFormatFrom( f->pixels, record.width, record.height, 32, record.width * 4, SDL_PIXELFORMAT_RGBA32 );
+    if ( surface ) {
+        r = record.save_png( surface, filename );
+        SDL_FreeSurface( surface );
+    }
+
+    free( filename );
+    return r;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int record_write_y4m( RECORD_FRAME * f ) {
+    int64_t n, size = ( int64_t ) record.width * record.height;
+    uint8_t * p = f->pixels, * y = record.yuv, * u = y + size, * v = u + size;
+    int r, g, b;
+
+    /* BT.601, studio range */
+    for ( n = 0; n < size; n++, p += 4 ) {
+        r = p[0]; g = p[1]; b = p[2];
+        *y++ = ( uint8_t ) ( ( (  66 * r + 129 * g +  25 * b + 128 ) >> 8 ) +  16 );
+        *u++ = ( uint8_t ) ( ( ( -38 * r -  74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+        *v++ = ( uint8_t ) ( ( ( 112 * r -  94 * g -  18 * b + 128 ) >> 8 ) + 128 );
+    }
+
+    if ( fputs( "FRAME\n", record.file ) < 0 ) return -1;
+    return fwrite( record.yuv, size * 3, 1, record.file ) == 1 ? 0 : -1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int record_worker( void * data ) {
+    RECORD_FRAME * f;
+    int r;
+
+    for ( ;; ) {
+        SDL_LockMutex( record.lock );
+        while ( !record.count && record.active ) SDL_CondWait( record.cond, record.lock );
+        if ( !record.count ) {
+            SDL_UnlockMutex( record.lock );
+            break;
+        }
+        f = &record.queue[ record.tail ];
+        SDL_UnlockMutex( record.lock );
+
+        switch ( record.format ) {
+            case RECORD_PNG:
+                r = record_write_png( f );
+                break;
+
+            case RECORD_Y4M:
+                r = record_write_y4m( f );
+                break;
+
+            default:
+                r = fwrite( f->pixels, ( size_t ) record.width * record.height * 4, 1, record.file ) == 1 ? 0 : -1;
+                break;
+        }
+
+        SDL_LockMutex( record.lock );
+        if ( r ) record.error = 1;
+        record.tail = ( record.tail + 1 ) % RECORD_BUFFERS;
+        record.count--;
+        SDL_CondBroadcast( record.cond );
+        SDL_UnlockMutex( record.lock );
+    }
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void record_free( void ) {
+    int n;
+
+    for ( n = 0; n < RECORD_BUFFERS; n++ ) {
+        free( record.queue[ n ].pixels );
+        record.queue[ n ].pixels = NULL;
+    }
+
+    if ( record.file ) fclose( record.file );
+    if ( record.cond ) SDL_DestroyCond( record.cond );
+    if ( record.lock ) SDL_DestroyMutex( record.lock );
+    free( record.filename );
+    free( record.yuv );
+
+    record.file = NULL;
+    record.cond = NULL;
+    record.lock = NULL;
+    record.filename = NULL;
+    record.yuv = NULL;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : g_record_start
+ *
+ *  Starts recording every frame drawn to a file
+ *
+ *  PARAMS :
+ *      filename        File, for RECORD_PNG the frame number is added
+ *                      to the name of each file
+ *      format          RECORD_PNG, RECORD_Y4M or RECORD_RAW
+ *      save_png        Function used to write the PNG files
+ *
+ *  RETURN VALUE :
+ *      1 on success, 0 on error or if already recording
+ */
+
+int64_t g_record_start( const char * filename, int64_t format, int ( * save_png )( SDL_Surface * surface, const char * file ) ) {
+    size_t len;
+    int n;
+
+    if ( record.active || !filename || !*filename || renderer_width < 1 || renderer_height < 1 ) return 0;
+    if ( format != RECORD_PNG && format != RECORD_Y4M && format != RECORD_RAW ) return 0;
+    if ( format == RECORD_PNG && !save_png ) return 0;
+
+    record.format = format;
+    record.error = 0;
+    record.width = renderer_width;
+    record.height = renderer_height;
+    record.frames = 0;
+    record.head = record.tail = record.count = 0;
+    record.save_png = save_png;
+
+    if ( !( record.filename = strdup( filename ) ) ) return 0;
+
+    /* The frame number goes before the extension */
+    len = strlen( record.filename );
+    if ( format == RECORD_PNG && len > 4 && !SDL_strcasecmp( record.filename + len - 4, ".png" ) ) record.filename[ len - 4 ] = '\0';
+
+    for ( n = 0; n < RECORD_BUFFERS; n++ ) {
+        if ( !( record.queue[ n ].pixels = malloc( ( size_t ) record.width * record.height * 4 ) ) ) {
+            record_free();
+            return 0;
+        }
+    }
+
+    if ( format != RECORD_PNG ) {
+        if ( !( record.file = fopen( filename, "wb" ) ) ) {
+            record_free();
+            return 0;
+        }
+    }
+
+    if ( format == RECORD_Y4M ) {
+        if ( !( record.yuv = malloc( ( size_t ) record.width * record.height * 3 ) ) ) {
+            record_free();
+            return 0;
+        }
+        fprintf( record.file, "YUV4MPEG2 W%d H%d F%" PRId64 ":1 Ip A1:1 C444\n", record.width, record.height, fps_value > 0 ? fps_value : ( int64_t ) 60 );
+    }
+
+    record.lock = SDL_CreateMutex();
+    record.cond = SDL_CreateCond();
+    if ( !record.lock || !record.cond ) {
+        record_free();
+        return 0;
+    }
+
+    record.active = 1;
+
+    if ( !( record.thread = SDL_CreateThread( record_worker, "record", NULL ) ) ) {
+        record.active = 0;
+        record_free();
+        return 0;
+    }
+
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : g_record_stop
+ *
+ *  Writes the queued frames and ends the recording
+ *
+ *  RETURN VALUE :
+ *      Frames recorded, -1 if there was any write error
+ */
+
+int64_t g_record_stop( void ) {
+    int64_t frames;
+
+    if ( !record.active ) return 0;
+
+    SDL_LockMutex( record.lock );
+    record.active = 0;
+    SDL_CondBroadcast( record.cond );
+    SDL_UnlockMutex( record.lock );
+
+    SDL_WaitThread( record.thread, NULL );
+    record.thread = NULL;
+
+    if ( record.file && fclose( record.file ) ) record.error = 1;
+    record.file = NULL;
+
+    frames = record.error ? -1 : record.frames;
+
+    record_free();
+
+    return frames;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : g_record_frame
+ *
+ *  Queues the frame being drawn, must be called before presenting it.
+ *  Frames of a different size than the recording are skipped.
+ */
+
+void g_record_frame( void ) {
+    RECORD_FRAME * f;
+    uint8_t * p, * end;
+#ifdef USE_SDL2
+    SDL_Rect rect;
+#endif
+#ifdef USE_SDL2_GPU
+    int n;
+#endif
+
+    if ( !record.active || renderer_width != record.width || renderer_height != record.height ) return;
+
+    SDL_LockMutex( record.lock );
+    while ( record.count == RECORD_BUFFERS ) SDL_CondWait( record.cond, record.lock );
+    f = &record.queue[ record.head ];
+    SDL_UnlockMutex( record.lock );
+
+#ifdef USE_SDL2
+    rect.x = rect.y = 0;
+    rect.w = record.width;
+    rect.h = record.height;
+
+    if ( SDL_RenderReadPixels( gRenderer, &rect, SDL_PIXELFORMAT_RGBA32, f->pixels, record.width * 4 ) ) return;
+#endif
+#ifdef USE_SDL2_GPU
+    SDL_Surface * surface = GPU_CopySurfaceFromTarget( gRenderer );
+    if ( !surface ) return;
+    n = SDL_ConvertPixels( record.width, record.height, surface->format->format, surface->pixels, surface->pitch, SDL_PIXELFORMAT_RGBA32, f->pixels, record.width * 4 );
+    SDL_FreeSurface( surface );
+    if ( n ) return;
+#endif
+
+    /* Force alpha to opaque */
+    for ( p = f->pixels + 3, end = f->pixels + ( size_t ) record.width * record.height * 4; p < end; p += 4 ) *p = 0xff;
+
+    f->frame = record.frames++;
+
+    SDL_LockMutex( record.lock );
+    record.head = ( record.head + 1 ) % RECORD_BUFFERS;
+    record.count++;
+    SDL_CondBroadcast( record.cond );
+    SDL_UnlockMutex( record.lock );
+}
+
+/* --------------------------------------------------------------------------- */
@@ -31,8 +31,20 @@
 
 /* --------------------------------------------------------------------------- */
 
+/* Screen recording formats */
+
+#define RECORD_PNG      0       /* One PNG file per frame */
+#define RECORD_Y4M      1       /* YUV4MPEG2 stream, 4:4:4 */
+#define RECORD_RAW      2       /* RGBA frames, 8 bits per channel */
+
+/* --------------------------------------------------------------------------- */
+
 extern GRAPH * g_get_screen( void );
 
+extern int64_t g_record_start( const char * filename, int64_t format, int ( * save_png )( SDL_Surface * surface, const char * file ) );
+extern int64_t g_record_stop( void );
+extern void g_record_frame( void );
+
 /* --------------------------------------------------------------------------- */
 
 #endif
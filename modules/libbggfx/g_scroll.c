@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "bgdrtm.h"
@@ -48,6 +49,31 @@
 #define BACK_HWRAP 4
 #define BACK_VWRAP 8
 
+/* Celdas del indice espacial: 256x256 pixels del mundo */
+#define SCROLL_CELL_SHIFT   8
+#define SCROLL_CELL_MAX     16
+#define SCROLL_BUCKETS      1024
+
+/* --------------------------------------------------------------------------- */
+
+/* C_SCROLL instances of the current frame, with the bounding box in world
+   coordinates and the mask of the scrolls where they are drawn */
+
+typedef struct {
+    INSTANCE * i;
+    uint64_t mask;
+    REGION bbox;
+    int64_t cx, cy, cx2, cy2;
+} SCROLL_MEMBER;
+
+/* Entry of a member in a cell of the grid, chained by bucket */
+
+typedef struct {
+    int64_t member;
+    int64_t cx, cy;
+    int64_t next;
+} SCROLL_CELL;
+
 /* --------------------------------------------------------------------------- */
 
 int64_t scrolls_objects[ MAX_SCROLLS ] = { 0 };
@@ -100,13 +126,80 @@ void scroll_stop( int64_t n ) {
             scrolls_objects[n] = 0;
             scrolls[n].active = 0;
         }
+        memset( scrolls[n].layers, 0, sizeof( scrolls[n].layers ) );
+    }
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : scroll_set_tilemap
+ *
+ *  Sets the tilemap of a layer of the scroll, NULL removes it. The layers
+ *  are drawn in order over the scroll graph, moving at the given percent
+ *  of the scroll position.
+ *
+ *  PARAMS :
+ *      n               Scroll number
+ *      layer           Layer number
+ *      tm              Tilemap or NULL
+ *      parallax_x      Horizontal speed, 100 is the scroll speed
+ *      parallax_y      Vertical speed
+ *
+ *  RETURN VALUE :
+ *      1 on success, 0 if the scroll or layer is not valid
+ */
+
+int64_t scroll_set_tilemap( int64_t n, int64_t layer, TILEMAP * tm, double parallax_x, double parallax_y ) {
+    if ( n < 0 || n >= MAX_SCROLLS || layer < 0 || layer >= MAX_SCROLL_LAYERS ) return 0;
+
+    scrolls[n].layers[layer].tilemap = tm;
+    scrolls[n].layers[layer].parallax_x = parallax_x;
+    scrolls[n].layers[layer].parallax_y = parallax_y;
+
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Removes a tilemap being destroyed from every scroll */
+
+void scroll_remove_tilemap( TILEMAP * tm ) {
+    int64_t n, l;
+
+    for ( n = 0; n < MAX_SCROLLS; n++ )
+        for ( l = 0; l < MAX_SCROLL_LAYERS; l++ )
+            if ( scrolls[n].layers[l].tilemap == tm ) scrolls[n].layers[l].tilemap = NULL;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Size of the scroll: the graph, or the first tilemap layer if it has no graph */
+
+static int scroll_size( int64_t n, GRAPH * graph, int64_t * width, int64_t * height ) {
+    int64_t l;
+
+    if ( graph ) {
+        *width = graph->width;
+        *height = graph->height;
+        return 1;
+    }
+
+    for ( l = 0; l < MAX_SCROLL_LAYERS; l++ ) {
+        TILEMAP * tm = scrolls[n].layers[l].tilemap;
+        if ( tm ) {
+            *width = tm->width * tm->tile_width;
+            *height = tm->height * tm->tile_height;
+            return 1;
+        }
     }
+
+    return 0;
 }
 
 /* --------------------------------------------------------------------------- */
 
 void scroll_update( int64_t n ) {
-    int64_t w, h;
+    int64_t w, h, width, height;
 
     REGION bbox;
     GRAPH * graph, * back;
@@ -117,13 +210,15 @@ void scroll_update( int64_t n ) {
 
     if ( n < 0 || n >= MAX_SCROLLS ) return;
 
-    if ( !scrolls[n].active || !scrolls[n].region || !scrolls[n].graphid ) return;
+    if ( !scrolls[n].active || !scrolls[n].region ) return;
 
     graph = scrolls[n].graphid ? bitmap_get( scrolls[n].fileid, scrolls[n].graphid ) : NULL;
     back  = scrolls[n].backid  ? bitmap_get( scrolls[n].filebackid, scrolls[n].backid )  : NULL;
 
-    if (                        !graph ) return; // El fondo de scroll no existe
-    if (  scrolls[n].backid  && !back  ) return; // Grafico no existe
+    if ( scrolls[n].graphid  && !graph ) return; // El fondo de scroll no existe
+    if ( scrolls[n].backid   && !back  ) return; // Grafico no existe
+
+    if ( !scroll_size( n, graph, &width, &height ) ) return; // Sin grafico ni tilemap
 
     data = &(( SCROLL_EXTRA_DATA * ) GLOADDR( libbggfx, SCROLLS ) )[n];
 
@@ -214,8 +309,8 @@ void scroll_update( int64_t n ) {
 
     /* Scrolls no c�clicos y posici�n del background */
 
-    if ( !( scrolls[n].flags & GRAPH_HWRAP ) ) data->x0 = MAX( 0, MIN( data->x0, ( int64_t )graph->width  - w ) );
-    if ( !( scrolls[n].flags & GRAPH_VWRAP ) ) data->y0 = MAX( 0, MIN( data->y0, ( int64_t )graph->height - h ) );
+    if ( !( scrolls[n].flags & GRAPH_HWRAP ) ) data->x0 = MAX( 0, MIN( data->x0, width  - w ) );
+    if ( !( scrolls[n].flags & GRAPH_VWRAP ) ) data->y0 = MAX( 0, MIN( data->y0, height - h ) );
 
     if ( scrolls[n].ratio ) {
         data->x1 = data->x0 * 100.0 / scrolls[n].ratio;
@@ -231,11 +326,11 @@ void scroll_update( int64_t n ) {
 
     scrolls[n].posx0 = data->x0;
     scrolls[n].posy0 = data->y0;
-    scrolls[n].x0 = fmod( data->x0, ( int64_t ) graph->width );
-    scrolls[n].y0 = fmod( data->y0, ( int64_t ) graph->height );
+    scrolls[n].x0 = fmod( data->x0, width );
+    scrolls[n].y0 = fmod( data->y0, height );
 
-    if ( scrolls[n].x0 < 0.0 ) scrolls[n].x0 += graph->width;
-    if ( scrolls[n].y0 < 0.0 ) scrolls[n].y0 += graph->height;
+    if ( scrolls[n].x0 < 0.0 ) scrolls[n].x0 += width;
+    if ( scrolls[n].y0 < 0.0 ) scrolls[n].y0 += height;
 
     if ( back ) {
         scrolls[n].x1 = fmod( data->x1, ( int64_t ) back->width );
@@ -258,28 +353,230 @@ static int compare_instances( const void * ptr1, const void * ptr2 ) {
 
 /* --------------------------------------------------------------------------- */
 
+static SCROLL_MEMBER * scroll_members = NULL;
+static int64_t scroll_members_count = 0;
+static int64_t scroll_members_reserved = 0;
+
+static SCROLL_CELL * scroll_cells = NULL;
+static int64_t scroll_cells_count = 0;
+static int64_t scroll_cells_reserved = 0;
+
+/* Members too big for the grid, always tested */
+static int64_t * scroll_big = NULL;
+static int64_t scroll_big_count = 0;
+static int64_t scroll_big_reserved = 0;
+
+/* First cell of each bucket plus one, 0 if empty */
+static int64_t scroll_buckets[ SCROLL_BUCKETS ];
+
+/* --------------------------------------------------------------------------- */
+
+static void * scroll_index_grow( void * list, int64_t * reserved, size_t size ) {
+    void * l = realloc( list, size * ( *reserved + 256 ) );
+    if ( !l ) {
+        fprintf( stderr, "no enough memory\n");
+        exit(1);
+    }
+    *reserved += 256;
+    return l;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static inline int64_t scroll_bucket( int64_t cx, int64_t cy ) {
+    return ( ( uint64_t ) cx * 73856093 ^ ( uint64_t ) cy * 19349663 ) & ( SCROLL_BUCKETS - 1 );
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : scroll_index_reset
+ *
+ *  Empties the index of C_SCROLL instances. The index is rebuilt every
+ *  frame by instance_update_objects, calling scroll_index_add for each
+ *  instance, so changes of CTYPE, CNUMBER or position are always seen.
+ *
+ *  PARAMS :
+ *      None
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void scroll_index_reset( void ) {
+    if ( scroll_cells_count ) memset( scroll_buckets, 0, sizeof( scroll_buckets ) );
+    scroll_members_count = 0;
+    scroll_cells_count = 0;
+    scroll_big_count = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : scroll_index_add
+ *
+ *  Adds the instance to the index if it is a visible C_SCROLL instance,
+ *  putting it in every cell of the grid covered by its bounding box.
+ *
+ *  PARAMS :
+ *      i           Pointer to the instance
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void scroll_index_add( INSTANCE * i ) {
+    SCROLL_MEMBER * m;
+    SCROLL_CELL * c;
+    GRAPH * graph;
+    int64_t cx, cy, b;
+
+    if ( LOCQWORD( libbggfx, i, CTYPE ) != C_SCROLL ||
+         !( LOCQWORD( libbggfx, i, STATUS ) & ( STATUS_RUNNING | STATUS_FROZEN ) ) ) return;
+
+    if ( !( graph = instance_graph( i ) ) ) return;
+
+    if ( scroll_members_count == scroll_members_reserved ) scroll_members = scroll_index_grow( scroll_members, &scroll_members_reserved, sizeof( SCROLL_MEMBER ) );
+
+    m = &scroll_members[ scroll_members_count ];
+
+    m->i = i;
+    m->mask = LOCQWORD( libbggfx, i, CNUMBER ) ? ( uint64_t ) LOCQWORD( libbggfx, i, CNUMBER ) : ~( uint64_t ) 0;
+
+    instance_get_bbox( i, graph, &m->bbox );
+
+    m->cx  = ( m->bbox.x  - 1 ) >> SCROLL_CELL_SHIFT;
+    m->cy  = ( m->bbox.y  - 1 ) >> SCROLL_CELL_SHIFT;
+    m->cx2 = ( m->bbox.x2 + 1 ) >> SCROLL_CELL_SHIFT;
+    m->cy2 = ( m->bbox.y2 + 1 ) >> SCROLL_CELL_SHIFT;
+
+    if ( ( m->cx2 - m->cx + 1 ) * ( m->cy2 - m->cy + 1 ) > SCROLL_CELL_MAX ) {
+        if ( scroll_big_count == scroll_big_reserved ) scroll_big = scroll_index_grow( scroll_big, &scroll_big_reserved, sizeof( int64_t ) );
+        scroll_big[ scroll_big_count++ ] = scroll_members_count++;
+        return;
+    }
+
+    for ( cy = m->cy; cy <= m->cy2; cy++ ) {
+        for ( cx = m->cx; cx <= m->cx2; cx++ ) {
+            if ( scroll_cells_count == scroll_cells_reserved ) scroll_cells = scroll_index_grow( scroll_cells, &scroll_cells_reserved, sizeof( SCROLL_CELL ) );
+
+            b = scroll_bucket( cx, cy );
+
+            c = &scroll_cells[ scroll_cells_count ];
+            c->member = scroll_members_count;
+            c->cx = cx;
+            c->cy = cy;
+            c->next = scroll_buckets[ b ];
+
+            scroll_buckets[ b ] = ++scroll_cells_count;
+        }
+    }
+
+    scroll_members_count++;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Member m is drawn in scroll n and overlaps the world rectangle */
+
+static inline int scroll_member_visible( SCROLL_MEMBER * m, int64_t n, REGION * view ) {
+    return ( m->mask & ( ( uint64_t ) 1 << n ) ) &&
+           m->bbox.x <= view->x2 + 1 && m->bbox.x2 >= view->x - 1 &&
+           m->bbox.y <= view->y2 + 1 && m->bbox.y2 >= view->y - 1;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : scroll_index_query
+ *
+ *  Collects the instances of the scroll that overlap the world rectangle.
+ *  Instances covering several cells are only taken from the first cell
+ *  they share with the rectangle.
+ *
+ *  PARAMS :
+ *      n           Scroll number
+ *      view        Rectangle in world coordinates
+ *      list        Pointer to the list, grown as needed
+ *      reserved    Pointer to the size of the list
+ *
+ *  RETURN VALUE :
+ *      Number of instances in the list
+ */
+
+static int64_t scroll_index_query( int64_t n, REGION * view, INSTANCE *** list, int64_t * reserved ) {
+    int64_t qx, qy, qx2, qy2, cx, cy, c, count = 0;
+    SCROLL_MEMBER * m;
+
+    if ( !scroll_members_count ) return 0;
+
+    if ( *reserved < scroll_members_count ) {
+        INSTANCE ** l = ( INSTANCE ** ) realloc( *list, sizeof( INSTANCE * ) * scroll_members_count );
+        if ( !l ) {
+            fprintf( stderr, "no enough memory\n");
+            exit(1);
+        }
+        *list = l;
+        *reserved = scroll_members_count;
+    }
+
+    qx  = ( view->x  - 1 ) >> SCROLL_CELL_SHIFT;
+    qy  = ( view->y  - 1 ) >> SCROLL_CELL_SHIFT;
+    qx2 = ( view->x2 + 1 ) >> SCROLL_CELL_SHIFT;
+    qy2 = ( view->y2 + 1 ) >> SCROLL_CELL_SHIFT;
+
+    /* Few instances for such a view, test them all */
+
+    if ( ( qx2 - qx + 1 ) * ( qy2 - qy + 1 ) > scroll_members_count ) {
+        for ( c = 0; c < scroll_members_count; c++ ) {
+            if ( scroll_member_visible( &scroll_members[c], n, view ) ) ( *list )[ count++ ] = scroll_members[c].i;
+        }
+        return count;
+    }
+
+    for ( cy = qy; cy <= qy2; cy++ ) {
+        for ( cx = qx; cx <= qx2; cx++ ) {
+            for ( c = scroll_buckets[ scroll_bucket( cx, cy ) ]; c; c = scroll_cells[ c - 1 ].next ) {
+                if ( scroll_cells[ c - 1 ].cx != cx || scroll_cells[ c - 1 ].cy != cy ) continue;
+
+                m = &scroll_members[ scroll_cells[ c - 1 ].member ];
+                if ( cx != MAX( m->cx, qx ) || cy != MAX( m->cy, qy ) ) continue;
+
+                if ( scroll_member_visible( m, n, view ) ) ( *list )[ count++ ] = m->i;
+            }
+        }
+    }
+
+    for ( c = 0; c < scroll_big_count; c++ ) {
+        m = &scroll_members[ scroll_big[c] ];
+        if ( scroll_member_visible( m, n, view ) ) ( *list )[ count++ ] = m->i;
+    }
+
+    return count;
+}
+
+/* --------------------------------------------------------------------------- */
+
 void scroll_draw( int64_t n, REGION * clipping ) {
     double x, y, cx, cy;
 
     static INSTANCE ** proclist = 0;
     static int64_t proclist_reserved = 0;
-    int64_t proclist_count;
-    REGION r;
+    int64_t proclist_count, width, height, l;
+    REGION r, view;
 
     GRAPH * graph, * back, * dest = NULL;
 
     SCROLL_EXTRA_DATA * data;
-    INSTANCE * i;
 
     if ( n < 0 || n >= MAX_SCROLLS ) return;
 
-    if ( !scrolls[n].active || !scrolls[n].region || !scrolls[n].graphid ) return;
+    if ( !scrolls[n].active || !scrolls[n].region ) return;
 
     graph = scrolls[n].graphid ? bitmap_get( scrolls[n].fileid, scrolls[n].graphid ) : NULL;
     back  = scrolls[n].backid  ? bitmap_get( scrolls[n].filebackid, scrolls[n].backid )  : NULL;
 
-    if (                        !graph ) return; // El fondo de scroll no existe
-    if (  scrolls[n].backid  && !back  ) return; // Grafico no existe
+    if ( scrolls[n].graphid  && !graph ) return; // El fondo de scroll no existe
+    if ( scrolls[n].backid   && !back  ) return; // Grafico no existe
+
+    if ( !scroll_size( n, graph, &width, &height ) ) return; // Sin grafico ni tilemap
 
     data = &(( SCROLL_EXTRA_DATA * ) GLOADDR( libbggfx, SCROLLS ) )[n];
 
@@ -335,73 +632,65 @@ void scroll_draw( int64_t n, REGION * clipping ) {
 
     /* Dibuja el primer plano */
 
-    if ( graph->ncpoints > 0 && graph->cpoints[0].x >= 0 ) {
-        cx = graph->cpoints[0].x;
-        cy = graph->cpoints[0].y;
-    }
-    else {
-        cx = graph->width / 2.0;
-        cy = graph->height / 2.0;
-    }
+    if ( graph ) {
+        if ( graph->ncpoints > 0 && graph->cpoints[0].x >= 0 ) {
+            cx = graph->cpoints[0].x;
+            cy = graph->cpoints[0].y;
+        }
+        else {
+            cx = graph->width / 2.0;
+            cy = graph->height / 2.0;
+        }
 
-    shader_activate( data->shader1 );
-
-    y = scrolls[n].region->y - scrolls[n].y0;
-    while ( y < scrolls[n].region->y2 ) {
-        x = scrolls[n].region->x - scrolls[n].x0;
-        while ( x < scrolls[n].region->x2 ) {
-            gr_blit(    dest,
-                        &r,
-                        x + cx,
-                        y + cy,
-                        data->flags1,
-                        0,
-                        100,
-                        100,
-                        POINT_UNDEFINED,
-                        POINT_UNDEFINED,
-                        graph,
-                        NULL,
-                        data->alpha,
-                        data->color_r,
-                        data->color_g,
-                        data->color_b,
-                        data->blend_mode1,
-                        &data->custom_blend_mode1
-                    );
-            x += graph->width;
+        shader_activate( data->shader1 );
+
+        y = scrolls[n].region->y - scrolls[n].y0;
+        while ( y < scrolls[n].region->y2 ) {
+            x = scrolls[n].region->x - scrolls[n].x0;
+            while ( x < scrolls[n].region->x2 ) {
+                gr_blit(    dest,
+                            &r,
+                            x + cx,
+                            y + cy,
+                            data->flags1,
+                            0,
+                            100,
+                            100,
+                            POINT_UNDEFINED,
+                            POINT_UNDEFINED,
+                            graph,
+                            NULL,
+                            data->alpha,
+                            data->color_r,
+                            data->color_g,
+                            data->color_b,
+                            data->blend_mode1,
+                            &data->custom_blend_mode1
+                        );
+                x += graph->width;
+            }
+            y += graph->height;
         }
-        y += graph->height;
     }
 
-    /* Crea una lista ordenada de instancias a dibujar */
-
-    i = first_instance;
-    proclist_count = 0;
-    while ( i ) {
-        if ( LOCQWORD( libbggfx, i, CTYPE ) == C_SCROLL &&
-             ( LOCQWORD( libbggfx, i, STATUS ) & ( STATUS_RUNNING | STATUS_FROZEN ) )
-           ) {
-            if ( LOCQWORD( libbggfx, i, CNUMBER ) && !( LOCQWORD( libbggfx, i, CNUMBER ) & ( 1 << n ) ) ) {
-                i = i->next;
-                continue;
-            }
+    /* Dibuja las capas de tiles */
 
-            if ( proclist_count == proclist_reserved ) {
-                proclist_reserved += 16;
-                INSTANCE ** pl = ( INSTANCE ** ) realloc( proclist, sizeof( INSTANCE * ) * proclist_reserved );
-                if ( !pl ) {
-                    fprintf( stderr, "no enough memory\n");
-                    exit(1);
-                }
-                proclist = pl;
-            }
+    shader_activate( NULL );
 
-            proclist[proclist_count++] = i;
-        }
-        i = i->next;
+    for ( l = 0; l < MAX_SCROLL_LAYERS; l++ ) {
+        SCROLL_LAYER * layer = &scrolls[n].layers[l];
+        if ( layer->tilemap ) tilemap_draw( layer->tilemap, dest, &r, scrolls[n].region->x - scrolls[n].posx0 * layer->parallax_x / 100.0, scrolls[n].region->y - scrolls[n].posy0 * layer->parallax_y / 100.0 );
     }
 
+    /* Crea una lista ordenada de las instancias visibles en la camara */
+
+    view.x  = r.x  - scrolls[n].region->x + ( int64_t ) scrolls[n].posx0;
+    view.y  = r.y  - scrolls[n].region->y + ( int64_t ) scrolls[n].posy0;
+    view.x2 = r.x2 - scrolls[n].region->x + ( int64_t ) scrolls[n].posx0;
+    view.y2 = r.y2 - scrolls[n].region->y + ( int64_t ) scrolls[n].posy0;
+
+    proclist_count = scroll_index_query( n, &view, &proclist, &proclist_reserved );
+
     if ( proclist_count ) {
         /* Ordena la listilla */
         qsort( proclist, proclist_count, sizeof( INSTANCE * ), compare_instances );
@@ -35,6 +35,8 @@
 
 #define MAX_SCROLLS     64
 
+#define MAX_SCROLL_LAYERS   8
+
 /* --------------------------------------------------------------------------- */
 
 #ifndef __BGDC__
@@ -51,6 +53,14 @@
 #define inline __inline
 #endif
 
+/* Tilemap drawn over the scroll graph, parallax in percent of the scroll position */
+
+typedef struct {
+    TILEMAP * tilemap;
+    double parallax_x;
+    double parallax_y;
+} __PACKED SCROLL_LAYER;
+
 typedef struct _scrolldata {
     int64_t fileid;
     int64_t graphid;
@@ -77,6 +87,8 @@ typedef struct _scrolldata {
     int64_t active;
 
     struct _scrolldata * follows;
+
+    SCROLL_LAYER layers[ MAX_SCROLL_LAYERS ];
 } __PACKED scrolldata;
 
 typedef struct _scroll_Extra_data {
@@ -128,6 +140,10 @@ extern void scroll_stop( int64_t n );
 extern void scroll_update( int64_t n );
 extern void scroll_draw( int64_t n, REGION * clipping );
 extern void scroll_region( int64_t n, REGION * r );
+extern int64_t scroll_set_tilemap( int64_t n, int64_t layer, TILEMAP * tm, double parallax_x, double parallax_y );
+extern void scroll_remove_tilemap( TILEMAP * tm );
+extern void scroll_index_reset( void );
+extern void scroll_index_add( INSTANCE * i );
 
 /* --------------------------------------------------------------------------- */
 
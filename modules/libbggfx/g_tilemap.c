@@ -0,0 +1,337 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/* --------------------------------------------------------------------------- */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "bgdrtm.h"
+
+#include "bgddl.h"
+#include "dlvaracc.h"
+
+#include "libbggfx.h"
+
+/* --------------------------------------------------------------------------- */
+/* Tilemaps                                                                    */
+/* --------------------------------------------------------------------------- */
+/*
+ * The tiles are drawn in chunks of TILEMAP_CHUNK_TILES x TILEMAP_CHUNK_TILES,
+ * each one baked into a graph the first time it is visible and again only
+ * after its tiles change. Only the TILEMAP_CACHE_CHUNKS chunks drawn last
+ * are kept, so the cost of a frame depends on the view, not the map size.
+ */
+
+/* --------------------------------------------------------------------------- */
+
+static void tilemap_unlist( TILEMAP * tm, TILEMAP_CHUNK * c ) {
+    int64_t last;
+
+    if ( c->slot < 0 ) return;
+
+    last = tm->baked[ --tm->nbaked ];
+    tm->baked[ c->slot ] = last;
+    tm->chunks[ last ].slot = c->slot;
+    c->slot = -1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int tilemap_list( TILEMAP * tm, TILEMAP_CHUNK * c ) {
+    if ( c->slot >= 0 ) return 0;
+
+    if ( tm->nbaked == tm->baked_reserved ) {
+        int64_t reserved = tm->baked_reserved ? tm->baked_reserved * 2 : TILEMAP_CACHE_CHUNKS;
+        int64_t * baked = ( int64_t * ) realloc( tm->baked, sizeof( int64_t ) * reserved );
+        if ( !baked ) return -1;
+        tm->baked = baked;
+        tm->baked_reserved = reserved;
+    }
+
+    c->slot = tm->nbaked;
+    tm->baked[ tm->nbaked++ ] = c - tm->chunks;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void tilemap_dirty( TILEMAP * tm, int64_t x, int64_t y, int64_t x2, int64_t y2 ) {
+    int64_t cx, cy;
+
+    for ( cy = y / tm->chunk_tiles; cy <= y2 / tm->chunk_tiles; cy++ )
+        for ( cx = x / tm->chunk_tiles; cx <= x2 / tm->chunk_tiles; cx++ )
+            tm->chunks[ cy * tm->chunks_width + cx ].baked = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void tilemap_bake( TILEMAP * tm, int64_t cx, int64_t cy ) {
+    TILEMAP_CHUNK * c = &tm->chunks[ cy * tm->chunks_width + cx ];
+    int64_t x, y, x0, y0, x2, y2;
+    int32_t * tile;
+    GRAPH * gr;
+
+    c->baked = 1;
+
+    if ( c->graph ) {
+        bitmap_destroy( c->graph );
+        c->graph = NULL;
+    }
+
+    x0 = cx * tm->chunk_tiles;
+    y0 = cy * tm->chunk_tiles;
+    x2 = MIN( x0 + tm->chunk_tiles, tm->width );
+    y2 = MIN( y0 + tm->chunk_tiles, tm->height );
+
+    for ( y = y0; y < y2; y++ ) {
+        tile = &tm->tiles[ y * tm->width + x0 ];
+        for ( x = x0; x < x2; x++, tile++ ) {
+            if ( !*tile || !( gr = bitmap_get( tm->fileid, *tile ) ) ) continue;
+
+            if ( !c->graph ) {
+                c->graph = bitmap_new( 0, ( x2 - x0 ) * tm->tile_width, ( y2 - y0 ) * tm->tile_height, NULL );
+                if ( !c->graph ) break;
+                gr_clear( c->graph );
+            }
+
+            /* Copied as is, the chunk is blended when drawn */
+            gr_blit( c->graph, NULL, ( x - x0 ) * tm->tile_width, ( y - y0 ) * tm->tile_height, B_NOCOLORKEY, 0, 100, 100, 0, 0, gr, NULL, 255, 255, 255, 255, BLEND_DISABLED, NULL );
+        }
+    }
+
+    if ( c->graph && tilemap_list( tm, c ) ) {
+        bitmap_destroy( c->graph );
+        c->graph = NULL;
+    }
+
+    if ( !c->graph ) tilemap_unlist( tm, c );
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Frees the oldest chunks over TILEMAP_CACHE_CHUNKS, but not the ones of this frame */
+
+static void tilemap_trim( TILEMAP * tm, int64_t frame ) {
+    TILEMAP_CHUNK * c, * oldest;
+    int64_t n;
+
+    while ( tm->nbaked > TILEMAP_CACHE_CHUNKS ) {
+        oldest = NULL;
+        for ( n = 0; n < tm->nbaked; n++ ) {
+            c = &tm->chunks[ tm->baked[ n ] ];
+            if ( c->frame < frame && ( !oldest || c->frame < oldest->frame ) ) oldest = c;
+        }
+
+        if ( !oldest ) break;
+
+        bitmap_destroy( oldest->graph );
+        oldest->graph = NULL;
+        oldest->baked = 0;
+        tilemap_unlist( tm, oldest );
+    }
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : tilemap_new
+ *
+ *  Creates an empty tilemap
+ *
+ *  PARAMS :
+ *      width, height   Size in tiles
+ *      fileid          Library of the tile graphs
+ *      tile_width      Width of a tile in pixels
+ *      tile_height     Height of a tile in pixels
+ *
+ *  RETURN VALUE :
+ *      Pointer to the tilemap or NULL on error
+ */
+
+TILEMAP * tilemap_new( int64_t width, int64_t height, int64_t fileid, int64_t tile_width, int64_t tile_height ) {
+    TILEMAP * tm;
+    int64_t n;
+
+    if ( width < 1 || height < 1 || tile_width < 1 || tile_height < 1 ) return NULL;
+
+    if ( !( tm = ( TILEMAP * ) calloc( 1, sizeof( TILEMAP ) ) ) ) return NULL;
+
+    tm->width = width;
+    tm->height = height;
+    tm->fileid = fileid;
+    tm->tile_width = tile_width;
+    tm->tile_height = tile_height;
+
+    /* Chunks must fit in a texture */
+    tm->chunk_tiles = TILEMAP_CHUNK_TILES;
+    if ( gMaxTextureSize > 0 )
+        while ( tm->chunk_tiles > 1 && ( tm->chunk_tiles * tile_width > gMaxTextureSize || tm->chunk_tiles * tile_height > gMaxTextureSize ) ) tm->chunk_tiles /= 2;
+
+    tm->chunks_width = ( width - 1 ) / tm->chunk_tiles + 1;
+    tm->chunks_height = ( height - 1 ) / tm->chunk_tiles + 1;
+
+    tm->tiles = ( int32_t * ) calloc( width * height, sizeof( int32_t ) );
+    tm->chunks = ( TILEMAP_CHUNK * ) calloc( tm->chunks_width * tm->chunks_height, sizeof( TILEMAP_CHUNK ) );
+    if ( !tm->tiles || !tm->chunks ) {
+        free( tm->tiles );
+        free( tm->chunks );
+        free( tm );
+        return NULL;
+    }
+
+    for ( n = 0; n < tm->chunks_width * tm->chunks_height; n++ ) tm->chunks[ n ].slot = -1;
+
+    return tm;
+}
+
+/* --------------------------------------------------------------------------- */
+
+void tilemap_destroy( TILEMAP * tm ) {
+    int64_t n;
+
+    if ( !tm ) return;
+
+    scroll_remove_tilemap( tm );
+
+    for ( n = 0; n < tm->nbaked; n++ ) bitmap_destroy( tm->chunks[ tm->baked[ n ] ].graph );
+
+    free( tm->baked );
+    free( tm->chunks );
+    free( tm->tiles );
+    free( tm );
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t tilemap_get( TILEMAP * tm, int64_t x, int64_t y ) {
+    if ( !tm || x < 0 || y < 0 || x >= tm->width || y >= tm->height ) return 0;
+    return tm->tiles[ y * tm->width + x ];
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t tilemap_set( TILEMAP * tm, int64_t x, int64_t y, int64_t tile ) {
+    int32_t * t;
+
+    if ( !tm || x < 0 || y < 0 || x >= tm->width || y >= tm->height ) return 0;
+
+    t = &tm->tiles[ y * tm->width + x ];
+    if ( *t != tile ) {
+        *t = ( int32_t ) tile;
+        tilemap_dirty( tm, x, y, x, y );
+    }
+
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t tilemap_fill( TILEMAP * tm, int64_t x, int64_t y, int64_t width, int64_t height, int64_t tile ) {
+    int64_t x2, y2, n, m;
+    int32_t * t;
+
+    if ( !tm ) return 0;
+
+    x2 = MIN( x + width, tm->width ) - 1;
+    y2 = MIN( y + height, tm->height ) - 1;
+    if ( x < 0 ) x = 0;
+    if ( y < 0 ) y = 0;
+
+    if ( x > x2 || y > y2 ) return 0;
+
+    for ( m = y; m <= y2; m++ ) {
+        t = &tm->tiles[ m * tm->width + x ];
+        for ( n = x; n <= x2; n++ ) *t++ = ( int32_t ) tile;
+    }
+
+    tilemap_dirty( tm, x, y, x2, y2 );
+
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Bakes every chunk again, for when the tile graphs changed */
+
+void tilemap_refresh( TILEMAP * tm ) {
+    int64_t n;
+
+    if ( !tm ) return;
+
+    for ( n = 0; n < tm->chunks_width * tm->chunks_height; n++ ) tm->chunks[ n ].baked = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+/*
+ *  FUNCTION : tilemap_draw
+ *
+ *  Draws the chunks of the tilemap visible in the clipping region,
+ *  baking the ones that changed
+ *
+ *  PARAMS :
+ *      tm              Tilemap
+ *      dest            Destination bitmap or NULL for screen
+ *      clip            Clipping region
+ *      x, y            Position of the top-left corner of the map
+ *
+ *  RETURN VALUE :
+ *      None
+ */
+
+void tilemap_draw( TILEMAP * tm, GRAPH * dest, REGION * clip, double x, double y ) {
+    int64_t cx, cy, cx0, cy0, cx2, cy2, cw, ch, frame;
+    TILEMAP_CHUNK * c;
+
+    if ( !tm || !clip ) return;
+
+    cw = tm->chunk_tiles * tm->tile_width;
+    ch = tm->chunk_tiles * tm->tile_height;
+
+    cx0 = MAX( 0, ( int64_t ) floor( ( clip->x - x ) / cw ) );
+    cy0 = MAX( 0, ( int64_t ) floor( ( clip->y - y ) / ch ) );
+    cx2 = MIN( tm->chunks_width - 1, ( int64_t ) floor( ( clip->x2 - x ) / cw ) );
+    cy2 = MIN( tm->chunks_height - 1, ( int64_t ) floor( ( clip->y2 - y ) / ch ) );
+
+    frame = GLOQWORD( libbggfx, FRAMES_COUNT );
+
+    for ( cy = cy0; cy <= cy2; cy++ ) {
+        for ( cx = cx0; cx <= cx2; cx++ ) {
+            c = &tm->chunks[ cy * tm->chunks_width + cx ];
+
+            if ( !c->baked ) tilemap_bake( tm, cx, cy );
+
+            c->frame = frame;
+
+            if ( c->graph ) gr_blit( dest, clip, x + cx * cw, y + cy * ch, 0, 0, 100, 100, 0, 0, c->graph, NULL, 255, 255, 255, 255, BLEND_DISABLED, NULL );
+        }
+    }
+
+    tilemap_trim( tm, frame );
+}
+
+/* --------------------------------------------------------------------------- */
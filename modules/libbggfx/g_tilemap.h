@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/* --------------------------------------------------------------------------- */
+
+#ifndef __G_TILEMAP_H
+#define __G_TILEMAP_H
+
+#include <bgddl.h>
+#include <g_bitmap.h>
+#include <g_regions.h>
+
+/* --------------------------------------------------------------------------- */
+
+#define TILEMAP_CHUNK_TILES     32      /* Chunk size in tiles */
+#define TILEMAP_CACHE_CHUNKS    64      /* Baked chunks kept per tilemap */
+
+/* --------------------------------------------------------------------------- */
+
+/* Block of tiles baked into a single graph */
+
+typedef struct {
+    GRAPH * graph;          /* NULL if not baked or empty */
+    int64_t frame;          /* Last frame drawn */
+    int64_t slot;           /* Position in the baked list, -1 if none */
+    int64_t baked;          /* 0 when the tiles changed */
+} TILEMAP_CHUNK;
+
+typedef struct {
+    int64_t width, height;              /* Size in tiles */
+    int64_t fileid;
+    int64_t tile_width, tile_height;
+    int32_t * tiles;                    /* Graph codes, 0 is empty */
+
+    int64_t chunk_tiles;
+    int64_t chunks_width, chunks_height;
+    TILEMAP_CHUNK * chunks;
+
+    int64_t * baked;                    /* Chunks with a graph */
+    int64_t nbaked;
+    int64_t baked_reserved;
+} TILEMAP;
+
+/* --------------------------------------------------------------------------- */
+
+extern TILEMAP * tilemap_new( int64_t width, int64_t height, int64_t fileid, int64_t tile_width, int64_t tile_height );
+extern void tilemap_destroy( TILEMAP * tm );
+extern int64_t tilemap_get( TILEMAP * tm, int64_t x, int64_t y );
+extern int64_t tilemap_set( TILEMAP * tm, int64_t x, int64_t y, int64_t tile );
+extern int64_t tilemap_fill( TILEMAP * tm, int64_t x, int64_t y, int64_t width, int64_t height, int64_t tile );
+extern void tilemap_refresh( TILEMAP * tm );
+extern void tilemap_draw( TILEMAP * tm, GRAPH * dest, REGION * clip, double x, double y );
+
+/* --------------------------------------------------------------------------- */
+
+#endif
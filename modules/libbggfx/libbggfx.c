@@ -52,6 +52,8 @@ DLVARFIXUP __bgdexport( libbggfx, globals_fixup )[] = {
     { "frame_info.speed_gauge"                          , NULL, -1, -1 },
     { "frame_info.frame_time"                           , NULL, -1, -1 },
     { "frame_info.frames_count"                         , NULL, -1, -1 },
+    { "frame_info.frame_time_us"                        , NULL, -1, -1 },
+    { "frame_info.alpha"                                , NULL, -1, -1 },
 
     { "fade_info.fading"                                , NULL, -1, -1 },
 
@@ -146,6 +148,7 @@ DLVARFIXUP __bgdexport( libbggfx, locals_fixup )[] = {
     { "custom_blendmode.equation_rgb"                   , NULL, -1, -1 },
     { "custom_blendmode.equation_alpha"                 , NULL, -1, -1 },
     { "shader"                                          , NULL, -1, -1 },
+    { "_render_reserved_.bbox"                          , NULL, -1, -1 },
 
     { NULL                                              , NULL, -1, -1 }
 };
@@ -174,8 +177,9 @@ HOOK __bgdexport( libbggfx, handler_hooks )[] = {
  */
 
 void __bgdexport( libbggfx, instance_create_hook )( INSTANCE * r ) {
-    /* COORZ is 0 when a new instance is created */
-    LOCQWORD( libbggfx, r, _OBJECTID ) = gr_new_object( /* LOCINT32( libbggfx, r, COORDZ ) */ 0, draw_instance_info, draw_instance, r );
+    /* The object is created when the instance has a graph, see instance_update_objects.
+       Clones and restored instances come with the object of other instance */
+    LOCQWORD( libbggfx, r, _OBJECTID ) = 0;
 }
 
 /* --------------------------------------------------------------------------- */
@@ -206,6 +210,8 @@ void __bgdexport( libbggfx, module_initialize )() {
 /* --------------------------------------------------------------------------- */
 
 void __bgdexport( libbggfx, module_finalize )() {
+    g_record_stop();
+    gr_raster_exit();
     frame_exit();
     gr_video_exit();
 }
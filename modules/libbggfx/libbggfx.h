@@ -52,6 +52,8 @@ enum {
     SPEED_GAUGE,
     FRAME_TIME,
     FRAMES_COUNT,
+    FRAME_TIME_US,
+    FRAME_ALPHA,
 
     FADING,
 
@@ -144,7 +146,8 @@ enum {
     DST_ALPHA,
     EQUATION_RGB,
     EQUATION_ALPHA,
-    SHADER_ID
+    SHADER_ID,
+    _BBOX
 };
 
 #endif
@@ -171,7 +174,9 @@ enum {
 #include "g_text.h"
 #include "g_clear.h"
 #include "g_pixel.h"
+#include "g_raster.h"
 #include "g_fade.h"
+#include "g_tilemap.h"
 #include "g_scroll.h"
 #include "g_draw.h"
 #include "g_screen.h"
@@ -260,6 +260,8 @@ char * __bgdexport( libbggfx, globals_def ) =
     "   INT speed_gauge=0;\n"
     "   DOUBLE frame_time=0;\n"
     "   INT frames_count=0;\n"
+    "   INT frame_time_us=0;\n"
+    "   DOUBLE alpha=0;\n"
     "END\n"
 
     /* Fade */
@@ -380,6 +382,26 @@ char * __bgdexport( libbggfx, locals_def ) =
     "   INT object_id=0;\n"
 //    "   INT graph_ptr=0;\n"
     "   INT xgraph_flags;\n"
+    "   STRUCT bbox\n"               /* BBOX_CACHE in g_instance.c */
+    "       INT graph;\n"
+    "       INT width;\n"
+    "       INT height;\n"
+    "       INT cpoint;\n"
+    "       DOUBLE x;\n"
+    "       DOUBLE y;\n"
+    "       INT flags;\n"
+    "       INT angle;\n"
+    "       DOUBLE size_x;\n"
+    "       DOUBLE size_y;\n"
+    "       DOUBLE center_x;\n"
+    "       DOUBLE center_y;\n"
+    "       INT clip_w;\n"
+    "       INT clip_h;\n"
+    "       INT x1;\n"
+    "       INT y1;\n"
+    "       INT x2;\n"
+    "       INT y2;\n"
+    "   END\n"
     "END\n"
 
     "INT blendmode = -1;\n"
@@ -3620,7 +3620,7 @@ static void console_draw( void * what, REGION * clip ) {
 
     if ( debugger_show_console && trace_sentence != -1 ) {
         if ( dcb.data.Version < 0x0710 ) {
-            if ( trace_instance && instance_exists( trace_instance ) && dcb.sourcecount[trace_sentence >> 24] ) {
+            if ( trace_instance && instance_exists( trace_instance ) && dcb_source_count( trace_sentence >> 24 ) ) {
                 console_printf( COLOR_SILVER "[%s(%"PRIu64"):%"PRId64"]\n" COLOR_YELLOW "%s" COLOR_SILVER "\n\n",
                         trace_instance->proc->name,
                         LOCINT64( libmod_debug, trace_instance, PROCESS_ID ),
@@ -3628,7 +3628,7 @@ static void console_draw( void * what, REGION * clip ) {
                         dcb.sourcelines [trace_sentence >> 24] [( trace_sentence & 0xFFFFFF )-1] ) ;
             }
         } else {
-            if ( trace_instance && instance_exists( trace_instance ) && dcb.sourcecount[trace_sentence >> 20] ) {
+            if ( trace_instance && instance_exists( trace_instance ) && dcb_source_count( trace_sentence >> 20 ) ) {
                 console_printf( COLOR_SILVER "[%s(%"PRIu64"):%"PRId64"]\n" COLOR_YELLOW "%s" COLOR_SILVER "\n\n",
                         trace_instance->proc->name,
                         LOCINT64( libmod_debug, trace_instance, PROCESS_ID ),
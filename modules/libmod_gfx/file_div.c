@@ -28,11 +28,14 @@
 
 /* --------------------------------------------------------------------------- */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "file_div.h"
 
 /* --------------------------------------------------------------------------- */
 
-struct {
+typedef struct {
     int     code;
     int     regsize;
     char    name[32];
@@ -40,7 +43,7 @@ struct {
     int     width;
     int     height;
     int     flags;
-} chunk;
+} FPG_CHUNK;
 
 /* --------------------------------------------------------------------------- */
 
@@ -54,6 +57,13 @@ typedef struct _chardata {
     int fileoffset;
 } _chardata;
 
+/* --------------------------------------------------------------------------- */
+
+/* FPGs are loaded from BGLOAD threads too, the lock guards the metrics */
+
+GR_LOAD_METRICS gr_load_metrics = { 0 };
+SDL_SpinLock gr_load_metrics_lock = 0;
+
 /* --------------------------------------------------------------------------- */
 /* --------------------------------------------------------------------------- */
 /* --------------------------------------------------------------------------- */
@@ -82,187 +92,331 @@ static char * gr_read_pal_with_gamma( file * fp ) {
 
 /* --------------------------------------------------------------------------- */
 
-/* Static convenience function */
-static int64_t gr_read_lib( file * fp ) {
-    char header[8];
-    short int px, py;
-    int bpp, ii;
-    int64_t libid;
-    uint32_t y;
-    unsigned c;
-    GRLIB * lib;
-    char * colors = NULL;
-    int st = 0;
+static int gr_read_colors( file * fp, SDL_Color * cl ) {
+    char * colors = gr_read_pal_with_gamma( fp );
+    int i;
 
-    libid = grlib_new();
-    if ( libid < 0 ) return -1;
+    if ( !colors ) return 0;
 
-    lib = grlib_get( libid );
-    if ( !lib ) {
-        grlib_destroy( libid );
-        return -1;
+    for ( i = 0; i < 256; i++ ) {
+        cl[i].r = colors[i*3];
+        cl[i].g = colors[i*3+1];
+        cl[i].b = colors[i*3+2];
+        cl[i].a = 255;
     }
+    free( colors );
 
-    if ( file_read( fp, header, sizeof( header ) ) != sizeof( header ) ) {
-        grlib_destroy( libid );
-        return -1;
-    }
+    return 1;
+}
 
-    if ( strcmp( header, F32_MAGIC ) == 0 ) bpp = 32;
-    else if ( strcmp( header, F16_MAGIC ) == 0 ) bpp = 16;
-    else if ( strcmp( header, FPG_MAGIC ) == 0 ) bpp = 8;
-    else if ( strcmp( header, F01_MAGIC ) == 0 ) bpp = 1;
-    else {
-        grlib_destroy( libid );
-        return -1;
-    }
+/* --------------------------------------------------------------------------- */
 
-    if ( bpp == 8 && !( colors = gr_read_pal_with_gamma( fp ) ) ) {
-        grlib_destroy( libid );
-        return -1;
+static int64_t gr_line_size( int64_t width, int bpp ) {
+    int64_t widthb = width * bpp / 8;
+    if (( widthb * 8 / bpp ) < width ) widthb++;
+    return widthb;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static SDL_Surface * gr_new_surface( int width, int height, int bpp ) {
+    uint32_t rmask, gmask, bmask, amask;
+
+    getRGBA_mask( bpp, &rmask, &gmask, &bmask, &amask );
+
+    return SDL_CreateRGBSurface( 0, width, height, bpp, rmask, gmask, bmask, amask );
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* The graphic data of a map is read at once at the end of the surface
+   pixels, gr_unpack_surface moves it to its lines */
+
+static int gr_read_surface( file * fp, SDL_Surface * surface, int bpp ) {
+    int64_t size = gr_line_size( surface->w, bpp ) * surface->h;
+    uint8_t * data = ( uint8_t * ) surface->pixels + ( int64_t ) surface->pitch * surface->h - size;
+
+    return file_read( fp, data, ( int ) size ) == size;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* Only touches the surface, so it can run on any thread */
+
+static void gr_unpack_surface( SDL_Surface * surface, int bpp, const SDL_Color * colors ) {
+    int widthb = ( int ) gr_line_size( surface->w, bpp ), y, ii;
+    const uint8_t * data = ( uint8_t * ) surface->pixels + ( int64_t )( surface->pitch - widthb ) * surface->h;
+
+    if ( colors ) SDL_SetPaletteColors( surface->format->palette, colors, 0, 256 );
+
+    // Set transparent color
+    if ( bpp != 32 ) {
+        if ( bpp == 1 ) SDL_SetColorKey( surface, SDL_TRUE, 1 );
+        else            SDL_SetColorKey( surface, SDL_TRUE, 0 );
     }
 
-    SDL_Palette * pal = NULL;
-    if ( colors ) {
-        pal = SDL_AllocPalette( 256 );
-        if ( !pal ) {
-            grlib_destroy( libid );
-            free( colors );
-            return -1;
-        }
+    for ( y = 0; y < surface->h; y++ ) {
+        uint8_t * line = ( uint8_t * ) surface->pixels + surface->pitch * y;
 
-        SDL_Color * cl = malloc( sizeof( SDL_Color ) * 256 );
-        if ( !cl ) {
-            SDL_FreePalette( pal );
-            grlib_destroy( libid );
-            free( colors );
-            return -1;
-        }
+        /* Lines never overlap the data still to move */
+        if ( line != data ) memmove( line, data, widthb );
+        data += widthb;
 
-        int i;
+        switch ( bpp ) {
+            case    32:
+                ARRANGE_DWORDS( line, surface->w );
+                break;
 
-        for ( i = 0; i < 256; i++ ) {
-            cl[i].r = colors[i*3];
-            cl[i].g = colors[i*3+1];
-            cl[i].b = colors[i*3+2];
-            cl[i].a = 255;
+            case    16:
+                ARRANGE_WORDS( line, surface->w );
+                break;
+
+            case    1:
+                for ( ii = 0; ii < widthb; ii++ ) line[ii] = ~line[ii];
+                break;
         }
-        free( colors );
-        SDL_SetPaletteColors( pal, (const SDL_Color *)cl, 0, 256 );
-        free( cl );
     }
+}
 
-    uint32_t rmask, gmask, bmask, amask;
-    getRGBA_mask( bpp, &rmask, &gmask, &bmask, &amask );
+/* --------------------------------------------------------------------------- */
 
-    while ( !file_eof( fp ) ) {
-        if ( file_read( fp, &chunk, sizeof( chunk ) ) != sizeof( chunk ) ) break;
+static int64_t gr_load_ticks( uint64_t from ) {
+    return ( int64_t )( ( SDL_GetPerformanceCounter() - from ) * 1000000 / SDL_GetPerformanceFrequency() );
+}
 
-        ARRANGE_DWORD( &chunk.code );
-        if ( chunk.code < 0 || chunk.code > 999 ) break;
-        ARRANGE_DWORD( &chunk.regsize );
-        ARRANGE_DWORD( &chunk.width );
-        ARRANGE_DWORD( &chunk.height );
-        ARRANGE_DWORD( &chunk.flags );
+/* --------------------------------------------------------------------------- */
+/* FPG                                                                         */
+/* --------------------------------------------------------------------------- */
 
-        /* Graph header */
+/* The maps are read in file order, then unpacked and converted by a pool of
+   threads, and added to the library on the calling thread */
+
+#define FPG_THREAD_MAPS         8       /* Minimum maps for each thread */
+#define FPG_MAX_THREADS         16
+
+typedef struct {
+    int             code;
+    char            name[32];
+    int             ncpoints;
+    CPOINT *        cpoints;
+    SDL_Surface *   surface;
+    GRAPH *         gr;
+} FPG_MAP;
+
+typedef struct {
+    FPG_MAP *       maps;
+    int             count;
+    int             bpp;
+    SDL_Color *     colors;
+    SDL_atomic_t    next;
+    SDL_atomic_t    error;
+} FPG_DECODER;
 
-        SDL_Surface* surface = SDL_CreateRGBSurface(0, chunk.width, chunk.height, bpp, rmask, gmask, bmask, amask );
-        if ( !surface ) {
-            if ( pal ) SDL_FreePalette( pal );
-            grlib_destroy( libid );
-            return -1;
-        }
+/* --------------------------------------------------------------------------- */
 
-        if ( pal ) SDL_SetSurfacePalette( surface, pal );
+static void gr_fpg_decode_map( FPG_DECODER * d, FPG_MAP * m ) {
+    gr_unpack_surface( m->surface, d->bpp, d->colors );
 
-        // Set transparent color
-        if ( bpp != 32 ) {
-            if ( bpp == 1 ) SDL_SetColorKey( surface, SDL_TRUE, 1 );
-            else            SDL_SetColorKey( surface, SDL_TRUE, 0 );
-        }
+#ifndef USE_SDL2_GPU
+    /* GPU textures are created on the main thread */
+    m->gr = bitmap_new( m->code, 0, 0, m->surface );
+    SDL_FreeSurface( m->surface );
+    m->surface = NULL;
+    if ( !m->gr ) SDL_AtomicSet( &d->error, 1 );
+#endif
+}
 
-        int ncpoints = chunk.flags;
-        CPOINT * cpoints = NULL;
+/* --------------------------------------------------------------------------- */
 
-        if ( ncpoints ) {
-            cpoints = ( CPOINT * ) malloc( ncpoints * sizeof( CPOINT ) );
-            if ( !cpoints ) {
-                SDL_FreeSurface( surface );
-                if ( pal ) SDL_FreePalette( pal );
-                grlib_destroy( libid );
-                return -1;
-            }
+static int gr_fpg_decode_worker( void * data ) {
+    FPG_DECODER * d = ( FPG_DECODER * ) data;
+    int n;
 
-            for ( c = 0; c < ncpoints; c++ ) {
-                file_readSint16( fp, &px );
-                file_readSint16( fp, &py );
-                if ( px == -1 && py == -1 ) {
-                    cpoints[c].x = CPOINT_UNDEFINED;
-                    cpoints[c].y = CPOINT_UNDEFINED;
-                } else {
-                    cpoints[c].x = px;
-                    cpoints[c].y = py;
-                }
+    while ( ( n = SDL_AtomicAdd( &d->next, 1 ) ) < d->count ) gr_fpg_decode_map( d, &d->maps[n] );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void gr_fpg_decode( FPG_DECODER * d ) {
+    SDL_Thread * threads[FPG_MAX_THREADS];
+    int count = SDL_GetCPUCount(), n;
+
+    if ( count > FPG_MAX_THREADS ) count = FPG_MAX_THREADS;
+    if ( count > d->count / FPG_THREAD_MAPS ) count = d->count / FPG_THREAD_MAPS;
+
+    SDL_AtomicSet( &d->next, 0 );
+
+    for ( n = 1; n < count; n++ ) threads[n] = SDL_CreateThread( gr_fpg_decode_worker, "fpg", d );
+
+    gr_fpg_decode_worker( d );
+
+    for ( n = 1; n < count; n++ ) if ( threads[n] ) SDL_WaitThread( threads[n], NULL );
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void gr_fpg_free_maps( FPG_DECODER * d ) {
+    int n;
+
+    for ( n = 0; n < d->count; n++ ) {
+        if ( d->maps[n].gr ) bitmap_destroy( d->maps[n].gr );
+        if ( d->maps[n].surface ) SDL_FreeSurface( d->maps[n].surface );
+        free( d->maps[n].cpoints );
+    }
+    free( d->maps );
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int gr_fpg_read_map( file * fp, FPG_MAP * m, int bpp ) {
+    FPG_CHUNK chunk;
+    short int px, py;
+    int c;
+
+    if ( file_read( fp, &chunk, sizeof( chunk ) ) != sizeof( chunk ) ) return 0;
+
+    ARRANGE_DWORD( &chunk.code );
+    if ( chunk.code < 0 || chunk.code > 999 ) return 0;
+    ARRANGE_DWORD( &chunk.regsize );
+    ARRANGE_DWORD( &chunk.width );
+    ARRANGE_DWORD( &chunk.height );
+    ARRANGE_DWORD( &chunk.flags );
+
+    m->code = chunk.code;
+    memcpy( m->name, chunk.name, sizeof( m->name ) );
+    m->name[31] = 0;
+    m->ncpoints = chunk.flags;
+
+    if ( chunk.width < 1 || chunk.height < 1 || chunk.flags < 0 ) return -1;
+
+    if ( m->ncpoints ) {
+        if ( !( m->cpoints = ( CPOINT * ) malloc( m->ncpoints * sizeof( CPOINT ) ) ) ) return -1;
+
+        for ( c = 0; c < m->ncpoints; c++ ) {
+            file_readSint16( fp, &px );
+            file_readSint16( fp, &py );
+            if ( px == -1 && py == -1 ) {
+                m->cpoints[c].x = CPOINT_UNDEFINED;
+                m->cpoints[c].y = CPOINT_UNDEFINED;
+            } else {
+                m->cpoints[c].x = px;
+                m->cpoints[c].y = py;
             }
         }
+    }
 
-        /* Graphic data */
+    /* Graphic data */
 
-        int widthb = chunk.width * bpp / 8;
-        if (( widthb * 8 / bpp ) < chunk.width ) widthb++;
+    if ( !( m->surface = gr_new_surface( chunk.width, chunk.height, bpp ) ) ) return -1;
+    if ( !gr_read_surface( fp, m->surface, bpp ) ) return -1;
 
-        for ( y = 0; y < chunk.height; y++ ) {
-            uint8_t * line = ( uint8_t * ) surface->pixels + surface->pitch * y;
+    return 1;
+}
 
-            switch ( bpp ) {
-                case    32:
-                    st = file_readUint32A( fp, ( uint32_t * ) line, chunk.width );
-                    break;
+/* --------------------------------------------------------------------------- */
 
-                case    16:
-                    st = file_readUint16A( fp, ( uint16_t * ) line, chunk.width );
-                    break;
+/* Static convenience function */
+static int64_t gr_read_lib( file * fp ) {
+    char header[8];
+    int bpp;
+    int64_t libid;
+    uint64_t ticks = SDL_GetPerformanceCounter();
+    SDL_Color colors[256];
+    FPG_DECODER d;
+    FPG_MAP * m;
+    int n, allocated = 0, st = 0;
+    int64_t read_us, decode_us;
 
-                case    8:
-                    st = file_read( fp, line, widthb );
-                    break;
+    if ( file_read( fp, header, sizeof( header ) ) != sizeof( header ) ) return -1;
 
-                case    1:
-                    st = file_read( fp, line, widthb );
-                    for ( ii = 0; ii < widthb; ii++ ) line[ii] = ~line[ii];
-                    break;
+    if ( strcmp( header, F32_MAGIC ) == 0 ) bpp = 32;
+    else if ( strcmp( header, F16_MAGIC ) == 0 ) bpp = 16;
+    else if ( strcmp( header, FPG_MAGIC ) == 0 ) bpp = 8;
+    else if ( strcmp( header, F01_MAGIC ) == 0 ) bpp = 1;
+    else return -1;
 
-            }
+    if ( bpp == 8 && !gr_read_colors( fp, colors ) ) return -1;
 
-            if ( !st ) {
-                free( cpoints );
-                SDL_FreeSurface( surface );
-                if ( pal ) SDL_FreePalette( pal );
-                grlib_destroy( libid );
-                return -1;
+    memset( &d, 0, sizeof( d ) );
+    d.bpp = bpp;
+    d.colors = ( bpp == 8 ) ? colors : NULL;
+
+    /* Read */
+
+    while ( !file_eof( fp ) ) {
+        if ( d.count == allocated ) {
+            allocated += 256;
+            if ( !( m = ( FPG_MAP * ) realloc( d.maps, allocated * sizeof( FPG_MAP ) ) ) ) {
+                st = -1;
+                break;
             }
+            d.maps = m;
         }
 
-        GRAPH *gr = bitmap_new( chunk.code, 0, 0, surface );
-        if ( !gr ) {
-            free( cpoints );
-            SDL_FreeSurface( surface );
-            if ( pal ) SDL_FreePalette( pal );
+        m = &d.maps[d.count];
+        memset( m, 0, sizeof( FPG_MAP ) );
+
+        st = gr_fpg_read_map( fp, m, bpp );
+        if ( st ) d.count++;
+        if ( st <= 0 ) break;
+    }
+
+    read_us = gr_load_ticks( ticks );
+    ticks = SDL_GetPerformanceCounter();
+
+    /* Decode */
+
+    if ( st >= 0 ) {
+        gr_fpg_decode( &d );
+        if ( SDL_AtomicGet( &d.error ) ) st = -1;
+    }
+
+    decode_us = gr_load_ticks( ticks );
+    ticks = SDL_GetPerformanceCounter();
+
+    libid = ( st < 0 ) ? -1 : grlib_new();
+    if ( libid < 0 || !grlib_get( libid ) ) {
+        if ( libid >= 0 ) grlib_destroy( libid );
+        gr_fpg_free_maps( &d );
+        return -1;
+    }
+
+    /* Register */
+
+    for ( n = 0; n < d.count; n++ ) {
+        m = &d.maps[n];
+
+#ifdef USE_SDL2_GPU
+        m->gr = bitmap_new( m->code, 0, 0, m->surface );
+        SDL_FreeSurface( m->surface );
+        m->surface = NULL;
+        if ( !m->gr ) {
             grlib_destroy( libid );
+            gr_fpg_free_maps( &d );
             return -1;
         }
-        SDL_FreeSurface( surface );
+#endif
 
-        memcpy( gr->name, chunk.name, sizeof( chunk.name ) );
-        gr->name[31] = 0;
-        gr->ncpoints = ncpoints;
-        gr->cpoints = cpoints;
+        memcpy( m->gr->name, m->name, sizeof( m->name ) );
+        m->gr->ncpoints = m->ncpoints;
+        m->gr->cpoints = m->cpoints;
+        m->cpoints = NULL;
 
-        grlib_add_map( libid, gr );
+        grlib_add_map( libid, m->gr );
+        m->gr = NULL;
     }
 
-    if ( pal ) SDL_FreePalette( pal );
+    SDL_AtomicLock( &gr_load_metrics_lock );
+    gr_load_metrics.read_us += read_us;
+    gr_load_metrics.decode_us += decode_us;
+    gr_load_metrics.register_us += gr_load_ticks( ticks );
+    gr_load_metrics.files++;
+    gr_load_metrics.maps += d.count;
+    SDL_AtomicUnlock( &gr_load_metrics_lock );
+
+    free( d.maps );
 
     return libid;
 }
@@ -491,11 +645,9 @@ static int64_t gr_font_loadfrom( file * fp ) {
 static GRAPH * gr_read_map( file * fp ) {
     char header[8], name[32];
     unsigned short int w, h, c;
-    int height, width, ii;
-    uint32_t y;
+    int height, width;
     int bpp, code;
-    int st = 0;
-    char * colors = NULL;
+    SDL_Color colors[256];
 
     /* Carga los datos de cabecera */
     if ( file_read( fp, header, sizeof( header ) ) != sizeof( header ) ) return NULL;
@@ -513,38 +665,12 @@ static GRAPH * gr_read_map( file * fp ) {
     height = h;
     width = w;
 
+    if ( width < 1 || height < 1 ) return NULL;
+
     if ( file_read( fp, name, sizeof( name ) ) != sizeof( name ) ) return NULL;
     name[31] = 0;
 
-    if ( bpp == 8 && !( colors = gr_read_pal_with_gamma( fp ) ) ) return NULL;
-
-    SDL_Palette * pal = NULL;
-    if ( colors ) {
-        pal = SDL_AllocPalette( 256 );
-        if ( !pal ) {
-            free( colors );
-            return NULL;
-        }
-
-        SDL_Color * cl = malloc( sizeof( SDL_Color ) * 256 );
-        if ( !cl ) {
-            SDL_FreePalette( pal );
-            free( colors );
-            return NULL;
-        }
-
-        int i;
-
-        for ( i = 0; i < 256; i++ ) {
-            cl[i].r = colors[i*3];
-            cl[i].g = colors[i*3+1];
-            cl[i].b = colors[i*3+2];
-            cl[i].a = 255;
-        }
-        free( colors );
-        SDL_SetPaletteColors( pal, (const SDL_Color *)cl, 0, 256 );
-        free( cl );
-    }
+    if ( bpp == 8 && !gr_read_colors( fp, colors ) ) return NULL;
 
     /* Control points */
 
@@ -554,10 +680,7 @@ static GRAPH * gr_read_map( file * fp ) {
 
     if ( ncpoints ) {
         cpoints = ( CPOINT * ) malloc( ncpoints * sizeof( CPOINT ) );
-        if ( !cpoints ) {
-            if ( pal ) SDL_FreePalette( pal );
-            return NULL;
-        }
+        if ( !cpoints ) return NULL;
 
         for ( c = 0; c < ncpoints; c++ ) {
             file_readUint16( fp, &w );
@@ -571,69 +694,22 @@ static GRAPH * gr_read_map( file * fp ) {
         }
     }
 
-    /* Graph header */
-
-    uint32_t rmask, gmask, bmask, amask;
-    getRGBA_mask( bpp, &rmask, &gmask, &bmask, &amask );
+    /* Graphic data */
 
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, bpp, rmask, gmask, bmask, amask );
-    if ( !surface ) {
-        if ( pal ) SDL_FreePalette( pal );
+    SDL_Surface * surface = gr_new_surface( width, height, bpp );
+    if ( !surface || !gr_read_surface( fp, surface, bpp ) ) {
+        if ( surface ) SDL_FreeSurface( surface );
         free( cpoints );
         return NULL;
     }
 
-    if ( pal ) SDL_SetSurfacePalette( surface, pal );
-
-    // Set transparent color
-    if ( bpp != 32 ) {
-        if ( bpp == 1 ) SDL_SetColorKey( surface, SDL_TRUE, 1 );
-        else            SDL_SetColorKey( surface, SDL_TRUE, 0 );
-    }
-
-    /* Graphic data */
-
-    int widthb = width * bpp / 8;
-    if (( widthb * 8 / bpp ) < width ) widthb++;
-
-    for ( y = 0; y < height; y++ ) {
-        uint8_t * line = ( uint8_t * ) surface->pixels + surface->pitch * y;
-
-        switch ( bpp ) {
-            case    32:
-                st = file_readUint32A( fp, ( uint32_t * ) line, width );
-                break;
-
-            case    16:
-                st = file_readUint16A( fp, ( uint16_t * ) line, width );
-                break;
-
-            case    8:
-                if ( ( st = file_read( fp, line, widthb ) ) != widthb ) st = 0;
-                break;
-
-            case    1:
-                if ( ( st = file_read( fp, line, widthb ) ) != widthb ) st = 0;
-                else
-                    for ( ii = 0; ii < widthb; ii++ ) line[ii] = ~line[ii];
-                break;
-
-        }
-
-        if ( !st ) {
-            SDL_FreeSurface( surface );
-            if ( pal ) SDL_FreePalette( pal );
-            free( cpoints );
-            return 0;
-        }
-    }
+    gr_unpack_surface( surface, bpp, ( bpp == 8 ) ? colors : NULL );
 
     GRAPH *gr = bitmap_new( code, 0, 0, surface );
     SDL_FreeSurface( surface );
     if ( !gr ) {
-        if ( pal ) SDL_FreePalette( pal );
         free( cpoints );
-        return 0;
+        return NULL;
     }
 
     strcpy( gr->name, name );
@@ -1004,6 +1080,7 @@ int gr_save_fpg( int libid, const char * filename )
     int     nmaps;
     uint8_t header[8];
     rgb_component * palette = NULL;
+    FPG_CHUNK chunk;
 
     /* Get the library and open the file */
 /*
@@ -83,6 +83,21 @@ MAP_HEADER ;
 
 /* --------------------------------------------------------------------------- */
 
+/* Accumulated FPG load times, in microseconds */
+
+typedef struct {
+    int64_t files;
+    int64_t maps;
+    int64_t read_us;
+    int64_t decode_us;
+    int64_t register_us;
+} GR_LOAD_METRICS;
+
+extern GR_LOAD_METRICS gr_load_metrics;
+extern SDL_SpinLock gr_load_metrics_lock;
+
+/* --------------------------------------------------------------------------- */
+
 extern int64_t gr_load_fpg( const char * libname );
 extern int64_t gr_font_load( char * filename );
 extern int64_t gr_load_map( const char * mapname );
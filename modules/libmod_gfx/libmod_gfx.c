@@ -116,6 +116,14 @@ void __bgdexport( libmod_gfx, process_exec_hook )( INSTANCE * r ) {
     #include "m_collision_process_exec_hook.h"
 }
 
+/* --------------------------------------------------------------------------- */
+
+/* The collision locals are only used by COLLISION */
+
+static int libmod_gfx_process_exec_filter( PROCDEF * proc ) {
+    return procdef_calls( proc, libmod_gfx_collision ) || procdef_calls( proc, libmod_gfx_collision2 );
+}
+
 /* --------------------------------------------------------------------------- */
 /* exports                                                                     */
 /* --------------------------------------------------------------------------- */
@@ -125,11 +133,14 @@ void __bgdexport( libmod_gfx, process_exec_hook )( INSTANCE * r ) {
 
 void __bgdexport( libmod_gfx, module_initialize )() {
     #include "m_map_initialize.h"
+    instance_hook_filter( __bgdexport( libmod_gfx, process_exec_hook ), libmod_gfx_process_exec_filter );
 }
 
 /* --------------------------------------------------------------------------- */
 
 void __bgdexport( libmod_gfx, module_finalize )() {
+    /* Recordings write PNG files with SDL_image */
+    g_record_stop();
     #include "m_map_finalize.h"
 }
 
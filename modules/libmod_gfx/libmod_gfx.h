@@ -48,6 +48,7 @@
 #include "m_screen.h"
 #include "m_scroll.h"
 #include "m_text.h"
+#include "m_tilemap.h"
 #include "m_wm.h"
 #include "m_draw.h"
 #include "m_shaders.h"
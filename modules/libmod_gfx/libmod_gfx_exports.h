@@ -56,6 +56,9 @@ DLCONSTANT __bgdexport( libmod_gfx, constants_def )[] = {
 
     { "B_CLEAR"             , TYPE_INT          , B_CLEAR                               },
 
+    { "FPS_SYNC"            , TYPE_INT          , FPS_SYNC                              },
+    { "FPS_FIXED"           , TYPE_INT          , FPS_FIXED                             },
+
     { "Q_NEAREST"           , TYPE_INT          , Q_NEAREST                             },
     { "Q_LINEAR"            , TYPE_INT          , Q_LINEAR                              },
     { "Q_BEST"              , TYPE_INT          , Q_BEST                                },
@@ -116,6 +119,11 @@ DLCONSTANT __bgdexport( libmod_gfx, constants_def )[] = {
     { "GRAPH_MAX_SIZE"      , TYPE_INT          , BITMAP_CB_CIRCLE_GRAPH_MAX_SIZE       },
     { "GRAPH_AVERAGE_SIZE"  , TYPE_INT          , BITMAP_CB_CIRCLE_GRAPH_AVERAGE_SIZE   },
 
+    /* Screen recording */
+    { "RECORD_PNG"          , TYPE_INT          , RECORD_PNG                            },
+    { "RECORD_Y4M"          , TYPE_INT          , RECORD_Y4M                            },
+    { "RECORD_RAW"          , TYPE_INT          , RECORD_RAW                            },
+
 #ifdef LIBVLC_ENABLED
     /* MEDIA */
 
@@ -213,6 +221,16 @@ DLSYSFUNCS  __bgdexport( libmod_gfx, functions_exports )[] = {
     FUNC( "SCROLL_START"        , "IIIIII"          , TYPE_INT        , libmod_gfx_scroll_start3        ),
     FUNC( "SCROLL_STOP"         , "I"               , TYPE_INT        , libmod_gfx_scroll_stop          ),
     FUNC( "SCROLL_MOVE"         , "I"               , TYPE_INT        , libmod_gfx_scroll_move          ),
+    FUNC( "SCROLL_TILEMAP"      , "IIPDD"           , TYPE_INT        , libmod_gfx_scroll_tilemap2      ),
+    FUNC( "SCROLL_TILEMAP"      , "IIP"             , TYPE_INT        , libmod_gfx_scroll_tilemap       ),
+
+    /* tilemaps */
+    FUNC( "TILEMAP_NEW"         , "IIIII"           , TYPE_POINTER    , libmod_gfx_tilemap_new          ),
+    FUNC( "TILEMAP_DESTROY"     , "P"               , TYPE_INT        , libmod_gfx_tilemap_destroy      ),
+    FUNC( "TILEMAP_GET"         , "PII"             , TYPE_INT        , libmod_gfx_tilemap_get          ),
+    FUNC( "TILEMAP_SET"         , "PIII"            , TYPE_INT        , libmod_gfx_tilemap_set          ),
+    FUNC( "TILEMAP_FILL"        , "PIIIII"          , TYPE_INT        , libmod_gfx_tilemap_fill         ),
+    FUNC( "TILEMAP_REFRESH"     , "P"               , TYPE_INT        , libmod_gfx_tilemap_refresh      ),
 
     /* Regiones */
     FUNC( "REGION_DEFINE"       , "IIIII"           , TYPE_INT        , libmod_gfx_define_region        ),
@@ -220,6 +238,8 @@ DLSYSFUNCS  __bgdexport( libmod_gfx, functions_exports )[] = {
 
     /* Video */
     FUNC( "SCREEN_GET"          , ""                , TYPE_INT        , libmod_gfx_get_screen           ),
+    FUNC( "SCREEN_RECORD_START" , "SI"              , TYPE_INT        , libmod_gfx_screen_record_start  ),
+    FUNC( "SCREEN_RECORD_STOP"  , ""                , TYPE_INT        , libmod_gfx_screen_record_stop   ),
 
     FUNC( "RGB"                 , "BBB"             , TYPE_INT        , libmod_gfx_rgb                  ),
     FUNC( "RGB"                 , "IIBBB"           , TYPE_INT        , libmod_gfx_rgb_map              ),
@@ -236,11 +256,16 @@ DLSYSFUNCS  __bgdexport( libmod_gfx, functions_exports )[] = {
     FUNC( "FADE_ON"             , "II"              , TYPE_INT        , libmod_gfx_fade_on_region       ),
     FUNC( "FADE_OFF"            , "I"               , TYPE_INT        , libmod_gfx_fade_off             ),
     FUNC( "FADE_OFF"            , "II"              , TYPE_INT        , libmod_gfx_fade_off_region      ),
+    FUNC( "SCREEN_TINT"         , "IIII"            , TYPE_INT        , libmod_gfx_screen_tint          ),
+    FUNC( "SCREEN_FLASH"        , "IIII"            , TYPE_INT        , libmod_gfx_screen_flash         ),
+    FUNC( "SCREEN_LETTERBOX"    , "II"              , TYPE_INT        , libmod_gfx_screen_letterbox     ),
+    FUNC( "SCREEN_VIGNETTE"     , "II"              , TYPE_INT        , libmod_gfx_screen_vignette      ),
 
     /* Video */
     FUNC( "SET_MODE"            , "II"              , TYPE_INT        , libmod_gfx_set_mode             ),
     FUNC( "SET_MODE"            , "III"             , TYPE_INT        , libmod_gfx_set_mode_extended    ),
     FUNC( "SET_FPS"             , "II"              , TYPE_INT        , libmod_gfx_set_fps              ),
+    FUNC( "SET_FPS"             , "III"             , TYPE_INT        , libmod_gfx_set_fps_mode         ),
 
     FUNC( "WINDOW_SET_TITLE"    , "S"               , TYPE_INT        , libmod_gfx_set_title            ),
     FUNC( "WINDOW_SET_ICON"     , "II"              , TYPE_INT        , libmod_gfx_set_icon             ),
@@ -288,6 +313,7 @@ DLSYSFUNCS  __bgdexport( libmod_gfx, functions_exports )[] = {
     FUNC( "MAP_PUT"             , "IIIIIIIIIIBBBB"  , TYPE_INT        , libmod_gfx_map_put2             ),
     FUNC( "MAP_PUT"             , "IIIIIIIIIIBBBBI" , TYPE_INT        , libmod_gfx_map_put3             ),
     FUNC( "MAP_PUT"             , "IIIIIIIIIIBBBBIIIIIII", TYPE_INT   , libmod_gfx_map_put4             ),
+    FUNC( "MAP_RASTER_THREADS"  , "I"               , TYPE_INT        , libmod_gfx_map_raster_threads   ),
     FUNC( "MAP_NEW"             , "II"              , TYPE_INT        , libmod_gfx_new_map              ),
     FUNC( "MAP_NEW"             , "III"             , TYPE_INT        , libmod_gfx_new_map_extend       ),
     FUNC( "MAP_CLEAR"           , "II"              , TYPE_INT        , libmod_gfx_map_clear            ),
@@ -316,6 +342,7 @@ DLSYSFUNCS  __bgdexport( libmod_gfx, functions_exports )[] = {
 //    FUNC( "FPG_SAVE"            , "IS"              , TYPE_INT        , libmod_gfx_save_fpg             ),
     FUNC( "FPG_DEL"             , "I"               , TYPE_INT        , libmod_gfx_unload_fpg           ),
     FUNC( "FPG_UNLOAD"          , "I"               , TYPE_INT        , libmod_gfx_unload_fpg           ),
+    FUNC( "FPG_LOAD_METRICS"    , "P"               , TYPE_INT        , libmod_gfx_fpg_load_metrics     ),
 
     /* Graphic information */
     FUNC( "MAP_INFO_SET"        , "IIII"            , TYPE_INT        , libmod_gfx_graphic_set          ),
@@ -119,7 +119,7 @@ typedef struct _drawing_object {
 
     int64_t data_size; // count items of objs
     void * data; // objs Rects/Points
-                 // For DRAWOBJ_CIRCLE / DRAWOBJ_CIRCLE_FILLED / DRAWOBJ_CURVE is cache
+                 // For DRAWOBJ_CIRCLE / DRAWOBJ_CIRCLE_FILLED / DRAWOBJ_CURVE is a DRAW_CACHE
 
     /* Private */
 
@@ -379,15 +379,15 @@ static void _libmod_gfx_draw_object_draw( void * what, REGION * clip ) {
             break;
 #endif
         case DRAWOBJ_CIRCLE:
-            draw_circle( NULL, clip, dr->x1, dr->y1, dr->radius, &dr->data_size, &dr->data );
+            draw_circle( NULL, clip, dr->x1, dr->y1, dr->radius, ( DRAW_CACHE ** ) &dr->data );
             break;
 
         case DRAWOBJ_CIRCLE_FILLED:
-            draw_circle_filled( NULL, clip, dr->x1, dr->y1, dr->radius, &dr->data_size, &dr->data );
+            draw_circle_filled( NULL, clip, dr->x1, dr->y1, dr->radius, ( DRAW_CACHE ** ) &dr->data );
             break;
 
         case DRAWOBJ_CURVE:
-            draw_bezier( NULL, clip, dr->x1, dr->y1, dr->x1 + dr->x2, dr->y1 + dr->y2, dr->x1 + dr->x3, dr->y1 + dr->y3, dr->x1 + dr->x4, dr->y1 + dr->y4, dr->level, &dr->data_size, &dr->data );
+            draw_bezier( NULL, clip, dr->x1, dr->y1, dr->x1 + dr->x2, dr->y1 + dr->y2, dr->x1 + dr->x3, dr->y1 + dr->y3, dr->x1 + dr->x4, dr->y1 + dr->y4, dr->level, ( DRAW_CACHE ** ) &dr->data );
             break;
 
 #ifdef USE_SDL2_GPU
@@ -601,7 +601,6 @@ static void _libmod_gfx_draw_object_move( int64_t id, int64_t x, int64_t y ) {
     if ( dr ) {
         int64_t incx = x - dr->x1;
         int64_t incy = y - dr->y1;
-        int64_t i;
 
         dr->x1 += incx;
         dr->y1 += incy;
@@ -620,31 +619,28 @@ static void _libmod_gfx_draw_object_move( int64_t id, int64_t x, int64_t y ) {
 #if ENABLE_MULTIDRAW
             case DRAWOBJ_POINTS:
             case DRAWOBJ_LINES:
-#endif
-#ifdef USE_SDL2
-            case DRAWOBJ_CIRCLE:
-            case DRAWOBJ_CIRCLE_FILLED:
-#endif
-            case DRAWOBJ_CURVE:
                 if ( dr->data ) {
                     SDL_Point * p = ( SDL_Point * ) dr->data;
+                    int64_t i;
                     for ( i = 0; i < dr->data_size; i++, p++ ) {
                         p->x += incx, p->y += incy;
                     }
                 }
                 break;
+#endif
 
-#ifdef USE_SDL2_GPU
+            /* The cache is moved to x1, y1 the next time it's drawn */
             case DRAWOBJ_CIRCLE:
             case DRAWOBJ_CIRCLE_FILLED:
+            case DRAWOBJ_CURVE:
                 break;
-#endif
 
 #if ENABLE_MULTIDRAW
             case DRAWOBJ_RECTANGLES:
             case DRAWOBJ_RECTANGLES_FILLED:
                 if ( dr->data ) {
                     SDL_Rect * p = ( SDL_Rect * ) dr->data;
+                    int64_t i;
                     for ( i = 0; i < dr->data_size; i++, p++ ) {
                         p->x += incx, p->y += incy;
                     }
@@ -989,7 +985,7 @@ int64_t libmod_gfx_draw_circle( INSTANCE * my, int64_t * params ) {
         return _libmod_gfx_draw_object_new( dr, drawing_z );
     }
 
-    draw_circle( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], NULL, NULL ) ;
+    draw_circle( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], NULL ) ;
     return 1 ;
 }
 
@@ -1010,7 +1006,7 @@ int64_t libmod_gfx_draw_circle_filled( INSTANCE * my, int64_t * params ) {
         return _libmod_gfx_draw_object_new( dr, drawing_z );
     }
 
-    draw_circle_filled( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], NULL, NULL ) ;
+    draw_circle_filled( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], NULL ) ;
     return 1 ;
 }
 
@@ -1037,7 +1033,7 @@ int64_t libmod_gfx_draw_bezier( INSTANCE * my, int64_t * params ) {
         return _libmod_gfx_draw_object_new( dr, drawing_z );
     }
 
-    draw_bezier( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], params[ 3 ], params[ 4 ], params[ 5 ], params[ 6 ], params[ 7 ], params[ 8 ], NULL, NULL );
+    draw_bezier( drawing_graph, 0, params[ 0 ], params[ 1 ], params[ 2 ], params[ 3 ], params[ 4 ], params[ 5 ], params[ 6 ], params[ 7 ], params[ 8 ], NULL );
     return 1;
 }
 
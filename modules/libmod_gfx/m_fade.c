@@ -76,3 +76,31 @@ int64_t libmod_gfx_fade_off_region( INSTANCE * my, int64_t * params ) {
 }
 
 /* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_tint( INSTANCE * my, int64_t * params ) {
+    gr_tint_init( params[0], params[1], params[2], params[3] ) ;
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_flash( INSTANCE * my, int64_t * params ) {
+    gr_flash_init( params[0], params[1], params[2], params[3] ) ;
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_letterbox( INSTANCE * my, int64_t * params ) {
+    gr_letterbox_init( params[0], params[1] ) ;
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_vignette( INSTANCE * my, int64_t * params ) {
+    gr_vignette_init( params[0], params[1] ) ;
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
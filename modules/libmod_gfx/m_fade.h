@@ -39,4 +39,8 @@ extern int64_t libmod_gfx_fade_off( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fade_region( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fade_on_region( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fade_off_region( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_tint( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_flash( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_letterbox( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_vignette( INSTANCE * my, int64_t * params );
 #endif
@@ -28,6 +28,8 @@
 
 /* --------------------------------------------------------------------------- */
 
+#include <string.h>
+
 #include "bgdrtm.h"
 #include "bgddl.h"
 
@@ -92,6 +94,18 @@ int64_t libmod_gfx_fpg_new( INSTANCE * my, int64_t * params ) {
     return grlib_new();
 }
 
+/* --------------------------------------------------------------------------- */
+
+/* Fills files, maps, read, decode and register times (usecs) */
+
+int64_t libmod_gfx_fpg_load_metrics( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] ) return 0;
+    SDL_AtomicLock( &gr_load_metrics_lock );
+    memcpy( ( void * )( intptr_t ) params[0], &gr_load_metrics, sizeof( gr_load_metrics ) );
+    SDL_AtomicUnlock( &gr_load_metrics_lock );
+    return 1;
+}
+
 /* --------------------------------------------------------------------------- */
 /* --------------------------------------------------------------------------- */
 /* --------------------------------------------------------------------------- */
@@ -38,5 +38,6 @@ extern int64_t libmod_gfx_unload_fpg( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fpg_exists( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fpg_add( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_fpg_new( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_fpg_load_metrics( INSTANCE * my, int64_t * params );
 
 #endif
@@ -927,6 +927,16 @@ int64_t libmod_gfx_map_save( INSTANCE * my, int64_t * params )
     return r;
 }
 
+/* --------------------------------------------------------------------------- */
+/** MAP_RASTER_THREADS(THREADS)
+ *  Draws graph to graph operations in software, with THREADS threads
+ *  (0 disables it, -1 uses one by CPU). Returns the previous value
+ */
+
+int64_t libmod_gfx_map_raster_threads( INSTANCE * my, int64_t * params ) {
+    return gr_raster_set_threads( params[0] );
+}
+
 /* --------------------------------------------------------------------------- */
 
 int64_t libmod_gfx_set_texture_quality( INSTANCE * my, int64_t * params ) {
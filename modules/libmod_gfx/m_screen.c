@@ -28,8 +28,11 @@
 
 /* --------------------------------------------------------------------------- */
 
+#include <SDL_image.h>
+
 #include "bgdrtm.h"
 #include "bgddl.h"
+#include "xstrings.h"
 
 #include "libbggfx.h"
 #include "libmod_gfx.h"
@@ -89,6 +92,20 @@ int64_t libmod_gfx_get_screen( INSTANCE * my, int64_t * params ) {
     return 0;
 }
 
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_record_start( INSTANCE * my, int64_t * params ) {
+    int64_t r = g_record_start( string_get( params[0] ), params[1], IMG_SavePNG );
+    string_discard( params[0] );
+    return r;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_screen_record_stop( INSTANCE * my, int64_t * params ) {
+    return g_record_stop();
+}
+
 /* --------------------------------------------------------------------------- */
 /* Funciones de inicializacion y carga                                         */
 /* --------------------------------------------------------------------------- */
@@ -111,3 +128,11 @@ int64_t libmod_gfx_set_fps( INSTANCE * my, int64_t * params ) {
 }
 
 /* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_set_fps_mode( INSTANCE * my, int64_t * params ) {
+    gr_set_fps( params[0], params[1] ) ;
+    gr_set_fps_mode( params[2] ) ;
+    return params[0];
+}
+
+/* --------------------------------------------------------------------------- */
@@ -36,9 +36,12 @@
 extern int64_t libmod_gfx_define_region( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_out_region( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_get_screen( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_record_start( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_screen_record_stop( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_set_mode( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_set_mode_extended( INSTANCE * my, int64_t * params );
 extern int64_t libmod_gfx_set_fps( INSTANCE * my, int64_t * params );
+extern int64_t libmod_gfx_set_fps_mode( INSTANCE * my, int64_t * params );
 //extern int64_t libmod_gfx_list_modes( INSTANCE * my, int64_t * params );
 //extern int64_t libmod_gfx_mode_is_ok( INSTANCE * my, int64_t * params );
 
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/* --------------------------------------------------------------------------- */
+
+#ifndef __M_TILEMAP_H
+#define __M_TILEMAP_H
+
+#include "bgddl.h"
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_gfx_tilemap_new( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_tilemap_destroy( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_tilemap_get( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_tilemap_set( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_tilemap_fill( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_tilemap_refresh( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_scroll_tilemap( INSTANCE * my, int64_t * params );
+int64_t libmod_gfx_scroll_tilemap2( INSTANCE * my, int64_t * params );
+
+/* --------------------------------------------------------------------------- */
+
+#endif
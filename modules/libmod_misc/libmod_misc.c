@@ -28,6 +28,7 @@
 
 #include <SDL.h>
 
+#include "bgdrtm.h"
 #include "xctype.h"
 #include "bgddl.h"
 #include "dlvaracc.h"
@@ -86,21 +87,34 @@ DLVARFIXUP __bgdexport( libmod_misc, globals_fixup)[] = {
    Lowest priority last execute */
 
 HOOK __bgdexport( libmod_misc, handler_hooks )[] = {
+    { 9600, libmod_misc_proc_state_hook  },
     {  100, libmod_misc_advance_timers   },
     {    0, NULL                         }
 } ;
 
 /* --------------------------------------------------------------------------- */
 
+/* The scan locals are only used by GET_ID */
+
+void __bgdexport( libmod_misc, process_exec_hook )( INSTANCE * r );
+
+static int libmod_misc_process_exec_filter( PROCDEF * proc ) {
+    return procdef_calls( proc, libmod_misc_proc_get_id );
+}
+
+/* --------------------------------------------------------------------------- */
+
 void __bgdexport( libmod_misc, module_initialize )() {
 #ifndef TARGET_DINGUX_A320
     if ( !SDL_WasInit( SDL_INIT_TIMER ) ) SDL_InitSubSystem( SDL_INIT_TIMER );
 #endif
+    instance_hook_filter( __bgdexport( libmod_misc, process_exec_hook ), libmod_misc_process_exec_filter );
 }
 
 /* --------------------------------------------------------------------------- */
 
 void __bgdexport( libmod_misc, module_finalize )() {
+    crypt_stream_pool_exit();
 #ifndef TARGET_DINGUX_A320
     if ( SDL_WasInit( SDL_INIT_TIMER ) ) SDL_QuitSubSystem( SDL_INIT_TIMER );
 #endif
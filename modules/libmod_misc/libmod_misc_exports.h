@@ -56,6 +56,7 @@ DLCONSTANT  __bgdexport( libmod_misc, constants_def)[] =
     { "O_WRITE"                 , TYPE_QWORD    , 2                     },
     { "O_ZREAD"                 , TYPE_QWORD    , 3                     },
     { "O_ZWRITE"                , TYPE_QWORD    , 4                     },
+    { "O_CWRITE"                , TYPE_QWORD    , 5                     },
 
     { "SEEK_SET"                , TYPE_QWORD    , 0                     },
     { "SEEK_CUR"                , TYPE_QWORD    , 1                     },
@@ -149,6 +150,14 @@ DLSYSFUNCS  __bgdexport( libmod_misc, functions_exports)[] =
     FUNC( "CRYPT_DECRYPT"   , "IPPPI"   , TYPE_INT          , libmod_misc_crypt_decrypt2         ),
 #endif
 
+    FUNC( "CRYPT_STREAM_NEW"    , "PP"  , TYPE_POINTER      , libmod_misc_crypt_stream_new       ),
+    FUNC( "CRYPT_STREAM_DEL"    , "P"   , TYPE_INT          , libmod_misc_crypt_stream_del       ),
+    FUNC( "CRYPT_STREAM_ENCRYPT", "PPI" , TYPE_INT          , libmod_misc_crypt_stream_encrypt   ),
+    FUNC( "CRYPT_STREAM_DECRYPT", "PPI" , TYPE_INT          , libmod_misc_crypt_stream_decrypt   ),
+    FUNC( "CRYPT_STREAM_TAG"    , "PP"  , TYPE_INT          , libmod_misc_crypt_stream_tag       ),
+    FUNC( "CRYPT_STREAM_VERIFY" , "PP"  , TYPE_INT          , libmod_misc_crypt_stream_verify    ),
+    FUNC( "CRYPT_FILE_KEY"      , "P"   , TYPE_INT          , libmod_misc_crypt_file_key         ),
+
     /* Directories */
     FUNC( "CD"              , ""        , TYPE_STRING       , libmod_misc_dir_cd                 ),
     FUNC( "CD"              , "S"       , TYPE_INT          , libmod_misc_dir_chdir              ),
@@ -264,6 +273,24 @@ DLSYSFUNCS  __bgdexport( libmod_misc, functions_exports)[] =
     FUNC( "MEMORY_FREE"     , ""        , TYPE_INT          , libmod_misc_mem_memory_free        ),
     FUNC( "MEMORY_TOTAL"    , ""        , TYPE_INT          , libmod_misc_mem_memory_total       ),
 
+    /* Vec */
+    FUNC( "VEC_AXPY"        , "PPDI"    , TYPE_INT          , libmod_misc_vec_axpy               ),
+    FUNC( "VEC_CLAMP"       , "PDDI"    , TYPE_INT          , libmod_misc_vec_clamp              ),
+    FUNC( "VEC_CLAMPI"      , "PIII"    , TYPE_INT          , libmod_misc_vec_clampi             ),
+    FUNC( "VEC_SUM"         , "PI"      , TYPE_DOUBLE       , libmod_misc_vec_sum                ),
+    FUNC( "VEC_MIN"         , "PI"      , TYPE_DOUBLE       , libmod_misc_vec_min                ),
+    FUNC( "VEC_MAX"         , "PI"      , TYPE_DOUBLE       , libmod_misc_vec_max                ),
+    FUNC( "VEC_SUMI"        , "PI"      , TYPE_INT          , libmod_misc_vec_sumi               ),
+    FUNC( "VEC_MINI"        , "PI"      , TYPE_INT          , libmod_misc_vec_mini               ),
+    FUNC( "VEC_MAXI"        , "PI"      , TYPE_INT          , libmod_misc_vec_maxi               ),
+    FUNC( "VEC_DISTANCE"    , "PPPDDI"  , TYPE_INT          , libmod_misc_vec_distance           ),
+    FUNC( "VEC_SIN"         , "PPI"     , TYPE_INT          , libmod_misc_vec_sin                ),
+    FUNC( "VEC_COS"         , "PPI"     , TYPE_INT          , libmod_misc_vec_cos                ),
+    FUNC( "VEC_GATHER"      , "PPPI"    , TYPE_INT          , libmod_misc_vec_gather             ),
+    FUNC( "VEC_SCATTER"     , "PPPI"    , TYPE_INT          , libmod_misc_vec_scatter            ),
+    FUNC( "VEC_GATHERI"     , "PPPI"    , TYPE_INT          , libmod_misc_vec_gatheri            ),
+    FUNC( "VEC_SCATTERI"    , "PPPI"    , TYPE_INT          , libmod_misc_vec_scatteri           ),
+
     /* Signals & Processes */
     FUNC( "GET_ID"          , "I"       , TYPE_INT          , libmod_misc_proc_get_id            ),
     FUNC( "GET_STATUS"      , "I"       , TYPE_QWORD        , libmod_misc_proc_get_status        ),
@@ -275,8 +302,11 @@ DLSYSFUNCS  __bgdexport( libmod_misc, functions_exports)[] =
     FUNC( "EXIT"            , "S"       , TYPE_INT          , libmod_misc_proc_exit_1            ),
     FUNC( "EXIT"            , ""        , TYPE_INT          , libmod_misc_proc_exit_0            ),
     FUNC( "EXISTS"          , "I"       , TYPE_INT          , libmod_misc_proc_running           ),
+    FUNC( "COUNT"           , "I"       , TYPE_INT          , libmod_misc_proc_count             ),
     FUNC( "PAUSE"           , ""        , TYPE_INT          , libmod_misc_proc_pause0            ),
     FUNC( "RESUME"          , ""        , TYPE_INT          , libmod_misc_proc_resume0           ),
+    FUNC( "SAVE_STATE"      , "S"       , TYPE_INT          , libmod_misc_proc_save_state        ),
+    FUNC( "LOAD_STATE"      , "S"       , TYPE_INT          , libmod_misc_proc_load_state        ),
 /*    FUNC( "PAUSE"           , "I"       , TYPE_INT          , libmod_misc_proc_pause1            ),
     FUNC( "RESUME"          , "I"       , TYPE_INT          , libmod_misc_proc_resume1           ), */
 
@@ -287,6 +317,9 @@ DLSYSFUNCS  __bgdexport( libmod_misc, functions_exports)[] =
     FUNC( "REGEX"           , "SS"      , TYPE_INT          , libmod_misc_regex_regex            ),
     FUNC( "REGEX_REPLACE"   , "SSS"     , TYPE_STRING       , libmod_misc_regex_regex_replace    ),
     FUNC( "SPLIT"           , "SSPI"    , TYPE_INT          , libmod_misc_regex_split            ),
+    FUNC( "REGEX_COMPILE"   , "S"       , TYPE_INT          , libmod_misc_regex_compile          ),
+    FUNC( "REGEX_MATCH"     , "IS"      , TYPE_INT          , libmod_misc_regex_match            ),
+    FUNC( "REGEX_FREE"      , "I"       , TYPE_INT          , libmod_misc_regex_free             ),
     FUNC( "JOIN"            , "SPI"     , TYPE_STRING       , libmod_misc_regex_join             ),
 
     FUNC( "SAY"             , "S"       , TYPE_UNDEFINED    , libmod_misc_say_say                ),
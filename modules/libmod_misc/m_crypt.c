@@ -26,7 +26,7 @@
  *
  */
 
-#if USE_CRYPT
+#include <SDL.h>
 
 #include "b_crypt.h"
 
@@ -35,11 +35,16 @@
 #include <string.h>
 
 #include "bgddl.h"
+#include "files.h"
 
 #include "libmod_misc.h"
 
 /* --------------------------------------------------------------------------- */
 
+#if USE_CRYPT
+
+/* --------------------------------------------------------------------------- */
+
 int64_t libmod_misc_crypt_new( INSTANCE * my, int64_t * params ) {
     return ( ( int64_t ) crypt_create( params[0], ( char * ) params[1] ) );
 }
@@ -100,3 +105,256 @@ int64_t libmod_misc_crypt_decrypt2( INSTANCE * my, int64_t * params ) {
 /* --------------------------------------------------------------------------- */
 
 #endif
+
+/* --------------------------------------------------------------------------- */
+/* Stream cipher (ChaCha20 + Poly1305)                                         */
+/* --------------------------------------------------------------------------- */
+
+#define CRYPT_STREAM_PARALLEL_MIN   ( 1024 * 1024 )
+#define CRYPT_STREAM_MAX_THREADS    16
+
+typedef struct {
+    const crypt_stream * cs;
+    uint64_t offset;
+    uint8_t * data;
+    size_t size;
+} crypt_stream_part;
+
+/* Workers are started on the first big buffer and wait for the next one,
+   they are stopped when the module is unloaded */
+
+static struct {
+    SDL_Thread * threads[CRYPT_STREAM_MAX_THREADS];
+    int nthreads;
+    int started;
+    SDL_mutex * lock;
+    SDL_cond * wake;
+    SDL_cond * done;
+    int generation;
+    int pending;
+    int quit;
+    SDL_atomic_t next;
+    int nparts;
+    crypt_stream_part parts[CRYPT_STREAM_MAX_THREADS];
+} crypt_pool;
+
+/* --------------------------------------------------------------------------- */
+
+static void crypt_stream_run_parts() {
+    int n;
+
+    while ( ( n = SDL_AtomicAdd( &crypt_pool.next, 1 ) ) < crypt_pool.nparts )
+        crypt_stream_xor( crypt_pool.parts[n].cs, crypt_pool.parts[n].offset, crypt_pool.parts[n].data, crypt_pool.parts[n].size );
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int crypt_stream_worker( void * arg ) {
+    int generation = ( int ) ( intptr_t ) arg;
+
+    SDL_LockMutex( crypt_pool.lock );
+    for ( ;; ) {
+        while ( !crypt_pool.quit && crypt_pool.generation == generation ) SDL_CondWait( crypt_pool.wake, crypt_pool.lock );
+        if ( crypt_pool.quit ) break;
+        generation = crypt_pool.generation;
+        SDL_UnlockMutex( crypt_pool.lock );
+
+        crypt_stream_run_parts();
+
+        SDL_LockMutex( crypt_pool.lock );
+        if ( !--crypt_pool.pending ) SDL_CondSignal( crypt_pool.done );
+    }
+    SDL_UnlockMutex( crypt_pool.lock );
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+static int crypt_stream_pool_start() {
+    int count = SDL_GetCPUCount(), n;
+
+    crypt_pool.started = 1;
+
+    if ( count > CRYPT_STREAM_MAX_THREADS ) count = CRYPT_STREAM_MAX_THREADS;
+    if ( count < 2 ) return 0;
+
+    crypt_pool.lock = SDL_CreateMutex();
+    crypt_pool.wake = SDL_CreateCond();
+    crypt_pool.done = SDL_CreateCond();
+
+    /* Without a pool the caller ciphers alone */
+    if ( !crypt_pool.lock || !crypt_pool.wake || !crypt_pool.done ) return 0;
+
+    for ( n = 0; n < count - 1; n++ ) {
+        if ( !( crypt_pool.threads[n] = SDL_CreateThread( crypt_stream_worker, "crypt", ( void * ) ( intptr_t ) crypt_pool.generation ) ) ) break;
+    }
+    crypt_pool.nthreads = n;
+
+    return n;
+}
+
+/* --------------------------------------------------------------------------- */
+
+void crypt_stream_pool_exit() {
+    int n;
+
+    if ( crypt_pool.nthreads ) {
+        SDL_LockMutex( crypt_pool.lock );
+        crypt_pool.quit = 1;
+        SDL_CondBroadcast( crypt_pool.wake );
+        SDL_UnlockMutex( crypt_pool.lock );
+
+        for ( n = 0; n < crypt_pool.nthreads; n++ ) {
+            SDL_WaitThread( crypt_pool.threads[n], NULL );
+            crypt_pool.threads[n] = NULL;
+        }
+    }
+
+    if ( crypt_pool.lock ) SDL_DestroyMutex( crypt_pool.lock );
+    if ( crypt_pool.wake ) SDL_DestroyCond( crypt_pool.wake );
+    if ( crypt_pool.done ) SDL_DestroyCond( crypt_pool.done );
+
+    crypt_pool.lock = NULL;
+    crypt_pool.wake = crypt_pool.done = NULL;
+    crypt_pool.nthreads = 0;
+    crypt_pool.started = 0;
+    crypt_pool.quit = 0;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* The key stream of each block is independent, big buffers are split in
+   block aligned parts, ciphered by the caller and the pool workers */
+
+static void crypt_stream_xor_parallel( const crypt_stream * cs, uint64_t offset, uint8_t * data, size_t size ) {
+    int count, n;
+    size_t part_size, done = 0;
+
+    if ( size >= CRYPT_STREAM_PARALLEL_MIN && !crypt_pool.started ) crypt_stream_pool_start();
+
+    if ( !crypt_pool.nthreads || size < CRYPT_STREAM_PARALLEL_MIN ) {
+        crypt_stream_xor( cs, offset, data, size );
+        return;
+    }
+
+    count = crypt_pool.nthreads + 1;
+    part_size = ( size / count + CHACHA_BLOCK_SIZE - 1 ) & ~( size_t )( CHACHA_BLOCK_SIZE - 1 );
+
+    for ( n = 0; n < count && done < size; n++ ) {
+        crypt_pool.parts[n].cs = cs;
+        crypt_pool.parts[n].offset = offset + done;
+        crypt_pool.parts[n].data = data + done;
+        crypt_pool.parts[n].size = ( size - done > part_size ) ? part_size : size - done;
+        done += crypt_pool.parts[n].size;
+    }
+    crypt_pool.nparts = n;
+    SDL_AtomicSet( &crypt_pool.next, 0 );
+
+    SDL_LockMutex( crypt_pool.lock );
+    crypt_pool.pending = crypt_pool.nthreads;
+    crypt_pool.generation++;
+    SDL_CondBroadcast( crypt_pool.wake );
+    SDL_UnlockMutex( crypt_pool.lock );
+
+    crypt_stream_run_parts();
+
+    SDL_LockMutex( crypt_pool.lock );
+    while ( crypt_pool.pending ) SDL_CondWait( crypt_pool.done, crypt_pool.lock );
+    SDL_UnlockMutex( crypt_pool.lock );
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* CRYPT_STREAM_NEW( POINTER key, POINTER nonce )
+   key is 32 bytes, nonce is 12 bytes and must not be repeated with the same key */
+
+int64_t libmod_misc_crypt_stream_new( INSTANCE * my, int64_t * params ) {
+    crypt_stream * cs;
+
+    if ( !params[0] || !params[1] ) return 0;
+
+    cs = ( crypt_stream * ) malloc( sizeof( crypt_stream ) );
+    if ( cs ) crypt_stream_init( cs, ( uint8_t * )( intptr_t ) params[0], ( uint8_t * )( intptr_t ) params[1], NULL, 0 );
+
+    return ( int64_t )( intptr_t ) cs;
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_misc_crypt_stream_del( INSTANCE * my, int64_t * params ) {
+    free( ( crypt_stream * )( intptr_t ) params[0] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* CRYPT_STREAM_ENCRYPT( POINTER stream, POINTER data, INT size )
+   Ciphers the data in place, after the data of the previous calls */
+
+int64_t libmod_misc_crypt_stream_encrypt( INSTANCE * my, int64_t * params ) {
+    crypt_stream * cs = ( crypt_stream * )( intptr_t ) params[0];
+    uint8_t * data = ( uint8_t * )( intptr_t ) params[1];
+
+    if ( !cs || !data || params[2] < 0 ) return -1;
+
+    crypt_stream_xor_parallel( cs, cs->data_size, data, params[2] );
+    crypt_stream_authenticate( cs, data, params[2] );
+
+    return params[2];
+}
+
+/* --------------------------------------------------------------------------- */
+
+int64_t libmod_misc_crypt_stream_decrypt( INSTANCE * my, int64_t * params ) {
+    crypt_stream * cs = ( crypt_stream * )( intptr_t ) params[0];
+    uint8_t * data = ( uint8_t * )( intptr_t ) params[1];
+    uint64_t offset;
+
+    if ( !cs || !data || params[2] < 0 ) return -1;
+
+    offset = cs->data_size;
+    crypt_stream_authenticate( cs, data, params[2] );
+    crypt_stream_xor_parallel( cs, offset, data, params[2] );
+
+    return params[2];
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* CRYPT_STREAM_TAG( POINTER stream, POINTER tag )
+   Ends the stream and stores the 16 bytes tag */
+
+int64_t libmod_misc_crypt_stream_tag( INSTANCE * my, int64_t * params ) {
+    crypt_stream * cs = ( crypt_stream * )( intptr_t ) params[0];
+
+    if ( !cs || !params[1] ) return 0;
+
+    crypt_stream_tag( cs, ( uint8_t * )( intptr_t ) params[1] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* CRYPT_STREAM_VERIFY( POINTER stream, POINTER tag )
+   Ends the stream, returns 1 if the data was not modified */
+
+int64_t libmod_misc_crypt_stream_verify( INSTANCE * my, int64_t * params ) {
+    crypt_stream * cs = ( crypt_stream * )( intptr_t ) params[0];
+
+    if ( !cs || !params[1] ) return 0;
+
+    return crypt_stream_verify( cs, ( uint8_t * )( intptr_t ) params[1] );
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* CRYPT_FILE_KEY( POINTER key )
+   32 bytes key for crypted files, NULL for none */
+
+int64_t libmod_misc_crypt_file_key( INSTANCE * my, int64_t * params ) {
+    file_crypt_key( ( uint8_t * )( intptr_t ) params[0] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
@@ -26,16 +26,26 @@
  *
  */
 
-#if USE_CRYPT
 #ifndef __M_CRYPT_H
 #define __M_CRYPT_H
 
+#if USE_CRYPT
 extern int64_t libmod_misc_crypt_new( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_crypt_del( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_crypt_encrypt( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_crypt_decrypt( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_crypt_encrypt2( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_crypt_decrypt2( INSTANCE * my, int64_t * params );
-
 #endif
+
+extern int64_t libmod_misc_crypt_stream_new( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_stream_del( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_stream_encrypt( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_stream_decrypt( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_stream_tag( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_stream_verify( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_crypt_file_key( INSTANCE * my, int64_t * params );
+
+extern void crypt_stream_pool_exit();
+
 #endif
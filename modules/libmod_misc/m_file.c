@@ -50,9 +50,9 @@ int64_t libmod_misc_file_save( INSTANCE * my, int64_t * params ) {
     filename = string_get( params[0] );
     if ( !filename ) return 0;
 
-    fp = file_open( filename, "wb0" );
+    fp = file_open( filename, file_crypt_keyed() ? "wb0c" : "wb0" );
     if ( fp ) {
-        result = savetypes( fp, ( void * )( intptr_t )params[1], ( void * )( intptr_t )params[2], params[3], 0 );
+        result = savetypes_snapshot( fp, ( void * )( intptr_t )params[1], ( void * )( intptr_t )params[2], params[3] );
         file_close( fp );
     }
     string_discard( params[0] );
@@ -69,7 +69,7 @@ int64_t libmod_misc_file_load( INSTANCE * my, int64_t * params ) {
 
     fp = file_open( filename, "rb0" );
     if ( fp ) {
-        result = loadtypes( fp, ( void * )( intptr_t )params[1], ( void * )( intptr_t )params[2], params[3], 0 );
+        result = loadtypes_snapshot( fp, ( void * )( intptr_t )params[1], ( void * )( intptr_t )params[2], params[3] );
         file_close( fp );
     }
     string_discard( params[0] );
@@ -77,10 +77,10 @@ int64_t libmod_misc_file_load( INSTANCE * my, int64_t * params ) {
 }
 
 int64_t libmod_misc_file_fopen( INSTANCE * my, int64_t * params ) {
-    static char * ops[] = { "rb0", "r+b0", "wb0", "rb", "wb6" };
+    static char * ops[] = { "rb0", "r+b0", "wb0", "rb", "wb6", "wb0c" };
     int64_t r;
 
-    if ( params[1] < 0 || params[1] > 4 )
+    if ( params[1] < 0 || params[1] > 5 )
         params[0] = 0;
 
     r = ( int64_t ) ( intptr_t ) file_open( string_get( params[0] ), ops[params[1]] );
@@ -35,6 +35,7 @@
 #include "instance.h"
 
 #include "xstrings.h"
+#include "instance_state.h"
 
 #include "libmod_misc.h"
 
@@ -113,103 +114,134 @@ int64_t libmod_misc_proc_running( INSTANCE * my, int64_t * params ) {
 
 /* ----------------------------------------------------------------- */
 
+/* Instances of a type (all if 0), without looking at them. The killed ones
+   are counted until they end */
+
+int64_t libmod_misc_proc_count( INSTANCE * my, int64_t * params ) {
+    if ( params[0] >= FIRST_INSTANCE_ID ) return instance_get( params[0] ) ? 1 : 0;
+    return instance_count_by_type( params[0] );
+}
+
+/* ----------------------------------------------------------------- */
+
+/* Signals are sent in two steps: the targets are gathered in a list, and
+   then the signal is applied to all of them in one pass. The list is also
+   the queue used to walk the trees, so there is no recursion */
+
+static INSTANCE ** signal_targets = NULL;
+static int64_t signal_targets_count = 0;
+static int64_t signal_targets_reserved = 0;
+
+/* ----------------------------------------------------------------- */
+
+static int __libmod_misc_proc_signal_add( INSTANCE * i ) {
+    INSTANCE ** targets;
+    int64_t reserved;
+
+    if ( signal_targets_count >= signal_targets_reserved ) {
+        reserved = signal_targets_reserved ? signal_targets_reserved * 2 : 256;
+        if ( !( targets = ( INSTANCE ** ) realloc( signal_targets, reserved * sizeof( INSTANCE * ) ) ) ) return -1;
+        signal_targets = targets;
+        signal_targets_reserved = reserved;
+    }
+
+    signal_targets[ signal_targets_count++ ] = i;
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+/* Adds an instance and all its descendants */
+
+static void __libmod_misc_proc_signal_add_tree( INSTANCE * root ) {
+    int64_t n = signal_targets_count, limit = n + instance_count_by_type( ALL_PROCESS );
+    INSTANCE * i;
+
+    if ( __libmod_misc_proc_signal_add( root ) ) return;
+
+    /* The limit stops on family locals changed by hand that make a loop */
+    for ( ; n < signal_targets_count && signal_targets_count <= limit; n++ ) {
+        for ( i = instance_getson( signal_targets[ n ] ); i; i = instance_getbigbro( i ) ) {
+            if ( __libmod_misc_proc_signal_add( i ) ) return;
+        }
+    }
+}
+
+/* ----------------------------------------------------------------- */
+
+/* Applies the signal to every target and empties the list. The instances
+   killed are destroyed when they get their turn, as always */
+
+static void __libmod_misc_proc_signal_apply( int64_t signal ) {
+    int64_t n, status, tree = signal >= S_TREE, force, what, mask, newstatus;
+    INSTANCE * i;
+
+    what = tree ? signal - S_TREE : signal;
+    force = what >= S_FORCE;
+    if ( force ) what -= S_FORCE;
+
+    mask = ( tree ? SMASK_KILL_TREE : SMASK_KILL ) << what;
+
+    switch ( what ) {
+        case S_KILL:    newstatus = STATUS_KILLED;      break;
+        case S_WAKEUP:  newstatus = STATUS_RUNNING;     break;
+        case S_SLEEP:   newstatus = STATUS_SLEEPING;    break;
+        default:        newstatus = STATUS_FROZEN;      break;
+    }
+
+    for ( n = 0; n < signal_targets_count; n++ ) {
+        i = signal_targets[ n ];
+        status = LOCQWORD( libmod_misc, i, STATUS );
+
+        if ( !( status & ( STATUS_RUNNING | STATUS_SLEEPING | STATUS_FROZEN ) ) ) continue;
+        if ( !force && ( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & mask ) ) continue;
+
+        /* S_KILL clears the waiting and paused flags, the others keep them */
+        if ( !tree && what == S_KILL )
+            LOCQWORD( libmod_misc, i, STATUS ) = STATUS_KILLED;
+        else
+            LOCQWORD( libmod_misc, i, STATUS ) = ( status & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | newstatus;
+    }
+
+    signal_targets_count = 0;
+}
+
+/* ----------------------------------------------------------------- */
+
 int64_t libmod_misc_proc_signal( INSTANCE * my, int64_t * params ) {
     INSTANCE * i, * ctx;
-    int64_t fake_params[2];
+    int64_t signal = params[1], what = signal % S_FORCE;
+
+    /* Unknown signals do nothing */
+    if ( signal < 0 || signal >= S_TREE + S_FORCE + S_FORCE || what < S_KILL || what > S_FREEZE ) return params[0] < FIRST_INSTANCE_ID ? 0 : 1;
+
+    signal_targets_count = 0;
 
     if ( params[0] == ALL_PROCESS ) {
-        /* Signal all process but my */
-        int64_t myid = LOCQWORD( libmod_misc, my, PROCESS_ID );
-        fake_params[1] = ( params[1] >= S_TREE ) ? params[1] - S_TREE : params[1];
-        i = first_instance;
-        while ( i ) {
-            if ( LOCQWORD( libmod_misc, i, PROCESS_ID ) != myid && ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_RUNNING | STATUS_SLEEPING | STATUS_FROZEN ) ) ) {
-                fake_params[0] = LOCQWORD( libmod_misc, i, PROCESS_ID );
-                libmod_misc_proc_signal( my, fake_params );
-            }
-            i = i->next;
-        }
+        /* Signal all process but my, without trees */
+        if ( signal >= S_TREE ) signal -= S_TREE;
+        for ( i = first_instance; i; i = i->next )
+            if ( i != my && __libmod_misc_proc_signal_add( i ) ) break;
+        __libmod_misc_proc_signal_apply( signal );
         return 0;
     }
     else if ( params[0] < FIRST_INSTANCE_ID ) {
         /* Signal by type */
-        fake_params[1] = params[1];
-
         ctx = NULL;
         while ( ( i = instance_get_by_type( params[0], &ctx ) ) ) {
-            fake_params[0] = LOCQWORD( libmod_misc, i, PROCESS_ID );
-            libmod_misc_proc_signal( my, fake_params );
+            if ( signal >= S_TREE ) __libmod_misc_proc_signal_add_tree( i );
+            else if ( __libmod_misc_proc_signal_add( i ) ) break;
         }
+        __libmod_misc_proc_signal_apply( signal );
         return 0;
     }
 
-    i = instance_get( params[0] );
-    if ( i ) {
-        if ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_RUNNING | STATUS_SLEEPING | STATUS_FROZEN ) ) {
-            switch ( params[1] ) {
-                case S_KILL:
-                case S_KILL_FORCE:
-                    if ( params[1] == S_KILL_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_KILL ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = STATUS_KILLED;
-                    break;
-
-                case S_WAKEUP:
-                case S_WAKEUP_FORCE:
-                    if ( params[1] == S_WAKEUP_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_WAKEUP ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_RUNNING;
-                    break;
-
-                case S_SLEEP:
-                case S_SLEEP_FORCE:
-                    if ( params[1] == S_SLEEP_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_SLEEP ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_SLEEPING;
-                    break;
-
-                case S_FREEZE:
-                case S_FREEZE_FORCE:
-                    if ( params[1] == S_FREEZE_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_FREEZE ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_FROZEN;
-                    break;
-
-                case S_KILL_TREE:
-                case S_KILL_TREE_FORCE:
-                    if ( params[1] == S_KILL_TREE_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_KILL_TREE ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_KILLED;
-                    break;
-
-                case S_WAKEUP_TREE:
-                case S_WAKEUP_TREE_FORCE:
-                    if ( params[1] == S_WAKEUP_TREE_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_WAKEUP_TREE ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_RUNNING;
-                    break;
-
-                case S_SLEEP_TREE:
-                case S_SLEEP_TREE_FORCE:
-                    if ( params[1] == S_SLEEP_TREE_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_SLEEP_TREE ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_SLEEPING;
-                    break;
-
-                case S_FREEZE_TREE:
-                case S_FREEZE_TREE_FORCE:
-                    if ( params[1] == S_FREEZE_TREE_FORCE || !( LOCQWORD( libmod_misc, i, SIGNAL_ACTION ) & SMASK_FREEZE_TREE ) )
-                        LOCQWORD( libmod_misc, i, STATUS ) = ( LOCQWORD( libmod_misc, i, STATUS ) & ( STATUS_WAITING_MASK | STATUS_PAUSED_MASK ) ) | STATUS_FROZEN;
-                    break;
-
-                default:
-                    return 1;
-            }
-        }
-
-        if ( params[1] >= S_TREE ) {
-            fake_params[1] = params[1];
-            i = instance_getson( i );
-            while ( i ) {
-                fake_params[0] = LOCQWORD( libmod_misc, i, PROCESS_ID );
-                libmod_misc_proc_signal( my, fake_params );
-                i = instance_getbigbro( i ) ;
-            }
-        }
+    if ( ( i = instance_get( params[0] ) ) ) {
+        if ( signal >= S_TREE ) __libmod_misc_proc_signal_add_tree( i );
+        else __libmod_misc_proc_signal_add( i );
+        __libmod_misc_proc_signal_apply( signal );
     }
+
     return 1;
 }
 
@@ -520,3 +552,70 @@ int64_t libmod_misc_proc_resume1( INSTANCE * my, int64_t * params ) {
 }
 #endif
 /* ----------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------- */
+/* Process tree state. Saving and restoring are done when the frame  */
+/* is complete, with every process stopped at its FRAME.             */
+
+static file * state_save_fp = NULL;
+static void * state_load_pending = NULL;
+
+/* --------------------------------------------------------------------------- */
+/** SAVE_STATE (STRING filename)
+ *  Saves globals, processes and strings at the end of the current frame
+ *  Returns 1 if the save is scheduled, 0 if the file can't be created
+ */
+
+int64_t libmod_misc_proc_save_state( INSTANCE * my, int64_t * params ) {
+    const char * filename = string_get( params[0] );
+    file * fp = NULL;
+
+    if ( filename && ( fp = file_open( filename, file_crypt_keyed() ? "wb0c" : "wb0" ) ) ) {
+        if ( state_save_fp ) file_close( state_save_fp );
+        state_save_fp = fp;
+    }
+    string_discard( params[0] );
+    return fp ? 1 : 0;
+}
+
+/* --------------------------------------------------------------------------- */
+/** LOAD_STATE (STRING filename)
+ *  Replaces globals and processes with a saved state at the end of the
+ *  current frame. The state must be saved by the same program.
+ *  Returns 1 if the load is scheduled, 0 if the file is not a valid state
+ */
+
+int64_t libmod_misc_proc_load_state( INSTANCE * my, int64_t * params ) {
+    const char * filename = string_get( params[0] );
+    void * state = NULL;
+    file * fp;
+
+    if ( filename && ( fp = file_open( filename, "rb0" ) ) ) {
+        if ( ( state = instance_state_read( fp ) ) ) {
+            instance_state_free( state_load_pending );
+            state_load_pending = state;
+        }
+        file_close( fp );
+    }
+    string_discard( params[0] );
+    return state ? 1 : 0;
+}
+
+/* ----------------------------------------------------------------- */
+
+void libmod_misc_proc_state_hook( void ) {
+    if ( !frame_completed ) return;
+
+    if ( state_save_fp ) {
+        instance_state_save( state_save_fp );
+        file_close( state_save_fp );
+        state_save_fp = NULL;
+    }
+
+    if ( state_load_pending ) {
+        instance_state_restore( state_load_pending );
+        state_load_pending = NULL;
+    }
+}
+
+/* ----------------------------------------------------------------- */
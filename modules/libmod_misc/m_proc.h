@@ -73,6 +73,7 @@ extern int64_t libmod_misc_proc_exit_0( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_exit_1( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_exit( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_running( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_proc_count( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_signal( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_signal_action( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_signal_action3( INSTANCE * my, int64_t * params );
@@ -83,6 +84,10 @@ extern int64_t libmod_misc_proc_pause0( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_pause1( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_resume0( INSTANCE * my, int64_t * params );
 extern int64_t libmod_misc_proc_resume1( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_proc_save_state( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_proc_load_state( INSTANCE * my, int64_t * params );
+
+extern void libmod_misc_proc_state_hook( void );
 
 /* ----------------------------------------------------------------- */
 
@@ -43,6 +43,137 @@
 #include "regex.h"
 
 
+/* ----------------------------------------------------------------- */
+/* Compiled patterns                                                 */
+/* ----------------------------------------------------------------- */
+
+#define REGEX_SYNTAX            ( RE_SYNTAX_POSIX_MINIMAL_EXTENDED | REG_ICASE )
+#define REGEX_REPLACE_SYNTAX    RE_SYNTAX_POSIX_MINIMAL_EXTENDED
+
+/* The last patterns used by REGEX, REGEX_REPLACE and SPLIT are kept
+   compiled, the least recently used is replaced */
+
+#define REGEX_CACHE_SIZE        32
+
+typedef struct {
+    char * pattern;
+    uint32_t hash;
+    reg_syntax_t syntax;
+    uint64_t used;
+    struct re_pattern_buffer * pb;
+} REGEX_CACHED;
+
+static REGEX_CACHED regex_cache[REGEX_CACHE_SIZE];
+static uint64_t regex_cache_clock = 0;
+
+/* ----------------------------------------------------------------- */
+
+static struct re_pattern_buffer * regex_pattern_new (const char * reg, reg_syntax_t syntax) {
+    struct re_pattern_buffer * pb = calloc (1, sizeof(struct re_pattern_buffer));
+    if (!pb) return NULL;
+
+    pb->buffer = malloc(4096);
+    pb->allocated = 4096;
+    pb->fastmap = malloc(256);
+
+    re_syntax_options = syntax;
+
+    if (!pb->buffer || !pb->fastmap || re_compile_pattern (reg, strlen(reg), pb) != 0) {
+        free (pb->buffer);
+        free (pb->fastmap);
+        free (pb);
+        return NULL;
+    }
+
+    return pb;
+}
+
+static void regex_pattern_free (struct re_pattern_buffer * pb) {
+    free (pb->buffer);
+    free (pb->fastmap);
+    free (pb);
+}
+
+/* Returns the compiled pattern from the cache, compiling it if needed.
+   The pattern is valid until the next call. */
+
+static struct re_pattern_buffer * regex_pattern_cached (const char * reg, reg_syntax_t syntax) {
+    const unsigned char * ptr = (const unsigned char *) reg;
+    uint32_t hash = 2166136261U;
+    REGEX_CACHED * c, * lru = regex_cache;
+    struct re_pattern_buffer * pb;
+
+    while (*ptr) hash = (hash ^ *ptr++) * 16777619U;
+
+    for (c = regex_cache; c < regex_cache + REGEX_CACHE_SIZE; c++) {
+        if (c->pb && c->hash == hash && c->syntax == syntax && !strcmp(c->pattern, reg)) {
+            c->used = ++regex_cache_clock;
+            return c->pb;
+        }
+        if (c->used < lru->used) lru = c;
+    }
+
+    if (!(pb = regex_pattern_new (reg, syntax))) return NULL;
+
+    if (lru->pb) {
+        regex_pattern_free (lru->pb);
+        free (lru->pattern);
+    }
+
+    lru->pattern = strdup(reg);
+    if (!lru->pattern) {
+        lru->pb = NULL;
+        lru->used = 0;
+        return pb; /* Not cached, leaks only on out of memory */
+    }
+    lru->pb = pb;
+    lru->hash = hash;
+    lru->syntax = syntax;
+    lru->used = ++regex_cache_clock;
+
+    return pb;
+}
+
+/* Registers are allocated by re_search, a compiled pattern can be used
+   again once they are released */
+
+static void regex_registers_init (struct re_pattern_buffer * pb, struct re_registers * re) {
+    memset (re, 0, sizeof(*re));
+    pb->regs_allocated = REGS_UNALLOCATED;
+}
+
+static void regex_registers_free (struct re_registers * re) {
+    free (re->start);
+    free (re->end);
+}
+
+/* Search, and fill the REGEX_REG global variables if found */
+
+static int64_t regex_search (struct re_pattern_buffer * pb, const char * str) {
+    struct re_registers re;
+    int64_t result;
+
+    regex_registers_init (pb, &re);
+
+    result = re_search (pb, str, strlen(str), 0, strlen(str), &re);
+
+    if (result >= 0) {
+        int64_t * regex_reg = (int64_t *) &GLOQWORD( libmod_misc, REGEX_REG);
+
+        unsigned n;
+
+        for (n = 0; n < 16 && n <= pb->re_nsub; n++) {
+            string_discard (regex_reg[n]);
+            regex_reg[n] = string_newa (str + re.start[n], re.end[n] - re.start[n]);
+            string_use (regex_reg[n]);
+        }
+    }
+
+    regex_registers_free (&re);
+
+    return result < 0 ? -1 : result;
+}
+
 /* ----------------------------------------------------------------- */
 
 /** REGEX (STRING pattern, STRING string)
@@ -52,50 +183,13 @@
  */
 
 int64_t libmod_misc_regex_regex (INSTANCE * my, int64_t * params) {
-    const char * reg = string_get(params[0]),
-               * str = string_get(params[1]);
+    struct re_pattern_buffer * pb = regex_pattern_cached ((const char *) string_get(params[0]), REGEX_SYNTAX);
     int64_t result = -1;
 
-    struct re_pattern_buffer pb;
-    struct re_registers re;
-    int start[16], end[16];
-
-    /* Alloc the pattern resources */
-
-    memset (&pb, 0, sizeof(pb));
-    memset (&re, 0, sizeof(re));
-    pb.buffer = malloc(4096);
-    pb.allocated = 4096;
-    pb.fastmap = malloc(256);
-    pb.regs_allocated = REGS_FIXED;
-    re.num_regs = 16;
-    re.start = start;
-    re.end = end;
-
-    re_syntax_options = RE_SYNTAX_POSIX_MINIMAL_EXTENDED | REG_ICASE;
-
     /* Match the regex */
 
-    if (re_compile_pattern (reg, strlen(reg), &pb) == 0) {
-        result = re_search (&pb, str, strlen(str), 0, strlen(str), &re);
-
-        if (result != -1) {
-            /* Fill the regex_reg global variables */
-            int64_t * regex_reg = (int64_t *) &GLOQWORD( libmod_misc, REGEX_REG);
-            
-            unsigned n;
-            
-            for (n = 0; n < 16 && n <= pb.re_nsub; n++) {
-                string_discard (regex_reg[n]);
-                regex_reg[n] = string_newa (str + re.start[n], re.end[n] - re.start[n]);
-                string_use (regex_reg[n]);
-            }
-        }
-    }
+    if (pb) result = regex_search (pb, (const char *) string_get(params[1]));
 
-    /* Free the resources */
-    free (pb.buffer);
-    free (pb.fastmap);
     string_discard(params[0]);
     string_discard(params[1]);
 
@@ -115,15 +209,13 @@ int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params) {
                * rep = string_get(params[1]),
                * str = string_get(params[2]);
 
-    unsigned reg_len = strlen(reg);
     unsigned str_len = strlen(str);
     unsigned rep_len = strlen(rep);
 
     int fixed_replacement = strchr(rep, '\\') ? 0:1;
 
-    struct re_pattern_buffer pb;
+    struct re_pattern_buffer * pb;
     struct re_registers re;
-    int start[16], end[16];
 
     unsigned startpos = 0;
     unsigned nextpos;
@@ -138,34 +230,20 @@ int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params) {
     result_allocated = 128;
     *result = 0;
 
-    /* Alloc the pattern resources */
-
-    memset (&pb, 0, sizeof(pb));
-    memset (&re, 0, sizeof(re));
-    pb.buffer = malloc(4096);
-    pb.allocated = 4096;
-    pb.used = 0;
-    pb.fastmap = malloc(256);
-    pb.translate = NULL;
-    pb.fastmap_accurate = 0;
-    pb.regs_allocated = REGS_FIXED;
-    re.start = start;
-    re.end = end;
-
-    re_syntax_options = RE_SYNTAX_POSIX_MINIMAL_EXTENDED;
-
     /* Run the regex */
 
-    if (re_compile_pattern (reg, reg_len, &pb) == 0) {
+    if ((pb = regex_pattern_cached (reg, REGEX_REPLACE_SYNTAX))) {
         int regex_filled = 0;
 
+        regex_registers_init (pb, &re);
+
         startpos = 0;
 
         while (startpos < str_len) {
             char * replacement;
             unsigned replacement_len;
 
-            nextpos = re_search (&pb, str, str_len, startpos, str_len - startpos, &re);
+            nextpos = re_search (pb, str, str_len, startpos, str_len - startpos, &re);
             if ((int)nextpos < 0) break;
 
             /* Fill the REGEX_REG global variables */
@@ -174,7 +252,7 @@ int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params) {
                 unsigned n;
                 regex_filled = 1;
                 int64_t * regex_reg = (int64_t *)&GLOQWORD( libmod_misc, REGEX_REG);
-                for (n = 0; n < 16 && n <= pb.re_nsub; n++) {
+                for (n = 0; n < 16 && n <= pb->re_nsub; n++) {
                     string_discard (regex_reg[n]);
                     regex_reg[n] = string_newa (str + re.start[n], re.end[n] - re.start[n]);
                     string_use (regex_reg[n]);
@@ -232,10 +310,12 @@ int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params) {
 
             /* Continue the search */
 
-            startpos = nextpos+re_match(&pb, str, str_len, nextpos, 0);
+            startpos = nextpos+re_match(pb, str, str_len, nextpos, 0);
             if (startpos <  nextpos) break;
             if (startpos == nextpos) startpos++;
         }
+
+        regex_registers_free (&re);
     }
 
     /* Copy remaining characters */
@@ -250,8 +330,6 @@ int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params) {
 
     /* Free resources */
 
-    free (pb.buffer);
-    free (pb.fastmap);
     string_discard(params[0]);
     string_discard(params[1]);
     string_discard(params[2]);
@@ -279,31 +357,18 @@ int64_t libmod_misc_regex_split (INSTANCE * my, int64_t * params) {
     int result_array_size = params[3];
     int64_t count = 0;
 
-    struct re_pattern_buffer pb;
+    struct re_pattern_buffer * pb;
     struct re_registers re;
-    int start[16], end[16];
-
-    /* Alloc the pattern resources */
-
-    memset (&pb, 0, sizeof(pb));
-    memset (&re, 0, sizeof(re));
-    pb.buffer = malloc(4096);
-    pb.allocated = 4096;
-    pb.fastmap = malloc(256);
-    pb.regs_allocated = REGS_FIXED;
-    re.num_regs = 16;
-    re.start = start;
-    re.end = end;
-
-    re_syntax_options = RE_SYNTAX_POSIX_MINIMAL_EXTENDED;
 
     /* Match the regex */
 
-    if (re_compile_pattern (reg, strlen(reg), &pb) == 0) {
+    if ((pb = regex_pattern_cached (reg, REGEX_REPLACE_SYNTAX))) {
         int lastpos = 0;
 
+        regex_registers_init (pb, &re);
+
         for (;;) {
-            int pos = re_search (&pb, str, strlen(str), lastpos, strlen(str), &re);
+            int pos = re_search (pb, str, strlen(str), lastpos, strlen(str), &re);
             if (pos == -1) break;
             *result_array = string_newa (str + lastpos, pos-lastpos);
             string_use(*result_array);
@@ -311,7 +376,7 @@ int64_t libmod_misc_regex_split (INSTANCE * my, int64_t * params) {
             count++;
             result_array_size--;
             if (result_array_size == 0) break;
-            lastpos = pos + re_match (&pb, str, strlen(str), pos, 0);
+            lastpos = pos + re_match (pb, str, strlen(str), pos, 0);
             if (lastpos < pos) break;
             if (lastpos == pos) lastpos++;
         }
@@ -320,17 +385,53 @@ int64_t libmod_misc_regex_split (INSTANCE * my, int64_t * params) {
             string_use (*result_array);
             count++;
         }
+
+        regex_registers_free (&re);
     }
 
     /* Free the resources */
-    free (pb.buffer);
-    free (pb.fastmap);
     string_discard(params[0]);
     string_discard(params[1]);
 
     return count;
 }
 
+/** REGEX_COMPILE (STRING pattern)
+ *  Compiles a regular expresion for REGEX_MATCH. Returns a handle,
+ *  or 0 if the pattern is not valid. The handle must be released
+ *  with REGEX_FREE.
+ */
+
+int64_t libmod_misc_regex_compile (INSTANCE * my, int64_t * params) {
+    struct re_pattern_buffer * pb = regex_pattern_new ((const char *) string_get(params[0]), REGEX_SYNTAX);
+    string_discard(params[0]);
+    return (int64_t)(intptr_t)pb;
+}
+
+/** REGEX_MATCH (INT handle, STRING string)
+ *  Same as REGEX, with a pattern compiled by REGEX_COMPILE.
+ */
+
+int64_t libmod_misc_regex_match (INSTANCE * my, int64_t * params) {
+    struct re_pattern_buffer * pb = (struct re_pattern_buffer *)(intptr_t)params[0];
+    int64_t result = -1;
+
+    if (pb) result = regex_search (pb, (const char *) string_get(params[1]));
+    string_discard(params[1]);
+
+    return result;
+}
+
+/** REGEX_FREE (INT handle)
+ *  Releases a pattern compiled by REGEX_COMPILE.
+ */
+
+int64_t libmod_misc_regex_free (INSTANCE * my, int64_t * params) {
+    struct re_pattern_buffer * pb = (struct re_pattern_buffer *)(intptr_t)params[0];
+    if (pb) regex_pattern_free (pb);
+    return 1;
+}
+
 /** JOIN (STRING separator, STRING POINTER array, INT array_size)
  *  Joins an array of strings, given a separator. Returns the
  *  resulting string.
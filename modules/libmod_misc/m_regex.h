@@ -32,6 +32,9 @@
 extern int64_t libmod_misc_regex_regex (INSTANCE * my, int64_t * params);
 extern int64_t libmod_misc_regex_regex_replace (INSTANCE * my, int64_t * params);
 extern int64_t libmod_misc_regex_split (INSTANCE * my, int64_t * params);
+extern int64_t libmod_misc_regex_compile (INSTANCE * my, int64_t * params);
+extern int64_t libmod_misc_regex_match (INSTANCE * my, int64_t * params);
+extern int64_t libmod_misc_regex_free (INSTANCE * my, int64_t * params);
 extern int64_t libmod_misc_regex_join (INSTANCE * my, int64_t * params);
 
 #endif
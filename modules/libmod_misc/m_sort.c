@@ -38,56 +38,327 @@
 
 #include "libmod_misc.h"
 
-static int keyoffset = 0;
+/*
+ *  Sort engine
+ *
+ *  Keys are extracted once into an array of (key, index) pairs, the pairs
+ *  are sorted and the elements are moved to their final place in a single
+ *  permutation pass. Numeric keys are encoded as order-preserving unsigned
+ *  integers and sorted with a LSD radix sort; string keys carry their first
+ *  8 characters as key and only fall back to strcmp when those match.
+ */
+
+#define SORT_SMALL_THRESHOLD    32
+
+typedef struct {
+    uint64_t key;
+    uint64_t index;
+} SORT_KEY;
+
+/* String key context, used on ties of the prefix */
+
+static uint8_t * sort_str_data = NULL;
+static int sort_str_offset = 0;
+static int sort_str_size = 0;
+
+/* ----------------------------------------------------------------- */
 
 /*
- *  Comparison functions used by sort_variables
+ *  FUNCTION : sort_key_encode
+ *
+ *  Converts the key stored at ptr to an unsigned integer that keeps the
+ *  ordering of the original type.
+ *
+ *  PARAMS:
+ *      ptr             Pointer to the key
+ *      key_type        Basic type (like TYPE_INT) of the key variable
+ *
+ *  RETURN VALUE:
+ *      Encoded key
+ *
  */
 
-static int compare_int64( const int64_t * a, const int64_t * b ) {
-    return *( int64_t * )(( uint8_t * )a + keyoffset ) - *( int64_t * )(( uint8_t * )b + keyoffset );
-}
+static inline uint64_t sort_key_encode( const uint8_t * ptr, int key_type ) {
+    uint64_t u;
+    uint32_t u32;
 
-static int compare_qword( const uint64_t * a, const uint64_t * b ) {
-    return *( uint64_t * )(( uint8_t * )a + keyoffset ) - *( uint64_t * )(( uint8_t * )b + keyoffset );
-}
+    switch ( key_type ) {
+        case TYPE_QWORD:    return *( uint64_t * ) ptr;
+        case TYPE_INT:      return *( uint64_t * ) ptr ^ 0x8000000000000000ULL;
+        case TYPE_DWORD:    return *( uint32_t * ) ptr;
+        case TYPE_INT32:    return *( uint32_t * ) ptr ^ 0x80000000U;
+        case TYPE_WORD:     return *( uint16_t * ) ptr;
+        case TYPE_SHORT:    return *( uint16_t * ) ptr ^ 0x8000U;
+        case TYPE_CHAR:
+        case TYPE_BYTE:     return *( uint8_t * ) ptr;
+        case TYPE_SBYTE:    return *( uint8_t * ) ptr ^ 0x80U;
 
-static int compare_int32( const int32_t * a, const int32_t * b ) {
-    return *( int32_t * )(( uint8_t * )a + keyoffset ) - *( int32_t * )(( uint8_t * )b + keyoffset );
-}
+        case TYPE_DOUBLE:
+            memcpy( &u, ptr, sizeof( u ) );
+            return ( u & 0x8000000000000000ULL ) ? ~u : ( u | 0x8000000000000000ULL );
 
-static int compare_dword( const uint32_t * a, const uint32_t * b ) {
-    return *( uint32_t * )(( uint8_t * )a + keyoffset ) - *( uint32_t * )(( uint8_t * )b + keyoffset );
+        case TYPE_FLOAT:
+            memcpy( &u32, ptr, sizeof( u32 ) );
+            return ( u32 & 0x80000000U ) ? ( uint32_t ) ~u32 : ( u32 | 0x80000000U );
+
+        case TYPE_STRING: {
+            /* First 8 chars, big endian, so integer order is string order */
+            const unsigned char * str = string_get( *( int64_t * ) ptr );
+            int n;
+
+            u = 0;
+            for ( n = 0; n < 8; n++ ) {
+                u <<= 8;
+                if ( str && *str ) u |= *str++;
+            }
+            return u;
+        }
+    }
+    return 0;
 }
 
-static int compare_word( const uint16_t * a, const uint16_t * b ) {
-    return *( uint16_t * )(( uint8_t * )a + keyoffset ) - *( uint16_t * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : sort_key_bytes
+ *
+ *  Returns the number of significant bytes of an encoded key
+ *
+ */
+
+static int sort_key_bytes( int key_type ) {
+    switch ( key_type ) {
+        case TYPE_DWORD:
+        case TYPE_INT32:
+        case TYPE_FLOAT:
+            return 4;
+
+        case TYPE_WORD:
+        case TYPE_SHORT:
+            return 2;
+
+        case TYPE_CHAR:
+        case TYPE_BYTE:
+        case TYPE_SBYTE:
+            return 1;
+    }
+    return 8;
 }
 
-static int compare_short( const int16_t * a, const int16_t * b ) {
-    return *( int16_t * )(( uint8_t * )a + keyoffset ) - *( int16_t * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+static inline int sort_key_compare( const SORT_KEY * a, const SORT_KEY * b, int is_string ) {
+    if ( a->key != b->key ) return a->key < b->key ? -1 : 1;
+
+    if ( is_string && ( a->key & 0xff ) ) {
+        /* Same 8 first chars and both strings are longer, compare the rest */
+        return strcmp( ( const char * ) string_get( *( int64_t * )( sort_str_data + a->index * sort_str_size + sort_str_offset ) ),
+                       ( const char * ) string_get( *( int64_t * )( sort_str_data + b->index * sort_str_size + sort_str_offset ) ) );
+    }
+
+    return 0;
 }
 
-static int compare_byte( const uint8_t * a, const uint8_t * b ) {
-    return *( uint8_t * )(( uint8_t * )a + keyoffset ) - *( uint8_t * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+static void sort_keys_insertion( SORT_KEY * keys, int64_t count, int is_string ) {
+    int64_t i, j;
+    SORT_KEY tmp;
+
+    for ( i = 1; i < count; i++ ) {
+        tmp = keys[i];
+        for ( j = i; j > 0 && sort_key_compare( &tmp, &keys[j - 1], is_string ) < 0; j-- ) keys[j] = keys[j - 1];
+        keys[j] = tmp;
+    }
 }
 
-static int compare_sbyte( const int8_t * a, const int8_t * b ) {
-    return *( int8_t * )(( uint8_t * )a + keyoffset ) - *( int8_t * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+static void sort_keys_heap_sift( SORT_KEY * keys, int64_t root, int64_t count, int is_string ) {
+    SORT_KEY tmp = keys[root];
+    int64_t child;
+
+    while ( ( child = root * 2 + 1 ) < count ) {
+        if ( child + 1 < count && sort_key_compare( &keys[child], &keys[child + 1], is_string ) < 0 ) child++;
+        if ( sort_key_compare( &tmp, &keys[child], is_string ) >= 0 ) break;
+        keys[root] = keys[child];
+        root = child;
+    }
+    keys[root] = tmp;
 }
 
-static int compare_double( const double * a, const double * b ) {
-    return *( double * )(( uint8_t * )a + keyoffset ) - *( double * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : sort_keys_intro
+ *
+ *  Pattern-defeating quicksort on (key, index) pairs: median of three
+ *  pivot, pivot randomization when a partition is too unbalanced,
+ *  insertion sort on small ranges, and heapsort when the recursion
+ *  budget is exhausted.
+ *
+ */
+
+static void sort_keys_intro( SORT_KEY * keys, int64_t count, int budget, int is_string ) {
+    SORT_KEY pivot, tmp;
+    int64_t i, j, n;
+
+    while ( count > SORT_SMALL_THRESHOLD ) {
+        if ( budget-- <= 0 ) {
+            for ( n = count / 2 - 1; n >= 0; n-- ) sort_keys_heap_sift( keys, n, count, is_string );
+            for ( n = count - 1; n > 0; n-- ) {
+                tmp = keys[0]; keys[0] = keys[n]; keys[n] = tmp;
+                sort_keys_heap_sift( keys, 0, n, is_string );
+            }
+            return;
+        }
+
+        /* Median of three, moved to keys[0] */
+        {
+            int64_t m = count / 2, l = count - 1;
+            if ( sort_key_compare( &keys[m], &keys[0], is_string ) < 0 ) { tmp = keys[m]; keys[m] = keys[0]; keys[0] = tmp; }
+            if ( sort_key_compare( &keys[l], &keys[m], is_string ) < 0 ) { tmp = keys[l]; keys[l] = keys[m]; keys[m] = tmp; }
+            if ( sort_key_compare( &keys[m], &keys[0], is_string ) < 0 ) { tmp = keys[m]; keys[m] = keys[0]; keys[0] = tmp; }
+            tmp = keys[0]; keys[0] = keys[m]; keys[m] = tmp;
+        }
+
+        /* Hoare partition around keys[0] */
+        pivot = keys[0];
+        i = 0;
+        j = count;
+        for ( ;; ) {
+            while ( ++i < count && sort_key_compare( &keys[i], &pivot, is_string ) < 0 );
+            while ( sort_key_compare( &pivot, &keys[--j], is_string ) < 0 );
+            if ( i >= j ) break;
+            tmp = keys[i]; keys[i] = keys[j]; keys[j] = tmp;
+        }
+        keys[0] = keys[j];
+        keys[j] = pivot;
+
+        /* Unbalanced partition, break the pattern inside each side */
+        if ( j < count / 8 || count - j < count / 8 ) {
+            SORT_KEY * side = keys;
+            int64_t size = j;
+
+            for ( n = 0; n < 2; n++ ) {
+                if ( size >= SORT_SMALL_THRESHOLD ) {
+                    tmp = side[0]; side[0] = side[size / 4]; side[size / 4] = tmp;
+                    tmp = side[size - 1]; side[size - 1] = side[size - 1 - size / 4]; side[size - 1 - size / 4] = tmp;
+                }
+                side = keys + j + 1;
+                size = count - j - 1;
+            }
+        }
+
+        /* Recurse on the smaller side, loop on the bigger one */
+        if ( j < count - j - 1 ) {
+            sort_keys_intro( keys, j, budget, is_string );
+            keys += j + 1;
+            count -= j + 1;
+        } else {
+            sort_keys_intro( keys + j + 1, count - j - 1, budget, is_string );
+            count = j;
+        }
+    }
+
+    sort_keys_insertion( keys, count, is_string );
 }
 
-static int compare_float( const float * a, const float * b ) {
-    return *( float * )(( uint8_t * )a + keyoffset ) - *( float * )(( uint8_t * )b + keyoffset );
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : sort_keys_radix
+ *
+ *  Stable LSD radix sort on the encoded keys, 8 bits per pass. All the
+ *  histograms are built in a single sweep, and passes where every key
+ *  has the same digit are skipped.
+ *
+ *  RETURN VALUE:
+ *      Pointer to the sorted buffer (keys or tmp)
+ *
+ */
+
+static SORT_KEY * sort_keys_radix( SORT_KEY * keys, SORT_KEY * tmp, int64_t count, int key_bytes ) {
+    uint64_t ( * histogram )[256];
+    SORT_KEY * src = keys, * dst = tmp, * swap;
+    int64_t n, sum, c;
+    int pass, digit;
+
+    histogram = calloc( key_bytes, sizeof( *histogram ) );
+    if ( !histogram ) return NULL;
+
+    for ( n = 0; n < count; n++ ) {
+        uint64_t k = keys[n].key;
+        for ( pass = 0; pass < key_bytes; pass++, k >>= 8 ) histogram[pass][k & 0xff]++;
+    }
+
+    for ( pass = 0; pass < key_bytes; pass++ ) {
+        int shift = pass * 8;
+
+        /* All keys share this digit */
+        if ( histogram[pass][( src[0].key >> shift ) & 0xff] == ( uint64_t ) count ) continue;
+
+        for ( sum = 0, digit = 0; digit < 256; digit++ ) {
+            c = histogram[pass][digit];
+            histogram[pass][digit] = sum;
+            sum += c;
+        }
+
+        for ( n = 0; n < count; n++ ) dst[histogram[pass][( src[n].key >> shift ) & 0xff]++] = src[n];
+
+        swap = src; src = dst; dst = swap;
+    }
+
+    free( histogram );
+
+    return src;
 }
 
-static int compare_string( const int * a, const int * b ) {
-    return strcmp( string_get( *( int * )(( uint8_t * )a + keyoffset ) ), string_get( *( int * )(( uint8_t * )b + keyoffset ) ) );
+/* ----------------------------------------------------------------- */
+
+/*
+ *  FUNCTION : sort_apply_permutation
+ *
+ *  Moves every element to its sorted position following the cycles of the
+ *  permutation, using a single element as temporary storage.
+ *
+ *  PARAMS:
+ *      data            Pointer to the start of the array
+ *      keys            Sorted pairs, keys[n].index is the source of element n
+ *      element_size    Size of a single element
+ *      elements        Number of elements
+ *
+ *  RETURN VALUE:
+ *      1 if succesful, 0 if error
+ *
+ */
+
+static int sort_apply_permutation( uint8_t * data, SORT_KEY * keys, int element_size, int64_t elements ) {
+    uint8_t * hold = malloc( element_size );
+    int64_t n, dst, src;
+
+    if ( !hold ) return 0;
+
+    for ( n = 0; n < elements; n++ ) {
+        if ( keys[n].index == ( uint64_t ) n ) continue;
+
+        memcpy( hold, data + n * element_size, element_size );
+        dst = n;
+        while ( ( src = keys[dst].index ) != n ) {
+            memcpy( data + dst * element_size, data + src * element_size, element_size );
+            keys[dst].index = dst;
+            dst = src;
+        }
+        memcpy( data + dst * element_size, hold, element_size );
+        keys[dst].index = dst;
+    }
+
+    free( hold );
+    return 1;
 }
 
+/* ----------------------------------------------------------------- */
+
 /*
  *  FUNCTION : dcb_typedef_reduce
  *
@@ -234,58 +505,25 @@ static int dcb_typedef_size( const DCB_TYPEDEF * type ) {
  *
  */
 
-static int sort_variables( void * data, int key_offset, int key_type, int element_size, int elements ) {
-    int ( *compare )( const void *, const void * ) = NULL;
-
-    keyoffset = key_offset;
+static int sort_variables( void * data, int key_offset, int key_type, int element_size, int64_t elements ) {
+    SORT_KEY * keys, * tmp = NULL, * sorted;
+    uint8_t * ptr = ( uint8_t * ) data;
+    int64_t n;
+    int budget;
 
     switch ( key_type ) {
         case TYPE_QWORD:
-            compare = ( int ( * )( const void*, const void* ) ) compare_qword;
-            break;
-
         case TYPE_INT:
-            compare = ( int ( * )( const void*, const void* ) ) compare_int64;
-            break;
-
         case TYPE_DWORD:
-            compare = ( int ( * )( const void*, const void* ) ) compare_dword;
-            break;
-
         case TYPE_INT32:
-            compare = ( int ( * )( const void*, const void* ) ) compare_int32;
-            break;
-
         case TYPE_WORD:
-            compare = ( int ( * )( const void*, const void* ) ) compare_word;
-            break;
-
         case TYPE_SHORT:
-            compare = ( int ( * )( const void*, const void* ) ) compare_short;
-            break;
-
         case TYPE_BYTE:
-            compare = ( int ( * )( const void*, const void* ) ) compare_byte;
-            break;
-
         case TYPE_SBYTE:
-            compare = ( int ( * )( const void*, const void* ) ) compare_sbyte;
-            break;
-
         case TYPE_CHAR:
-            compare = ( int ( * )( const void*, const void* ) ) compare_byte;
-            break;
-
         case TYPE_STRING:
-            compare = ( int ( * )( const void*, const void* ) ) compare_string;
-            break;
-
         case TYPE_DOUBLE:
-            compare = ( int ( * )( const void*, const void* ) ) compare_double;
-            break;
-
         case TYPE_FLOAT:
-            compare = ( int ( * )( const void*, const void* ) ) compare_float;
             break;
 
         default:
@@ -293,8 +531,50 @@ static int sort_variables( void * data, int key_offset, int key_type, int elemen
             return 0;
     }
 
-    qsort( data, elements, element_size, compare );
-    return 1;
+    if ( elements < 2 ) return 1;
+
+    keys = malloc( elements * sizeof( SORT_KEY ) );
+    if ( !keys ) return 0;
+
+    /* Extract keys */
+
+    for ( n = 0; n < elements; n++, ptr += element_size ) {
+        keys[n].key = sort_key_encode( ptr + key_offset, key_type );
+        keys[n].index = n;
+    }
+
+    /* Sort (key, index) pairs */
+
+    sorted = keys;
+
+    if ( key_type == TYPE_STRING ) {
+        sort_str_data = ( uint8_t * ) data;
+        sort_str_offset = key_offset;
+        sort_str_size = element_size;
+
+        for ( budget = 0, n = elements; n > 1; n >>= 1 ) budget += 2;
+        sort_keys_intro( keys, elements, budget, 1 );
+
+        sort_str_data = NULL;
+    } else if ( elements <= SORT_SMALL_THRESHOLD ) {
+        sort_keys_insertion( keys, elements, 0 );
+    } else {
+        tmp = malloc( elements * sizeof( SORT_KEY ) );
+        if ( !tmp || !( sorted = sort_keys_radix( keys, tmp, elements, sort_key_bytes( key_type ) ) ) ) {
+            free( tmp );
+            free( keys );
+            return 0;
+        }
+    }
+
+    /* Reorder data */
+
+    n = sort_apply_permutation( ( uint8_t * ) data, sorted, element_size, elements );
+
+    free( tmp );
+    free( keys );
+
+    return n;
 }
 
 /**
@@ -527,48 +807,6 @@ int64_t libmod_misc_sort_ksort_n( INSTANCE * my, int64_t * params ) {
     return sort_variables( data, ( uint8_t* )key_data - ( uint8_t* )data, copy.BaseType[0], element_size, params[6] );
 }
 
-/*
- * Auxiliary QSort functions
- *
- */
-
-static double GetData( uint8_t *Data, int pos, int64_t * params ) {
-    if ( params[4] == sizeof( uint8_t ) ) return Data[pos*params[1] + params[3]];
-    if ( params[4] == sizeof( uint16_t ) ) return *( uint16_t * )( &Data[pos*params[1] + params[3]] );
-    if ( params[4] == sizeof( uint32_t ) ) return *( uint32_t * )( &Data[pos*params[1] + params[3]] );
-    if ( params[4] == sizeof( uint64_t ) && params[5] == 0 ) return *( uint64_t * )( &Data[pos*params[1] + params[3]] );
-    if ( params[4] == sizeof( float ) && params[5] == 1 ) return *( float * )( &Data[pos*params[1] + params[3]] );
-    if ( params[4] == sizeof( double ) && params[5] == 1 ) return *( double * )( &Data[pos*params[1] + params[3]] );
-    return 1 ;
-}
-
-static void QuickSort( uint8_t *Data, int inf, int sup, int64_t * params ) {
-    register int left, rigth;
-    double middle;
-    uint8_t* x = ( uint8_t* )malloc( params[1] );
-    left = inf;
-    rigth = sup;
-    middle = GetData( Data, ( left + rigth ) >> 1, params );
-    do {
-        while ( GetData( Data, left, params ) < middle && left < sup ) left++;
-        while ( middle < GetData( Data, rigth, params ) && rigth > inf ) rigth--;
-
-        if ( left <= rigth ) {
-            memcpy( x, &Data[left*params[1]], params[1] );
-            memcpy( &Data[left*params[1]], &Data[rigth*params[1]], params[1] );
-            memcpy( &Data[rigth*params[1]], x, params[1] );
-            left++;
-            rigth--;
-        }
-    }
-    while ( left <= rigth );
-
-    if ( inf < rigth ) QuickSort( Data, inf, rigth, params );
-    if ( left < sup ) QuickSort( Data, left, sup, params );
-
-    free(x);
-}
-
 /*
  *  QSort:
  *      pointer to array,
@@ -580,9 +818,16 @@ static void QuickSort( uint8_t *Data, int inf, int sup, int64_t * params ) {
  */
 
 int64_t libmod_misc_sort_quicksort( INSTANCE *my, int64_t * params ) {
-    uint8_t *Data = ( uint8_t * )( intptr_t )params[0];
-    QuickSort( Data, 0, params[2] - 1, params );
-    return 1 ;
+    int key_type;
+    switch ( params[4] ) {
+        case sizeof( uint8_t ):     key_type = TYPE_BYTE;                                   break;
+        case sizeof( uint16_t ):    key_type = TYPE_WORD;                                   break;
+        case sizeof( uint32_t ):    key_type = params[5] == 1 ? TYPE_FLOAT : TYPE_DWORD;    break;
+        case sizeof( uint64_t ):    key_type = params[5] == 1 ? TYPE_DOUBLE : TYPE_QWORD;   break;
+        default:                    return 0;
+    }
+
+    return sort_variables( ( void * )( intptr_t )params[0], params[3], key_type, params[1], params[2] );
 }
 
 /* ----------------------------------------------------------------- */
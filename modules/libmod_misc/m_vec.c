@@ -0,0 +1,378 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/* --------------------------------------------------------------------------- */
+/* Bulk math on arrays of FLOAT (32 bits) and INT (64 bits)                    */
+/*                                                                             */
+/* The arrays are plain memory, script arrays or MEM_ALLOC blocks. FLOAT       */
+/* kernels use AVX2, SSE2 or NEON (AArch64) when the module is built for them, */
+/* INT kernels and the remaining elements are scalar.                          */
+/* --------------------------------------------------------------------------- */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fmath.h"
+
+#include "bgddl.h"
+
+#include "libmod_misc.h"
+
+/* --------------------------------------------------------------------------- */
+
+#if defined( __AVX2__ )
+
+#include <immintrin.h>
+
+typedef __m256 VF;
+
+#define VF_WIDTH            8
+#define VF_LOAD(p)          _mm256_loadu_ps( p )
+#define VF_STORE(p,v)       _mm256_storeu_ps( p, v )
+#define VF_SET1(f)          _mm256_set1_ps( f )
+#define VF_ADD(a,b)         _mm256_add_ps( a, b )
+#define VF_SUB(a,b)         _mm256_sub_ps( a, b )
+#define VF_MUL(a,b)         _mm256_mul_ps( a, b )
+#define VF_MIN(a,b)         _mm256_min_ps( a, b )
+#define VF_MAX(a,b)         _mm256_max_ps( a, b )
+#define VF_SQRT(a)          _mm256_sqrt_ps( a )
+
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+
+#include <emmintrin.h>
+
+typedef __m128 VF;
+
+#define VF_WIDTH            4
+#define VF_LOAD(p)          _mm_loadu_ps( p )
+#define VF_STORE(p,v)       _mm_storeu_ps( p, v )
+#define VF_SET1(f)          _mm_set1_ps( f )
+#define VF_ADD(a,b)         _mm_add_ps( a, b )
+#define VF_SUB(a,b)         _mm_sub_ps( a, b )
+#define VF_MUL(a,b)         _mm_mul_ps( a, b )
+#define VF_MIN(a,b)         _mm_min_ps( a, b )
+#define VF_MAX(a,b)         _mm_max_ps( a, b )
+#define VF_SQRT(a)          _mm_sqrt_ps( a )
+
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+
+#include <arm_neon.h>
+
+typedef float32x4_t VF;
+
+#define VF_WIDTH            4
+#define VF_LOAD(p)          vld1q_f32( p )
+#define VF_STORE(p,v)       vst1q_f32( p, v )
+#define VF_SET1(f)          vdupq_n_f32( f )
+#define VF_ADD(a,b)         vaddq_f32( a, b )
+#define VF_SUB(a,b)         vsubq_f32( a, b )
+#define VF_MUL(a,b)         vmulq_f32( a, b )
+#define VF_MIN(a,b)         vminq_f32( a, b )
+#define VF_MAX(a,b)         vmaxq_f32( a, b )
+#define VF_SQRT(a)          vsqrtq_f32( a )
+
+#endif
+
+/* --------------------------------------------------------------------------- */
+
+#define VEC_DOUBLE(n)       ( *( double * ) &params[n] )
+
+static int64_t vec_return_double( double res ) {
+    return *(( int64_t * )&res );
+}
+
+/* --------------------------------------------------------------------------- */
+/* Kernels                                                                     */
+/* --------------------------------------------------------------------------- */
+
+/* y[i] += a * x[i] */
+
+static void vec_axpy( float * y, float * x, float a, int64_t n ) {
+    int64_t i = 0;
+
+#ifdef VF_WIDTH
+    VF va = VF_SET1( a );
+    for ( ; i + VF_WIDTH <= n; i += VF_WIDTH ) VF_STORE( y + i, VF_ADD( VF_LOAD( y + i ), VF_MUL( va, VF_LOAD( x + i ) ) ) );
+#endif
+
+    for ( ; i < n; i++ ) y[i] += a * x[i];
+}
+
+/* --------------------------------------------------------------------------- */
+
+static void vec_clamp( float * x, float min, float max, int64_t n ) {
+    int64_t i = 0;
+
+#ifdef VF_WIDTH
+    VF vmin = VF_SET1( min ), vmax = VF_SET1( max );
+    for ( ; i + VF_WIDTH <= n; i += VF_WIDTH ) VF_STORE( x + i, VF_MIN( VF_MAX( VF_LOAD( x + i ), vmin ), vmax ) );
+#endif
+
+    for ( ; i < n; i++ ) {
+        if ( x[i] < min ) x[i] = min;
+        if ( x[i] > max ) x[i] = max;
+    }
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* op is 0 sum, 1 min, 2 max. n must be > 0 */
+
+static double vec_reduce( float * x, int64_t n, int op ) {
+    int64_t i = 0;
+    float res = ( op == 0 ) ? 0.0f : x[0];
+
+#ifdef VF_WIDTH
+    if ( n >= VF_WIDTH ) {
+        float lanes[VF_WIDTH];
+        VF acc = VF_LOAD( x );
+        int l;
+
+        for ( i = VF_WIDTH; i + VF_WIDTH <= n; i += VF_WIDTH ) {
+            switch ( op ) {
+                case 0: acc = VF_ADD( acc, VF_LOAD( x + i ) ); break;
+                case 1: acc = VF_MIN( acc, VF_LOAD( x + i ) ); break;
+                case 2: acc = VF_MAX( acc, VF_LOAD( x + i ) ); break;
+            }
+        }
+
+        VF_STORE( lanes, acc );
+        res = lanes[0];
+        for ( l = 1; l < VF_WIDTH; l++ ) {
+            switch ( op ) {
+                case 0: res += lanes[l]; break;
+                case 1: if ( lanes[l] < res ) res = lanes[l]; break;
+                case 2: if ( lanes[l] > res ) res = lanes[l]; break;
+            }
+        }
+    }
+#endif
+
+    for ( ; i < n; i++ ) {
+        switch ( op ) {
+            case 0: res += x[i]; break;
+            case 1: if ( x[i] < res ) res = x[i]; break;
+            case 2: if ( x[i] > res ) res = x[i]; break;
+        }
+    }
+
+    return res;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* dst[i] = distance from ( x[i], y[i] ) to ( px, py ) */
+
+static void vec_distance( float * dst, float * x, float * y, float px, float py, int64_t n ) {
+    int64_t i = 0;
+    float dx, dy;
+
+#ifdef VF_WIDTH
+    VF vpx = VF_SET1( px ), vpy = VF_SET1( py ), vdx, vdy;
+    for ( ; i + VF_WIDTH <= n; i += VF_WIDTH ) {
+        vdx = VF_SUB( VF_LOAD( x + i ), vpx );
+        vdy = VF_SUB( VF_LOAD( y + i ), vpy );
+        VF_STORE( dst + i, VF_SQRT( VF_ADD( VF_MUL( vdx, vdx ), VF_MUL( vdy, vdy ) ) ) );
+    }
+#endif
+
+    for ( ; i < n; i++ ) {
+        dx = x[i] - px;
+        dy = y[i] - py;
+        dst[i] = sqrtf( dx * dx + dy * dy );
+    }
+}
+
+/* --------------------------------------------------------------------------- */
+/* Exported functions                                                          */
+/* --------------------------------------------------------------------------- */
+
+/* VEC_AXPY( float pointer y, float pointer x, double a, int n )
+ *  y[i] += a * x[i]
+ */
+
+int64_t libmod_misc_vec_axpy( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || !params[1] || params[3] <= 0 ) return 0;
+    vec_axpy( ( float * )( intptr_t )params[0], ( float * )( intptr_t )params[1], ( float ) VEC_DOUBLE( 2 ), params[3] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_CLAMP( float pointer x, double min, double max, int n ) */
+
+int64_t libmod_misc_vec_clamp( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || params[3] <= 0 ) return 0;
+    vec_clamp( ( float * )( intptr_t )params[0], ( float ) VEC_DOUBLE( 1 ), ( float ) VEC_DOUBLE( 2 ), params[3] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_CLAMPI( int pointer x, int min, int max, int n ) */
+
+int64_t libmod_misc_vec_clampi( INSTANCE * my, int64_t * params ) {
+    int64_t * x = ( int64_t * )( intptr_t )params[0], i;
+
+    if ( !x || params[3] <= 0 ) return 0;
+
+    for ( i = 0; i < params[3]; i++ ) {
+        if ( x[i] < params[1] ) x[i] = params[1];
+        if ( x[i] > params[2] ) x[i] = params[2];
+    }
+
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_SUM, VEC_MIN, VEC_MAX( float pointer x, int n ) */
+
+int64_t libmod_misc_vec_sum( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || params[1] <= 0 ) return vec_return_double( 0.0 );
+    return vec_return_double( vec_reduce( ( float * )( intptr_t )params[0], params[1], 0 ) );
+}
+
+int64_t libmod_misc_vec_min( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || params[1] <= 0 ) return vec_return_double( 0.0 );
+    return vec_return_double( vec_reduce( ( float * )( intptr_t )params[0], params[1], 1 ) );
+}
+
+int64_t libmod_misc_vec_max( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || params[1] <= 0 ) return vec_return_double( 0.0 );
+    return vec_return_double( vec_reduce( ( float * )( intptr_t )params[0], params[1], 2 ) );
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_SUMI, VEC_MINI, VEC_MAXI( int pointer x, int n ) */
+
+int64_t libmod_misc_vec_sumi( INSTANCE * my, int64_t * params ) {
+    int64_t * x = ( int64_t * )( intptr_t )params[0], i, res = 0;
+    if ( !x ) return 0;
+    for ( i = 0; i < params[1]; i++ ) res += x[i];
+    return res;
+}
+
+int64_t libmod_misc_vec_mini( INSTANCE * my, int64_t * params ) {
+    int64_t * x = ( int64_t * )( intptr_t )params[0], i, res;
+    if ( !x || params[1] <= 0 ) return 0;
+    for ( res = x[0], i = 1; i < params[1]; i++ ) if ( x[i] < res ) res = x[i];
+    return res;
+}
+
+int64_t libmod_misc_vec_maxi( INSTANCE * my, int64_t * params ) {
+    int64_t * x = ( int64_t * )( intptr_t )params[0], i, res;
+    if ( !x || params[1] <= 0 ) return 0;
+    for ( res = x[0], i = 1; i < params[1]; i++ ) if ( x[i] > res ) res = x[i];
+    return res;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_DISTANCE( float pointer dst, float pointer x, float pointer y, double px, double py, int n ) */
+
+int64_t libmod_misc_vec_distance( INSTANCE * my, int64_t * params ) {
+    if ( !params[0] || !params[1] || !params[2] || params[5] <= 0 ) return 0;
+    vec_distance( ( float * )( intptr_t )params[0], ( float * )( intptr_t )params[1], ( float * )( intptr_t )params[2],
+                  ( float ) VEC_DOUBLE( 3 ), ( float ) VEC_DOUBLE( 4 ), params[5] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_SIN, VEC_COS( float pointer dst, int pointer angles, int n )
+ *  Angles in thousandths of degree, from the runtime cos table
+ */
+
+int64_t libmod_misc_vec_sin( INSTANCE * my, int64_t * params ) {
+    float * dst = ( float * )( intptr_t )params[0];
+    int64_t * angles = ( int64_t * )( intptr_t )params[1], i;
+
+    if ( !dst || !angles || params[2] <= 0 ) return 0;
+    for ( i = 0; i < params[2]; i++ ) dst[i] = ( float ) sin_deg( angles[i] );
+    return 1;
+}
+
+int64_t libmod_misc_vec_cos( INSTANCE * my, int64_t * params ) {
+    float * dst = ( float * )( intptr_t )params[0];
+    int64_t * angles = ( int64_t * )( intptr_t )params[1], i;
+
+    if ( !dst || !angles || params[2] <= 0 ) return 0;
+    for ( i = 0; i < params[2]; i++ ) dst[i] = ( float ) cos_deg( angles[i] );
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
+
+/* VEC_GATHER( float pointer dst, float pointer src, int pointer index, int n )
+ *  dst[i] = src[index[i]]
+ * VEC_SCATTER( float pointer dst, float pointer src, int pointer index, int n )
+ *  dst[index[i]] = src[i]
+ * VEC_GATHERI and VEC_SCATTERI do the same with int arrays
+ */
+
+int64_t libmod_misc_vec_gather( INSTANCE * my, int64_t * params ) {
+    float * dst = ( float * )( intptr_t )params[0], * src = ( float * )( intptr_t )params[1];
+    int64_t * index = ( int64_t * )( intptr_t )params[2], i;
+
+    if ( !dst || !src || !index || params[3] <= 0 ) return 0;
+    for ( i = 0; i < params[3]; i++ ) dst[i] = src[index[i]];
+    return 1;
+}
+
+int64_t libmod_misc_vec_scatter( INSTANCE * my, int64_t * params ) {
+    float * dst = ( float * )( intptr_t )params[0], * src = ( float * )( intptr_t )params[1];
+    int64_t * index = ( int64_t * )( intptr_t )params[2], i;
+
+    if ( !dst || !src || !index || params[3] <= 0 ) return 0;
+    for ( i = 0; i < params[3]; i++ ) dst[index[i]] = src[i];
+    return 1;
+}
+
+int64_t libmod_misc_vec_gatheri( INSTANCE * my, int64_t * params ) {
+    int64_t * dst = ( int64_t * )( intptr_t )params[0], * src = ( int64_t * )( intptr_t )params[1];
+    int64_t * index = ( int64_t * )( intptr_t )params[2], i;
+
+    if ( !dst || !src || !index || params[3] <= 0 ) return 0;
+    for ( i = 0; i < params[3]; i++ ) dst[i] = src[index[i]];
+    return 1;
+}
+
+int64_t libmod_misc_vec_scatteri( INSTANCE * my, int64_t * params ) {
+    int64_t * dst = ( int64_t * )( intptr_t )params[0], * src = ( int64_t * )( intptr_t )params[1];
+    int64_t * index = ( int64_t * )( intptr_t )params[2], i;
+
+    if ( !dst || !src || !index || params[3] <= 0 ) return 0;
+    for ( i = 0; i < params[3]; i++ ) dst[index[i]] = src[i];
+    return 1;
+}
+
+/* --------------------------------------------------------------------------- */
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *  Copyright (C) 2002-2006 Fenix Team (Fenix)
+ *  Copyright (C) 1999-2002 José Luis Cebrián Pagüe (Fenix)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+#ifndef __M_VEC_H
+#define __M_VEC_H
+
+extern int64_t libmod_misc_vec_axpy( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_clamp( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_clampi( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_sum( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_min( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_max( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_sumi( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_mini( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_maxi( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_distance( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_sin( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_cos( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_gather( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_scatter( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_gatheri( INSTANCE * my, int64_t * params );
+extern int64_t libmod_misc_vec_scatteri( INSTANCE * my, int64_t * params );
+
+#endif
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Compiles and runs the benchmark workloads, writing a JSON array with the
+# report of each one.
+#
+# usage: bench.sh [frames] [output.json] [workload ...]
+#
+# bgdc, bgdbench and the modules are taken from BIN (default ../../bin).
+
+FRAMES=${1:-1000}
+OUTPUT=${2:-bench.json}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+BIN=$(cd "${BIN:-$DIR/../../bin}" && pwd)
+WORK=$(mktemp -d)
+
+WORKLOADS="$@"
+if [ -z "$WORKLOADS" ]; then
+    WORKLOADS=$(cd "$DIR/workloads" && ls *.prg | sed 's/\.prg$//')
+fi
+
+export LD_LIBRARY_PATH="$BIN:$LD_LIBRARY_PATH"
+
+status=0
+first=1
+
+echo "[" > "$OUTPUT"
+
+for w in $WORKLOADS; do
+    echo "$w..." >&2
+
+    cp "$DIR/workloads/$w.prg" "$WORK/"
+    if ! ( cd "$WORK" && "$BIN/bgdc" "$w.prg" > "$WORK/$w.log" 2>&1 ) || [ ! -f "$WORK/$w.dcb" ]; then
+        cat "$WORK/$w.log" >&2
+        status=1
+        continue
+    fi
+
+    if ! "$BIN/bgdbench" -f "$FRAMES" -o "$WORK/$w.json" "$WORK/$w.dcb" >&2; then
+        status=1
+    fi
+
+    if [ -f "$WORK/$w.json" ]; then
+        [ $first -eq 0 ] && echo "," >> "$OUTPUT"
+        cat "$WORK/$w.json" >> "$OUTPUT"
+        first=0
+    fi
+done
+
+echo "]" >> "$OUTPUT"
+
+rm -rf "$WORK"
+
+exit $status
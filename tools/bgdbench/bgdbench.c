@@ -0,0 +1,320 @@
+/*
+ *  Copyright (C) SplinterGU (Fenix/BennuGD) (Since 2006)
+ *
+ *  This file is part of Bennu Game Development
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty. In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *     1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *     2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *     3. This notice may not be removed or altered from any source
+ *     distribution.
+ *
+ */
+
+/*
+ * Headless benchmark runner
+ *
+ * Runs a DCB for a number of frames with the SDL dummy video and audio
+ * drivers and a fixed random seed, and writes the results as JSON:
+ * frames per second, the time spent executing processes and in each
+ * module hook, and the peak RSS.
+ */
+
+#include <loadlib.h> /* Must be fist include */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "bgdrtm.h"
+#include "xstrings.h"
+#include "dirs.h"
+#include "sysprocs_p.h"
+
+#include <bgddl.h>
+
+/* ---------------------------------------------------------------------- */
+
+#define BENCH_FRAMES    1000
+#define BENCH_SEED      1234
+
+/* ---------------------------------------------------------------------- */
+
+static int64_t bench_ticks() {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter( &count );
+    QueryPerformanceFrequency( &freq );
+    return ( int64_t ) ( count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart );
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( int64_t ) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Peak resident set size in KB, -1 if unknown */
+
+static int64_t bench_peak_rss() {
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage ru;
+    if ( getrusage( RUSAGE_SELF, &ru ) ) return -1;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void bench_setenv( const char * name, const char * value ) {
+    if ( getenv( name ) ) return;
+#ifdef _WIN32
+    _putenv_s( name, value );
+#else
+    setenv( name, value, 0 );
+#endif
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Name of the module exporting a handler hook */
+
+static const char * bench_hook_module( HOOK * h ) {
+    int n;
+
+    for ( n = 0; n < nmodules; n++ ) {
+        HOOK * hooks = ( HOOK * ) _dlibaddr( modules_hnd[n], "handler_hooks" );
+        while ( hooks && hooks->hook ) {
+            if ( hooks->hook == h->hook && hooks->prio == h->prio ) return modules_name[n];
+            hooks++;
+        }
+    }
+
+    return "unknown";
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Calls SET_FPS(0, 0) of the module exporting it, if any is loaded */
+
+static void bench_unlimited_fps() {
+    int64_t params[2] = { 0, 0 };
+    int n;
+
+    for ( n = 0; n < nmodules; n++ ) {
+        DLSYSFUNCS * f = ( DLSYSFUNCS * ) _dlibaddr( modules_hnd[n], "functions_exports" );
+        while ( f && f->name ) {
+            if ( !strcmp( f->name, "SET_FPS" ) && !strcmp( f->paramtypes, "II" ) ) {
+                ( ( SYSFUNC * ) f->func )( NULL, params );
+                return;
+            }
+            f++;
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void bench_json_string( FILE * out, const char * s ) {
+    fputc( '"', out );
+    for ( ; *s; s++ ) {
+        if ( *s == '"' || *s == '\\' ) fputc( '\\', out );
+        if ( ( unsigned char ) *s < 0x20 ) fprintf( out, "\\u%04x", *s );
+        else                               fputc( *s, out );
+    }
+    fputc( '"', out );
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void bench_report( FILE * out, const char * program, int64_t seed, int64_t load_us, int64_t run_us ) {
+    int64_t frames = frame_profile.frames, n;
+    char key[ __MAX_PATH ];
+    double ms = frames ? 1.0 / ( frames * 1000.0 ) : 0.0; /* usecs to msecs per frame */
+
+    fprintf( out, "{\n  \"program\": " );
+    bench_json_string( out, program );
+    fprintf( out, ",\n  \"seed\": %" PRId64 ",\n", seed );
+    fprintf( out, "  \"frames\": %" PRId64 ",\n", frames );
+    fprintf( out, "  \"load_ms\": %.3f,\n", load_us / 1000.0 );
+    fprintf( out, "  \"run_ms\": %.3f,\n", run_us / 1000.0 );
+    fprintf( out, "  \"fps\": %.2f,\n", run_us ? frames * 1000000.0 / run_us : 0.0 );
+    fprintf( out, "  \"phases_ms_per_frame\": {\n" );
+    fprintf( out, "    \"exec\": %.4f", frame_profile.exec_us * ms );
+
+    /* Hooks as module:priority */
+    for ( n = 0; n < handler_hook_count; n++ ) {
+        snprintf( key, sizeof( key ), "%s:%" PRId64, bench_hook_module( &handler_hook_list[n] ), handler_hook_list[n].prio );
+        fprintf( out, ",\n    " );
+        bench_json_string( out, key );
+        fprintf( out, ": %.4f", frame_profile.hook_us[n] * ms );
+    }
+
+    fprintf( out, "\n  },\n" );
+    fprintf( out, "  \"peak_rss_kb\": %" PRId64 "\n}\n", bench_peak_rss() );
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void bench_help( char * name ) {
+    printf( "Bennu Game Development Benchmark Runner (Build: %s %s)\n\n"
+            "Usage: %s [options] <data code block file>[.dcb] [program params]\n\n"
+            "   -f frames   Frames to run (default %d)\n"
+            "   -s seed     Random seed (default %d)\n"
+            "   -o file     Write the JSON report to file (default stdout)\n"
+            "   -i dir      Adds the directory to the PATH\n\n"
+            "The program runs with the SDL dummy video and audio drivers, unless\n"
+            "SDL_VIDEODRIVER or SDL_AUDIODRIVER are set. The FPS limit starts\n"
+            "disabled, as with SET_FPS(0, 0), calls to SET_FPS in the program\n"
+            "set it again.\n",
+            __DATE__, __TIME__, name, BENCH_FRAMES, BENCH_SEED );
+}
+
+/* ---------------------------------------------------------------------- */
+
+int main( int argc, char *argv[] ) {
+    char * filename = NULL, * output = NULL, * ptr;
+    int64_t frames = BENCH_FRAMES, seed = BENCH_SEED, ticks, load_us, run_us;
+    FILE * out = stdout;
+    int i;
+
+    for ( i = 1; i < argc && !filename; i++ ) {
+        if ( argv[i][0] == '-' && argv[i][1] && !argv[i][2] && i < argc - 1 ) {
+            switch ( argv[i][1] ) {
+                case 'f':
+                    frames = atoll( argv[++i] );
+                    continue;
+
+                case 's':
+                    seed = atoll( argv[++i] );
+                    continue;
+
+                case 'o':
+                    output = argv[++i];
+                    continue;
+
+                case 'i':
+                    file_addp( argv[++i] );
+                    continue;
+            }
+        }
+
+        if ( argv[i][0] == '-' ) {
+            bench_help( argv[0] );
+            return -1;
+        }
+
+        filename = argv[i];
+    }
+
+    if ( !filename || frames < 1 ) {
+        bench_help( argv[0] );
+        return -1;
+    }
+
+    bench_setenv( "SDL_VIDEODRIVER", "dummy" );
+    bench_setenv( "SDL_AUDIODRIVER", "dummy" );
+
+    srand( ( unsigned int ) seed );
+
+    /* Same startup as bgdi */
+
+    appexefullpath = getfullpath( argv[0] );
+    ptr = appexefullpath + strlen( appexefullpath );
+    while ( ptr > appexefullpath && ptr[-1] != '\\' && ptr[-1] != '/' ) ptr--;
+    appexename = strdup( ptr );
+    appexepath = calloc( 1, ptr - appexefullpath + 1 );
+    strncpy( appexepath, appexefullpath, ptr - appexefullpath );
+
+    file_addp( appexepath );
+
+    string_init();
+    init_c_type();
+
+    ptr = filename + strlen( filename );
+    while ( ptr > filename && ptr[-1] != '\\' && ptr[-1] != '/' ) ptr--;
+    appname = strdup( ptr );
+    if ( strlen( appname ) > 4 && !strcmp( &appname[strlen( appname ) - 4], ".dcb" ) ) appname[strlen( appname ) - 4] = '\0';
+
+    ticks = bench_ticks();
+
+    if ( !dcb_load( filename ) ) {
+        char dcbname[ __MAX_PATH ];
+        snprintf( dcbname, sizeof( dcbname ), "%s.dcb", filename );
+        if ( !dcb_load( dcbname ) ) {
+            fprintf( stderr, "%s: can't load the DCB\n", filename );
+            return -1;
+        }
+    }
+
+    if ( dcb.data.NSourceFiles == 0 ) debug = 0;
+
+    sysproc_init();
+
+    argv[i - 1] = filename;
+    bgdrtm_entry( argc - i + 1, &argv[i - 1] );
+
+    /* Frames run as fast as they can, unless the program sets the FPS */
+    bench_unlimited_fps();
+
+    load_us = bench_ticks() - ticks;
+
+    frame_profile.enabled = 1;
+    frame_profile.frame_limit = frames;
+    frame_profile.hook_us = calloc( handler_hook_count + 1, sizeof( int64_t ) );
+    if ( !frame_profile.hook_us ) {
+        fprintf( stderr, "bgdbench: out of memory\n" );
+        return -1;
+    }
+
+    ticks = bench_ticks();
+
+    if ( mainproc ) {
+        ( void ) instance_new( mainproc, NULL );
+        ( void ) instance_go_all();
+    }
+
+    run_us = bench_ticks() - ticks;
+
+    if ( output && !( out = fopen( output, "w" ) ) ) {
+        fprintf( stderr, "%s: can't write the report\n", output );
+        out = stdout;
+    }
+
+    bench_report( out, appname, seed, load_us, run_us );
+
+    if ( out != stdout ) fclose( out );
+
+    bgdrtm_exit();
+
+    return ( frame_profile.frames == frames ) ? 0 : 1;
+}
+
+/* ---------------------------------------------------------------------- */